@@ -27,6 +27,9 @@ sHuffman::sHufCtx::sHufCtx(int bits)
     Code = new int[Max];
     Bits = new int[Max];
     Nodes = new sHufNode[Max*2-1];
+    Sorted = new int[Max];
+    Table = 0;
+    TableBits = 0;
 
     Clear();
 }
@@ -37,6 +40,8 @@ sHuffman::sHufCtx::~sHufCtx()
     delete[] Code;
     delete[] Bits;
     delete[] Nodes;
+    delete[] Sorted;
+    delete[] Table;
 }
 
 void sHuffman::sHufCtx::Clear()
@@ -159,6 +164,131 @@ void sHuffman::sHufCtx::MakeTree()
     AssignSymbol(RootNode,0,0);
 
     sASSERT(MaxBits<32);        // actually, 32 would be ok.
+
+    // keep only the code lengths, and build the decoder from them
+
+    MakeCanonical();
+    MakeTable();
+}
+
+void sHuffman::sHufCtx::MakeCanonical()
+{
+    // count codes by length
+
+    for(int i=0;i<=MaxCodeBits;i++)
+        LengthCount[i] = 0;
+    for(int i=0;i<Max;i++)
+        if(Hist[i]>0)
+            LengthCount[Bits[i]]++;
+
+    // first code and first sorted index for each length
+
+    uint code = 0;
+    int index = 0;
+    for(int i=0;i<=MaxCodeBits;i++)
+    {
+        FirstCode[i] = code;
+        FirstIndex[i] = index;
+        index += LengthCount[i];
+        if(i>0)
+            code = (code + LengthCount[i])<<1;
+    }
+
+    // assign codes in symbol order. the bitstream is lsb first, so reverse them
+
+    int next[MaxCodeBits+1];
+    for(int i=0;i<=MaxCodeBits;i++)
+        next[i] = FirstIndex[i];
+    for(int i=0;i<Max;i++)
+    {
+        if(Hist[i]>0)
+        {
+            int bits = Bits[i];
+            int n = next[bits]++;
+            uint c = FirstCode[bits] + (n-FirstIndex[bits]);
+            uint r = 0;
+            for(int j=0;j<bits;j++)
+                r |= ((c>>j)&1)<<(bits-1-j);
+            Sorted[n] = i;
+            Code[i] = r;
+        }
+    }
+
+    // rebuild the tree with the new codes, for UnpackTree()
+
+    NodeUsed = 1;
+    RootNode = 0;
+    Nodes[0].Symbol = -1;
+    Nodes[0].Left = -1;
+    Nodes[0].Right = -1;
+    for(int i=0;i<Max;i++)
+    {
+        if(Hist[i]>0)
+        {
+            int node = RootNode;
+            for(int j=0;j<Bits[i];j++)
+            {
+                int &child = ((Code[i]>>j)&1) ? Nodes[node].Right : Nodes[node].Left;
+                if(child==-1)
+                {
+                    child = NodeUsed++;
+                    Nodes[child].Symbol = -1;
+                    Nodes[child].Left = -1;
+                    Nodes[child].Right = -1;
+                }
+                node = child;
+            }
+            Nodes[node].Symbol = i;
+            Nodes[node].Code = Code[i];
+            Nodes[node].CodeBits = Bits[i];
+            Nodes[node].Prop = Hist[i];
+        }
+    }
+    sASSERT(NodeUsed<=Max*2-1);
+}
+
+void sHuffman::sHufCtx::MakeTable()
+{
+    TableBits = sMin(MaxBits,int(MaxTableBits));
+    int size = 1<<TableBits;
+    delete[] Table;
+    Table = new sHufEntry[size];
+    for(int i=0;i<size;i++)
+        sClear(Table[i]);
+
+    // one symbol per entry. longer codes keep Count = 0
+
+    for(int i=0;i<Max;i++)
+    {
+        if(Hist[i]>0 && Bits[i]<=TableBits)
+        {
+            sHufEntry e;
+            e.Symbol0 = i;
+            e.Symbol1 = 0;
+            e.Bits0 = Bits[i];
+            e.Bits = Bits[i];
+            e.Count = 1;
+            e.pad = 0;
+            for(int j=Code[i];j<size;j+=1<<Bits[i])
+                Table[j] = e;
+        }
+    }
+
+    // add a second symbol if its code fits completely in the remaining bits
+
+    for(int i=0;i<size;i++)
+    {
+        sHufEntry &e = Table[i];
+        if(e.Count==0 || e.Bits0==0)
+            continue;
+        const sHufEntry &e1 = Table[i>>e.Bits0];
+        if(e1.Count>0 && e1.Bits0>0 && e1.Bits0<=TableBits-e.Bits0)
+        {
+            e.Symbol1 = e1.Symbol0;
+            e.Bits = e.Bits0 + e1.Bits0;
+            e.Count = 2;
+        }
+    }
 }
 
 void sHuffman::sHufCtx::AssignSymbol(int node,int value,int bits)
@@ -277,6 +407,26 @@ void sHuffman::BeginUnpack()
     DataRead = 0;
 }
 
+uint sHuffman::UnpackLong(sHufCtx *ctx)
+{
+    // canonical decoding, one bit at a time. msb of the code comes first
+
+    uint code = 0;
+    for(int bits=1;bits<=ctx->MaxBits;bits++)
+    {
+        code = (code<<1) | uint((PackWord>>(bits-1))&1);
+        uint n = code - ctx->FirstCode[bits];
+        if(n < uint(ctx->LengthCount[bits]))
+        {
+            PackWord = PackWord >> bits;
+            PackShift = PackShift - bits;
+            return ctx->Sorted[ctx->FirstIndex[bits]+n];
+        }
+    }
+    sASSERT0();
+    return 0;
+}
+
 uint sHuffman::Unpack(int context)
 {
     if(PackShift<32)
@@ -289,6 +439,69 @@ uint sHuffman::Unpack(int context)
         sASSERT(DataRead<=DataUsed+4);
     }
 
+    auto ctx = Ctx[context];
+    const sHufEntry &e = ctx->Table[PackWord & ((1<<ctx->TableBits)-1)];
+    if(e.Count==0)
+        return UnpackLong(ctx);
+
+    PackWord = PackWord >> e.Bits0;
+    PackShift = PackShift - e.Bits0;
+    return e.Symbol0;
+}
+
+void sHuffman::Unpack(int context,uint *dest,int count)
+{
+    auto ctx = Ctx[context];
+    const sHufEntry *table = ctx->Table;
+    uint64 mask = (1<<ctx->TableBits)-1;
+    uint *end = dest+count;
+
+    while(dest<end)
+    {
+        if(PackShift<32)
+        {
+            uint64 newdata = *((uint *)(&Data[DataRead]));
+            PackWord |= newdata<<PackShift;
+
+            PackShift += 32;
+            DataRead += 4;
+            sASSERT(DataRead<=DataUsed+4);
+        }
+
+        const sHufEntry &e = table[PackWord & mask];
+        if(e.Count==2 && dest+1<end)
+        {
+            dest[0] = e.Symbol0;
+            dest[1] = e.Symbol1;
+            dest += 2;
+            PackWord = PackWord >> e.Bits;
+            PackShift = PackShift - e.Bits;
+        }
+        else if(e.Count>0)
+        {
+            *dest++ = e.Symbol0;
+            PackWord = PackWord >> e.Bits0;
+            PackShift = PackShift - e.Bits0;
+        }
+        else
+        {
+            *dest++ = UnpackLong(ctx);
+        }
+    }
+}
+
+uint sHuffman::UnpackTree(int context)
+{
+    if(PackShift<32)
+    {
+        uint64 newdata = *((uint *)(&Data[DataRead]));
+        PackWord |= newdata<<PackShift;
+
+        PackShift += 32;
+        DataRead += 4;
+        sASSERT(DataRead<=DataUsed+4);
+    }
+
     auto ctx = Ctx[context];
     int node = ctx->RootNode;
     int bits = 0;
@@ -18,6 +18,11 @@ namespace Altona2 {
 /***                                                                      ***/
 /****************************************************************************/
 
+// codes are canonical, so they follow from the code lengths alone. they
+// are stored bit-reversed, because the bitstream is read from the lsb.
+// decoding looks up the next TableBits bits in a table, which gives one or
+// two symbols. only codes longer than that go the slow way.
+
 class sHuffman
 {
     struct sHufNode
@@ -30,6 +35,22 @@ class sHuffman
         int Prop;                           // propability of this node (left + right, or leaf)
     };
 
+    struct sHufEntry                        // decoding table
+    {
+        uint16 Symbol0;                     // first symbol
+        uint16 Symbol1;                     // second symbol, if Count==2
+        uint8 Bits0;                        // bits of first symbol
+        uint8 Bits;                         // bits of both symbols, if Count==2
+        uint8 Count;                        // number of symbols, 0 for codes longer than TableBits
+        uint8 pad;
+    };
+
+    enum
+    {
+        MaxTableBits = 11,                  // 2048 entries, 16 KB per context
+        MaxCodeBits = 32,
+    };
+
     class sHufCtx
     {
     public:
@@ -50,13 +71,24 @@ class sHuffman
         int NodeUsed;                       // number of nodes used
         int RootNode;                       // the root node
 
+        int TableBits;                      // decoding table
+        sHufEntry *Table;
+        int *Sorted;                        // symbols sorted by canonical code
+        uint FirstCode[MaxCodeBits+1];      // canonical code of first symbol with n bits
+        int FirstIndex[MaxCodeBits+1];      // index in Sorted of that symbol
+        int LengthCount[MaxCodeBits+1];     // number of symbols with n bits
+
         uint64 Bandwidth;                   // while encoding, count the number of bits written
 
         void Clear();
         void MakeTree();
         void AssignSymbol(int node,int value,int bits);
+        void MakeCanonical();
+        void MakeTable();
     };
 
+    uint UnpackLong(sHufCtx *ctx);
+
     uint64 PackWord;                        // buffer for packing / unpacking
     int PackShift;                          // buffer for packing / unpacking
     int DataRead;                           // read pointer for unpacking
@@ -79,6 +111,8 @@ public:
 
     void BeginUnpack();
     uint Unpack(int context);
+    void Unpack(int context,uint *dest,int count);  // many symbols from one context, faster
+    uint UnpackTree(int context);           // walk the code tree bit by bit, for reference
     void EndUnpack();
 
     // data
@@ -821,6 +821,19 @@ void Huffman()
         huf.EndUnpack();
 
         CHECK(sCmpMem(Src,Dest,count*sizeof(uint))==0);
+
+        huf.BeginUnpack();
+        huf.Unpack(0,Dest,count);
+        huf.EndUnpack();
+
+        CHECK(sCmpMem(Src,Dest,count*sizeof(uint))==0);
+
+        huf.BeginUnpack();
+        for(int i=0;i<count;i++)
+            Dest[i] = huf.UnpackTree(0);
+        huf.EndUnpack();
+
+        CHECK(sCmpMem(Src,Dest,count*sizeof(uint))==0);
     }
 
     End();
@@ -0,0 +1,138 @@
+/****************************************************************************/
+/***                                                                      ***/
+/***   (C) 2012-2014 Dierk Ohlerich et al., all rights reserved.          ***/
+/***                                                                      ***/
+/***   Released under BSD 2 clause license, see LICENSE.TXT               ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+#include "Altona2/Libs/Base/Base.hpp"
+#include "Altona2/Libs/Util/Compression.hpp"
+
+using namespace Altona2;
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Decoding speed: tree walk, table and batched table                 ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+enum
+{
+    Count = 1024*1024,
+    Contexts = 4,
+    Runs = 5,
+};
+
+static void MakeData(uint *data,int distribution,sRandomKISS &rnd)
+{
+    for(int i=0;i<Count;i++)
+    {
+        uint v = 0;
+        switch(distribution)
+        {
+        case 0:                                 // deltas: small values are likely
+            while(v<1023 && rnd.Int(4)!=0)
+                v++;
+            break;
+        case 1:                                 // sum of three, roughly gaussian
+            v = (rnd.Int(1024)+rnd.Int(1024)+rnd.Int(1024))/3;
+            break;
+        case 2:                                 // skewed, like text
+            v = rnd.Int(rnd.Int(rnd.Int(256)+1)+1);
+            break;
+        case 3:                                 // uniform, all codes 10 bits
+            v = rnd.Int(1024);
+            break;
+        }
+        data[i] = v;
+    }
+}
+
+static void Pack(sHuffman &huf,const uint *src,int contexts)
+{
+    huf.BeginPack();
+    for(int i=0;i<Count;i++)
+        huf.HistPack(i%contexts,src[i]);
+    huf.PreparePack();
+    for(int i=0;i<Count;i++)
+        huf.Pack(i%contexts,src[i]);
+    huf.EndPack();
+}
+
+static uint Measure(sHuffman &huf,const uint *src,uint *dest,int contexts,int mode,int &errors)
+{
+    uint best = ~0U;
+    for(int run=0;run<Runs;run++)
+    {
+        sSetMem(dest,0,Count*sizeof(uint));
+
+        uint64 time0 = sGetTimeUS();
+        huf.BeginUnpack();
+        switch(mode)
+        {
+        case 0:
+            for(int i=0;i<Count;i++)
+                dest[i] = huf.UnpackTree(i%contexts);
+            break;
+        case 1:
+            for(int i=0;i<Count;i++)
+                dest[i] = huf.Unpack(i%contexts);
+            break;
+        case 2:
+            huf.Unpack(0,dest,Count);
+            break;
+        }
+        huf.EndUnpack();
+        uint64 time1 = sGetTimeUS();
+
+        best = sMin(best,uint(time1-time0));
+        if(sCmpMem(src,dest,Count*sizeof(uint))!=0)
+            errors++;
+    }
+    return best;
+}
+
+void Altona2::Main()
+{
+    const char *diststring[] = { "deltas","gauss","text","uniform" };
+    sRandomKISS rnd;
+    uint *src = new uint[Count];
+    uint *dest = new uint[Count];
+    int errors = 0;
+
+    sHuffman huf;
+    for(int i=0;i<Contexts;i++)
+        huf.AddContext(i,10);
+
+    sPrintF("%d symbols, best of %d runs, time in us\n\n",Count,Runs);
+    sPrintF("%-10s %8s %8s %8s %8s %8s %8s\n","data","bits","tree","table","batch","tree x4","table x4");
+
+    for(int dist=0;dist<sCOUNTOF(diststring);dist++)
+    {
+        MakeData(src,dist,rnd);
+
+        // one context: all three decoders
+
+        Pack(huf,src,1);
+        uint tree = Measure(huf,src,dest,1,0,errors);
+        uint table = Measure(huf,src,dest,1,1,errors);
+        uint batch = Measure(huf,src,dest,1,2,errors);
+
+        // interleaved contexts, as in a real file format. no batching here
+
+        Pack(huf,src,Contexts);
+        uint tree4 = Measure(huf,src,dest,Contexts,0,errors);
+        uint table4 = Measure(huf,src,dest,Contexts,1,errors);
+
+        sPrintF("%-10s %8.2f %8d %8d %8d %8d %8d\n",
+            diststring[dist],huf.DataUsed*8.0f/Count,tree,table,batch,tree4,table4);
+    }
+
+    sPrintF("\n%d errors\n",errors);
+
+    delete[] src;
+    delete[] dest;
+}
+
+/****************************************************************************/
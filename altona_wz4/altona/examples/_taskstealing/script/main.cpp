@@ -0,0 +1,165 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "main.hpp"
+#include "util/taskscheduler.hpp"
+#include "wz4lib/script.hpp"
+
+/****************************************************************************/
+
+// benchmark for the wz4 script interpreter: many contexts, each executing
+// the same script a few thousand times. first on the main thread only, then
+// spread over the task scheduler, then all contexts as lanes of one batch.
+// all runs must give the same results.
+
+static const sChar *Source =
+  L"x,y : float;\n"
+  L"i : int = 0;\n"
+  L"x = sin(time*3)+cos(time*5);\n"
+  L"y = 0;\n"
+  L"do\n"
+  L"{\n"
+  L"  y = y + smoothstep(clamp(x*0.5+0.5,0,1))*noise(time+i);\n"
+  L"  i = i+1;\n"
+  L"}\n"
+  L"while(i<16);\n"
+  L"result = x + y + perlinnoise(time,1) + length([x,y,1]) + dot([x,y,1,2],[y,x,2,1]);\n";
+
+enum
+{
+  JOBS = 256,
+  RUNS = 4000,
+};
+
+struct ScriptJob
+{
+  sF32 Offset;
+  sF32 Result;
+  sBool Ok;
+};
+
+static void RunJob(ScriptJob *job)
+{
+  ScriptContext ctx;
+  ScriptSymbol *_time = ctx.AddSymbol(L"time");
+  ScriptSymbol *_result = ctx.AddSymbol(L"result");
+  ScriptCode code(Source);
+
+  job->Result = 0;
+  job->Ok = 1;
+  for(sInt i=0;i<RUNS && job->Ok;i++)
+  {
+    ctx.BeginExe();
+    ScriptValue *time = ctx.MakeFloat(1);
+    ScriptValue *result = ctx.MakeFloat(1);
+    time->FloatPtr[0] = job->Offset + i*0.01f;
+    ctx.BindGlobal(_time,time);
+    ctx.BindGlobal(_result,result);
+
+    if(!code.Execute(&ctx))
+    {
+      sDPrintF(L"script error: %s\n",code.ErrorMsg);
+      job->Ok = 0;
+    }
+    ctx.FlushLocal();
+    job->Result += result->FloatPtr[0];
+    ctx.EndExe();
+  }
+}
+
+static void RunBatch(ScriptJob *jobs)
+{
+  ScriptContext ctx;
+  ScriptSymbol *_time = ctx.AddSymbol(L"time");
+  ScriptSymbol *_result = ctx.AddSymbol(L"result");
+  ScriptCode code(Source);
+  sF32 time[JOBS];
+  sF32 result[JOBS];
+
+  for(sInt j=0;j<JOBS;j++)
+  {
+    jobs[j].Result = 0;
+    jobs[j].Ok = 1;
+  }
+  for(sInt i=0;i<RUNS;i++)
+  {
+    ctx.BeginExe();
+    for(sInt j=0;j<JOBS;j++)
+      time[j] = jobs[j].Offset + i*0.01f;
+    ctx.BindBatchFloat(_time,1,time,sizeof(sF32));
+    ctx.BindBatchFloat(_result,1,result,sizeof(sF32));
+
+    sBool ok = code.ExecuteBatch(&ctx,JOBS);
+    if(!ok)
+      sDPrintF(L"script error: %s\n",code.ErrorMsg);
+    ctx.FlushLocal();
+    for(sInt j=0;j<JOBS;j++)
+    {
+      jobs[j].Result += result[j];
+      jobs[j].Ok &= ok;
+    }
+    ctx.EndExe();
+    if(!ok)
+      break;
+  }
+}
+
+static void ScriptTask(sStsManager *man,sStsThread *thr,sInt start,sInt count,void *data)
+{
+  ScriptJob *jobs = (ScriptJob *) data;
+  for(sInt i=start;i<start+count;i++)
+    RunJob(&jobs[i]);
+}
+
+/****************************************************************************/
+
+void sMain()
+{
+  sGetMemHandler(sAMF_HEAP)->MakeThreadSafe();    // the jobs allocate on the worker threads
+  sAddSched();
+  sInit(0);
+
+  ScriptJob serial[JOBS];
+  ScriptJob parallel[JOBS];
+  ScriptJob batch[JOBS];
+  for(sInt i=0;i<JOBS;i++)
+    serial[i].Offset = parallel[i].Offset = batch[i].Offset = i*0.125f;
+
+  // main thread only
+
+  sU64 t0 = sGetTimeUS();
+  ScriptTask(sSched,0,0,JOBS,serial);
+  sU64 t1 = sGetTimeUS();
+
+  // all threads
+
+  sStsWorkload *wl = sSched->BeginWorkload();
+  wl->AddTask(wl->NewTask(ScriptTask,parallel,JOBS,0));
+  wl->Start();
+  wl->Sync();
+  wl->End();
+  sU64 t2 = sGetTimeUS();
+
+  // main thread, one batch
+
+  RunBatch(batch);
+  sU64 t3 = sGetTimeUS();
+
+  sInt errors = 0;
+  for(sInt i=0;i<JOBS;i++)
+    if(!serial[i].Ok || !parallel[i].Ok || !batch[i].Ok || serial[i].Result!=parallel[i].Result || serial[i].Result!=batch[i].Result)
+      errors++;
+
+  sInt calls = JOBS*RUNS;
+  sPrintF(L"%d script executions, %d threads\n",calls,sSched->GetThreadCount());
+  sPrintF(L"serial:   %8d us (%5.3f us per call)\n",sInt(t1-t0),sF32(t1-t0)/calls);
+  sPrintF(L"parallel: %8d us (%5.3f us per call)\n",sInt(t2-t1),sF32(t2-t1)/calls);
+  sPrintF(L"batch:    %8d us (%5.3f us per call)\n",sInt(t3-t2),sF32(t3-t2)/calls);
+  sPrintF(L"%d mismatches\n",errors);
+}
+
+/****************************************************************************/
@@ -0,0 +1,20 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#ifndef FILE_TEST_MAIN_HPP
+#define FILE_TEST_MAIN_HPP
+
+#include "base/types.hpp"
+
+/****************************************************************************/
+
+
+
+/****************************************************************************/
+
+#endif // FILE_TEST_MAIN_HPP
+
@@ -0,0 +1,108 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "base/types.hpp"
+#include "base/system.hpp"
+#include "base/math.hpp"
+#include "util/taskscheduler.hpp"
+#include "util/depthsort.hpp"
+
+/****************************************************************************/
+
+// particles that drift each frame while a few respawn, sorted by depth
+// with all modes of sDepthSort. sDSM_HEAP is what the sprite renderer did
+// before. the last test shuffles all depths every frame, which is the
+// worst case for sDSM_COHERENT.
+
+enum
+{
+  COUNT = 200000,
+  FRAMES = 100,
+};
+
+static const sChar *ModeNames[] = { L"heap",L"radix",L"coherent",L"parallel" };
+static const sChar *TestNames[] = { L"slow",L"fast",L"shuffle" };
+static const sF32 TestSpeed[] = { 0.0002f,0.002f,0 };
+
+static sInt Check(const sDepthSort &ds,const sF32 *depth,sF32 eps)
+{
+  const sU32 *order = ds.GetOrder();
+  sInt errors = 0;
+  for(sInt i=1;i<ds.GetCount();i++)
+    if(depth[order[i-1]] > depth[order[i]]+eps)
+      errors++;
+  return errors;
+}
+
+static void Run(sInt mode,sInt test)
+{
+  sRandomKISS rand;
+  rand.Init();
+
+  sF32 *depth = new sF32[COUNT];
+  sF32 *speed = new sF32[COUNT];
+  for(sInt i=0;i<COUNT;i++)
+  {
+    depth[i] = rand.Float(100);
+    speed[i] = (rand.Float(2)-1)*TestSpeed[test];
+  }
+
+  sDepthSort ds;
+  sInt time = 0;
+  sInt errors = 0;
+  sInt fallbacks = 0;
+  sS64 moves = 0;
+  sS64 jumped = 0;
+
+  for(sInt frame=0;frame<FRAMES;frame++)
+  {
+    for(sInt i=0;i<COUNT;i++)
+    {
+      if(test==2)
+        depth[i] = rand.Float(100);
+      else if(rand.Int(1000)==0)
+        depth[i] = rand.Float(100);
+      else
+        depth[i] += speed[i];
+    }
+
+    sInt t0 = sGetTime();
+    ds.Begin(COUNT);
+    for(sInt i=0;i<COUNT;i++)
+      if(depth[i]>1)                      // clipped by the near plane
+        ds.Add(i,depth[i]);
+    ds.Sort(mode);
+    sInt t1 = sGetTime();
+
+    time += t1-t0;
+    errors += Check(ds,depth,(mode==sDSM_HEAP || (mode==sDSM_COHERENT && !ds.Fallback)) ? 0.0f : 0.0001f);
+    fallbacks += ds.Fallback;
+    moves += ds.Moves;
+    jumped += ds.Jumped;
+  }
+
+  sPrintF(L"%-8s %-10s %6d ms  %7.3f ms/frame",TestNames[test],ModeNames[mode],time,sF32(time)/FRAMES);
+  if(mode==sDSM_COHERENT)
+    sPrintF(L"  %d fallbacks, %d moves, %d jumps per frame",fallbacks,sInt(moves/FRAMES),sInt(jumped/FRAMES));
+  sPrintF(L"  %d errors\n",errors);
+
+  delete[] depth;
+  delete[] speed;
+}
+
+void sMain()
+{
+  sAddSched();
+  sInit(0);
+
+  sPrintF(L"%d particles, %d frames, %d threads\n",COUNT,FRAMES,sSched->GetThreadCount());
+  for(sInt test=0;test<3;test++)
+    for(sInt mode=sDSM_HEAP;mode<=sDSM_PARALLEL;mode++)
+      Run(mode,test);
+}
+
+/****************************************************************************/
@@ -0,0 +1,100 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "base/types.hpp"
+#include "base/types2.hpp"
+#include "base/system.hpp"
+#include "base/math.hpp"
+
+/****************************************************************************/
+
+// insert and find throughput of sHashTable (chained, virtual hash and
+// compare) against sHashMap (open addressing). half of the lookups miss.
+
+enum
+{
+  COUNT = 1000000,
+  RUNS = 4,
+};
+
+struct Key
+{
+  sU32 a,b;
+  sU32 Hash() const { return a+b; }
+  sBool operator==(const Key &k) const { return a==k.a && b==k.b; }
+};
+
+void sMain()
+{
+  sRandomKISS rand;
+  rand.Init();
+
+  Key *keys = new Key[COUNT*2];
+  sInt *values = new sInt[COUNT];
+  for(sInt i=0;i<COUNT*2;i++)
+  {
+    keys[i].a = rand.Int32();
+    keys[i].b = rand.Int32();
+  }
+  for(sInt i=0;i<COUNT;i++)
+    values[i] = i;
+
+  sInt timetable[2] = { 0,0 };
+  sInt timemap[2] = { 0,0 };
+  sInt errors = 0;
+
+  for(sInt run=0;run<RUNS;run++)
+  {
+    sInt t0 = sGetTime();
+    sHashTable<Key,sInt> *table = new sHashTable<Key,sInt>(1<<sFindHigherPower(COUNT),0x1000);
+    for(sInt i=0;i<COUNT;i++)
+      table->Add(&keys[i],&values[i]);
+    sInt t1 = sGetTime();
+    sInt foundtable = 0;
+    for(sInt i=0;i<COUNT*2;i++)
+      if(table->Find(&keys[i]))
+        foundtable++;
+    sInt t2 = sGetTime();
+    delete table;
+
+    sInt t3 = sGetTime();
+    sHashMap<Key,sInt> *map = new sHashMap<Key,sInt>(COUNT);
+    for(sInt i=0;i<COUNT;i++)
+      map->Add(keys[i],i);
+    sInt t4 = sGetTime();
+    sInt foundmap = 0;
+    for(sInt i=0;i<COUNT*2;i++)
+    {
+      sInt *v = map->Find(keys[i]);
+      if(v)
+      {
+        foundmap++;
+        if(*v!=i)
+          errors++;
+      }
+    }
+    sInt t5 = sGetTime();
+    delete map;
+
+    if(foundtable!=foundmap)
+      errors++;
+    timetable[0] += t1-t0;
+    timetable[1] += t2-t1;
+    timemap[0] += t4-t3;
+    timemap[1] += t5-t4;
+  }
+
+  sPrintF(L"%d keys, %d finds, %d runs\n",COUNT,COUNT*2,RUNS);
+  sPrintF(L"sHashTable: insert %5d ms, find %5d ms\n",timetable[0],timetable[1]);
+  sPrintF(L"sHashMap:   insert %5d ms, find %5d ms\n",timemap[0],timemap[1]);
+  sPrintF(L"%d errors\n",errors);
+
+  delete[] keys;
+  delete[] values;
+}
+
+/****************************************************************************/
@@ -0,0 +1,110 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "base/types.hpp"
+#include "base/system.hpp"
+
+/****************************************************************************/
+
+// stress test for sMemoryHeap (first fit) and sTlsfHeap (segregated fit).
+// both heaps get the same random sequence of allocations and frees with
+// mixed sizes and alignments. the heap fragments over time, which slows
+// down first fit but not tlsf. statistics go to the "mem" log.
+
+enum
+{
+  HEAPSIZE = 64*1024*1024,
+  SLOTS = 8192,
+  OPS = 2000000,
+};
+
+struct Op
+{
+  sInt Slot;
+  sInt Size;
+  sInt Align;
+};
+
+static void MakeOps(Op *ops)
+{
+  sRandomKISS rand;
+  rand.Init();
+  for(sInt i=0;i<OPS;i++)
+  {
+    sInt r = rand.Int(100);
+    ops[i].Slot = rand.Int(SLOTS);
+    if(r<75)
+      ops[i].Size = 8+rand.Int(248);
+    else if(r<95)
+      ops[i].Size = 256+rand.Int(4096-256);
+    else
+      ops[i].Size = 4096+rand.Int(65536-4096);
+    r = rand.Int(100);
+    ops[i].Align = r<90 ? 16 : r<98 ? 64 : 4096;
+  }
+}
+
+template<class Heap> static void Run(Heap &heap,const Op *ops)
+{
+  void *slots[SLOTS];
+  sInt failed = 0;
+  sClear(slots);
+
+  sInt time = sGetTime();
+  for(sInt i=0;i<OPS;i++)
+  {
+    void *&p = slots[ops[i].Slot];
+    if(p)
+    {
+      heap.Free(p);
+      p = 0;
+    }
+    else
+    {
+      p = heap.Alloc(ops[i].Size,ops[i].Align,0);
+      if(p)
+        ((sU8 *)p)[ops[i].Size-1] = 1;
+      else
+        failed++;
+    }
+  }
+  time = sGetTime()-time;
+
+  heap.Validate();
+  heap.DumpStats();
+  sPrintF(L"  %5d ms, %K free, %K largest, %d failed\n",time,sU64(heap.GetFree()),sU64(heap.GetLargestFree()),failed);
+
+  for(sInt i=0;i<SLOTS;i++)
+    if(slots[i])
+      heap.Free(slots[i]);
+}
+
+void sMain()
+{
+  Op *ops = new Op[OPS];
+  sU8 *mem = new sU8[HEAPSIZE];
+  MakeOps(ops);
+
+  sPrintF(L"%d operations on %d slots, %K heap\n",OPS,SLOTS,sU64(HEAPSIZE));
+  {
+    sMemoryHeap heap;
+    heap.Init(mem,HEAPSIZE);
+    sPrintF(L"sMemoryHeap:\n");
+    Run(heap,ops);
+  }
+  {
+    sTlsfHeap heap;
+    heap.Init(mem,HEAPSIZE);
+    sPrintF(L"sTlsfHeap:\n");
+    Run(heap,ops);
+  }
+
+  delete[] mem;
+  delete[] ops;
+}
+
+/****************************************************************************/
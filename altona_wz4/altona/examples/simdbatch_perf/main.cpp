@@ -0,0 +1,259 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "base/types.hpp"
+#include "base/system.hpp"
+#include "base/math.hpp"
+#include "util/simd_batch.hpp"
+
+/****************************************************************************/
+
+// each test runs the loop the way it was written before, with the math.hpp
+// operators, and then with simd_batch.hpp. the results must be the same,
+// bit for bit. the vertex is laid out like Wz4MeshVertex, so the AoS
+// versions see the same strides as in the mesh code.
+
+enum
+{
+  ELEMENTS = 4*1024*1024,         // per test and count
+  BONES = 64,
+};
+
+struct Vertex
+{
+  sVector31 Pos;
+  sVector30 Normal;
+  sVector30 Tangent;
+  sF32 BiSign;
+  sF32 U0,V0;
+  sF32 U1,V1;
+  sU32 Color0;
+  sU32 Color1;
+  sS16 Index[4];
+  sF32 Weight[4];
+  sF32 Select;
+  sInt Temp;
+};
+
+struct Particle
+{
+  sVector31 Pos;
+  sF32 Time;
+};
+
+static sRandomKISS Rand;
+static sMatrix34 Mat;
+static sMatrix34 Bones[BONES];
+static sVector4 Plane;
+
+static void InitVertices(Vertex *v,sInt count)
+{
+  for(sInt i=0;i<count;i++)
+  {
+    v[i].Pos.Init(Rand.Float(2)-1,Rand.Float(2)-1,Rand.Float(2)-1);
+    v[i].Normal.Init(Rand.Float(2)-1,Rand.Float(2)-1,Rand.Float(2)-1);
+    v[i].Tangent.Init(Rand.Float(2)-1,Rand.Float(2)-1,Rand.Float(2)-1);
+    sF32 sum = 0;
+    for(sInt j=0;j<4;j++)
+    {
+      v[i].Index[j] = (j<1+Rand.Int(4)) ? Rand.Int(BONES) : -1;
+      v[i].Weight[j] = Rand.Float(1);
+      sum += v[i].Weight[j];
+    }
+    for(sInt j=0;j<4;j++)
+      v[i].Weight[j] /= sum;
+  }
+}
+
+static sInt Compare(const void *a,const void *b,sInt bytes)
+{
+  return sCmpMem(a,b,bytes)!=0;
+}
+
+static void Print(const sChar *name,sInt count,sU64 t0,sU64 t1,sInt errors)
+{
+  sPrintF(L"%-16s %7d  %8.2f ns  %8.2f ns  %5.2fx  %s\n",name,count,
+    sF32(t0)*1000/ELEMENTS,sF32(t1)*1000/ELEMENTS,sF32(t0)/sMax<sF32>(1,sF32(t1)),errors ? L"ERROR" : L"ok");
+}
+
+/****************************************************************************/
+
+static void Run(sInt count)
+{
+  sInt loops = ELEMENTS/count;
+  Vertex *src = new Vertex[count];
+  Vertex *a = new Vertex[count];
+  Vertex *b = new Vertex[count];
+  InitVertices(src,count);
+  const sInt stride = sizeof(Vertex);
+  sU64 t0,t1;
+
+  // points
+
+  sCopyMem(a,src,sizeof(Vertex)*count);
+  sCopyMem(b,src,sizeof(Vertex)*count);
+  t0 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+    for(sInt i=0;i<count;i++)
+      a[i].Pos = a[i].Pos*Mat;
+  t0 = sGetTimeUS()-t0;
+  t1 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+    sBatchTransform(Mat,&b[0].Pos,stride,&b[0].Pos,stride,count);
+  t1 = sGetTimeUS()-t1;
+  Print(L"points",count,t0,t1,Compare(a,b,sizeof(Vertex)*count));
+
+  // normals, like Wz4MeshVertex::Transform()
+
+  sCopyMem(a,src,sizeof(Vertex)*count);
+  sCopyMem(b,src,sizeof(Vertex)*count);
+  t0 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+  {
+    for(sInt i=0;i<count;i++)
+    {
+      a[i].Normal = a[i].Normal*Mat;
+      a[i].Normal.Unit();
+    }
+  }
+  t0 = sGetTimeUS()-t0;
+  t1 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+    sBatchTransform(Mat,&b[0].Normal,stride,&b[0].Normal,stride,count,1);
+  t1 = sGetTimeUS()-t1;
+  Print(L"normals",count,t0,t1,Compare(a,b,sizeof(Vertex)*count));
+
+  // skinning, like Wz4MeshVertex::Skin()
+
+  sVector31 *sa = new sVector31[count];
+  sVector31 *sb = new sVector31[count];
+  t0 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+  {
+    for(sInt i=0;i<count;i++)
+    {
+      const Vertex &v = src[i];
+      if(v.Index[0]<0 || v.Index[0]>=BONES)
+      {
+        sa[i] = v.Pos;
+      }
+      else
+      {
+        sVector30 accu;
+        for(sInt j=0;j<4;j++)
+        {
+          if(v.Index[j]>=0 && v.Index[j]<BONES)
+            accu += sVector30(v.Pos*Bones[v.Index[j]])*v.Weight[j];
+          else
+            break;
+        }
+        sa[i] = sVector31(accu);
+      }
+    }
+  }
+  t0 = sGetTimeUS()-t0;
+  t1 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+    sBatchSkin(Bones,BONES,&src[0].Pos,src[0].Index,src[0].Weight,stride,sb,sizeof(sVector31),count);
+  t1 = sGetTimeUS()-t1;
+  Print(L"skin",count,t0,t1,Compare(sa,sb,sizeof(sVector31)*count));
+
+  // particle depth, like RNSprites::Prepare()
+
+  Particle *parts = new Particle[count];
+  sF32 *da = new sF32[count];
+  sF32 *db = new sF32[count];
+  for(sInt i=0;i<count;i++)
+    parts[i].Pos = src[i].Pos;
+  t0 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+    for(sInt i=0;i<count;i++)
+      da[i] = Plane ^ (parts[i].Pos*Mat);
+  t0 = sGetTimeUS()-t0;
+  t1 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+    sBatchPlaneDist(Plane,Mat,&parts[0].Pos,sizeof(Particle),db,count);
+  t1 = sGetTimeUS()-t1;
+  Print(L"plane distance",count,t0,t1,Compare(da,db,sizeof(sF32)*count));
+
+  // SoA streams
+
+  sF32 *x = new sF32[count*6];
+  sF32 *y = x+count;
+  sF32 *z = y+count;
+  sF32 *rx = z+count;
+  sF32 *ry = rx+count;
+  sF32 *rz = ry+count;
+  for(sInt i=0;i<count;i++)
+  {
+    x[i] = src[i].Pos.x;
+    y[i] = src[i].Pos.y;
+    z[i] = src[i].Pos.z;
+  }
+  t0 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+  {
+    for(sInt i=0;i<count;i++)
+    {
+      sVector31 p = sVector31(x[i],y[i],z[i])*Mat;
+      rx[i] = p.x;
+      ry[i] = p.y;
+      rz[i] = p.z;
+    }
+  }
+  t0 = sGetTimeUS()-t0;
+  for(sInt i=0;i<count;i++)
+  {
+    sa[i].x = rx[i];
+    sa[i].y = ry[i];
+    sa[i].z = rz[i];
+  }
+  t1 = sGetTimeUS();
+  for(sInt l=0;l<loops;l++)
+    sBatchTransformSoA(Mat,x,y,z,rx,ry,rz,count,1);
+  t1 = sGetTimeUS()-t1;
+  for(sInt i=0;i<count;i++)
+  {
+    sb[i].x = rx[i];
+    sb[i].y = ry[i];
+    sb[i].z = rz[i];
+  }
+  Print(L"SoA points",count,t0,t1,Compare(sa,sb,sizeof(sVector31)*count));
+
+  delete[] x;
+  delete[] parts;
+  delete[] da;
+  delete[] db;
+  delete[] sa;
+  delete[] sb;
+  delete[] src;
+  delete[] a;
+  delete[] b;
+}
+
+void sMain()
+{
+  sInit(0);
+
+  Rand.Init();
+  Mat.EulerXYZ(0.3f,1.2f,-0.7f);
+  Mat.Scale(1.5f,0.5f,2.0f);
+  Mat.l.Init(1,2,3);
+  for(sInt i=0;i<BONES;i++)
+  {
+    Bones[i].EulerXYZ(Rand.Float(sPI2F),Rand.Float(sPI2F),Rand.Float(sPI2F));
+    Bones[i].l.Init(Rand.Float(2)-1,Rand.Float(2)-1,Rand.Float(2)-1);
+  }
+  Plane.InitPlane(sVector31(0,0,-5),sVector30(0.2f,0.1f,1));
+
+  sPrintF(L"%s, time per element for the old loop and the batch\n",sBATCH_AVX ? L"avx" : L"sse");
+  for(sInt count=1024;count<=256*1024;count*=16)
+    Run(count);
+}
+
+/****************************************************************************/
+
@@ -0,0 +1,222 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "base/types.hpp"
+#include "base/system.hpp"
+#include "base/math.hpp"
+#include "util/taskscheduler.hpp"
+#include "util/spatialgrid.hpp"
+
+/****************************************************************************/
+
+// finds all pairs of particles closer than the interaction radius, like
+// the sph fluid simulator does each step. the density stays the same, so
+// the box grows with the number of particles.
+//
+// "hash" is the 1024 bucket hash the simulator used before, with 9 rows of
+// 3 buckets each. "grid" is sSpatialGrid, "threaded" sorts in sSched.
+
+enum
+{
+  HASHSIZE = 0x400,
+  HASHMASK = HASHSIZE-1,
+  STEPX = 1,
+  STEPY = 17,
+  STEPZ = 23,
+  RUNS = 3,
+};
+
+static const sF32 Radius = 0.1f;
+static const sF32 Density = 8.0f;         // particles per cell
+
+/****************************************************************************/
+
+struct OldHash
+{
+  sInt Start[HASHSIZE];
+  sInt Count[HASHSIZE];
+  sU32 *Hashes;
+  sVector31 *Sorted;
+  sU32 *SortedHash;
+
+  void Build(const sVector31 *pos,sInt max)
+  {
+    sF32 rr = 1.0f/Radius;
+    for(sInt i=0;i<HASHSIZE;i++)
+      Count[i] = 0;
+    for(sInt i=0;i<max;i++)
+    {
+      sInt x = sInt((pos[i].x+1024.0f)*rr);
+      sInt y = sInt((pos[i].y+1024.0f)*rr);
+      sInt z = sInt((pos[i].z+1024.0f)*rr);
+      Hashes[i] = (x*STEPX + y*STEPY + z*STEPZ) & HASHMASK;
+      Count[Hashes[i]]++;
+    }
+    sInt n = 0;
+    for(sInt i=0;i<HASHSIZE;i++)
+    {
+      Start[i] = n;
+      n += Count[i];
+    }
+    for(sInt i=0;i<max;i++)
+    {
+      sInt n = Start[Hashes[i]]++;
+      Sorted[n] = pos[i];
+      SortedHash[n] = Hashes[i];
+    }
+    for(sInt i=0;i<HASHSIZE;i++)
+      Start[i] -= Count[i];
+  }
+
+  sInt Ranges(sU32 hash,sInt max,sInt *rs,sInt *rc)
+  {
+    static const sInt rows[9] =
+    {
+      - STEPX - STEPY - STEPZ,  - STEPX - STEPZ,  - STEPX + STEPY - STEPZ,
+      - STEPX - STEPY        ,  - STEPX        ,  - STEPX + STEPY        ,
+      - STEPX - STEPY + STEPZ,  - STEPX + STEPZ,  - STEPX + STEPY + STEPZ,
+    };
+    sInt ranges = 9;
+    for(sInt i=0;i<9;i++)
+    {
+      sU32 h0 = (hash+rows[i])&HASHMASK;
+      rs[i] = Start[h0];
+      rc[i] = Count[h0]+Count[(h0+1)&HASHMASK]+Count[(h0+2)&HASHMASK];
+    }
+    for(sInt i=0;i<9;i++)
+    {
+      if(rs[i]+rc[i]>max)
+      {
+        rs[ranges] = 0;
+        rc[ranges] = rs[i]+rc[i]-max;
+        rc[i] = max-rs[i];
+        ranges++;
+      }
+    }
+    return ranges;
+  }
+};
+
+// half the neighbourhood: only j<n, like RPSPH::Inter()
+
+static sS64 Pairs(const sVector31 *parts,sInt n,const sInt *rs,const sInt *rc,sInt ranges)
+{
+  sS64 pairs = 0;
+  for(sInt r=0;r<ranges;r++)
+  {
+    for(sInt j=rs[r];j<rs[r]+rc[r];j++)
+    {
+      if(j>=n) continue;
+      sVector30 d = parts[n]-parts[j];
+      if((d^d)<Radius*Radius)
+        pairs++;
+    }
+  }
+  return pairs;
+}
+
+static void Run(sInt count)
+{
+  sRandomKISS rand;
+  rand.Init();
+  sF32 size = Radius*sFPow(count/Density,1.0f/3.0f);
+  sVector31 *pos = new sVector31[count];
+  for(sInt i=0;i<count;i++)
+    pos[i].Init(rand.Float(size),rand.Float(size),rand.Float(size));
+
+  sInt rs[32],rc[32];
+
+  // the old hash
+
+  OldHash *oh = new OldHash;
+  oh->Hashes = new sU32[count];
+  oh->Sorted = new sVector31[count];
+  oh->SortedHash = new sU32[count];
+  sInt tb0 = 0x7fffffff,tq0 = 0x7fffffff;
+  sS64 pairs0 = 0;
+  for(sInt run=0;run<RUNS;run++)
+  {
+    sInt t0 = sGetTime();
+    oh->Build(pos,count);
+    sInt t1 = sGetTime();
+    sU32 oldhash = ~0U;
+    sInt ranges = 0;
+    pairs0 = 0;
+    for(sInt n=0;n<count;n++)
+    {
+      if(oh->SortedHash[n]!=oldhash)
+      {
+        oldhash = oh->SortedHash[n];
+        ranges = oh->Ranges(oldhash,count,rs,rc);
+      }
+      pairs0 += Pairs(oh->Sorted,n,rs,rc,ranges);
+    }
+    sInt t2 = sGetTime();
+    tb0 = sMin(tb0,t1-t0);
+    tq0 = sMin(tq0,t2-t1);
+  }
+  sPrintF(L"%7d hash     %5d ms build %6d ms pairs  %d pairs\n",count,tb0,tq0,sInt(pairs0));
+  delete[] oh->Hashes;
+  delete[] oh->Sorted;
+  delete[] oh->SortedHash;
+  delete oh;
+
+  // the grid
+
+  sSpatialGrid grid;
+  sVector31 *sorted = new sVector31[count];
+  for(sInt parallel=0;parallel<2;parallel++)
+  {
+    sInt tb1 = 0x7fffffff,tq1 = 0x7fffffff;
+    sS64 pairs1 = 0;
+    for(sInt run=0;run<RUNS;run++)
+    {
+      sInt t0 = sGetTime();
+      grid.Begin(count,Radius);
+      for(sInt i=0;i<count;i++)
+        grid.Add(i,pos[i]);
+      grid.Sort(parallel);
+      const sU32 *order = grid.GetOrder();
+      for(sInt i=0;i<count;i++)
+        sorted[i] = pos[order[i]];
+      sInt t1 = sGetTime();
+      sU32 oldkey = ~0U;
+      sInt ranges = 0;
+      pairs1 = 0;
+      for(sInt n=0;n<count;n++)
+      {
+        if(grid.GetSortedKey(n)!=oldkey)
+        {
+          oldkey = grid.GetSortedKey(n);
+          ranges = grid.GetNeighbours(oldkey,rs,rc);
+        }
+        pairs1 += Pairs(sorted,n,rs,rc,ranges);
+      }
+      sInt t2 = sGetTime();
+      tb1 = sMin(tb1,t1-t0);
+      tq1 = sMin(tq1,t2-t1);
+    }
+    sPrintF(L"%7d %-8s %5d ms build %6d ms pairs  %d pairs, %d cells%s\n",count,parallel ? L"threaded" : L"grid",
+      tb1,tq1,sInt(pairs1),grid.GetCellCount(),pairs1==pairs0 ? L"" : L"  ERROR");
+  }
+
+  delete[] sorted;
+  delete[] pos;
+}
+
+void sMain()
+{
+  sAddSched();
+  sInit(0);
+
+  sPrintF(L"radius %f, %f particles per cell, %d threads\n",Radius,Density,sSched->GetThreadCount());
+  for(sInt count=0x1000;count<=0x40000;count*=4)
+    Run(count);
+}
+
+/****************************************************************************/
+
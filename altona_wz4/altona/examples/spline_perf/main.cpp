@@ -0,0 +1,116 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "base/types.hpp"
+#include "base/system.hpp"
+#include "base/math.hpp"
+#include "wz4lib/script.hpp"
+
+/****************************************************************************/
+
+// benchmark for ScriptSpline::Eval() on long curves: linear key search
+// (spline not prepared), binary search on precalculated segments, and
+// precalculated segments with a cursor. times are played back in order,
+// like an animation, and then at random.
+//
+// the precalculated segments round differently than the unprepared code,
+// so those are only close. the cursor just finds the same segment faster
+// and has to give exactly the binary search results.
+
+enum
+{
+  CURVES = 3,
+  KEYS = 4096,
+  SAMPLES = 50000,
+};
+
+static void MakeSpline(ScriptSpline &spline,sRandomKISS &rand)
+{
+  spline.Init(CURVES);
+  spline.Mode = SSM_Hermite;
+  spline.Flags = SSF_BoundClamp;
+  spline.MaxTime = KEYS;
+  for(sInt i=0;i<CURVES;i++)
+  {
+    sF32 time = 0;
+    for(sInt n=0;n<KEYS;n++)
+    {
+      ScriptSplineKey *key = spline.Curves[i]->AddMany(1);
+      key->Time = time;
+      key->Value = rand.Float(2.0f)-1.0f;
+      time += 0.5f+rand.Float(1.0f);
+    }
+  }
+}
+
+static sInt Run(ScriptSpline &spline,const sF32 *times,sF32 *results,sBool cursor)
+{
+  ScriptSplineCursor cur;
+  sInt t0 = sGetTime();
+  for(sInt i=0;i<SAMPLES;i++)
+    spline.Eval(times[i],results+i*CURVES,CURVES,cursor ? &cur : 0);
+  return sGetTime()-t0;
+}
+
+static sF32 MaxDiff(const sF32 *a,const sF32 *b)
+{
+  sF32 diff = 0;
+  for(sInt i=0;i<SAMPLES*CURVES;i++)
+    diff = sMax(diff,sAbs(a[i]-b[i]));
+  return diff;
+}
+
+static sInt Mismatches(const sF32 *a,const sF32 *b)
+{
+  sInt errors = 0;
+  for(sInt i=0;i<SAMPLES*CURVES;i++)
+    if(sCmpMem(a+i,b+i,sizeof(sF32)))
+      errors++;
+  return errors;
+}
+
+void sMain()
+{
+  sRandomKISS rand;
+  rand.Init();
+
+  ScriptSpline linear,prepared;
+  MakeSpline(linear,rand);
+  rand.Init();
+  MakeSpline(prepared,rand);
+  prepared.Prepare();
+
+  sF32 *times = new sF32[SAMPLES];
+  sF32 *ref = new sF32[SAMPLES*CURVES];
+  sF32 *bin = new sF32[SAMPLES*CURVES];
+  sF32 *res = new sF32[SAMPLES*CURVES];
+  sF32 length = linear.Length();
+
+  for(sInt pass=0;pass<2;pass++)
+  {
+    for(sInt i=0;i<SAMPLES;i++)
+      times[i] = pass==0 ? length*i/SAMPLES : rand.Float(length);
+
+    sInt tl = Run(linear,times,ref,0);
+    sInt tb = Run(prepared,times,bin,0);
+    sF32 db = MaxDiff(ref,bin);
+    sInt tc = Run(prepared,times,res,1);
+    sInt ec = Mismatches(bin,res);
+
+    sPrintF(L"%s times, %d keys, %d samples\n",pass==0 ? L"sequential" : L"random",KEYS,SAMPLES);
+    sPrintF(L"linear search: %5d ms\n",tl);
+    sPrintF(L"binary search: %5d ms, max difference to linear %.8f\n",tb,db);
+    sPrintF(L"cursor:        %5d ms, %d mismatches to binary search\n",tc,ec);
+  }
+
+  delete[] times;
+  delete[] ref;
+  delete[] bin;
+  delete[] res;
+}
+
+/****************************************************************************/
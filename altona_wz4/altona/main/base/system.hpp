@@ -965,6 +965,7 @@ void  sGetCurrentDir(const sStringDesc &str);
 void  sGetTempDir(const sStringDesc &str);
 void  sGetAppDataDir(const sStringDesc &str);
 sBool sGetFileInfo(const sChar *name,sDirEntry *);
+sBool sGetExecutableFile(const sStringDesc &name);  // full path of the running program
 sBool sGetDiskSizeInfo(const sChar *path, sS64 &availablesize, sS64 &totalsize);
 sBool sMakeDir(const sChar *);          // make one directory
 sBool sMakeDirAll(const sChar *);       // make all directories. may fail with strage paths.
@@ -148,6 +148,7 @@ sU8 *sMainHeapBase;
 sU8 *sDebugHeapBase;
 class sMemoryHeap sMainHeap;
 class sMemoryHeap sDebugHeap;
+class sTlsfHeap sMainTlsfHeap;
 
 class sLibcHeap_ : public sMemoryHandler
 {
@@ -201,9 +202,18 @@ void sInitMem1()
     sVERIFY(sMainHeapBase);
     if(flags & sIMF_CLEAR)
       sSetMem(sMainHeapBase,0x77,sMemoryInitSize);
-    sMainHeap.Init(sMainHeapBase,sMemoryInitSize);
-    sMainHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
-    sRegisterMemHandler(sAMF_HEAP,&sMainHeap);
+    if(flags & sIMF_TLSF)
+    {
+      sMainTlsfHeap.Init(sMainHeapBase,sMemoryInitSize);
+      sMainTlsfHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
+      sRegisterMemHandler(sAMF_HEAP,&sMainTlsfHeap);
+    }
+    else
+    {
+      sMainHeap.Init(sMainHeapBase,sMemoryInitSize);
+      sMainHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
+      sRegisterMemHandler(sAMF_HEAP,&sMainHeap);
+    }
   }
   else
   {
@@ -566,6 +576,8 @@ void  sGetTempDir(const sStringDesc &str)
 { sFatal(L"not implemented"); }
 sBool sGetFileInfo(const sChar *name,sDirEntry *)
 { sFatal(L"not implemented"); return 0; }
+sBool sGetExecutableFile(const sStringDesc &name)
+{ return 0; }
 sBool sGetDiskSizeInfo(const sChar *path, sS64 &availablesize, sS64 &totalsize)
 { sFatal(L"not implemented"); return 0; }
 sBool sMakeDir(const sChar *)          // make one directory
@@ -931,6 +931,23 @@ sBool sIsBelowCurrentDir(const sChar *relativePath)
   return sCheckPrefix(there,here);
 }
 
+sBool sGetExecutableFile(const sStringDesc &name)
+{
+  char path[sMAXPATH];
+  ssize_t len = readlink("/proc/self/exe",path,sizeof(path)-1);
+  if(len<=0)
+    return sFALSE;
+  path[len] = 0;
+
+  sU32 *convBuffer = sALLOCSTACK(sU32,name.Size); // wchar32-to-fake-wchar16
+  size_t count = mbstowcs((wchar_t *)convBuffer,path,name.Size);
+  if(count==size_t(-1) || count>=size_t(name.Size))
+    return sFALSE;
+  for(size_t i=0;i<=count;i++)
+    name.Buffer[i] = convBuffer[i];
+  return sTRUE;
+}
+
 sBool sGetFileInfo(const sChar *name,sDirEntry *de)
 {
   struct stat64 st;
@@ -1086,6 +1103,12 @@ sThread::~sThread()
   delete Context;
 }
 
+void sThread::SetHomeCore(sInt core)
+{
+  // windows only gets a hint for the ideal processor. pinning the thread
+  // with an affinity mask would be more than that, so leave it to linux.
+}
+
 /****************************************************************************/
 
 void sInitThread()
@@ -1517,6 +1540,9 @@ void sInit(sInt flags,sInt xs,sInt ys)
   // run remaining initializers
   sSetRunlevel(0x100);  
   sUpdateWindow();
+#else
+  // no window, but subsystems added in sMain() still have to start
+  sSetRunlevel(0x100);
 #endif
 }
 
@@ -2106,6 +2132,7 @@ sU8 *sMainHeapBase;
 sU8 *sDebugHeapBase;
 class sMemoryHeap sMainHeap;
 class sMemoryHeap sDebugHeap;
+class sTlsfHeap sMainTlsfHeap;
 
 class sLibcHeap_ : public sMemoryHandler
 {
@@ -2160,9 +2187,18 @@ void sInitMem1()
     sVERIFY(sMainHeapBase != (sU8*) MAP_FAILED);
     if(flags & sIMF_CLEAR)
       sSetMem(sMainHeapBase,0x77,sMemoryInitSize);
-    sMainHeap.Init(sMainHeapBase,sMemoryInitSize);
-    sMainHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
-    sRegisterMemHandler(sAMF_HEAP,&sMainHeap);
+    if(flags & sIMF_TLSF)
+    {
+      sMainTlsfHeap.Init(sMainHeapBase,sMemoryInitSize);
+      sMainTlsfHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
+      sRegisterMemHandler(sAMF_HEAP,&sMainTlsfHeap);
+    }
+    else
+    {
+      sMainHeap.Init(sMainHeapBase,sMemoryInitSize);
+      sMainHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
+      sRegisterMemHandler(sAMF_HEAP,&sMainHeap);
+    }
   }
   else
   {
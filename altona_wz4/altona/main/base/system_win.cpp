@@ -1466,6 +1466,12 @@ sBool sIsBelowCurrentDir(const sChar *relativePath)
   return sCheckPrefix(normalizedDir,currentDir);
 }
 
+sBool sGetExecutableFile(const sStringDesc &name)
+{
+  DWORD len = GetModuleFileNameW(0,name.Buffer,name.Size);
+  return len>0 && len<DWORD(name.Size);
+}
+
 sBool sGetFileInfo(const sChar *name,sDirEntry *de)
 {
   HANDLE hnd;
@@ -3677,6 +3683,7 @@ sU8 *sMainHeapBase;
 sU8 *sDebugHeapBase;
 class sMemoryHeap sMainHeap;
 class sMemoryHeap sDebugHeap;
+class sTlsfHeap sMainTlsfHeap;
 
 class sVSHeapBase : public sMemoryHandler
 {
@@ -3804,9 +3811,18 @@ void sInitMem1()
     sMainHeapBase = (sU8 *)VirtualAlloc(0,sMemoryInitSize,MEM_COMMIT,PAGE_READWRITE);
     if(flags & sIMF_CLEAR)
       sSetMem(sMainHeapBase,0x77,sMemoryInitSize);
-    sMainHeap.Init(sMainHeapBase,sMemoryInitSize);
-    sMainHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
-    sRegisterMemHandler(sAMF_HEAP,&sMainHeap);
+    if(flags & sIMF_TLSF)
+    {
+      sMainTlsfHeap.Init(sMainHeapBase,sMemoryInitSize);
+      sMainTlsfHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
+      sRegisterMemHandler(sAMF_HEAP,&sMainTlsfHeap);
+    }
+    else
+    {
+      sMainHeap.Init(sMainHeapBase,sMemoryInitSize);
+      sMainHeap.SetDebug((flags & sIMF_CLEAR)!=0,0);
+      sRegisterMemHandler(sAMF_HEAP,&sMainHeap);
+    }
   }
   else
   {
@@ -20,6 +20,10 @@
 // for _controlfp87 
 #include <float.h>
 #endif 
+#if sCONFIG_COMPILER_MSC
+// bit scan for sTlsfHeap
+#include <intrin.h>
+#endif
 
 /****************************************************************************/
 
@@ -6383,6 +6387,9 @@ sMemoryHeap::sMemoryHeap()
   TotalFree = 0;
   LastFreeNode = 0;
   Clear = MEMVERBOSE;
+  AllocCount = 0;
+  FreeCount = 0;
+  SearchCount = 0;
 }
 
 void sMemoryHeap::Init(sU8 *start,sPtr size)
@@ -6467,6 +6474,9 @@ void sMemoryHeap::DumpStats(sInt verbose)
   sLogF(L"mem",L"%08x(%5K) Smallest\n",smallest,smallest);
   sLogF(L"mem",L"%08x(%5K) Fragged in %d nodes\n",fragged,fragged,fcount);
   sLogF(L"mem",L"%08x(%5K) Unfragged in %d nodes\n",free-fragged,free-fragged,count-fcount);
+  sLogF(L"mem",L"%d%% fragmentation (free memory not in largest block)\n",free ? sInt(100-sU64(largest)*100/free) : 0);
+  sLogF(L"mem",L"%d allocs, %d frees, %d.%02d nodes searched per alloc\n",sInt(AllocCount),sInt(FreeCount),
+    sInt(SearchCount/sMax<sPtr>(AllocCount,1)),sInt(SearchCount*100/sMax<sPtr>(AllocCount,1)%100));
   if(free!=TotalFree)
     sLogF(L"mem",L"Heap Corrupted! (%08x free, %08x should)\n",free,TotalFree);
 }
@@ -6596,6 +6606,7 @@ void *sMemoryHeap::Alloc(sPtr bytes,sInt align,sInt flags)
       fe = fs+n->Size;              // free end
       as = sAlign(fs+HEADER,align)-HEADER;   // allocated start, aligned and with header
       ae = as+size;                 // allocated end
+      SearchCount++;
       if(ae<=fe)                          // does it fit?
       {
         sVERIFY(as>=fs);
@@ -6613,6 +6624,7 @@ void *sMemoryHeap::Alloc(sPtr bytes,sInt align,sInt flags)
       fe = fs+n->Size;              // free end
       as = ((fe-size+HEADER)&~(align-1))-HEADER;   // allocated start, aligned and with header
       ae = as+size;                 // allocated end
+      SearchCount++;
       if(fs<=as)                          // does it fit?
       {
         sVERIFY(as>=fs);
@@ -6656,6 +6668,7 @@ void *sMemoryHeap::Alloc(sPtr bytes,sInt align,sInt flags)
 
     TotalFree -= size;
     MinTotalFree = sMin(TotalFree,MinTotalFree);
+    AllocCount++;
 
     sVERIFY(((as+HEADER)&MASK)==0);
 
@@ -6693,6 +6706,7 @@ sBool sMemoryHeap::Free(void *ptr)
   sVERIFY(bs>=Start && be<=End);
 
   TotalFree += size;
+  FreeCount++;
 
   b = (sMemoryHeapFreeNode *) bs;
   b->Size = size;
@@ -6811,6 +6825,469 @@ sPtr sMemoryHeap::MemSize(void *ptr)
 #undef OFFSET
 #undef MASK
 
+/****************************************************************************/
+/***                                                                      ***/
+/***   Two Level Segregated Fit Heap                                      ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// blocks start 16 byte aligned minus the header, so that the memory behind
+// the header is 16 byte aligned. block sizes are multiples of 16, which
+// leaves the low bits of Size for the flags.
+
+enum
+{
+  sTLSF_HEADER = 2*sizeof(void *),          // PrevPhys and Size
+  sTLSF_GRAIN = 16,
+  sTLSF_MINBLOCK = (sizeof(sTlsfBlock)+15)&~15,
+  sTLSF_FREE = 1,
+  sTLSF_PREVFREE = 2,
+  sTLSF_FLAGS = 15,
+};
+
+static sInt sTlsfFls(sPtr x)     // index of highest set bit, x!=0
+{
+#if sCONFIG_COMPILER_MSC && sCONFIG_64BIT
+  unsigned long r; _BitScanReverse64(&r,x); return sInt(r);
+#elif sCONFIG_COMPILER_MSC
+  unsigned long r; _BitScanReverse(&r,x); return sInt(r);
+#elif sCONFIG_COMPILER_GCC && sCONFIG_64BIT
+  return 63-__builtin_clzll(x);
+#elif sCONFIG_COMPILER_GCC
+  return 31-__builtin_clz(x);
+#else
+  sInt r = 0;
+  while(x>>=1) r++;
+  return r;
+#endif
+}
+
+static sInt sTlsfFfs(sU32 x)     // index of lowest set bit, x!=0
+{
+#if sCONFIG_COMPILER_MSC
+  unsigned long r; _BitScanForward(&r,x); return sInt(r);
+#elif sCONFIG_COMPILER_GCC
+  return __builtin_ctz(x);
+#else
+  sInt r = 0;
+  while(!(x&1)) { x>>=1; r++; }
+  return r;
+#endif
+}
+
+static void sTlsfMapping(sPtr size,sInt &fl,sInt &sl)
+{
+  if(size<(1<<sTlsfHeap::MinShift))
+  {
+    fl = 0;
+    sl = sInt(size)/sTLSF_GRAIN;
+  }
+  else
+  {
+    sInt f = sTlsfFls(size);
+    sl = sInt(size>>(f-sTlsfHeap::SLBits)) ^ sTlsfHeap::SLCount;
+    fl = f-(sTlsfHeap::MinShift-1);
+  }
+}
+
+static inline sPtr sTlsfSize(const sTlsfBlock *b)             { return b->Size & ~sPtr(sTLSF_FLAGS); }
+static inline sTlsfBlock *sTlsfNext(const sTlsfBlock *b)      { return (sTlsfBlock *)(sPtr(b)+sTlsfSize(b)); }
+
+sTlsfHeap::sTlsfHeap()
+{
+  Start = 0;
+  End = 0;
+  TotalFree = 0;
+  Clear = 0;
+  Sentinel = 0;
+  FLBitmap = 0;
+  sClear(SLBitmap);
+  sClear(Lists);
+  AllocCount = 0;
+  FreeCount = 0;
+  FailCount = 0;
+}
+
+void sTlsfHeap::Init(sU8 *start,sPtr size)
+{
+  sVERIFY(start);
+  sPtr s = sAlign(sPtr(start)+sTLSF_HEADER,sTLSF_GRAIN)-sTLSF_HEADER;
+  sPtr e = ((sPtr(start)+size)&~sPtr(sTLSF_GRAIN-1))-sTLSF_GRAIN;
+  sVERIFY(e>s+sTLSF_MINBLOCK);
+  sVERIFY(sU64(e-s) < (sU64(1)<<(FLCount+MinShift-1)));   // shift is 32 on 32 bit
+
+  Start = s;
+  End = e+sTLSF_GRAIN;
+  if(Clear) sSetMem((void *)Start,0xaa,End-Start);
+
+  FLBitmap = 0;
+  sClear(SLBitmap);
+  sClear(Lists);
+
+  sTlsfBlock *b = (sTlsfBlock *) s;
+  Sentinel = (sTlsfBlock *) (e-sTLSF_HEADER+sTLSF_GRAIN);
+  b->PrevPhys = 0;
+  b->Size = sPtr(Sentinel)-s;
+  Sentinel->PrevPhys = b;
+  Sentinel->Size = 0;
+  TotalFree = b->Size;
+  InsertFree(b);
+  MinTotalFree = GetFree();
+}
+
+void sTlsfHeap::SetDebug(sBool clear,sInt memwall)
+{
+  Clear = clear;
+}
+
+/****************************************************************************/
+
+void sTlsfHeap::InsertFree(sTlsfBlock *b)
+{
+  sInt fl,sl;
+  sTlsfMapping(sTlsfSize(b),fl,sl);
+  b->Size |= sTLSF_FREE;
+  b->PrevFree = 0;
+  b->NextFree = Lists[fl][sl];
+  if(b->NextFree)
+    b->NextFree->PrevFree = b;
+  Lists[fl][sl] = b;
+  FLBitmap |= 1U<<fl;
+  SLBitmap[fl] |= 1U<<sl;
+
+  sTlsfBlock *n = sTlsfNext(b);
+  n->PrevPhys = b;
+  n->Size |= sTLSF_PREVFREE;
+}
+
+void sTlsfHeap::RemoveFree(sTlsfBlock *b)
+{
+  sInt fl,sl;
+  sTlsfMapping(sTlsfSize(b),fl,sl);
+  if(b->NextFree)
+    b->NextFree->PrevFree = b->PrevFree;
+  if(b->PrevFree)
+    b->PrevFree->NextFree = b->NextFree;
+  else
+  {
+    Lists[fl][sl] = b->NextFree;
+    if(!Lists[fl][sl])
+    {
+      SLBitmap[fl] &= ~(1U<<sl);
+      if(!SLBitmap[fl])
+        FLBitmap &= ~(1U<<fl);
+    }
+  }
+  b->Size &= ~sPtr(sTLSF_FREE);
+  sTlsfNext(b)->Size &= ~sPtr(sTLSF_PREVFREE);
+}
+
+// first block in the smallest list that only holds blocks >= size
+
+sTlsfBlock *sTlsfHeap::FindFree(sPtr size)
+{
+  if(size>=(1<<MinShift))
+    size += (sPtr(1)<<(sTlsfFls(size)-SLBits))-1;
+  sInt fl,sl;
+  sTlsfMapping(size,fl,sl);
+  if(fl>=FLCount)
+    return 0;
+
+  sU32 slmap = SLBitmap[fl] & (~0U<<sl);
+  if(!slmap)
+  {
+    sU32 flmap = (fl+1<32) ? (FLBitmap & (~0U<<(fl+1))) : 0;
+    if(!flmap)
+      return 0;
+    fl = sTlsfFfs(flmap);
+    slmap = SLBitmap[fl];
+  }
+  return Lists[fl][sTlsfFfs(slmap)];
+}
+
+// cut a used block to size, the rest goes back to the free lists.
+// the block after a used block is never free, so the rest needs no merge
+
+sTlsfBlock *sTlsfHeap::Split(sTlsfBlock *b,sPtr size)
+{
+  sPtr have = sTlsfSize(b);
+  if(have-size>=sTLSF_MINBLOCK)
+  {
+    sTlsfBlock *r = (sTlsfBlock *)(sPtr(b)+size);
+    r->PrevPhys = b;
+    r->Size = have-size;
+    b->Size = size | (b->Size & sTLSF_FLAGS);
+    InsertFree(r);
+  }
+  return b;
+}
+
+void *sTlsfHeap::Alloc(sPtr bytes,sInt align,sInt flags)
+{
+  sPtr size = sMax<sPtr>(sAlign(bytes+sTLSF_HEADER,sTLSF_GRAIN),sTLSF_MINBLOCK);
+  sVERIFY(bytes<size);                         // overflow check
+  if(align<sTLSF_GRAIN) align = sTLSF_GRAIN;
+
+  // with large alignment, reserve room to cut off a free block in front
+
+  sPtr search = size;
+  if(align>sTLSF_GRAIN)
+    search += align+sTLSF_MINBLOCK;
+
+  sTlsfBlock *b = search<=TotalFree ? FindFree(search) : 0;
+  if(!b)
+  {
+    FailCount++;
+    return 0;
+  }
+  RemoveFree(b);
+
+  if(align>sTLSF_GRAIN)
+  {
+    sPtr user = sAlign(sPtr(b)+sTLSF_HEADER,align);
+    sPtr gap = user-sTLSF_HEADER-sPtr(b);
+    if(gap>0 && gap<sTLSF_MINBLOCK)
+    {
+      user = sAlign(sPtr(b)+sTLSF_HEADER+sTLSF_MINBLOCK,align);
+      gap = user-sTLSF_HEADER-sPtr(b);
+    }
+    if(gap>0)                                 // previous block is used, no merge
+    {
+      sTlsfBlock *a = (sTlsfBlock *)(user-sTLSF_HEADER);
+      a->PrevPhys = b;
+      a->Size = sTlsfSize(b)-gap;
+      b->Size = gap | (b->Size & sTLSF_FLAGS);
+      sTlsfNext(a)->PrevPhys = a;
+      InsertFree(b);
+      b = a;
+    }
+  }
+
+  Split(b,size);
+  size = sTlsfSize(b);
+
+  TotalFree -= size;
+  MinTotalFree = sMin(TotalFree,MinTotalFree);
+  AllocCount++;
+
+  if(Clear) sSetMem(((sU8 *)b)+sTLSF_HEADER,0xcc,size-sTLSF_HEADER);
+  sAtomicAdd(&sMemoryUsed,size);
+
+  return ((sU8 *)b)+sTLSF_HEADER;
+}
+
+sBool sTlsfHeap::Free(void *ptr)
+{
+  sTlsfBlock *b = (sTlsfBlock *)(sPtr(ptr)-sTLSF_HEADER);
+  sVERIFY(sPtr(b)>=Start && b<Sentinel);
+  sVERIFY(!(b->Size & sTLSF_FREE));
+
+  sPtr size = sTlsfSize(b);
+  sAtomicAdd(&sMemoryUsed,-(sDInt)size);
+  if(Clear) sSetMem(ptr,0xee,size-sTLSF_HEADER);
+  TotalFree += size;
+  FreeCount++;
+
+  if(b->Size & sTLSF_PREVFREE)               // merge with previous
+  {
+    sTlsfBlock *a = b->PrevPhys;
+    RemoveFree(a);
+    a->Size += size;
+    b = a;
+  }
+  sTlsfBlock *n = sTlsfNext(b);
+  if(n->Size & sTLSF_FREE)                    // merge with next
+  {
+    RemoveFree(n);
+    b->Size += sTlsfSize(n);
+  }
+  InsertFree(b);
+
+  return 1;
+}
+
+sPtr sTlsfHeap::MemSize(void *ptr)
+{
+  sTlsfBlock *b = (sTlsfBlock *)(sPtr(ptr)-sTLSF_HEADER);
+  return sTlsfSize(b)-sTLSF_HEADER;
+}
+
+/****************************************************************************/
+
+sCONFIG_SIZET sTlsfHeap::GetFree()
+{
+  return TotalFree;
+}
+
+sCONFIG_SIZET sTlsfHeap::GetLargestFree()
+{
+  sPtr max = 0;
+  if(FLBitmap)
+  {
+    sInt fl = sTlsfFls(FLBitmap);
+    sInt sl = sTlsfFls(SLBitmap[fl]);
+    for(sTlsfBlock *b=Lists[fl][sl];b;b=b->NextFree)
+      max = sMax(max,sTlsfSize(b));
+  }
+  return max>sTLSF_HEADER ? max-sTLSF_HEADER : 0;
+}
+
+sPtr sTlsfHeap::GetUsed()
+{
+  return End-Start-TotalFree;
+}
+
+sBool sTlsfHeap::IsFree(const void *ptr) const
+{
+  for(sTlsfBlock *b=(sTlsfBlock *)Start;b!=Sentinel;b=sTlsfNext(b))
+    if(sPtr(ptr)>=sPtr(b) && sPtr(ptr)<sPtr(sTlsfNext(b)))
+      return (b->Size & sTLSF_FREE)!=0;
+  return 0;
+}
+
+void sTlsfHeap::DumpStats(sInt verbose)
+{
+  sInt count = 0;
+  sInt fcount = 0;
+  sInt ucount = 0;
+  sPtr largest = 0;
+  sPtr free = 0;
+  sPtr smallest = 0;
+  sPtr fragged = 0;
+
+  for(sTlsfBlock *b=(sTlsfBlock *)Start;b!=Sentinel;b=sTlsfNext(b))
+  {
+    sPtr size = sTlsfSize(b);
+    if(!(b->Size & sTLSF_FREE))
+    {
+      ucount++;
+      continue;
+    }
+    count++;
+    free += size;
+    if(size<64*1024)
+    {
+      fragged += size;
+      fcount++;
+    }
+    largest = sMax(largest,size);
+    smallest = count==1 ? size : sMin(smallest,size);
+  }
+
+  sU32 hash = MakeSnapshot();
+  sLogF(L"mem",L"TlsfHeapStats: %08x..%08x, HASH %08x\n",Start,End,hash);
+  sLogF(L"mem",L"%08x(%5K) Free in %d nodes, %d blocks used\n",free,free,count,ucount);
+  sLogF(L"mem",L"%08x(%5K) Largest\n",largest,largest);
+  sLogF(L"mem",L"%08x(%5K) Smallest\n",smallest,smallest);
+  sLogF(L"mem",L"%08x(%5K) Fragged in %d nodes\n",fragged,fragged,fcount);
+  sLogF(L"mem",L"%08x(%5K) Unfragged in %d nodes\n",free-fragged,free-fragged,count-fcount);
+  sLogF(L"mem",L"%d%% fragmentation (free memory not in largest block)\n",free ? sInt(100-sU64(largest)*100/free) : 0);
+  sLogF(L"mem",L"%d allocs, %d frees, %d failed\n",sInt(AllocCount),sInt(FreeCount),sInt(FailCount));
+  if(free!=TotalFree)
+    sLogF(L"mem",L"Heap Corrupted! (%08x free, %08x should)\n",free,TotalFree);
+}
+
+sU32 sTlsfHeap::MakeSnapshot()
+{
+  sInt freeNodeCount = 0;
+  sChecksumAdler32Begin();
+  for(sTlsfBlock *b=(sTlsfBlock *)Start;b!=Sentinel;b=sTlsfNext(b))
+  {
+    if(b->Size & sTLSF_FREE)
+    {
+      sPtr data[2] = { sPtr(b),sTlsfSize(b) };
+      sChecksumAdler32Add((const sU8 *)data,sizeof(data));
+      freeNodeCount++;
+    }
+  }
+  sLogF(L"mem", L"Free mem nodes: %d\n", freeNodeCount);
+  return sChecksumAdler32End();
+}
+
+void sTlsfHeap::Validate()
+{
+  sPtr free = 0;
+  sInt errors = 0;
+  sInt count = 0;
+  sTlsfBlock *prev = 0;
+
+  for(sTlsfBlock *b=(sTlsfBlock *)Start;;b=sTlsfNext(b))
+  {
+    if(sPtr(b)<Start || b>Sentinel)
+    {
+      sLogF(L"mem",L"block outside heap! %08x\n",sPtr(b));
+      errors++;
+      break;
+    }
+    if(b->PrevPhys!=prev)
+    {
+      sLogF(L"mem",L"block chain broken at %08x\n",sPtr(b));
+      errors++;
+    }
+    if(prev && ((b->Size & sTLSF_PREVFREE)!=0)!=((prev->Size & sTLSF_FREE)!=0))
+    {
+      sLogF(L"mem",L"free flags wrong at %08x\n",sPtr(b));
+      errors++;
+    }
+    if(b==Sentinel)
+      break;
+    if(sTlsfSize(b)<sTLSF_MINBLOCK)
+    {
+      sLogF(L"mem",L"invalid block size! %08x for %08x\n",sPtr(b),sTlsfSize(b));
+      errors++;
+      break;
+    }
+    if(b->Size & sTLSF_FREE)
+    {
+      if(prev && (prev->Size & sTLSF_FREE))
+      {
+        sLogF(L"mem",L"nodes not merged! %08x\n",sPtr(b));
+        errors++;
+      }
+      free += sTlsfSize(b);
+      count++;
+    }
+    prev = b;
+  }
+
+  for(sInt fl=0;fl<FLCount;fl++)
+  {
+    for(sInt sl=0;sl<SLCount;sl++)
+    {
+      sBool bit = (SLBitmap[fl]>>sl)&1;
+      if(bit != (Lists[fl][sl]!=0) || (bit && !((FLBitmap>>fl)&1)))
+      {
+        sLogF(L"mem",L"bitmap wrong for list %d/%d\n",fl,sl);
+        errors++;
+      }
+      for(sTlsfBlock *b=Lists[fl][sl];b;b=b->NextFree)
+      {
+        sInt f,s;
+        sTlsfMapping(sTlsfSize(b),f,s);
+        if(f!=fl || s!=sl || !(b->Size & sTLSF_FREE))
+        {
+          sLogF(L"mem",L"block %08x in wrong list\n",sPtr(b));
+          errors++;
+        }
+        count--;
+      }
+    }
+  }
+
+  if(count!=0)
+  {
+    sLogF(L"mem",L"free lists do not match heap\n");
+    errors++;
+  }
+  if(free!=TotalFree)
+  {
+    sLogF(L"mem",L"%08x free, %08x expected\n",free,TotalFree);
+    errors++;
+  }
+  if(errors)
+    sFatal(L"heap corrupted");
+}
+
 
 /****************************************************************************/
 /***                                                                      ***/
@@ -1560,6 +1560,7 @@ enum sInitMemFlags                // sInitMem() flags
   sIMF_NORTL        = 0x0004,     // pc only: use altona heap instead of RTL heap.
   sIMF_CLEAR        = 0x0008,     // debugging: clear memory on allocation and freeing
   sIMF_NOLEAKTRACK  = 0x0010,     // prevent initialization of leaktracker
+  sIMF_TLSF         = 0x0020,     // with sIMF_NORTL: use sTlsfHeap instead of sMemoryHeap
 };
 
 class sMemoryHandler              // used by system to register memory handlers
@@ -3380,6 +3381,10 @@ protected:
   sDList<sMemoryHeapFreeNode,&sMemoryHeapFreeNode::Node> FreeList;
   sMemoryHeapFreeNode *LastFreeNode;
 
+  sPtr AllocCount;                // statistics
+  sPtr FreeCount;
+  sPtr SearchCount;               // free nodes visited by Alloc()
+
 public:
   sMemoryHeap();
   void Init(sU8 *start,sPtr size);
@@ -3399,6 +3404,81 @@ public:
   sU32 MakeSnapshot();
 };
 
+/****************************************************************************/
+/***                                                                      ***/
+/***   two level segregated fit heap                                      ***/
+/***                                                                      ***/
+/****************************************************************************/
+/***                                                                      ***/
+/***   free blocks are sorted into lists by size class: one first level   ***/
+/***   per power of two, split into 16 second level lists. two bitmaps    ***/
+/***   find the smallest list that fits, so Alloc() and Free() take       ***/
+/***   constant time no matter how fragmented the heap is.                ***/
+/***                                                                      ***/
+/***   - same interface as sMemoryHeap, use sIMF_TLSF to get it as        ***/
+/***     main heap                                                        ***/
+/***   - sAMF_ALT is ignored, there is no preferred direction             ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+struct sTlsfBlock
+{
+  sTlsfBlock *PrevPhys;           // block before this in memory
+  sPtr Size;                      // including header. bit 0: free, bit 1: previous free
+  sTlsfBlock *NextFree;           // only valid for free blocks
+  sTlsfBlock *PrevFree;
+};
+
+class sTlsfHeap : public sMemoryHandler
+{
+public:
+  enum
+  {
+    SLBits = 4,                   // 16 lists per power of two
+    SLCount = 1<<SLBits,
+    MinShift = SLBits+4,          // below 256 bytes one list per 16 bytes
+#if sCONFIG_64BIT
+    FLCount = 32,
+#else
+    FLCount = 25,
+#endif
+  };
+protected:
+  sPtr TotalFree;
+  sInt Clear;
+  sTlsfBlock *Sentinel;           // zero size used block at the end of the heap
+
+  sU32 FLBitmap;                  // bit fl set: some list in SLBitmap[fl] is not empty
+  sU32 SLBitmap[FLCount];
+  sTlsfBlock *Lists[FLCount][SLCount];
+
+  sPtr AllocCount;                // statistics
+  sPtr FreeCount;
+  sPtr FailCount;
+
+  void InsertFree(sTlsfBlock *b);
+  void RemoveFree(sTlsfBlock *b);
+  sTlsfBlock *FindFree(sPtr size);
+  sTlsfBlock *Split(sTlsfBlock *b,sPtr size);
+
+public:
+  sTlsfHeap();
+  void Init(sU8 *start,sPtr size);
+  void SetDebug(sBool clear,sInt memwall);
+
+  sCONFIG_SIZET GetFree();
+  sCONFIG_SIZET GetLargestFree();
+  sPtr GetUsed();
+  void DumpStats(sInt verbose=0);
+  sBool IsFree(const void *ptr) const;
+
+  void *Alloc(sPtr bytes,sInt align,sInt flags=0);
+  sBool Free(void *);
+  sPtr MemSize(void *);
+  void Validate();
+  sU32 MakeSnapshot();
+};
+
 /****************************************************************************/
 /***                                                                      ***/
 /***   memory heap that stores it's free list and alloc info OUTSIDE      ***/
@@ -652,6 +652,7 @@ class sStringPool_
 
   sMemoryPool *Strings;
   sMemoryPool *Entries;
+  sThreadLock *Lock;              // pool strings are created from worker threads as well
 
   sStringPoolEntry *HashTable[HashSize];
 
@@ -660,6 +661,7 @@ public:
   {
     Strings = new sMemoryPool();
     Entries = new sMemoryPool();
+    Lock = new sThreadLock();
     sClear(HashTable);
   }
 
@@ -667,6 +669,7 @@ public:
   {
     delete Strings;
     delete Entries;
+    delete Lock;
   }
 
   const sChar *Add(const sChar *s,sInt len, sBool *isnew)
@@ -676,12 +679,14 @@ public:
 
     sU32 hash = sHashString(s,len);
 
+    Lock->Lock();
     hp = &HashTable[hash & (HashSize-1)]; 
     e = *hp;
     while(e)
     {
       if(sCmpMem(e->Data,s,len*sizeof(sChar))==0 && e->Data[len]==0)
       {
+        Lock->Unlock();
         if (isnew) *isnew=sFALSE;
         return e->Data;
       }
@@ -695,6 +700,7 @@ public:
     data[len] = 0;
     e->Next = *hp;
     *hp = e;
+    Lock->Unlock();
 
     if (isnew) *isnew=sTRUE;
     return e->Data;
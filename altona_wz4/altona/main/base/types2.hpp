@@ -763,6 +763,136 @@ public:
   void GetAll(sArray<ValueType *> *a)                 { sHashTableBase::GetAll((sArray<void *> *)a); }
 };
 
+/****************************************************************************/
+/***                                                                      ***/
+/***   Open Addressing Hash Map                                           ***/
+/***                                                                      ***/
+/****************************************************************************/
+/***                                                                      ***/
+/***   - keys and values are stored by value in one flat array            ***/
+/***   - key needs comparison operator and a Hash() member function,      ***/
+/***     like sHashTable                                                  ***/
+/***   - no virtual calls, no nodes. probing is linear, the full hash     ***/
+/***     is stored so keys are only compared when the hash matches        ***/
+/***   - grows when 3/4 full. Add() invalidates pointers from Find()      ***/
+/***   - add does not check if the key already exists                     ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+template<class KeyType,class ValueType>
+class sHashMap
+{
+  struct Slot
+  {
+    sU32 Hash;                    // 0 = empty
+    KeyType Key;
+    ValueType Value;
+  };
+
+  Slot *Slots;
+  sInt Size;                      // power of two
+  sInt Used;
+
+  static sU32 HashOf(const KeyType &key)
+  {
+    sU32 h = key.Hash();          // mix, user hashes are often weak in the low bits
+    h ^= h>>16; h *= 0x85ebca6b;
+    h ^= h>>13; h *= 0xc2b2ae35;
+    h ^= h>>16;
+    return h ? h : 1;
+  }
+
+  void Resize(sInt size)
+  {
+    Slot *old = Slots;
+    sInt oldsize = Size;
+    Size = size;
+    Slots = new Slot[Size];
+    for(sInt i=0;i<Size;i++)
+      Slots[i].Hash = 0;
+    for(sInt i=0;i<oldsize;i++)
+    {
+      if(old[i].Hash)
+      {
+        sInt n = old[i].Hash & (Size-1);
+        while(Slots[n].Hash)
+          n = (n+1) & (Size-1);
+        Slots[n] = old[i];
+      }
+    }
+    delete[] old;
+  }
+
+  Slot *FindSlot(const KeyType &key) const
+  {
+    sU32 hash = HashOf(key);
+    sInt n = hash & (Size-1);
+    while(Slots[n].Hash)
+    {
+      if(Slots[n].Hash==hash && Slots[n].Key==key)
+        return &Slots[n];
+      n = (n+1) & (Size-1);
+    }
+    return 0;
+  }
+
+public:
+  sHashMap(sInt count=0x100)      { Slots = 0; Size = 0; Used = 0; Resize(1<<sFindHigherPower(sMax(16,count+count/3+1))); }
+  ~sHashMap()                     { delete[] Slots; }
+  void Clear()                    { for(sInt i=0;i<Size;i++) Slots[i].Hash = 0; Used = 0; }
+  void HintSize(sInt count)       { if(count+count/3>=Size) Resize(1<<sFindHigherPower(count+count/3+1)); }
+  sInt GetCount() const           { return Used; }
+
+  ValueType *Find(const KeyType &key)             { Slot *s = FindSlot(key); return s ? &s->Value : 0; }
+  const ValueType *Find(const KeyType &key) const { Slot *s = FindSlot(key); return s ? &s->Value : 0; }
+
+  ValueType *Add(const KeyType &key,const ValueType &value)
+  {
+    if((Used+1)*4>Size*3)
+      Resize(Size*2);
+    sU32 hash = HashOf(key);
+    sInt n = hash & (Size-1);
+    while(Slots[n].Hash)
+      n = (n+1) & (Size-1);
+    Slots[n].Hash = hash;
+    Slots[n].Key = key;
+    Slots[n].Value = value;
+    Used++;
+    return &Slots[n].Value;
+  }
+
+  sBool Rem(const KeyType &key)
+  {
+    Slot *s = FindSlot(key);
+    if(!s)
+      return 0;
+    sInt hole = sInt(s-Slots);    // shift following entries back, no tombstones
+    sInt n = hole;
+    for(;;)
+    {
+      n = (n+1) & (Size-1);
+      if(!Slots[n].Hash)
+        break;
+      sInt home = Slots[n].Hash & (Size-1);
+      if(((n-home)&(Size-1)) >= ((n-hole)&(Size-1)))
+      {
+        Slots[hole] = Slots[n];
+        hole = n;
+      }
+    }
+    Slots[hole].Hash = 0;
+    Used--;
+    return 1;
+  }
+
+  void GetAll(sArray<ValueType> *a) const
+  {
+    for(sInt i=0;i<Size;i++)
+      if(Slots[i].Hash)
+        a->AddTail(Slots[i].Value);
+  }
+};
+
 /****************************************************************************/
 /***                                                                      ***/
 /***   Rectangular Regions                                                ***/
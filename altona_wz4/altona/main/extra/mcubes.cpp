@@ -383,8 +383,8 @@ MarchingCubes::MarchingCubes(sInt vertices)
   Scale = 0.5f;
 
   FreeContainers = 0;
-  sClear(Grid);
   ActiveCellsDB = 0;
+  CulledCells = 0;
 
   for(sInt i=0;i<256;i++)
   {
@@ -435,13 +435,9 @@ MarchingCubes::~MarchingCubes()
   Recycle();
   ActiveCellsDB = 1-ActiveCellsDB;
   Recycle();
-  Container *c = FreeContainers;
-  while(c)
-  {
-    Container *n = c->Next;
-    delete c;
-    c = n;
-  }
+  Container *c;
+  sFORALL(ContainerBlocks,c)
+    delete[] c;
 
   GeoBuffer *gb;
   sFORALL(GeoBuffers,gb)
@@ -471,17 +467,20 @@ void MarchingCubes::Recycle()
 
 MarchingCubes::Container *MarchingCubes::GetContainer()
 {
-  Container *c = FreeContainers;
-  if(c)
+  if(FreeContainers==0)
   {
-    FreeContainers = c->Next;
-    c->Next = 0;
-    c->Count = 0;
-  }
-  else
-  {
-    c = new Container;
+    Container *block = new Container[ContainerBlock];
+    ContainerBlocks.AddTail(block);
+    for(sInt i=0;i<ContainerBlock;i++)
+    {
+      block[i].Next = FreeContainers;
+      FreeContainers = &block[i];
+    }
   }
+  Container *c = FreeContainers;
+  FreeContainers = c->Next;
+  c->Next = 0;
+  c->Count = 0;
   return c;
 }
 
@@ -507,6 +506,7 @@ void MCTask(sStsManager *,sStsThread *thread,sInt start,sInt count,void *data)
 void MarchingCubes::Begin(sStsManager *sched,sStsWorkload *wl,sInt granularity)
 {
   ActiveCellsDB = 1-ActiveCellsDB;
+  CulledCells = 0;
 
   // lock geometry
 
@@ -564,22 +564,36 @@ void MarchingCubes::Begin(sStsManager *sched,sStsWorkload *wl,sInt granularity)
 out:;
 }
 
+// the grid is a hash of cells, so the particles may go anywhere. a cell is
+// added to ActiveCells when it gets its first particle, so the order does
+// not depend on the hash. the cells are where the old 16x16x16 grid had
+// them, but that grid dropped particles in its outer layer of cells, and
+// listed the cells by position. so with all particles in the inner 14^3
+// cells the triangles are the same, only in another order. particles in
+// the outer layer now change the mesh, also inside the old grid.
+
 void MarchingCubes::Render(sVector31 *parts,sInt pn)
 {
+  sArray<Container *> &cells = ActiveCells[1-ActiveCellsDB];
+  sVERIFY(cells.IsEmpty());
+  Grid.Clear();
+
   // distribute particles to buckets
 
-  sClear(Grid);
   const sF32 e = Influence/CellSize;
+  const sF32 max = MaxCoord;
   sVector30 gspos(1.0f/CellSize/Scale,1.0f/CellSize/Scale,1.0f/CellSize/Scale);
   sVector31 gtpos((GridSize)*0.5f,(GridSize)*0.5f,(GridSize)*0.5f);
+  sVector30 spos(CellSize,CellSize,CellSize);
+  sVector31 tpos(-CellSize*(GridSize)*0.5f,-CellSize*(GridSize)*0.5f,-CellSize*(GridSize)*0.5f);
   for(sInt i=0;i<pn;i++)
   {
     sVector31 pos = sVector30(parts[i])*gspos+gtpos;
-    sInt x = sInt(pos.x);
-    sInt y = sInt(pos.y);
-    sInt z = sInt(pos.z);
-    if(x>=1 && y>=1 && z>=1 && x<GridSize-1 && y<GridSize-1 && z<GridSize-1)
+    if(sAbs(pos.x)<max && sAbs(pos.y)<max && sAbs(pos.z)<max)
     {
+      sInt x = sRoundDownInt(pos.x);
+      sInt y = sRoundDownInt(pos.y);
+      sInt z = sRoundDownInt(pos.z);
       sF32 fx = pos.x-x;
       sF32 fy = pos.y-y;
       sF32 fz = pos.z-z;
@@ -595,43 +609,36 @@ void MarchingCubes::Render(sVector31 *parts,sInt pn)
       {
         if((bits & table[t][0])==table[t][0])
         {
-          Container **g = &Grid[z+table[t][1]][y+table[t][2]][x+table[t][3]];
-          Container *c = *g;
-          if(c==0 || c->Count==ContainerSize)
+          CellKey key;
+          key.X = x+table[t][3];
+          key.Y = y+table[t][2];
+          key.Z = z+table[t][1];
+          sInt *index = Grid.Find(key);
+          Container *c;
+          if(index==0)
           {
-            Container *oc = c;
             c = GetContainer();
-            c->Next = oc;
-            *g = c;
+            c->Pos = sVector30(key.X,key.Y,key.Z)*spos+tpos;
+            Grid.Add(key,cells.GetCount());
+            cells.AddTail(c);
+          }
+          else
+          {
+            c = cells[*index];
+            if(c->Count==ContainerSize)
+            {
+              Container *oc = c;
+              c = GetContainer();
+              c->Next = oc;
+              c->Pos = oc->Pos;
+              cells[*index] = c;
+            }
           }
           c->Parts[c->Count++] = parts[i];
         }
       }
     }
   }
-
-  // collect buckets
-    
-  sVector30 spos(CellSize,CellSize,CellSize);
-  sVector31 tpos(-CellSize*(GridSize)*0.5f,-CellSize*(GridSize)*0.5f,-CellSize*(GridSize)*0.5f);
-  sVERIFY(ActiveCells[1-ActiveCellsDB].IsEmpty());
-  for(sInt z=0;z<GridSize;z++)
-  {
-    for(sInt y=0;y<GridSize;y++)
-    {
-      for(sInt x=0;x<GridSize;x++)
-      {
-        Container *c = Grid[z][y][x];
-        Grid[z][y][x] = 0;
-        if(c)
-        {
-          sVector30 v(x,y,z);
-          c->Pos = v*spos+tpos;
-          ActiveCells[1-ActiveCellsDB].AddTail(c);
-        }
-      }
-    }
-  }
 }
 
 void MarchingCubes::MCTask(sInt container,sInt thread)
@@ -771,8 +778,48 @@ static void sINLINE func(const sVector31 &v,sVector4 &pot,const funcinfo &fi)
 }
 #endif
 
+// many cells only get the outskirts of particles from the neighbour cells.
+// each particle adds at most 1/d^2-tresh, where d is the distance to the
+// box of the cell. if all that is below the iso value, so is the potential
+// everywhere in the cell, and there are no triangles.
+
+sBool MarchingCubes::CullCell(Container *con)
+{
+  const sF32 S = Scale;
+  const sF32 tresh = 1/(Influence*Scale*Influence*Scale);
+  const sF32 limit = IsoValue*0.99f;  // some room for rounding
+  sVector31 lo(con->Pos*S);
+  sVector31 hi(lo+sVector30(CellSize*S,CellSize*S,CellSize*S));
+
+  sF32 sum = 0;
+  for(Container *cp=con;cp;cp=cp->Next)
+  {
+    for(sInt i=0;i<cp->Count;i++)
+    {
+      const sVector31 &p = cp->Parts[i];
+      sF32 dx = sMax(0.0f,sMax(lo.x-p.x,p.x-hi.x));
+      sF32 dy = sMax(0.0f,sMax(lo.y-p.y,p.y-hi.y));
+      sF32 dz = sMax(0.0f,sMax(lo.z-p.z,p.z-hi.z));
+      sF32 dd = dx*dx+dy*dy+dz*dz;
+      if(dd*tresh<1)
+      {
+        sum += 1/dd-tresh;        // infinite if the particle is inside
+        if(sum>=limit)
+          return 0;
+      }
+    }
+  }
+  return 1;
+}
+
 void MarchingCubes::RenderCell(GeoBuffer *gb,Container *con)
 {
+  if(CullCell(con))
+  {
+    sAtomicInc(&CulledCells);
+    return;
+  }
+
   const sInt s = CellSize;
   sF32 S = Scale;
   sVector30 spos(S,S,S);
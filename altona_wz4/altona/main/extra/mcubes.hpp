@@ -31,8 +31,10 @@ public:
   enum MarchingCubesConst
   {
     CellSize = 8,                // a cell holds many cubes 
-    GridSize = 16,                 // a grid hold many cells
+    GridSize = 16,                 // the grid is unbounded, this only centers it
     ContainerSize = 64,
+    ContainerBlock = 256,          // containers are allocated in blocks
+    MaxCoord = 1<<20,              // particles outside are ignored
 
     MaxVertex = (CellSize+1)*(CellSize+1)*(CellSize+1),
     MaxIndex = (CellSize)*(CellSize)*(CellSize)*15,
@@ -48,6 +50,12 @@ private:
 
     Container();
   };
+  struct CellKey
+  {
+    sInt X,Y,Z;
+    sBool operator==(const CellKey &b) const { return X==b.X && Y==b.Y && Z==b.Z; }
+    sU32 Hash() const { return sU32(X)*73856093 ^ sU32(Y)*19349663 ^ sU32(Z)*83492791; }
+  };
   struct GeoBuffer
   {
     sGeometry *Geo;
@@ -62,7 +70,8 @@ private:
 
   sInt MyTriTable[256][16];
   Container *FreeContainers;
-  Container *Grid[GridSize][GridSize][GridSize];
+  sArray<Container *> ContainerBlocks;
+  sHashMap<CellKey,sInt> Grid;      // cell -> index in ActiveCells
 
 
   sF32 Influence;
@@ -81,6 +90,7 @@ private:
 
   void Recycle();
   Container *GetContainer();
+  sBool CullCell(Container *con);
   void RenderCell(GeoBuffer *gb,Container *con);
   GeoBuffer *GetGeoBuffer();
 public:
@@ -93,6 +103,8 @@ public:
   void Draw();
 
   void MCTask(sInt container,sInt thread);
+
+  sU32 CulledCells;              // stats: cells that could not reach the iso value
 };
 
 /****************************************************************************/
@@ -0,0 +1,346 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "util/depthsort.hpp"
+#include "util/taskscheduler.hpp"
+#include "util/algorithms.hpp"
+
+/****************************************************************************/
+
+sDepthSort::sDepthSort()
+{
+  Max = 0;
+  Frame = 0;
+  Retry = 0;
+  Moves = 0;
+  Jumped = 0;
+  Fallback = 0;
+}
+
+sDepthSort::~sDepthSort()
+{
+}
+
+void sDepthSort::Begin(sInt max)
+{
+  if(max!=Max)
+  {
+    Slots.Resize(max);
+    for(sInt i=Max;i<max;i++)
+      Slots[i].Stamp = 0;
+    Max = max;
+  }
+
+  // two stamps per frame. when the counter wraps, old stamps could match
+
+  Frame += 2;
+  if(Frame==0)
+  {
+    for(sInt i=0;i<Max;i++)
+      Slots[i].Stamp = 0;
+    Frame = 2;
+  }
+
+  Items.Clear();
+  Items.HintSize(Max);
+  Order.HintSize(Max);
+  LastOrder.HintSize(Max);
+}
+
+void sDepthSort::Flush()
+{
+  LastOrder.Clear();
+  Retry = 0;
+}
+
+void sDepthSort::Sort(sInt mode)
+{
+  sInt count = Items.GetCount();
+  Order.Resize(count);
+  Moves = 0;
+  Jumped = 0;
+  Fallback = 0;
+
+  if(count>0)
+  {
+    switch(mode)
+    {
+    case sDSM_HEAP:
+      SortHeap();
+      break;
+    default:
+    case sDSM_RADIX:
+      SortRadix(0);
+      break;
+    case sDSM_COHERENT:
+      if(Retry>0)
+        Retry--;
+      if(Retry>0 || !SortCoherent())
+      {
+        Fallback = 1;
+        SortRadix(0);
+      }
+      break;
+    case sDSM_PARALLEL:
+      SortRadix(1);
+      break;
+    }
+  }
+
+  LastOrder.Resize(count);
+  sCopyMem(LastOrder.GetData(),Order.GetData(),count*sizeof(sU32));
+}
+
+/****************************************************************************/
+
+void sDepthSort::SortHeap()
+{
+  sInt count = Items.GetCount();
+  const sU32 *items = Items.GetData();
+  const Slot *slots = Slots.GetData();
+
+  Pairs.Resize(count);
+  Pair *pairs = Pairs.GetData();
+  for(sInt i=0;i<count;i++)
+  {
+    pairs[i].Depth = slots[items[i]].Depth;
+    pairs[i].Index = items[i];
+  }
+
+  sHeapSortUp(Pairs,&Pair::Depth);
+
+  sU32 *order = Order.GetData();
+  for(sInt i=0;i<count;i++)
+    order[i] = pairs[i].Index;
+}
+
+/****************************************************************************/
+
+// stable counting sort on (key>>shift)&mask. leaves the end of each bucket
+// in hist.
+
+static void RadixPass(const sU64 *src,sU64 *dest,sInt count,sInt shift,sU32 mask,sInt *hist)
+{
+  for(sU32 i=0;i<=mask;i++)
+    hist[i] = 0;
+  for(sInt i=0;i<count;i++)
+    hist[(src[i]>>shift)&mask]++;
+  sInt sum = 0;
+  for(sU32 i=0;i<=mask;i++)
+  {
+    sInt n = hist[i];
+    hist[i] = sum;
+    sum += n;
+  }
+  for(sInt i=0;i<count;i++)
+    dest[hist[(src[i]>>shift)&mask]++] = src[i];
+}
+
+// the partitions are sorted independently, and are already in the right
+// order. two passes, from Temp to Keys and back.
+
+void sDepthSort::PartTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data)
+{
+  sDepthSort *ds = (sDepthSort *) data;
+  const sInt bits = KeyBits-PartBits;
+  const sInt lo = bits/2;
+  sInt hist[1<<(bits-lo)];
+
+  for(sInt i=start;i<start+count;i++)
+  {
+    sInt s = ds->PartStart[i];
+    sInt n = ds->PartStart[i+1]-s;
+    if(n<2)
+      continue;
+    sU64 *a = ds->Temp.GetData()+s;
+    sU64 *b = ds->Keys.GetData()+s;
+    RadixPass(a,b,n,32,(1<<lo)-1,hist);
+    RadixPass(b,a,n,32+lo,(1<<(bits-lo))-1,hist);
+  }
+}
+
+// quantize the depth to KeyBits, partition by the upper bits, then sort
+// the partitions. a partition fits in the cache much better than the
+// whole array.
+
+void sDepthSort::SortRadix(sBool parallel)
+{
+  sInt count = Items.GetCount();
+  const sU32 *items = Items.GetData();
+  const Slot *slots = Slots.GetData();
+
+  sF32 min = slots[items[0]].Depth;
+  sF32 max = min;
+  for(sInt i=1;i<count;i++)
+  {
+    sF32 d = slots[items[i]].Depth;
+    min = sMin(min,d);
+    max = sMax(max,d);
+  }
+
+  const sF32 top = sF32((1<<KeyBits)-1);
+  sF32 scale = (max>min) ? top/(max-min) : 0.0f;
+
+  Keys.Resize(count);
+  Temp.Resize(count);
+  sU64 *keys = Keys.GetData();
+  for(sInt i=0;i<count;i++)
+  {
+    sU32 n = items[i];
+    sU32 q = sU32(sClamp((slots[n].Depth-min)*scale,0.0f,top));
+    keys[i] = (sU64(q)<<32) | n;
+  }
+
+  // partition
+
+  const sInt parts = 1<<PartBits;
+  RadixPass(Keys.GetData(),Temp.GetData(),count,32+KeyBits-PartBits,parts-1,PartStart);
+  for(sInt i=parts;i>0;i--)
+    PartStart[i] = PartStart[i-1];
+  PartStart[0] = 0;
+
+  // sort partitions
+
+  if(parallel && sSched && count>=0x4000)
+  {
+    sStsWorkload *wl = sSched->BeginWorkload();
+    wl->AddTask(wl->NewTask(PartTask,this,parts,0));
+    wl->Start();
+    wl->Sync();
+    wl->End();
+  }
+  else
+  {
+    PartTask(0,0,0,parts,this);
+  }
+
+  const sU64 *temp = Temp.GetData();
+  sU32 *order = Order.GetData();
+  for(sInt i=0;i<count;i++)
+    order[i] = sU32(temp[i]);
+}
+
+/****************************************************************************/
+
+// the last order, without elements that are gone, is sorted by insertion.
+// elements that would move too far go to the Jumps list, together with
+// new elements. that list is sorted on its own and merged.
+
+sBool sDepthSort::SortCoherent()
+{
+  sInt count = Items.GetCount();
+  Slot *slots = Slots.GetData();
+  const sU32 *items = Items.GetData();
+  const sU32 *last = LastOrder.GetData();
+  sInt lastcount = LastOrder.GetCount();
+  sInt maxjumps = count/4+MaxMove;
+
+  if(lastcount+maxjumps<count)
+    return 0;
+
+  Pairs.Resize(count);
+  Jumps.Resize(count);
+  Pair *pairs = Pairs.GetData();
+  Pair *jumps = Jumps.GetData();
+  sInt sorted = 0;
+  sInt jumped = 0;
+  sInt moves = 0;
+
+  // elements that survived from last frame, in last order
+
+  sInt old = 0;
+  for(sInt i=0;i<lastcount;i++)
+  {
+    sU32 n = last[i];
+    if(n<sU32(Max) && slots[n].Stamp==Frame)
+    {
+      slots[n].Stamp = Frame+1;
+      pairs[old].Depth = slots[n].Depth;
+      pairs[old].Index = n;
+      old++;
+    }
+  }
+
+  // insertion sort in place. an element that is behind the one MaxMove
+  // places later would move too far, and so would an element that can't
+  // be inserted within MaxMove places.
+
+  for(sInt i=0;i<old;i++)
+  {
+    Pair p = pairs[i];
+    sBool jump = i+MaxMove<old && p.Depth>pairs[i+MaxMove].Depth;
+    sInt j = sorted;
+    if(!jump)
+    {
+      sInt stop = sMax(0,sorted-MaxMove);
+      while(j>stop && pairs[j-1].Depth>p.Depth)
+        j--;
+      jump = j>0 && pairs[j-1].Depth>p.Depth;
+    }
+    if(jump)
+    {
+      jumps[jumped++] = p;
+      if(jumped>maxjumps)
+      {
+        Retry = RetryFrames;
+        return 0;
+      }
+    }
+    else
+    {
+      for(sInt k=sorted;k>j;k--)
+        pairs[k] = pairs[k-1];
+      pairs[j] = p;
+      moves += sorted-j;
+      sorted++;
+    }
+  }
+
+  // new elements
+
+  for(sInt i=0;i<count;i++)
+  {
+    sU32 n = items[i];
+    if(slots[n].Stamp==Frame)
+    {
+      if(jumped>=maxjumps)
+      {
+        Retry = RetryFrames;
+        return 0;
+      }
+      jumps[jumped].Depth = slots[n].Depth;
+      jumps[jumped].Index = n;
+      jumped++;
+    }
+  }
+  sVERIFY(sorted+jumped==count);
+
+  sIntroSort(sArrayRange<Pair>(jumps,jumps+jumped));
+  Moves = moves;
+  Jumped = jumped;
+  if(moves>count)                 // radix sort would have been faster
+    Retry = RetryFrames;
+
+  // merge
+
+  sU32 *order = Order.GetData();
+  const Pair *a = pairs;
+  const Pair *ae = pairs+sorted;
+  const Pair *b = jumps;
+  const Pair *be = jumps+jumped;
+  while(a<ae && b<be)
+    *order++ = (b->Depth<a->Depth) ? (b++)->Index : (a++)->Index;
+  while(a<ae)
+    *order++ = (a++)->Index;
+  while(b<be)
+    *order++ = (b++)->Index;
+
+  return 1;
+}
+
+/****************************************************************************/
+
@@ -0,0 +1,105 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#ifndef FILE_UTIL_DEPTHSORT_HPP
+#define FILE_UTIL_DEPTHSORT_HPP
+
+#include "base/types.hpp"
+#include "base/types2.hpp"
+
+class sStsManager;
+class sStsThread;
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Sort indices by depth, for particles and other transparent stuff   ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// Begin(), Add() for all visible elements, Sort(), then GetOrder() lists
+// the indices with ascending depth.
+//
+// the sorter remembers the order of the last frame. particles move only a
+// little from frame to frame, so sDSM_COHERENT starts with that order and
+// fixes it with an insertion sort. new and respawned particles are sorted
+// separately and merged. when there are too many of those, or the
+// insertion sort has to move too much, it uses the radix sort for the next
+// few frames.
+//
+// the radix sorts quantize the depth of the current frame to 22 bits, so
+// elements with almost the same depth may come out in index order.
+
+enum sDepthSortMode
+{
+  sDSM_HEAP = 0,                  // sHeapSortUp() on the depth, the order sprites always had
+  sDSM_RADIX,                     // radix sort on the quantized depth
+  sDSM_COHERENT,                  // insertion sort, starting with the last order
+  sDSM_PARALLEL,                  // sDSM_RADIX, partitions are sorted in sSched
+};
+
+class sDepthSort
+{
+  struct Slot                     // one per index
+  {
+    sF32 Depth;
+    sU32 Stamp;                   // Frame: added, Frame+1: already in order
+  };
+
+  struct Pair
+  {
+    sF32 Depth;
+    sU32 Index;
+    sBool operator<(const Pair &b) const { return Depth<b.Depth; }
+  };
+
+  enum
+  {
+    KeyBits = 22,                 // quantized depth
+    PartBits = 6,                 // 64 partitions, then two passes of 8 bits each
+    MaxMove = 32,                 // elements that move further are sorted separately
+    RetryFrames = 8,              // radix sort frames after coherence was lost
+  };
+
+  sInt Max;                       // indices are 0..Max-1
+  sU32 Frame;
+  sInt Retry;                     // use radix sort until this is 0
+  sArray<Slot> Slots;
+  sArray<sU32> Items;             // indices added this frame
+  sArray<sU32> Order;             // result
+  sArray<sU32> LastOrder;         // result of last frame
+  sArray<Pair> Pairs;
+  sArray<Pair> Jumps;             // new elements and those that moved too far
+  sArray<sU64> Keys;              // quantized depth << 32 | index
+  sArray<sU64> Temp;
+  sInt PartStart[(1<<PartBits)+1];
+
+  void SortRadix(sBool parallel);
+  void SortHeap();
+  sBool SortCoherent();
+  static void PartTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data);
+
+public:
+  sDepthSort();
+  ~sDepthSort();
+
+  void Begin(sInt max);           // indices will be 0..max-1
+  void Add(sInt index,sF32 depth) { sVERIFY(index>=0 && index<Max); Slot &s = Slots.GetData()[index]; s.Depth = depth; s.Stamp = Frame; Items.AddTail(index); }
+  void Sort(sInt mode=sDSM_COHERENT);
+  void Flush();                   // forget the order of the last frame
+
+  sInt GetCount() const           { return Order.GetCount(); }
+  const sU32 *GetOrder() const    { return Order.GetData(); }
+
+  sInt Moves;                     // stats for sDSM_COHERENT: moves of the insertion sort
+  sInt Jumped;                    // stats for sDSM_COHERENT: sorted separately
+  sBool Fallback;                 // stats for sDSM_COHERENT: radix sort was used instead
+};
+
+/****************************************************************************/
+
+#endif // FILE_UTIL_DEPTHSORT_HPP
+
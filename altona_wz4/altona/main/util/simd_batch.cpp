@@ -0,0 +1,336 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "util/simd_batch.hpp"
+#include "util/simd_float.hpp"
+#if sBATCH_AVX
+#include <immintrin.h>
+#endif
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   SoA kernels                                                        ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// each kernel does as many elements as it can with AVX, then with SSE, and
+// the rest in C. the expressions are written exactly like in math.cpp.
+
+template <sInt point>
+static void TransformKernel(const sMatrix34 &m,const sF32 *sx,const sF32 *sy,const sF32 *sz,sF32 *dx,sF32 *dy,sF32 *dz,sInt count)
+{
+  sInt i = 0;
+
+#if sBATCH_AVX
+  {
+    __m256 ix = _mm256_set1_ps(m.i.x), iy = _mm256_set1_ps(m.i.y), iz = _mm256_set1_ps(m.i.z);
+    __m256 jx = _mm256_set1_ps(m.j.x), jy = _mm256_set1_ps(m.j.y), jz = _mm256_set1_ps(m.j.z);
+    __m256 kx = _mm256_set1_ps(m.k.x), ky = _mm256_set1_ps(m.k.y), kz = _mm256_set1_ps(m.k.z);
+    __m256 lx = _mm256_set1_ps(m.l.x), ly = _mm256_set1_ps(m.l.y), lz = _mm256_set1_ps(m.l.z);
+    for(;i+8<=count;i+=8)
+    {
+      __m256 x = _mm256_loadu_ps(sx+i);
+      __m256 y = _mm256_loadu_ps(sy+i);
+      __m256 z = _mm256_loadu_ps(sz+i);
+      __m256 rx = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x,ix),_mm256_mul_ps(y,jx)),_mm256_mul_ps(z,kx));
+      __m256 ry = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x,iy),_mm256_mul_ps(y,jy)),_mm256_mul_ps(z,ky));
+      __m256 rz = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(x,iz),_mm256_mul_ps(y,jz)),_mm256_mul_ps(z,kz));
+      if(point)
+      {
+        rx = _mm256_add_ps(rx,lx);
+        ry = _mm256_add_ps(ry,ly);
+        rz = _mm256_add_ps(rz,lz);
+      }
+      _mm256_storeu_ps(dx+i,rx);
+      _mm256_storeu_ps(dy+i,ry);
+      _mm256_storeu_ps(dz+i,rz);
+    }
+  }
+#endif
+
+#if sSIMD_INTRINSICS
+  {
+    sSSE ix = sVecLoadScalar(m.i.x), iy = sVecLoadScalar(m.i.y), iz = sVecLoadScalar(m.i.z);
+    sSSE jx = sVecLoadScalar(m.j.x), jy = sVecLoadScalar(m.j.y), jz = sVecLoadScalar(m.j.z);
+    sSSE kx = sVecLoadScalar(m.k.x), ky = sVecLoadScalar(m.k.y), kz = sVecLoadScalar(m.k.z);
+    sSSE lx = sVecLoadScalar(m.l.x), ly = sVecLoadScalar(m.l.y), lz = sVecLoadScalar(m.l.z);
+    for(;i+4<=count;i+=4)
+    {
+      sSSE x = sVecLoadU(sx+i);
+      sSSE y = sVecLoadU(sy+i);
+      sSSE z = sVecLoadU(sz+i);
+      sSSE rx = sVecAdd(sVecAdd(sVecMul(x,ix),sVecMul(y,jx)),sVecMul(z,kx));
+      sSSE ry = sVecAdd(sVecAdd(sVecMul(x,iy),sVecMul(y,jy)),sVecMul(z,ky));
+      sSSE rz = sVecAdd(sVecAdd(sVecMul(x,iz),sVecMul(y,jz)),sVecMul(z,kz));
+      if(point)
+      {
+        rx = sVecAdd(rx,lx);
+        ry = sVecAdd(ry,ly);
+        rz = sVecAdd(rz,lz);
+      }
+      sVecStoreU(rx,dx+i);
+      sVecStoreU(ry,dy+i);
+      sVecStoreU(rz,dz+i);
+    }
+  }
+#endif
+
+  for(;i<count;i++)
+  {
+    sF32 x = sx[i];
+    sF32 y = sy[i];
+    sF32 z = sz[i];
+    if(point)
+    {
+      dx[i] = x*m.i.x + y*m.j.x + z*m.k.x + m.l.x;
+      dy[i] = x*m.i.y + y*m.j.y + z*m.k.y + m.l.y;
+      dz[i] = x*m.i.z + y*m.j.z + z*m.k.z + m.l.z;
+    }
+    else
+    {
+      dx[i] = x*m.i.x + y*m.j.x + z*m.k.x;
+      dy[i] = x*m.i.y + y*m.j.y + z*m.k.y;
+      dz[i] = x*m.i.z + y*m.j.z + z*m.k.z;
+    }
+  }
+}
+
+void sBatchTransformSoA(const sMatrix34 &mat,const sF32 *sx,const sF32 *sy,const sF32 *sz,sF32 *dx,sF32 *dy,sF32 *dz,sInt count,sBool point)
+{
+  if(point)
+    TransformKernel<1>(mat,sx,sy,sz,dx,dy,dz,count);
+  else
+    TransformKernel<0>(mat,sx,sy,sz,dx,dy,dz,count);
+}
+
+// sVector30::Unit() leaves vectors that are too short alone
+
+void sBatchUnitSoA(sF32 *x,sF32 *y,sF32 *z,sInt count)
+{
+  sInt i = 0;
+
+#if sBATCH_AVX
+  {
+    __m256 one = _mm256_set1_ps(1.0f);
+    __m256 eps = _mm256_set1_ps(1e-12f);
+    for(;i+8<=count;i+=8)
+    {
+      __m256 vx = _mm256_loadu_ps(x+i);
+      __m256 vy = _mm256_loadu_ps(y+i);
+      __m256 vz = _mm256_loadu_ps(z+i);
+      __m256 e = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(vx,vx),_mm256_mul_ps(vy,vy)),_mm256_mul_ps(vz,vz));
+      __m256 mask = _mm256_cmp_ps(e,eps,_CMP_GT_OQ);
+      __m256 r = _mm256_div_ps(one,_mm256_sqrt_ps(e));
+      _mm256_storeu_ps(x+i,_mm256_blendv_ps(vx,_mm256_mul_ps(r,vx),mask));
+      _mm256_storeu_ps(y+i,_mm256_blendv_ps(vy,_mm256_mul_ps(r,vy),mask));
+      _mm256_storeu_ps(z+i,_mm256_blendv_ps(vz,_mm256_mul_ps(r,vz),mask));
+    }
+  }
+#endif
+
+#if sSIMD_INTRINSICS
+  {
+    sSSE one = sVecLoadScalar(1.0f);
+    sSSE eps = sVecLoadScalar(1e-12f);
+    for(;i+4<=count;i+=4)
+    {
+      sSSE vx = sVecLoadU(x+i);
+      sSSE vy = sVecLoadU(y+i);
+      sSSE vz = sVecLoadU(z+i);
+      sSSE e = sVecAdd(sVecAdd(sVecMul(vx,vx),sVecMul(vy,vy)),sVecMul(vz,vz));
+      sSSE mask = sVecCmpGT(e,eps);
+      sSSE r = _mm_div_ps(one,_mm_sqrt_ps(e));
+      sVecStoreU(sVecSel(vx,sVecMul(r,vx),mask),x+i);
+      sVecStoreU(sVecSel(vy,sVecMul(r,vy),mask),y+i);
+      sVecStoreU(sVecSel(vz,sVecMul(r,vz),mask),z+i);
+    }
+  }
+#endif
+
+  for(;i<count;i++)
+  {
+    sF32 e = x[i]*x[i] + y[i]*y[i] + z[i]*z[i];
+    if(e>1e-12f)
+    {
+      e = sFRSqrt(e);
+      x[i] = e*x[i];
+      y[i] = e*y[i];
+      z[i] = e*z[i];
+    }
+  }
+}
+
+void sBatchDotSoA(const sVector4 &p,const sF32 *x,const sF32 *y,const sF32 *z,sF32 *dest,sInt count)
+{
+  sInt i = 0;
+
+#if sBATCH_AVX
+  {
+    __m256 px = _mm256_set1_ps(p.x), py = _mm256_set1_ps(p.y), pz = _mm256_set1_ps(p.z), pw = _mm256_set1_ps(p.w);
+    for(;i+8<=count;i+=8)
+    {
+      __m256 d = _mm256_add_ps(_mm256_mul_ps(px,_mm256_loadu_ps(x+i)),_mm256_mul_ps(py,_mm256_loadu_ps(y+i)));
+      d = _mm256_add_ps(_mm256_add_ps(d,_mm256_mul_ps(pz,_mm256_loadu_ps(z+i))),pw);
+      _mm256_storeu_ps(dest+i,d);
+    }
+  }
+#endif
+
+#if sSIMD_INTRINSICS
+  {
+    sSSE px = sVecLoadScalar(p.x), py = sVecLoadScalar(p.y), pz = sVecLoadScalar(p.z), pw = sVecLoadScalar(p.w);
+    for(;i+4<=count;i+=4)
+    {
+      sSSE d = sVecAdd(sVecMul(px,sVecLoadU(x+i)),sVecMul(py,sVecLoadU(y+i)));
+      d = sVecAdd(sVecAdd(d,sVecMul(pz,sVecLoadU(z+i))),pw);
+      sVecStoreU(d,dest+i);
+    }
+  }
+#endif
+
+  for(;i<count;i++)
+    dest[i] = p.x*x[i] + p.y*y[i] + p.z*z[i] + p.w;
+}
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   AoS                                                                ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+template <class T> static sINLINE const T *Elem(const T *p,sInt n,sInt stride) { return (const T *)(((const sU8 *)p)+n*stride); }
+template <class T> static sINLINE T *Elem(T *p,sInt n,sInt stride) { return (T *)(((sU8 *)p)+n*stride); }
+
+struct BatchBlock
+{
+  sALIGNED(sF32,x[sBATCH_SIZE],32);
+  sALIGNED(sF32,y[sBATCH_SIZE],32);
+  sALIGNED(sF32,z[sBATCH_SIZE],32);
+
+  template <class T> void Load(const T *src,sInt stride,sInt count)
+  {
+    for(sInt i=0;i<count;i++)
+    {
+      const T *s = Elem(src,i,stride);
+      x[i] = s->x;
+      y[i] = s->y;
+      z[i] = s->z;
+    }
+  }
+  template <class T> void Store(T *dest,sInt stride,sInt count)
+  {
+    for(sInt i=0;i<count;i++)
+    {
+      T *d = Elem(dest,i,stride);
+      d->x = x[i];
+      d->y = y[i];
+      d->z = z[i];
+    }
+  }
+};
+
+void sBatchTransform(const sMatrix34 &mat,const sVector31 *src,sInt srcstride,sVector31 *dest,sInt deststride,sInt count)
+{
+  BatchBlock b;
+  for(sInt i=0;i<count;i+=sBATCH_SIZE)
+  {
+    sInt n = sMin<sInt>(count-i,sBATCH_SIZE);
+    b.Load(Elem(src,i,srcstride),srcstride,n);
+    TransformKernel<1>(mat,b.x,b.y,b.z,b.x,b.y,b.z,n);
+    b.Store(Elem(dest,i,deststride),deststride,n);
+  }
+}
+
+void sBatchTransform(const sMatrix34 &mat,const sVector30 *src,sInt srcstride,sVector30 *dest,sInt deststride,sInt count,sBool unit)
+{
+  BatchBlock b;
+  for(sInt i=0;i<count;i+=sBATCH_SIZE)
+  {
+    sInt n = sMin<sInt>(count-i,sBATCH_SIZE);
+    b.Load(Elem(src,i,srcstride),srcstride,n);
+    TransformKernel<0>(mat,b.x,b.y,b.z,b.x,b.y,b.z,n);
+    if(unit)
+      sBatchUnitSoA(b.x,b.y,b.z,n);
+    b.Store(Elem(dest,i,deststride),deststride,n);
+  }
+}
+
+void sBatchPlaneDist(const sVector4 &plane,const sMatrix34 &mat,const sVector31 *src,sInt srcstride,sF32 *dest,sInt count)
+{
+  BatchBlock b;
+  for(sInt i=0;i<count;i+=sBATCH_SIZE)
+  {
+    sInt n = sMin<sInt>(count-i,sBATCH_SIZE);
+    b.Load(Elem(src,i,srcstride),srcstride,n);
+    TransformKernel<1>(mat,b.x,b.y,b.z,b.x,b.y,b.z,n);
+    sBatchDotSoA(plane,b.x,b.y,b.z,dest+i,n);
+  }
+}
+
+/****************************************************************************/
+
+// every vertex has its own matrices, so this works on one vertex at a time,
+// with x, y and z in the lanes. the matrices are copied to 4 rows of 4 floats
+// first, the last row of the last matrix could not be loaded as it is.
+
+void sBatchSkin(const sMatrix34 *mats,sInt max,const sVector31 *pos,const sS16 *index,const sF32 *weight,sInt srcstride,sVector31 *dest,sInt deststride,sInt count)
+{
+#if sSIMD_INTRINSICS
+  sSSE *rows = new sSSE[max*4];
+  for(sInt i=0;i<max;i++)
+  {
+    rows[i*4+0] = _mm_setr_ps(mats[i].i.x,mats[i].i.y,mats[i].i.z,0);
+    rows[i*4+1] = _mm_setr_ps(mats[i].j.x,mats[i].j.y,mats[i].j.z,0);
+    rows[i*4+2] = _mm_setr_ps(mats[i].k.x,mats[i].k.y,mats[i].k.z,0);
+    rows[i*4+3] = _mm_setr_ps(mats[i].l.x,mats[i].l.y,mats[i].l.z,0);
+  }
+#endif
+
+  for(sInt n=0;n<count;n++)
+  {
+    const sVector31 &p = *Elem(pos,n,srcstride);
+    const sS16 *ix = Elem(index,n,srcstride);
+    const sF32 *w = Elem(weight,n,srcstride);
+    sVector31 &d = *Elem(dest,n,deststride);
+
+    if(ix[0]<0 || ix[0]>=max)
+    {
+      d = p;
+      continue;
+    }
+
+#if sSIMD_INTRINSICS
+    sSSE x = sVecLoadScalar(p.x);
+    sSSE y = sVecLoadScalar(p.y);
+    sSSE z = sVecLoadScalar(p.z);
+    sSSE accu = sVecZero();
+    for(sInt i=0;i<4 && ix[i]>=0 && ix[i]<max;i++)
+    {
+      const sSSE *m = rows+ix[i]*4;
+      sSSE v = sVecAdd(sVecAdd(sVecAdd(sVecMul(x,m[0]),sVecMul(y,m[1])),sVecMul(z,m[2])),m[3]);
+      accu = sVecAdd(accu,sVecMul(v,sVecLoadScalar(w[i])));
+    }
+    sALIGNED(sF32,r[4],16);
+    sVecStore(accu,r);
+    d.x = r[0];
+    d.y = r[1];
+    d.z = r[2];
+#else
+    sVector30 accu;
+    for(sInt i=0;i<4 && ix[i]>=0 && ix[i]<max;i++)
+      accu += sVector30(p*mats[ix[i]])*w[i];
+    d = sVector31(accu);
+#endif
+  }
+
+#if sSIMD_INTRINSICS
+  delete[] rows;
+#endif
+}
+
+/****************************************************************************/
+
@@ -0,0 +1,62 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#ifndef FILE_UTIL_SIMD_BATCH_HPP
+#define FILE_UTIL_SIMD_BATCH_HPP
+
+#include "base/types.hpp"
+#include "base/math.hpp"
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Math on many vectors at once                                       ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// the kernels work on SoA streams, with separate arrays for x, y and z.
+// they use simd_float.hpp, with an AVX path when the compiler targets AVX,
+// and plain C on platforms without intrinsics. the results are the same as
+// with the operators in math.hpp, bit for bit: the operations are done in
+// the same order, and there is no fused multiply-add.
+//
+// the AoS versions take a stride in bytes, so they work directly on arrays
+// of structs like vertices or particles. they copy blocks of BatchSize
+// elements to SoA on the stack. source and destination may be the same.
+
+#if defined(__AVX__)
+#define sBATCH_AVX 1
+#else
+#define sBATCH_AVX 0
+#endif
+
+enum sBatchConst
+{
+  sBATCH_SIZE = 256,              // elements per block in the AoS versions
+};
+
+// SoA
+
+void sBatchTransformSoA(const sMatrix34 &mat,const sF32 *sx,const sF32 *sy,const sF32 *sz,sF32 *dx,sF32 *dy,sF32 *dz,sInt count,sBool point);
+void sBatchUnitSoA(sF32 *x,sF32 *y,sF32 *z,sInt count);   // like sVector30::Unit()
+void sBatchDotSoA(const sVector4 &plane,const sF32 *x,const sF32 *y,const sF32 *z,sF32 *dest,sInt count); // plane ^ sVector31
+
+// AoS, strides in bytes
+
+void sBatchTransform(const sMatrix34 &mat,const sVector31 *src,sInt srcstride,sVector31 *dest,sInt deststride,sInt count);
+void sBatchTransform(const sMatrix34 &mat,const sVector30 *src,sInt srcstride,sVector30 *dest,sInt deststride,sInt count,sBool unit=0);
+void sBatchPlaneDist(const sVector4 &plane,const sMatrix34 &mat,const sVector31 *src,sInt srcstride,sF32 *dest,sInt count); // plane ^ (src*mat)
+
+// 4 bone skinning like Wz4MeshVertex::Skin(). index and weight are per
+// vertex, with the same stride as pos. an invalid index ends the list, if
+// the first is invalid the position is copied.
+
+void sBatchSkin(const sMatrix34 *mats,sInt matcount,const sVector31 *pos,const sS16 *index,const sF32 *weight,sInt srcstride,sVector31 *dest,sInt deststride,sInt count);
+
+/****************************************************************************/
+
+#endif // FILE_UTIL_SIMD_BATCH_HPP
+
@@ -0,0 +1,252 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#include "util/spatialgrid.hpp"
+#include "util/taskscheduler.hpp"
+
+/****************************************************************************/
+
+sSpatialGrid::sSpatialGrid()
+{
+  Scale = 1;
+  CellMask = 0;
+  CellShift = 32;
+  CellCount = 0;
+  PassSrc = 0;
+  PassDest = 0;
+  PassShift = 0;
+}
+
+sSpatialGrid::~sSpatialGrid()
+{
+}
+
+void sSpatialGrid::Begin(sInt max,sF32 cellsize)
+{
+  Scale = 1.0f/cellsize;
+  Keys.Clear();
+  Keys.HintSize(max);
+  Temp.HintSize(max);
+  Order.HintSize(max);
+}
+
+// insert two zero bits between each bit
+
+sU32 sSpatialGrid::Spread(sU32 x)
+{
+  x &= 0x3ff;
+  x = (x|(x<<16)) & 0x030000ff;
+  x = (x|(x<< 8)) & 0x0300f00f;
+  x = (x|(x<< 4)) & 0x030c30c3;
+  x = (x|(x<< 2)) & 0x09249249;
+  return x;
+}
+
+sU32 sSpatialGrid::Compact(sU32 x)
+{
+  x &= 0x09249249;
+  x = (x|(x>> 2)) & 0x030c30c3;
+  x = (x|(x>> 4)) & 0x0300f00f;
+  x = (x|(x>> 8)) & 0x030000ff;
+  x = (x|(x>>16)) & 0x000003ff;
+  return x;
+}
+
+sU32 sSpatialGrid::GetKey(const sVector31 &pos) const
+{
+  sU32 x = sU32(sRoundDownInt(pos.x*Scale)) & AxisMask;
+  sU32 y = sU32(sRoundDownInt(pos.y*Scale)) & AxisMask;
+  sU32 z = sU32(sRoundDownInt(pos.z*Scale)) & AxisMask;
+  return Spread(x) | (Spread(y)<<1) | (Spread(z)<<2);
+}
+
+/****************************************************************************/
+
+// a stable counting sort, the data is split in blocks. each block counts
+// its own histogram, and then scatters to its own part of each bucket. the
+// result does not depend on the number of threads.
+
+void sSpatialGrid::HistBlock(sInt block)
+{
+  sInt count = Keys.GetCount();
+  sInt i0 = sMulDiv(count,block,Blocks);
+  sInt i1 = sMulDiv(count,block+1,Blocks);
+  sInt *hist = Hist[block];
+  sClear(Hist[block]);
+  for(sInt i=i0;i<i1;i++)
+    hist[(PassSrc[i]>>PassShift)&((1<<RadixBits)-1)]++;
+}
+
+void sSpatialGrid::ScatterBlock(sInt block)
+{
+  sInt count = Keys.GetCount();
+  sInt i0 = sMulDiv(count,block,Blocks);
+  sInt i1 = sMulDiv(count,block+1,Blocks);
+  sInt *hist = Hist[block];
+  for(sInt i=i0;i<i1;i++)
+    PassDest[hist[(PassSrc[i]>>PassShift)&((1<<RadixBits)-1)]++] = PassSrc[i];
+}
+
+void sSpatialGrid::HistTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data)
+{
+  sSpatialGrid *grid = (sSpatialGrid *) data;
+  for(sInt i=start;i<start+count;i++)
+    grid->HistBlock(i);
+}
+
+void sSpatialGrid::ScatterTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data)
+{
+  sSpatialGrid *grid = (sSpatialGrid *) data;
+  for(sInt i=start;i<start+count;i++)
+    grid->ScatterBlock(i);
+}
+
+void sSpatialGrid::Pass(sInt shift,sBool parallel)
+{
+  PassShift = shift;
+
+  if(parallel)
+  {
+    sStsWorkload *wl = sSched->BeginWorkload();
+    wl->AddTask(wl->NewTask(HistTask,this,Blocks,0));
+    wl->Start();
+    wl->Sync();
+    wl->End();
+  }
+  else
+  {
+    HistTask(0,0,0,Blocks,this);
+  }
+
+  sInt sum = 0;
+  for(sInt i=0;i<(1<<RadixBits);i++)
+  {
+    for(sInt b=0;b<Blocks;b++)
+    {
+      sInt n = Hist[b][i];
+      Hist[b][i] = sum;
+      sum += n;
+    }
+  }
+
+  if(parallel)
+  {
+    sStsWorkload *wl = sSched->BeginWorkload();
+    wl->AddTask(wl->NewTask(ScatterTask,this,Blocks,0));
+    wl->Start();
+    wl->Sync();
+    wl->End();
+  }
+  else
+  {
+    ScatterTask(0,0,0,Blocks,this);
+  }
+}
+
+void sSpatialGrid::Sort(sBool parallel)
+{
+  sInt count = Keys.GetCount();
+  parallel = parallel && sSched && count>=0x4000;
+
+  // three passes of 10 bits on the morton code, ending in Keys
+
+  Temp.Resize(count);
+  PassSrc = Keys.GetData(); PassDest = Temp.GetData();
+  Pass(32,parallel);
+  PassSrc = Temp.GetData(); PassDest = Keys.GetData();
+  Pass(32+RadixBits,parallel);
+  Keys.Swap(Temp);
+  PassSrc = Temp.GetData(); PassDest = Keys.GetData();
+  Pass(32+RadixBits*2,parallel);
+
+  const sU64 *keys = Keys.GetData();
+  Order.Resize(count);
+  sU32 *order = Order.GetData();
+  for(sInt i=0;i<count;i++)
+    order[i] = sU32(keys[i]);
+
+  // count cells
+
+  CellCount = 0;
+  for(sInt i=0;i<count;i++)
+    if(i==0 || (keys[i]>>32)!=(keys[i-1]>>32))
+      CellCount++;
+
+  // the hash table is at most half full
+
+  sInt bits = 4;
+  while((1<<bits)<CellCount*2)
+    bits++;
+  CellMask = (1<<bits)-1;
+  CellShift = 32-bits;
+  Cells.Resize(1<<bits);
+  Cell *cells = Cells.GetData();
+  for(sInt i=0;i<=CellMask;i++)
+    cells[i].Key = ~0U;
+
+  for(sInt i=0;i<count;)
+  {
+    sU32 key = sU32(keys[i]>>32);
+    sInt start = i;
+    while(i<count && sU32(keys[i]>>32)==key)
+      i++;
+    sU32 n = HashCell(key);
+    while(cells[n].Key!=~0U)
+      n = (n+1)&CellMask;
+    cells[n].Key = key;
+    cells[n].Start = start;
+    cells[n].Count = i-start;
+  }
+}
+
+/****************************************************************************/
+
+const sSpatialGrid::Cell *sSpatialGrid::FindCell(sU32 key) const
+{
+  const Cell *cells = Cells.GetData();
+  sU32 n = HashCell(key);
+  while(cells[n].Key!=~0U)
+  {
+    if(cells[n].Key==key)
+      return &cells[n];
+    n = (n+1)&CellMask;
+  }
+  return 0;
+}
+
+sInt sSpatialGrid::GetNeighbours(sU32 key,sInt *start,sInt *count) const
+{
+  if(CellCount==0)
+    return 0;
+
+  sU32 x = Compact(key);
+  sU32 y = Compact(key>>1);
+  sU32 z = Compact(key>>2);
+  sInt ranges = 0;
+  for(sInt dz=-1;dz<=1;dz++)
+  {
+    sU32 kz = Spread(z+dz)<<2;
+    for(sInt dy=-1;dy<=1;dy++)
+    {
+      sU32 kyz = kz | (Spread(y+dy)<<1);
+      for(sInt dx=-1;dx<=1;dx++)
+      {
+        const Cell *c = FindCell(kyz | Spread(x+dx));
+        if(c)
+        {
+          start[ranges] = c->Start;
+          count[ranges] = c->Count;
+          ranges++;
+        }
+      }
+    }
+  }
+  return ranges;
+}
+
+/****************************************************************************/
+
@@ -0,0 +1,101 @@
+/*+**************************************************************************/
+/***                                                                      ***/
+/***   This file is distributed under a BSD license.                      ***/
+/***   See LICENSE.txt for details.                                       ***/
+/***                                                                      ***/
+/**************************************************************************+*/
+
+#ifndef FILE_UTIL_SPATIALGRID_HPP
+#define FILE_UTIL_SPATIALGRID_HPP
+
+#include "base/types.hpp"
+#include "base/types2.hpp"
+#include "base/math.hpp"
+
+class sStsManager;
+class sStsThread;
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Uniform grid for neighbour searches, like in particle fluids       ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// Begin(), Add() for all particles, Sort(). GetOrder() lists the indices
+// sorted by cell, so that particles of the same cell are in one range, and
+// GetNeighbours() finds the ranges of the 27 cells around a cell. With the
+// cell size set to the interaction radius, that contains all particles
+// that can be in reach.
+//
+// cells are sorted in morton order, so the neighbour cells are close in
+// memory too. the grid has 1024 cells in each direction and wraps around
+// outside. far away cells may show up as neighbours then, which costs time
+// but is not wrong, since all neighbours still have to be checked for the
+// distance.
+//
+// the cells are found with an open addressing hash, sized from the number
+// of cells that are actually used.
+
+class sSpatialGrid
+{
+  struct Cell
+  {
+    sU32 Key;                     // morton code, ~0 for empty
+    sInt Start;
+    sInt Count;
+  };
+
+  enum
+  {
+    AxisBits = 10,
+    AxisMask = (1<<AxisBits)-1,
+    RadixBits = 10,               // three passes for the 30 bit morton code
+    Blocks = 16,                  // for the parallel sort
+  };
+
+  sF32 Scale;                     // 1/cellsize
+  sArray<sU64> Keys;              // morton code << 32 | index
+  sArray<sU64> Temp;
+  sArray<sU32> Order;
+  sArray<Cell> Cells;             // hash table
+  sInt CellMask;
+  sInt CellShift;
+  sInt CellCount;
+  sInt Hist[Blocks][1<<RadixBits];
+
+  const sU64 *PassSrc;            // current pass for the tasks
+  sU64 *PassDest;
+  sInt PassShift;
+
+  static sU32 Spread(sU32 x);
+  static sU32 Compact(sU32 x);
+  sU32 HashCell(sU32 key) const   { return (key*0x9e3779b1U)>>CellShift; }
+  const Cell *FindCell(sU32 key) const;
+
+  void HistBlock(sInt block);
+  void ScatterBlock(sInt block);
+  static void HistTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data);
+  static void ScatterTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data);
+  void Pass(sInt shift,sBool parallel);
+
+public:
+  sSpatialGrid();
+  ~sSpatialGrid();
+
+  void Begin(sInt max,sF32 cellsize);
+  void Add(sInt index,const sVector31 &pos) { Keys.AddTail((sU64(GetKey(pos))<<32)|sU32(index)); }
+  void Sort(sBool parallel=0);    // parallel counting sort in sSched
+
+  sU32 GetKey(const sVector31 &pos) const;
+  sInt GetCount() const           { return Order.GetCount(); }
+  const sU32 *GetOrder() const    { return Order.GetData(); }
+  sU32 GetSortedKey(sInt n) const { return sU32(Keys[n]>>32); }
+  sInt GetCellCount() const       { return CellCount; }
+
+  sInt GetNeighbours(sU32 key,sInt *start,sInt *count) const; // up to 27 ranges in the sorted order
+};
+
+/****************************************************************************/
+
+#endif // FILE_UTIL_SPATIALGRID_HPP
+
@@ -157,6 +157,7 @@ public:
   sStsManager(sInt memory,sInt taskqueuelength,sInt maxcore=0);
   ~sStsManager();
   sInt GetThreadCount() { return ThreadCount; }
+  sBool IsWorkloadActive() { return ActiveWorkloadCount>0; } // a started workload is not finished yet
 
 // call this only from master thread
 
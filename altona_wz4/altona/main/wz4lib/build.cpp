@@ -23,6 +23,7 @@ wBuilder::wBuilder() : RecursionData(0)
   CallId = 1;
   CurrentCallId = 0;
   TypeCheckOnly = 0;
+  DiskCacheLoad = 0;
 }
 
 wBuilder::~wBuilder()
@@ -476,11 +477,113 @@ sBool wBuilder::TypeCheck()
 /****************************************************************************/
 /****************************************************************************/
 
+// hash everything the result of a node depends on, for the disk cache.
+// nodes depending on scripts, loops, subroutines or the shell are not
+// hashed, and neither is anything built on top of them.
+//
+// the code of the ops is identified by size and date of the executable, so
+// any rebuild invalidates the cache. without that, nothing is hashed.
+
+static sBool GetCodeVersion(sU64 *version)
+{
+  static sInt state = 0;          // 0: not checked yet, 1: ok, 2: failed
+  static sU64 stamp[2];
+
+  if(state==0)
+  {
+    sString<sMAXPATH> exe;
+    sDirEntry de;
+    state = 2;
+    if(sGetExecutableFile(exe) && sGetFileInfo(exe,&de))
+    {
+      stamp[0] = de.LastWriteTime;
+      stamp[1] = de.Size;
+      state = 1;
+    }
+  }
+  version[0] = stamp[0];
+  version[1] = stamp[1];
+  return state==1;
+}
+
+sBool wBuilder::HashR(wNode *node)
+{
+  if(node->HashDone)
+    return node->HashValid;
+  node->HashDone = 1;
+  node->HashValid = 0;
+
+  wOp *op = node->Op;
+  if(!op || node->CallId || node->LoopFlag || !node->LoopName.IsEmpty())
+    return 0;
+  if(node->ScriptOp && node->ScriptOp->ScriptSourceValid)
+    return 0;
+  if(op->Class->Flags & (wCF_LOAD|wCF_STORE|wCF_LOGGING|wCF_CALL|wCF_INPUT|wCF_LOOP|wCF_ENDLOOP|wCF_SHELLSWITCH))
+    return 0;
+
+  sU64 code[2];
+  if(!GetCodeVersion(code))
+    return 0;
+
+  sArray<sU8> data;
+  sU32 version = 2;
+  data.AddMany(sizeof(sU32)*2+sizeof(code));
+  sCopyMem(&data[0],&version,sizeof(sU32));
+  sCopyMem(&data[4],&Doc->LowQuality,sizeof(sU32));
+  sCopyMem(&data[8],code,sizeof(code));
+
+  const sChar *names[2] = { op->Class->Name,node->OutType->Symbol };
+  for(sInt i=0;i<2;i++)
+  {
+    sInt len = sGetStringLen(names[i])+1;
+    sCopyMem(data.AddMany(len*sizeof(sChar)),names[i],len*sizeof(sChar));
+  }
+
+  sCopyMem(data.AddMany(op->Class->ParaWords*4),op->EditData,op->Class->ParaWords*4);
+
+  for(sInt i=0;i<op->Class->ParaStrings;i++)
+  {
+    const sChar *str = op->EditString[i]->Get();
+    sInt len = sGetStringLen(str)+1;
+    sCopyMem(data.AddMany(len*sizeof(sChar)),str,len*sizeof(sChar));
+    if(op->Class->FileInMask & (1<<i))
+    {
+      sDirEntry de;
+      if(!sGetFileInfo(str,&de))
+        return 0;
+      sCopyMem(data.AddMany(sizeof(sInt)),&de.Size,sizeof(sInt));
+      sCopyMem(data.AddMany(sizeof(sU64)),&de.LastWriteTime,sizeof(sU64));
+    }
+  }
+
+  sInt words = op->Class->ArrayCount;
+  for(sInt i=0;i<op->ArrayData.GetCount() && words>0;i++)
+    sCopyMem(data.AddMany(words*4),op->ArrayData[i],words*4);
+
+  for(sInt i=0;i<node->FakeInputCount;i++)
+  {
+    wNode *in = node->Inputs[i];
+    sInt present = in!=0;
+    sCopyMem(data.AddMany(sizeof(sInt)),&present,sizeof(sInt));
+    if(in)
+    {
+      if(!HashR(in))
+        return 0;
+      sCopyMem(data.AddMany(sizeof(in->Hash)),&in->Hash,sizeof(in->Hash));
+    }
+  }
+
+  node->Hash.Calc(data.GetData(),data.GetCount());
+  node->HashValid = 1;
+  return 1;
+}
+
 void wBuilder::OptimizeCacheR(wNode **node)
 {
   if((*node)->Visited!=1)
   {
     wOp *op = (*node)->Op;
+    wObject *disk = 0;
     if(op)
     {
       if(op->Cache && op->Cache->CallId==(*node)->CallId)
@@ -492,7 +595,24 @@ void wBuilder::OptimizeCacheR(wNode **node)
         (*node)->CallId = op->Cache->CallId;
         op->BuilderNode = *node;
         op->BuilderNodeCallId = op->Cache->CallId;
-        op->CacheLRU = Doc->CacheLRU++;
+        Doc->TouchCache(op);
+        AllNodes.AddTail(*node);
+      }
+      else if((*node)->HashValid && (disk = Doc->LoadDiskCache((*node)->OutType,(*node)->Hash))!=0)
+      {
+        // the whole subtree is skipped, just like a memory cache hit
+
+        sRelease(op->Cache);
+        op->Cache = disk;
+        op->CacheVars.Clear();
+        *node = MakeNode(0);
+        (*node)->Op = op;
+        (*node)->LoadCache = 1;
+        (*node)->DiskLoaded = 1;
+        (*node)->OutType = disk->Type;
+        op->BuilderNode = *node;
+        op->BuilderNodeCallId = 0;
+        Doc->TouchCache(op);
         AllNodes.AddTail(*node);
       }
       else if(!((op->Class->Flags & wCF_PASSOUTPUT) && (*node)->OutputCount==1 && !op->ImportantOp)) // reasons not to cache
@@ -606,6 +726,8 @@ sBool wBuilder::Optimize(sBool cache)
 
   if(cache)
   {
+    if(DiskCacheLoad && !Doc->EditOptions.DiskCache.IsEmpty())
+      HashR(Root);
     OptimizeCacheR(&Root);
   }
 
@@ -749,6 +871,8 @@ wCommand *wBuilder::OutputR(wExecutive &exe,wNode *node)
   cmd->LoopName = node->LoopName;
   cmd->LoopValue = node->LoopValue;
   cmd->LoopFlag = node->LoopFlag;
+  cmd->HashValid = node->HashValid;
+  cmd->Hash = node->Hash;
   sVERIFY(cmd);
   if(node->StoreCache)
     cmd->StoreCacheOp = node->Op;
@@ -890,6 +1014,7 @@ wObject *wBuilder::Execute(wExecutive &exe,wOp *root,sBool honorslow,sBool progr
   wObject *result = 0;
   TypeCheckOnly = 0;
 
+  DiskCacheLoad = 1;
   if(!Parse(root)) goto ende;
   if(!Optimize(1)) goto ende;
   if(!TypeCheck()) goto ende;
@@ -909,11 +1034,14 @@ wObject *wBuilder::Execute(wExecutive &exe,wOp *root,sBool honorslow,sBool progr
 
 ende:
 
+  DiskCacheLoad = 0;
   exe.Commands.Clear();
   sFORALL(AllNodes,node)
   {
     if(node->Op)
     {
+      if(node->DiskLoaded && Doc->IsPlayer)   // the player does not keep a memory cache
+        sRelease(node->Op->Cache);
       node->Op->BuilderNode = 0;
 //      node->Op->BuilderNodeCallId = 0;
       node->Op->CycleCheck = 0;
@@ -40,7 +40,11 @@ struct wNode
   sU8 StoreCache;                 // while execution, store cache
   sU8 LoadCache;                  // do no execute op, just load cache
   sU8 Visited;                    // used during recursion (OptimizeCacheR)
+  sU8 HashDone;                   // used during recursion (HashR)
+  sU8 HashValid;                  // result depends only on Hash, may use disk cache
+  sU8 DiskLoaded;                 // LoadCache from disk cache, not from memory
   wCommand *StoreCacheDone;       // use the store cache!
+  sChecksumMD5 Hash;              // parameters and inputs of this node
 };
 
 struct wBuilderPush
@@ -65,6 +69,7 @@ class wBuilder
   const sChar *MakeString(const sChar *str1,const sChar *str2=0,const sChar *str3=0);
   wNode *ParseR(wOp *op,sInt recursion);
   void OptimizeCacheR(wNode **node);
+  sBool HashR(wNode *node);
   wCommand *OutputR(wExecutive &,wNode *node);
   wNode *SkipToSlowR(wNode *node);
   wCommand *MakeCommand(wExecutive &exe,wOp *op,wCommand **inputs,sInt inputcount,wOp *scriptop,wOp *d0,const sChar *d1,sInt callid,sInt fakeinputcount);
@@ -79,6 +84,7 @@ class wBuilder
   sInt CurrentCallId;
   sInt TypeCheckOnly;
   sInt LoopFlag;
+  sBool DiskCacheLoad;            // try wDocument::LoadDiskCache() in OptimizeCacheR
 
 
   struct RecursionData_
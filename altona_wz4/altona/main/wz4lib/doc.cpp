@@ -12,6 +12,8 @@
 #include "build.hpp"
 #include "base/system.hpp"
 #include "util/image.hpp"
+#include "util/taskscheduler.hpp"
+#include "util/fastcompress.hpp"
 #include "util/scanner.hpp"
 #include "wz4lib/serials.hpp"
 #include "wz4lib/script.hpp"
@@ -1236,12 +1238,16 @@ wOp::~wOp()
 
   RefParent->Release();
   RefObj->Release();
+  if(CacheNode.IsValid())
+    CacheNode.Rem();
   sRelease(Cache);
   sRelease(WeakCache);
 }
 
 void wOp::Finalize()
 {
+  if(CacheNode.IsValid())
+    CacheNode.Rem();
   sRelease(Cache);
   sRelease(WeakCache);
 }
@@ -2240,12 +2246,13 @@ void wEditOptions::Init()
   Theme = TH_DEFAULT;
   CustomTheme = sGuiThemeDefault;
   DefaultCamSpeed = 0;
+  DiskCache = L"";
 }
 
 template <class streamer> void wEditOptions::Serialize_(streamer &s)
 {
   sPoolString dummy;
-  sInt version = s.Header(sSerId::Wz4EditOptions,18);
+  sInt version = s.Header(sSerId::Wz4EditOptions,19);
   sInt dummyi = 32;
 
   if(version)
@@ -2266,6 +2273,7 @@ template <class streamer> void wEditOptions::Serialize_(streamer &s)
     if(version>=15) s | Theme | &CustomTheme;
     if(version>=16) s | DefaultCamSpeed;
     if(version==17) s | dummy;
+    if(version>=19) s | DiskCache;
     s.Footer();
   }
 }
@@ -2461,6 +2469,8 @@ wDocument::wDocument()
 
 wDocument::~wDocument()
 {
+  while(!CacheList.IsEmpty())
+    CacheList.RemHead();
   delete Exe;
   delete Builder;
 }
@@ -3604,40 +3614,64 @@ sBool wDocument::RenameAllOps(const sChar *from,const sChar *to)
   return 1;
 }
 
+// CacheList holds the ops with an uncachable Cache in LRU order, so only
+// the oldest few have to be looked at. of the oldest wUNCACHEWINDOW ops
+// whose object would really be freed, the one with the highest
+// age * bytes goes first, so one big old mesh is dropped before many small
+// bitmaps. ops with more than one ref left only go when there is nothing
+// else.
+
+void wDocument::TouchCache(wOp *op)
+{
+  op->CacheLRU = CacheLRU++;
+  if(op->CacheNode.IsValid())
+    CacheList.Rem(op);
+  if(op->Cache && (op->Cache->Type->Flags & wTF_UNCACHE))
+    CacheList.AddTail(op);
+}
+
 sBool wDocument::UnCacheLRU()
 {
   wOp *best0 = 0;
   wOp *best1 = 0;
-  sU32 lru0 = CacheLRU;
-  sU32 lru1 = CacheLRU;
-  wOp *op;
+  sF64 charge1 = 0;
+  sInt window = 0;
+  wOp *op,*next;
 
-  sFORALL(AllOps,op)
+  for(op=CacheList.GetHead();!CacheList.IsEnd(op) && window<wUNCACHEWINDOW;op=next)
   {
-    if(op->Cache && (op->Cache->Type->Flags & wTF_UNCACHE))
+    next = CacheList.GetNext(op);
+    if(!op->Cache)                // released somewhere else
     {
-      if(op->CacheLRU<lru0)
-      {
-        best0 = op;
-        lru0 = op->CacheLRU;
-      }
-      if(op->CacheLRU<lru1 && op->Cache->RefCount==1)
+      CacheList.Rem(op);
+    }
+    else if(op->Cache->RefCount==1)
+    {
+      sF64 charge = sF64(CacheLRU-op->CacheLRU) * sF64(sMax<sPtr>(op->Cache->GetByteSize(),1));
+      if(!best1 || charge>charge1)
       {
         best1 = op;
-        lru1 = op->CacheLRU;
+        charge1 = charge;
       }
+      window++;
+    }
+    else if(!best0)
+    {
+      best0 = op;
     }
   }
 
   if(best1)                       // best op with only one ref left
   {
+    CacheList.Rem(best1);
     sRelease(best1->Cache);
     if(LOGIT)
       sDPrintF(L" *");
     return 1;
   }
-  if(best0)                       // best op with more than one ref left
+  if(best0)                       // oldest op with more than one ref left
   {
+    CacheList.Rem(best0);
     sRelease(best0->Cache);
     if(LOGIT)
       sDPrintF(L" *");
@@ -3648,6 +3682,62 @@ sBool wDocument::UnCacheLRU()
 
 /****************************************************************************/
 
+// persistent op cache: one file per result, named after the hash from
+// wBuilder::HashR(). only types implementing wType::WriteDiskCache() and
+// ReadDiskCache() take part.
+
+static void DiskCacheName(const sStringDesc &name,wType *type,const sChecksumMD5 &hash)
+{
+  sSPrintF(name,L"%s/%08x%08x%08x%08x.%s",Doc->EditOptions.DiskCache,
+    hash.Hash[0],hash.Hash[1],hash.Hash[2],hash.Hash[3],type->Symbol);
+}
+
+wObject *wDocument::LoadDiskCache(wType *type,const sChecksumMD5 &hash)
+{
+  sString<sMAXPATH> name;
+  DiskCacheName(name,type,hash);
+  if(!sCheckFile(name))
+    return 0;
+
+  sFile *file = sFastLzpFile::OpenRead(sCreateFile(name,sFA_READ));
+  if(!file)
+    return 0;
+  sReader s;
+  s.Begin(file);
+  wObject *obj = type->ReadDiskCache(s);
+  s.End();
+  delete file;
+
+  if(obj && (!s.IsOk() || !obj->IsType(type)))
+    sRelease(obj);
+  return obj;
+}
+
+void wDocument::StoreDiskCache(wObject *obj,const sChecksumMD5 &hash)
+{
+  sString<sMAXPATH> name,temp;
+  DiskCacheName(name,obj->Type,hash);
+  if(sCheckFile(name))
+    return;
+  sSPrintF(temp,L"%s.tmp",name);
+
+  sMakeDirAll(EditOptions.DiskCache);
+  sFile *file = sFastLzpFile::OpenWrite(sCreateFile(temp,sFA_WRITE));
+  if(!file)
+    return;
+  sWriter s;
+  s.Begin(file);
+  sBool ok = obj->Type->WriteDiskCache(obj,s);
+  ok = s.End() && ok;
+  ok = file->Close() && ok;
+  delete file;
+
+  if(!ok || !sRenameFile(temp,name))
+    sDeleteFile(temp);
+}
+
+/****************************************************************************/
+
 void wDocument::GlobalAction(const sChar *name)
 {
   wOp *op;
@@ -3976,346 +4066,521 @@ void ProgressPaint(sInt count,sInt max)
 
 void (*ProgressPaintFunc)(sInt count, sInt max) = ProgressPaint;
 
-wObject *wExecutive::Execute(sBool progress,sBool depend)
+// state of one Execute(), shared by the command phases
+
+struct wExecutive::ExeState
 {
-  wCommand *cmd;
-  sBool allok = 1;
-  sBool logging = 0;
-  wObject *result = 0;
-  sBool ok;
-  sInt cmdcount = Commands.GetCount();
-  sInt ProgressTimer = sGetTime()+500;
-  sInt ProgressEnable = 0;
-  sBool Fail=0;
+  sBool Progress;
+  sBool Depend;
+  sBool AllOk;
+  sBool Logging;
+  sBool Fail;
+  sInt ProgressTimer;
+  sInt ProgressEnable;
+  sPtr MemLimit;
+  wObject *Result;
 
-  Doc->CacheWarmupBeat.Clear();
-  sCheckBreakKey();   // throw away any break key in queue
-  sPtr memlimit = sPtr(Doc->EditOptions.MemLimit)*1024*1024;
+  wExecutive *Exe;                // parallel: commands of the current batch
+  wCommand **Cmds;
+  sBool *Ok;
+};
 
-  if(cmdcount>0)
+// ops that must not run while other ops are calculated: the op class or
+// its output type says so, scripts share their context between calls,
+// logging uses the gui, and fake ops are not worth the trouble.
+
+sBool wExecutive::IsSerial(wCommand *cmd)
+{
+  if(!cmd->Op || !cmd->Code || cmd->Script)
+    return 1;
+  if(cmd->Op->Class->Flags & (wCF_SERIAL|wCF_LOGGING))
+    return 1;
+  for(wType *type=cmd->Op->Class->OutputType;type;type=type->Parent)
+    if(type->Flags & wTF_SERIAL)
+      return 1;
+  return 0;
+}
+
+// preparation: progress, weak cache, input passing and script.
+// always called on the main thread, in order of dependency.
+
+sBool wExecutive::BeginCommand(ExeState &st,wCommand *cmd,sInt index)
+{
+  sBool ok;
+
+  if(!st.Fail && sCheckBreakKey())
+    st.Fail = 1;
+  if(LOGIT)
+    if(cmd->Op)
+      sDPrintF(L" %s",cmd->Op->Class->Name);
+  if(cmd->Op && (cmd->Op->Class->Flags & wCF_LOGGING))
   {
-    sFORALL(Commands,cmd)
-      if(cmd->Op)
-        cmd->Op->CalcErrorString = 0;
-    if(LOGIT)
-      sDPrintF(L"Calc:");
+    if(!st.Logging)
+    {
+      st.Logging = 1;
+      BeginLogging();
+      st.ProgressTimer = 0;
+    }
+  }
+  if(st.Progress && !st.ProgressEnable && sGetTime()>st.ProgressTimer)
+    st.ProgressEnable = 1;
+  if(st.ProgressEnable && ProgressPaintFunc)
+    ProgressPaintFunc(index+1,Commands.GetCount());
+  ok = 1;
+  if(st.AllOk)
+  {
+    sVERIFY(cmd->Output==0);
+    if(cmd->Op && cmd->Op->WeakCache)
+    {
+      cmd->Output = cmd->Op->WeakCache;
+      cmd->Output->Reuse();
+      cmd->Output->AddRef();
+    }
 
-    sFORALL(Commands,cmd)
+    if(cmd->PassInput>=0)
     {
-      if(!Fail && sCheckBreakKey())
-        Fail = 1;
-      if(LOGIT)
-        if(cmd->Op)
-          sDPrintF(L" %s",cmd->Op->Class->Name);
-      if(cmd->Op && (cmd->Op->Class->Flags & wCF_LOGGING))
+      wObject *in = cmd->GetInput<wObject *>(cmd->PassInput);
+      if(in && in->RefCount==1)
       {
-        if(!logging)
-        {
-          logging = 1;
-          BeginLogging();
-          ProgressTimer = 0;
-        }
+        cmd->Output = in;
+        cmd->Inputs[cmd->PassInput]->Output=0;
       }
-      if(progress && !ProgressEnable && sGetTime()>ProgressTimer)
-        ProgressEnable = 1;
-      if(ProgressEnable && ProgressPaintFunc)
-        ProgressPaintFunc(_i+1,Commands.GetCount());
-      ok = 1;
-      if(allok)
-      {
-        sVERIFY(cmd->Output==0);
-        if(cmd->Op && cmd->Op->WeakCache)
-        {
-          cmd->Output = cmd->Op->WeakCache;
-          cmd->Output->Reuse();
-          cmd->Output->AddRef();
-        }
+    }
+
+    // script
 
-        if(cmd->PassInput>=0)
+    if(cmd->Script)
+    {
+      cmd->Script->PushGlobal();
+      cmd->Script->ClearImports();
+
+      for(sInt i=0;i<cmd->FakeInputCount;i++)
+      {
+        if(cmd->Inputs[i])
         {
-          wObject *in = cmd->GetInput<wObject *>(cmd->PassInput);
-          if(in && in->RefCount==1)
+          for(sInt j=0;j<cmd->Inputs[i]->OutputVarCount;j++)
           {
-            cmd->Output = in;
-            cmd->Inputs[cmd->PassInput]->Output=0;
+            wScriptVar *var = cmd->Inputs[i]->OutputVars+j;
+            cmd->Script->AddImport(var->Name,var->Type,var->Count,var->IntVal);
           }
         }
+      }
+      if(!cmd->LoopName.IsEmpty())
+      {
+        ScriptValue *val = cmd->Script->MakeFloat(1);
+        val->FloatPtr[0] = cmd->LoopValue;
+        cmd->Script->BindGlobal(cmd->Script->AddSymbol(cmd->LoopName),val);
+      }
 
-        // script
+      if(cmd->ScriptBind2)
+        (*cmd->ScriptBind2)(cmd,cmd->Script);
 
-        sBool vars_from_context = 0;
-        if(cmd->Script)
+      if(cmd->ScriptSource)
+      {
+        cmd->Script->AddImport(L"lowquality",ScriptTypeInt,1,&Doc->LowQuality);
+        wScriptDefine *sd;
+        sFORALL(Doc->ScriptDefines,sd)
         {
-          vars_from_context = 1;
-          cmd->Script->PushGlobal();
-          cmd->Script->ClearImports();
+          if(sd->Mode==1)
+            cmd->Script->AddImport(sd->Name,ScriptTypeString,1,&sd->StringValue);
+          if(sd->Mode==2)
+            cmd->Script->AddImport(sd->Name,ScriptTypeInt,1,&sd->IntValue);
+          if(sd->Mode==3)
+            cmd->Script->AddImport(sd->Name,ScriptTypeFloat,1,&sd->FloatValue);
+        }
+        ScriptCode code(cmd->ScriptSource,0);
+        const sChar *error = cmd->Script->Run();
+        if(error)
+        {
+          ok = 0;
+          cmd->SetError(sPoolString(error));
+          sDPrintF(L"\n%s\n",error);
+        }
+      }
+    }
+  }
+  return ok;
+}
 
-          for(sInt i=0;i<cmd->FakeInputCount;i++)
-          {
-            if(cmd->Inputs[i])
-            {
-              for(sInt j=0;j<cmd->Inputs[i]->OutputVarCount;j++)
-              {
-                wScriptVar *var = cmd->Inputs[i]->OutputVars+j;
-                cmd->Script->AddImport(var->Name,var->Type,var->Count,var->IntVal);
-              }
-            }
-          }
-          if(!cmd->LoopName.IsEmpty())
-          {
-            ScriptValue *val = cmd->Script->MakeFloat(1);
-            val->FloatPtr[0] = cmd->LoopValue;
-            cmd->Script->BindGlobal(cmd->Script->AddSymbol(cmd->LoopName),val);
-          }
+// the actual calculation. this may run on any thread, unless IsSerial().
 
-          if(cmd->ScriptBind2)
-            (*cmd->ScriptBind2)(cmd,cmd->Script);
+sBool wExecutive::CallCommand(ExeState &st,wCommand *cmd,sBool ok)
+{
+  if(cmd->Op)
+    sPushMemLeakDesc(cmd->Op->Class->OutputType->Symbol);
+  else
+    sPushMemLeakDesc(L"unknown op");
+  if(st.Fail)
+    ok = 0;
+  if(ok)
+  {
+    sInt time = sGetTime();
+    if(!(*cmd->Code)(this,cmd))
+      ok = 0;
+    cmd->CalcTime = sGetTime()-time;
+  }
+  if(ok && cmd->Output)
+    cmd->Output->CallId = cmd->CallId;
+  sPopMemLeakDesc();
+  return ok;
+}
 
-          if(cmd->ScriptSource)
-          {
-            cmd->Script->AddImport(L"lowquality",ScriptTypeInt,1,&Doc->LowQuality);
-            wScriptDefine *sd;
-            sFORALL(Doc->ScriptDefines,sd)
-            {
-              if(sd->Mode==1)
-                cmd->Script->AddImport(sd->Name,ScriptTypeString,1,&sd->StringValue);
-              if(sd->Mode==2)
-                cmd->Script->AddImport(sd->Name,ScriptTypeInt,1,&sd->IntValue);
-              if(sd->Mode==3)
-                cmd->Script->AddImport(sd->Name,ScriptTypeFloat,1,&sd->FloatValue);
-            }
-            ScriptCode code(cmd->ScriptSource,0);
-            const sChar *error = cmd->Script->Run();
-            if(error)
-            {
-              ok = 0;
-              cmd->SetError(sPoolString(error));
-              sDPrintF(L"\n%s\n",error);
-            }
-          }
-        }
+// bookkeeping: errors, script variables, reference counts and caches.
+// always called on the main thread.
 
-        // execute
+void wExecutive::EndCommand(ExeState &st,wCommand *cmd,sInt index,sBool ok)
+{
+  if(st.AllOk)
+  {
+    if(st.Depend)    // don't really execute, just determine dependencies
+    {
+      cmd->Output = new AnyType;
+      cmd->Output->CallId = cmd->CallId;
 
-        if(depend)    // don't really execute, just determine dependencies
+      if(cmd->Op)
+      {
+        for(sInt i=0;i<cmd->Op->Class->ParaStrings;i++)
         {
-          cmd->Output = new AnyType;
-          cmd->Output->CallId = cmd->CallId;
-
-          if(cmd->Op)
-          {
-            for(sInt i=0;i<cmd->Op->Class->ParaStrings;i++)
-            {
-              if((cmd->Op->Class->FileInMask & (1<<i)) && sCmpString(cmd->Strings[i],L"")!=0)
-                if(!sMatchWildcard(L"*.kd",cmd->Strings[i],0))
-                  sPrintF(L"in_execute \"%p\";\n",cmd->Strings[i]);
-              if((cmd->Op->Class->FileOutMask & (1<<i)) && sCmpString(cmd->Strings[i],L"")!=0)
-                if(!sMatchWildcard(L"*.kd",cmd->Strings[i],0))
-                  sPrintF(L"out \"%p\";\n",cmd->Strings[i]);
-            }
-          }
+          if((cmd->Op->Class->FileInMask & (1<<i)) && sCmpString(cmd->Strings[i],L"")!=0)
+            if(!sMatchWildcard(L"*.kd",cmd->Strings[i],0))
+              sPrintF(L"in_execute \"%p\";\n",cmd->Strings[i]);
+          if((cmd->Op->Class->FileOutMask & (1<<i)) && sCmpString(cmd->Strings[i],L"")!=0)
+            if(!sMatchWildcard(L"*.kd",cmd->Strings[i],0))
+              sPrintF(L"out \"%p\";\n",cmd->Strings[i]);
         }
-        else          // really execute
+      }
+    }
+    else          // really execute
+    {
+      if(!cmd->Code)
+      {
+        if(cmd->InputCount>0 && cmd->Inputs[0] && cmd->Inputs[0]->Output)
         {
-          if(cmd->Code)
-          {
-            if(cmd->Op)
-              sPushMemLeakDesc(cmd->Op->Class->OutputType->Symbol);
-            else
-              sPushMemLeakDesc(L"unknown op");
-            if(Fail)
-              ok = 0;
-            if(ok)
-              if(!(*cmd->Code)(this,cmd))
-                ok = 0;
-            if(ok && cmd->Output)
-              cmd->Output->CallId = cmd->CallId;
-            sPopMemLeakDesc();
-          }
-          else
-          {
-            if(cmd->InputCount>0 && cmd->Inputs[0] && cmd->Inputs[0]->Output)
-            {
-              cmd->Output = cmd->Inputs[0]->Output;
-              cmd->Output->AddRef();
-            }
-            else      // fake op, just generate variables 
-            {
-              cmd->Output = new wObject;
-            }
-            ok = 1;
-          }
+          cmd->Output = cmd->Inputs[0]->Output;
+          cmd->Output->AddRef();
+        }
+        else      // fake op, just generate variables 
+        {
+          cmd->Output = new wObject;
+        }
+        ok = 1;
+      }
 
-          if(allok && !ok)
-          {
-            sDPrintF(L" (FAIL)");
-            if(cmd->Op)
-            {
-              sPrintF(L"operator class %q failed\n",cmd->Op->Class->Label);
-              sDPrintF(L"operator class %q failed\n",cmd->Op->Class->Label);
-              wPage *page;
-              sFORALL(Doc->Pages,page)
-              {
-                if(sFindPtr(page->Ops,cmd->Op))
-                {
-                  wStackOp *op = (wStackOp *)cmd->Op;
-                  sPrintF(L"location page %q, x=%d, y=%d\n",page->Name,op->PosX,op->PosY);
-                  sDPrintF(L"location page %q, x=%d, y=%d\n",page->Name,op->PosX,op->PosY);
-                }
-              }
-              for(sInt i=0;i<cmd->Op->EditStringCount;i++)
-                sPrintF(L"string %d:%q\n",i,cmd->Op->EditString[i]->Get());
-              wOpInputInfo *info;
-              sFORALL(cmd->Op->Links,info)
-                if(!info->LinkName.IsEmpty())
-                  sPrintF(L"link %d:%q\n",_i,info->LinkName);
-            }
-          }
-          allok &= ok;
-          if(cmd->Op && cmd->Op->WeakOutputs.GetCount())
+      if(!ok)
+      {
+        sDPrintF(L" (FAIL)");
+        if(cmd->Op)
+        {
+          sPrintF(L"operator class %q failed\n",cmd->Op->Class->Label);
+          sDPrintF(L"operator class %q failed\n",cmd->Op->Class->Label);
+          wPage *page;
+          sFORALL(Doc->Pages,page)
           {
-            cmd->Op->WeakCache->Release();
-            if(ok)
+            if(sFindPtr(page->Ops,cmd->Op))
             {
-              cmd->Op->WeakCache = cmd->Output;
-              cmd->Op->WeakCache->AddRef();
+              wStackOp *op = (wStackOp *)cmd->Op;
+              sPrintF(L"location page %q, x=%d, y=%d\n",page->Name,op->PosX,op->PosY);
+              sDPrintF(L"location page %q, x=%d, y=%d\n",page->Name,op->PosX,op->PosY);
             }
           }
+          for(sInt i=0;i<cmd->Op->EditStringCount;i++)
+            sPrintF(L"string %d:%q\n",i,cmd->Op->EditString[i]->Get());
+          wOpInputInfo *info;
+          sFORALL(cmd->Op->Links,info)
+            if(!info->LinkName.IsEmpty())
+              sPrintF(L"link %d:%q\n",_i,info->LinkName);
+        }
+      }
+      st.AllOk &= ok;
+      if(cmd->Op && cmd->Op->WeakOutputs.GetCount())
+      {
+        cmd->Op->WeakCache->Release();
+        if(ok)
+        {
+          cmd->Op->WeakCache = cmd->Output;
+          cmd->Op->WeakCache->AddRef();
         }
+      }
+    }
 
-        // gather globals (inputs + script)
+    // gather globals (inputs + script)
 
-        if(allok)
+    if(st.AllOk)
+    {
+      cmd->OutputVarCount = 0;
+      sInt count = 0;
+      for(sInt i=0;i<cmd->FakeInputCount;i++)
+        if(cmd->Inputs[i])
+          count += cmd->Inputs[i]->OutputVarCount;
+      if(!cmd->LoopName.IsEmpty())
+        count++;
+
+      if(cmd->Script)
+      {
+        cmd->Script->FlushLocal();
+        ScriptValue *val = cmd->Script->GetFirstFromScope();
+        while(val)
         {
-          cmd->OutputVarCount = 0;
-          sInt count = 0;
-          for(sInt i=0;i<cmd->FakeInputCount;i++)
-            if(cmd->Inputs[i])
-              count += cmd->Inputs[i]->OutputVarCount;
-          if(!cmd->LoopName.IsEmpty())
-            count++;
-
-          if(vars_from_context)
-          {
-            cmd->Script->FlushLocal();
-            ScriptValue *val = cmd->Script->GetFirstFromScope();
-            while(val)
-            {
-              val = val->ScopeLink;
-              count++;
-            }
-          }
+          val = val->ScopeLink;
+          count++;
+        }
+      }
 
-          cmd->OutputVars = MemPool->Alloc<wScriptVar>(count);
-          if(!cmd->LoopName.IsEmpty())
+      cmd->OutputVars = MemPool->Alloc<wScriptVar>(count);
+      if(!cmd->LoopName.IsEmpty())
+      {
+        wScriptVar var;
+        var.Count = 1;
+        var.Name = cmd->LoopName;
+        var.Type = ScriptTypeFloat;
+        var.FloatVal[0] = cmd->LoopValue;
+        cmd->AddOutputVar(var);
+      }
+      for(sInt i=0;i<cmd->FakeInputCount;i++)
+      {
+        if(cmd->Inputs[i])
+        {
+          for(sInt j=0;j<cmd->Inputs[i]->OutputVarCount;j++)
+            cmd->AddOutputVar(cmd->Inputs[i]->OutputVars[j]);
+        }
+      }
+
+      if(cmd->Script)
+      {
+        ScriptValue *val = cmd->Script->GetFirstFromScope();
+        while(val)
+        {
+          if(val->Symbol && val->Count<4 && (val->Type==ScriptTypeInt || val->Type==ScriptTypeFloat || val->Type==ScriptTypeString || val->Type==ScriptTypeColor))
           {
             wScriptVar var;
-            var.Count = 1;
-            var.Name = cmd->LoopName;
-            var.Type = ScriptTypeFloat;
-            var.FloatVal[0] = cmd->LoopValue;
-            cmd->AddOutputVar(var);
-          }
-          for(sInt i=0;i<cmd->FakeInputCount;i++)
-          {
-            if(cmd->Inputs[i])
+            var.Name = val->Symbol->Name;
+            var.Type = val->Type;
+            var.Count = val->Count;
+            if(var.Type==ScriptTypeString)
             {
-              for(sInt j=0;j<cmd->Inputs[i]->OutputVarCount;j++)
-                cmd->AddOutputVar(cmd->Inputs[i]->OutputVars[j]);
+              for(sInt i=0;i<var.Count;i++)
+                var.StringVal[i] = val->StringPtr[i];
             }
-          }
-
-          if(vars_from_context)
-          {
-            ScriptValue *val = cmd->Script->GetFirstFromScope();
-            while(val)
+            else
             {
-              if(val->Symbol && val->Count<4 && (val->Type==ScriptTypeInt || val->Type==ScriptTypeFloat || val->Type==ScriptTypeString || val->Type==ScriptTypeColor))
-              {
-                wScriptVar var;
-                var.Name = val->Symbol->Name;
-                var.Type = val->Type;
-                var.Count = val->Count;
-                if(var.Type==ScriptTypeString)
-                {
-                  for(sInt i=0;i<var.Count;i++)
-                    var.StringVal[i] = val->StringPtr[i];
-                }
-                else
-                {
-                  for(sInt i=0;i<var.Count;i++)
-                    var.IntVal[i] = val->IntPtr[i];
-                }
-                cmd->AddOutputVar(var);
-              }
-              val = val->ScopeLink;
+              for(sInt i=0;i<var.Count;i++)
+                var.IntVal[i] = val->IntPtr[i];
             }
-            cmd->Script->PopGlobal();
+            cmd->AddOutputVar(var);
           }
+          val = val->ScopeLink;
         }
+        cmd->Script->PopGlobal();
       }
+    }
+  }
 
-      if(!allok /*&& cmd->CallId==0*/)
-      {
-        sInt error = 0;
-        for(sInt i=0;i<cmd->FakeInputCount;i++)
-          if(cmd->Inputs[i])
-            error |= cmd->Inputs[i]->ErrorFlag;
-        if(error)
-          cmd->SetError(L"....");
-      }
+  if(!st.AllOk /*&& cmd->CallId==0*/)
+  {
+    sInt error = 0;
+    for(sInt i=0;i<cmd->FakeInputCount;i++)
+      if(cmd->Inputs[i])
+        error |= cmd->Inputs[i]->ErrorFlag;
+    if(error)
+      cmd->SetError(L"....");
+  }
 
-      if(cmd->Output)
+  if(cmd->Output)
+  {
+    if(!cmd->Output->Type && cmd->Op)
+      sFatal(L"forgot to initialize Type field in wObject constructor of\n"
+             L"operator %s %s(...)",cmd->Op->Class->OutputType->Label,cmd->Op->Class->Label);
+    
+    cmd->Output->RefCount += cmd->OutputRefs;
+  }
+  if(ok && cmd->Op)
+    cmd->Op->Strobe = 0;
+  if(!ok)
+    cmd->SetError(L"calculation error");
+  for(sInt i=0;i<cmd->InputCount;i++)
+    if(cmd->Inputs[i])
+      cmd->Inputs[i]->Output->Release();
+  if(cmd->StoreCacheOp && st.AllOk)
+  {
+    if(cmd->StoreCacheOp->Cache)
+    {
+      // this should only happen in a subroutine that is evaluated multiple times!
+      cmd->StoreCacheOp->Cache->Release();
+    }
+    cmd->StoreCacheOp->Cache = cmd->Output;
+    Doc->TouchCache(cmd->StoreCacheOp);
+    cmd->StoreCacheOp->CacheVars.Clear();
+    cmd->StoreCacheOp->CacheVars.Resize(cmd->OutputVarCount);
+    for(sInt i=0;i<cmd->OutputVarCount;i++)
+      cmd->StoreCacheOp->CacheVars[i] = cmd->OutputVars[i];
+    cmd->Output->AddRef();
+  }
+  if(cmd->HashValid && ok && st.AllOk && cmd->Output && cmd->CalcTime>=wDISKCACHETIME)
+    Doc->StoreDiskCache(cmd->Output,cmd->Hash);
+  if(index==Commands.GetCount()-1 && st.AllOk)
+    st.Result = cmd->Output;
+  else
+    cmd->Output->Release();
+
+  // memorymanagement
+
+  while(st.AllOk && st.MemLimit>0 && sMemoryUsed>st.MemLimit)
+  {
+    if(!Doc->UnCacheLRU())
+      break;
+  }
+}
+
+/****************************************************************************/
+
+// parallel execution: the commands are sorted into levels, so that all
+// inputs of a command are in lower levels. level by level, serial commands
+// are calculated right away, all others are calculated together as one
+// workload on the task scheduler. preparation and bookkeeping stay on the
+// main thread, only CallCommand() runs in parallel.
+
+void wExecutive::CommandTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data)
+{
+  ExeState *st = (ExeState *) data;
+  for(sInt i=start;i<start+count;i++)
+    st->Ok[i] = st->Exe->CallCommand(*st,st->Cmds[i],st->Ok[i]);
+}
+
+void wExecutive::ExecuteParallel(ExeState &st)
+{
+  wCommand *cmd;
+  sInt cmdcount = Commands.GetCount();
+  sInt levels = 0;
+
+  // find levels. commands only refer to commands before them, or to
+  // load-cache commands that are not in the list (level 0)
+
+  sFORALL(Commands,cmd)
+  {
+    cmd->Level = 1;
+    for(sInt i=0;i<cmd->FakeInputCount;i++)
+      if(cmd->Inputs[i])
+        cmd->Level = sMax(cmd->Level,cmd->Inputs[i]->Level+1);
+    levels = sMax(levels,cmd->Level);
+  }
+
+  // sort by level, keeping the order inside a level
+
+  sInt *start = new sInt[levels+2];
+  sInt *order = new sInt[cmdcount];
+  sSetMem(start,0,sizeof(sInt)*(levels+2));
+  sFORALL(Commands,cmd)
+    start[cmd->Level+1]++;
+  for(sInt i=1;i<=levels+1;i++)
+    start[i] += start[i-1];
+  sFORALL(Commands,cmd)
+    order[start[cmd->Level]++] = _i;
+  for(sInt i=levels+1;i>0;i--)
+    start[i] = start[i-1];
+  start[0] = 0;
+
+  wCommand **cmds = new wCommand*[cmdcount];
+  sBool *ok = new sBool[cmdcount];
+  sInt *index = new sInt[cmdcount];
+
+  for(sInt level=1;level<=levels;level++)
+  {
+    sInt count = 0;
+
+    for(sInt j=start[level];j<start[level+1];j++)
+    {
+      sInt n = order[j];
+      cmd = Commands[n];
+
+      if(IsSerial(cmd))
       {
-        if(!cmd->Output->Type && cmd->Op)
-          sFatal(L"forgot to initialize Type field in wObject constructor of\n"
-                 L"operator %s %s(...)",cmd->Op->Class->OutputType->Label,cmd->Op->Class->Label);
-        
-        cmd->Output->RefCount += cmd->OutputRefs;
+        sBool cmdok = BeginCommand(st,cmd,n);
+        if(st.AllOk && cmd->Code)
+          cmdok = CallCommand(st,cmd,cmdok);
+        EndCommand(st,cmd,n,cmdok);
       }
-      if(ok && cmd->Op)
-        cmd->Op->Strobe = 0;
-      if(!ok)
-        cmd->SetError(L"calculation error");
-      for(sInt i=0;i<cmd->InputCount;i++)
-        if(cmd->Inputs[i])
-          cmd->Inputs[i]->Output->Release();
-      if(cmd->StoreCacheOp && allok)
+      else
       {
-        if(cmd->StoreCacheOp->Cache)
-        {
-          // this should only happen in a subroutine that is evaluated multiple times!
-          cmd->StoreCacheOp->Cache->Release();
-        }
-        cmd->StoreCacheOp->Cache = cmd->Output;
-        cmd->StoreCacheOp->CacheLRU = Doc->CacheLRU++;
-        cmd->StoreCacheOp->CacheVars.Clear();
-        cmd->StoreCacheOp->CacheVars.Resize(cmd->OutputVarCount);
-        for(sInt i=0;i<cmd->OutputVarCount;i++)
-          cmd->StoreCacheOp->CacheVars[i] = cmd->OutputVars[i];
-        cmd->Output->AddRef();
+        cmds[count] = cmd;
+        index[count] = n;
+        ok[count] = BeginCommand(st,cmd,n);
+        count++;
       }
-      if(_i==cmdcount-1 && allok)
-        result = cmd->Output;
-      else
-        cmd->Output->Release();
+    }
+
+    if(count>0 && st.AllOk)
+    {
+      st.Exe = this;
+      st.Cmds = cmds;
+      st.Ok = ok;
+
+      sStsWorkload *wl = sSched->BeginWorkload();
+      wl->AddTask(wl->NewTask(CommandTask,&st,count,0));
+      wl->Start();
+      wl->Sync();
+      wl->End();
+    }
+
+    for(sInt i=0;i<count;i++)
+      EndCommand(st,cmds[i],index[i],ok[i]);
+  }
+
+  delete[] index;
+  delete[] ok;
+  delete[] cmds;
+  delete[] order;
+  delete[] start;
+}
+
+wObject *wExecutive::Execute(sBool progress,sBool depend)
+{
+  wCommand *cmd;
+  ExeState st;
+  sInt cmdcount = Commands.GetCount();
 
-      // memorymanagement
+  st.Progress = progress;
+  st.Depend = depend;
+  st.AllOk = 1;
+  st.Logging = 0;
+  st.Fail = 0;
+  st.ProgressTimer = sGetTime()+500;
+  st.ProgressEnable = 0;
+  st.Result = 0;
 
-      while(allok && memlimit>0 && sMemoryUsed>memlimit)
+  Doc->CacheWarmupBeat.Clear();
+  sCheckBreakKey();   // throw away any break key in queue
+  st.MemLimit = sPtr(Doc->EditOptions.MemLimit)*1024*1024;
+
+  if(cmdcount>0)
+  {
+    sFORALL(Commands,cmd)
+      if(cmd->Op)
+        cmd->Op->CalcErrorString = 0;
+    if(LOGIT)
+      sDPrintF(L"Calc:");
+
+    if(!depend && sSched && sSched->GetThreadCount()>1 && !(Doc->EditOptions.Flags & wEOF_SERIALCALC))
+    {
+      ExecuteParallel(st);
+    }
+    else
+    {
+      sFORALL(Commands,cmd)
       {
-        if(!Doc->UnCacheLRU())
-          break;
+        sBool ok = BeginCommand(st,cmd,_i);
+        if(st.AllOk && !depend && cmd->Code)
+          ok = CallCommand(st,cmd,ok);
+        EndCommand(st,cmd,_i,ok);
       }
     }
 
     if(LOGIT)
       sDPrintF(L"\n");
   }
-  if(logging)
+  if(st.Logging)
     EndLogging();
 
-  if(ProgressEnable && ProgressPaintFunc)
+  if(st.ProgressEnable && ProgressPaintFunc)
   {
     ProgressPaintFunc(Commands.GetCount(),Commands.GetCount());
     sUpdateWindow();
@@ -4323,7 +4588,7 @@ wObject *wExecutive::Execute(sBool progress,sBool depend)
 
 //  sGetMemoryLeakTracker()->DumpLeaks(L"execution",0,1);
 
-  return result;
+  return st.Result;
 }
 
 
@@ -15,6 +15,7 @@
 #endif
 
 #include "base/types2.hpp"
+#include "base/system.hpp"
 #include "gui/gui.hpp"
 #include "gui/listwindow.hpp"
 #include "base/serialize.hpp"
@@ -26,6 +27,8 @@ class sViewport;
 class WinView;
 
 class ScriptContext;
+class sStsManager;
+class sStsThread;
 
 /****************************************************************************/
 /****************************************************************************/
@@ -37,6 +40,8 @@ enum wWerkkzeugConsts
   wPAGEXS = 192,
   wPAGEYS = 128,
   wSWITCHES = 10,                 // for switch op
+  wUNCACHEWINDOW = 16,            // UnCacheLRU() picks the biggest of the oldest cached objects
+  wDISKCACHETIME = 20,            // ms. only results that took longer are written to the disk cache
 };
 
 typedef sString<wNAMECOUNT> wDocName;
@@ -62,6 +67,7 @@ enum wTypeFlags
   wTF_NOTAB         = 0x01,
   wTF_RENDER3D      = 0x02,
   wTF_UNCACHE       = 0x04,       // use memorymanagement on this class
+  wTF_SERIAL        = 0x08,       // ops of this class (and derived classes) are not thread safe
 };
 
 enum wTypeGuiSets
@@ -296,6 +302,8 @@ private:                                          // please use Doc->Show(), don
 public:
   virtual void ListExtractions(wObject *obj,void (* cb)(const sChar *name,wType *type),const sChar *storename) {}
   virtual sBool OverrideCamera(wObject *obj,sViewport &view,sF32 &zoom,sF32 time) { return 0; }
+  virtual sBool WriteDiskCache(wObject *obj,sWriter &s) { return 0; }  // types that support wEditOptions::DiskCache
+  virtual wObject *ReadDiskCache(sReader &s) { return 0; }
 };
 
 
@@ -369,6 +377,7 @@ enum wClassFlags
   wCF_SHELLSWITCH     = 0x00400000, // modify build: depending on shell switch, use either input
   wCF_TYPEFROMINPUT   = 0x00800000, // op is tagged as AnyType, but actual type is same as input#0
   wCF_BLOCKCHANGE     = 0x01000000, // do not propagate changes to childs
+  wCF_SERIAL          = 0x02000000, // not thread safe: calculate on main thread, while no other op is calculated
 
   wCIF_METHODMASK     = 0x0007,   // method: link, input or optional=
   wCIF_METHODINPUT    = 0x0000,   // always input
@@ -569,6 +578,7 @@ public:
   sInt BuilderNodeCallerId;       // if this is a call, when this was called this id was used
   wObject *Cache;                 // permanently cached copy of data
   sU32 CacheLRU;
+  sDNode CacheNode;               // wDocument::CacheList, if Cache can be uncached
   sArray<wScriptVar> CacheVars;   // script vars associated to Cached Object
   wObject *WeakCache;             // if this op has weak outputs, cache the pointer here for reuse
   wCommand *CalcTemp;             // command with result during calculation
@@ -712,6 +722,7 @@ enum wEditOptionsFlags
 {
   wEOF_IGNORESLOW  = 1,           // always calculate slow commands
   wEOF_GRAYUNCONNECTED = 0x0002,  // gray out ops that are not connected to root
+  wEOF_SERIALCALC  = 0x0004,      // calculate all ops on main thread, one after the other
 };
 
 struct wEditOptions 
@@ -745,6 +756,7 @@ struct wEditOptions
   };
   sInt Theme;
   sGuiTheme CustomTheme;
+  sPoolString DiskCache;          // directory for persistent op results, empty for off
  
   // timeline options
 
@@ -889,7 +901,11 @@ public:
   void ClearSlowFlags();
   sBool RenameAllOps(const sChar *from,const sChar *to);
   sBool UnCacheLRU();
+  void TouchCache(wOp *op);       // op->Cache was stored or used
+  wObject *LoadDiskCache(wType *type,const sChecksumMD5 &hash);
+  void StoreDiskCache(wObject *obj,const sChecksumMD5 &hash);
   sU32 CacheLRU;
+  sDList<wOp,&wOp::CacheNode> CacheList;  // ops with uncachable Cache, least recently used first
   void GlobalAction(const sChar *name);
 
   sInt SecondsToBeats(sF32 t);
@@ -979,11 +995,12 @@ public:
   sInt CallId;
 
 
-  void AddRef()    { if(this) RefCount++; }
-  void Release()   { if(this) { if(--RefCount<=0) delete this; } }
+  void AddRef()    { if(this) sAtomicInc((sU32 *)&RefCount); }       // ops may run in parallel
+  void Release()   { if(this) { if(sInt(sAtomicDec((sU32 *)&RefCount))<=0) delete this; } }
   sBool IsType(wType *type) { return Type->IsType(type); }   // output->IsType(input). obj type is of type, or type is parent of obj type. 
   virtual void Reuse()  { sFatal(L"this class can not be used for weak linking."); }
   virtual wObject *Copy()  { return 0; }
+  virtual sPtr GetByteSize() { return 0; }  // memory used, for types with wTF_UNCACHE
 };
 
 struct wCommand
@@ -1000,6 +1017,10 @@ public:
   sInt CallId;                    // write this to object
   sInt ErrorFlag;                 // used for error propagation
   sInt LoopFlag;                  // called through subroutine or loop
+  sInt Level;                     // parallel execution: 1 + level of deepest input
+  sInt CalcTime;                  // ms spent in Code
+  sBool HashValid;                // result may be stored in the disk cache
+  sChecksumMD5 Hash;              // see wBuilder::HashR()
 
   sU32 *Data;                     // value parmeters
   const sChar **Strings;          // string parameters
@@ -1028,8 +1049,15 @@ public:
 
 class wExecutive
 {
+  struct ExeState;
   void BeginLogging();
   void EndLogging();
+  sBool IsSerial(wCommand *cmd);
+  sBool BeginCommand(ExeState &st,wCommand *cmd,sInt index);
+  sBool CallCommand(ExeState &st,wCommand *cmd,sBool ok);
+  void EndCommand(ExeState &st,wCommand *cmd,sInt index,sBool ok);
+  void ExecuteParallel(ExeState &st);
+  static void CommandTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data);
 public:
   wExecutive();
   ~wExecutive();
@@ -1521,7 +1521,7 @@ void MainWindow::CmdEditOptions()
     gh.Label(L"Goto Screen");
     gh.Choice(&Doc->EditOptions.Screen,L"page|dual|tree");
     gh.Label(L"Flags");
-    gh.Flags(&Doc->EditOptions.Flags,L"-|ignore slow:*1-|gray unconnected");
+    gh.Flags(&Doc->EditOptions.Flags,L"-|ignore slow:*1-|gray unconnected:*2-|serial calculation");
     gh.Group(L"Colors");
     gh.Label(L"Background");
     gh.ColorPick(&Doc->EditOptions.BackColor,L"rgba",0);
@@ -1550,6 +1550,8 @@ void MainWindow::CmdEditOptions()
     gh.Int(&Doc->EditOptions.AutosavePeriod,0,60*60);
     gh.Label(L"Memory Limit (MB) (0=off)");
     gh.Int(&Doc->EditOptions.MemLimit,0,16*1024,256);
+    gh.Label(L"Disk Cache Directory (empty=off)");
+    gh.String(&Doc->EditOptions.DiskCache);
     gh.Label(L"Expensive IPP Quality");
     gh.Choice(&Doc->EditOptions.ExpensiveIPPQuality,L"low|medium|high");
     gh.Label(L"GUI theme");
@@ -34,6 +34,7 @@ public:
 
   void CopyFrom(const PocBitmap *src);
   wObject *Copy();
+  sPtr GetByteSize() { return Image ? sPtr(Image->SizeX)*Image->SizeY*sizeof(sU32) : 0; }
 
   sImage *Image;
   sTexture2D *Texture;
@@ -9,6 +9,7 @@
 
 #include "wz4lib/script.hpp"
 #include "base/math.hpp"
+#include "util/simd_float.hpp"
 
 /****************************************************************************/
 /***                                                                      ***/
@@ -82,6 +83,7 @@ enum ScriptCodeEnum
   SC_BT,                          //       branch if true
   SC_BF,                          //       branch if true
   SC_STOP,                        //       end execution
+  SC_STACK,                       //       first command: count = stack size needed
   
   SC_LITERAL,                     // IFA   integer literal
   SC_GETVAR,                      // IF    load variable to stack
@@ -220,6 +222,7 @@ ScriptSpline::ScriptSpline()
 {
   Count = 0;
   Curves = 0;
+  Segments = 0;
   Bindings = -1;
   RotClampMask = 0;
 }
@@ -229,6 +232,7 @@ ScriptSpline::~ScriptSpline()
   for(sInt i=0;i<Count;i++)
     delete Curves[i];
   delete[] Curves;
+  delete[] Segments;
 }
 
 void ScriptSpline::Init(sInt count)
@@ -239,7 +243,159 @@ void ScriptSpline::Init(sInt count)
     Curves[i] = new sArray<ScriptSplineKey>;
 }
 
-void ScriptSpline::Eval(sF32 time,sF32 *result,sInt count)
+// the cubic of each segment only depends on the keys, so it can be
+// calculated in advance. curves with keys that are not sorted by time are
+// left out, they use the linear search and the basis functions in Eval().
+
+void ScriptSpline::Prepare()
+{
+  if(!Segments)
+    Segments = new sArray<ScriptSplineSegment>[Count];
+
+  for(sInt i=0;i<Count;i++)
+  {
+    sArray<ScriptSplineKey> &curve = *Curves[i];
+    sArray<ScriptSplineSegment> &segs = Segments[i];
+    sInt max = curve.GetCount();
+    segs.Clear();
+
+    sBool sorted = (Mode>=SSM_Step && Mode<=SSM_UniformBSpline);
+    for(sInt n=0;n<max-1 && sorted;n++)
+      if(!(curve[n].Time <= curve[n+1].Time))
+        sorted = 0;
+    if(!sorted || max<2)
+      continue;
+
+    segs.AddMany(max-1);
+    for(sInt n=0;n<max-1;n++)
+    {
+      ScriptSplineKey k0,k1,k2,k3;
+      sF32 v0,v1,v2,v3;
+
+      k1 = curve[n];
+      k2 = curve[n+1];
+      if(n-1<0)
+      {
+        k0.Time  = k1.Time *2 - k2.Time;
+        k0.Value = k1.Value*2 - k2.Value;
+      }
+      else
+      {
+        k0 = curve[n-1];
+      }
+      if(n+2>=max)
+      {
+        k3.Time  = k2.Time *2 - k1.Time;
+        k3.Value = k2.Value*2 - k1.Value;
+      }
+      else
+      {
+        k3 = curve[n+2];
+      }
+
+      if((1<<i) & RotClampMask)
+      {
+        v0 = sMod(k0.Value,1);
+        v1 = sMod(k1.Value,1);
+        v2 = sMod(k2.Value,1);
+        v3 = sMod(k3.Value,1);
+
+        while(v1>v0+0.5f) v1-=1;
+        while(v1<v0-0.5f) v1+=1;
+
+        while(v2>v1+0.5f) v2-=1;
+        while(v2<v1-0.5f) v2+=1;
+
+        while(v3>v2+0.5f) v3-=1;
+        while(v3<v2-0.5f) v3+=1;
+      }
+      else
+      {
+        v0 = k0.Value;
+        v1 = k1.Value;
+        v2 = k2.Value;
+        v3 = k3.Value;
+      }
+
+      ScriptSplineSegment &seg = segs[n];
+      seg.Time = k1.Time;
+      seg.InvLength = (k2.Time>k1.Time) ? 1/(k2.Time-k1.Time) : 0;
+      seg.c0 = v1;
+      seg.c1 = seg.c2 = seg.c3 = 0;
+
+      switch(Mode)
+      {
+      case SSM_Step:
+        break;
+      case SSM_Linear:
+        seg.c1 = v2-v1;
+        break;
+      case SSM_UniformHermite:    // hermite, with the outer keys moved to even out the tangents
+        {
+          sF32 t1 = k2.Time-k1.Time;
+          sF32 f0 = t1/(k1.Time-k0.Time);
+          sF32 f3 = t1/(k3.Time-k2.Time);
+          v0 = v0*f0 + v1*(1-f0);
+          v3 = v3*f3 + v2*(1-f3);
+        }
+        // fall through
+      case SSM_Hermite:
+        seg.c1 = 0.5f*(v2-v0);
+        seg.c2 = v0 - 2.5f*v1 + 2.0f*v2 - 0.5f*v3;
+        seg.c3 = -0.5f*v0 + 1.5f*v1 - 1.5f*v2 + 0.5f*v3;
+        break;
+      case SSM_UniformBSpline:
+        seg.c0 = (v0 + 4*v1 + v2)/6;
+        seg.c1 = 0.5f*(v2-v0);
+        seg.c2 = 0.5f*(v0+v2) - v1;
+        seg.c3 = (v3-v0)/6 + 0.5f*(v1-v2);
+        break;
+      }
+    }
+  }
+}
+
+// find the key n with keys[n].Time <= time < keys[n+1].Time, or -1.
+// prepared curves are sorted, so the cursor is tried first, then its
+// successor, then a binary search.
+
+sInt ScriptSpline::FindKey(sInt i,sF32 time,sInt hint) const
+{
+  const sArray<ScriptSplineKey> &curve = *Curves[i];
+  sInt max = curve.GetCount();
+
+  if(!Segments || Segments[i].GetCount()==0)
+  {
+    for(sInt n=0;n<max-1;n++)
+      if(time >= curve[n].Time && time < curve[n+1].Time)
+        return n;
+    return -1;
+  }
+
+  if(hint>=0 && hint<max-1 && time>=curve[hint].Time)
+  {
+    if(time<curve[hint+1].Time)
+      return hint;
+    if(hint+2<max && time<curve[hint+2].Time)
+      return hint+1;
+  }
+
+  if(!(time>=curve[0].Time && time<curve[max-1].Time))
+    return -1;
+  sInt lo = 0;                    // curve[lo].Time <= time < curve[hi].Time
+  sInt hi = max-1;
+  while(hi-lo>1)
+  {
+    sInt mid = (lo+hi)/2;
+    if(time<curve[mid].Time)
+      hi = mid;
+    else
+      lo = mid;
+  }
+  return lo;
+}
+
+void ScriptSpline::Eval(sF32 time,sF32 *result,sInt count,ScriptSplineCursor *cursor)
 {
   sVERIFY(count<=Count);
 
@@ -263,6 +419,8 @@ void ScriptSpline::Eval(sF32 time,sF32 *result,sInt count)
     break;
   }
 
+  sVERIFY(!cursor || count<=ScriptSplineCursor::MaxCurves);
+
   for(sInt i=0;i<count;i++)
   {
     sArray<ScriptSplineKey> &curve = *Curves[i];
@@ -271,10 +429,21 @@ void ScriptSpline::Eval(sF32 time,sF32 *result,sInt count)
     sF32 t,t0,t1,t2;
 
     sInt max = curve.GetCount();
-    sInt n;
-    for(n=0;n<max-1;n++)
-      if(time >= curve[n].Time && time < curve[n+1].Time)
-        goto found;
+    sInt n = FindKey(i,time,cursor ? cursor->Key[i] : -1);
+    if(n>=0)
+    {
+      if(cursor)
+        cursor->Key[i] = n;
+      if(Segments && Segments[i].GetCount()>0)
+      {
+        const ScriptSplineSegment &seg = Segments[i][n];
+        t = (time-seg.Time)*seg.InvLength;
+        sF32 v = ((seg.c3*t + seg.c2)*t + seg.c1)*t + seg.c0;
+        result[i] = ((1<<i) & RotClampMask) ? sMod(v,1) : v;
+        continue;
+      }
+      goto found;
+    }
 
     if(max==0)
       result[i] = 0;
@@ -403,10 +572,9 @@ void ScriptSpline::EvalD(sF32 time,sF32 *result,sInt count)
     sF32 t,t0,t1,t2;
 
     sInt max = curve->GetCount();
-    sInt n;
-    for(n=0;n<max-1;n++)
-      if(time >= (*curve)[n].Time && time < (*curve)[n+1].Time)
-        goto found;
+    sInt n = FindKey(i,time,-1);
+    if(n>=0)
+      goto found;
 
     result[i] = 0;
     continue;
@@ -510,6 +678,8 @@ sF64 ScriptSpline::ArcLengthIntegrand(sF64 x,void *user)
 ScriptContext::ScriptContext()
 {
   Locals = 0;
+  LaneLocals = 0;
+  LaneGlobals = 0;
   Scope = 0;
   Pool = new sMemoryPool(0x2000);
   Code = 0;
@@ -587,6 +757,7 @@ ScriptValue *ScriptContext::MakeValue(sInt type,sInt dim)
   val->OldValue = 0;
   val->Func = 0;
   val->Spline = 0;
+  val->LaneStride = 0;
 
   if(dim==0)
     dim = 1;
@@ -623,6 +794,7 @@ ScriptValue *ScriptContext::MakeValue(ScriptFunc *func)
   val->OldValue = 0;
   val->Func = func;
   val->Spline = 0;
+  val->LaneStride = 0;
 
   return val;
 }
@@ -637,6 +809,7 @@ ScriptValue *ScriptContext::MakeValue(ScriptSpline *spl)
   val->OldValue = 0;
   val->Func = 0;
   val->Spline = spl;
+  val->LaneStride = 0;
 
   return val;
 }
@@ -795,11 +968,11 @@ ScriptFunc *ScriptContext::AddFunc(sPoolString name,const sChar *proto)
 
 /****************************************************************************/
 
-static void Unlink(ScriptValue *sv)
+static void Unlink(ScriptValue *sv,ScriptValue *stop=0)
 {
   ScriptValue *next;
 
-  while(sv)
+  while(sv!=stop)
   {
     next = sv->ScopeLink;
     sVERIFY(sv->Symbol->Value == sv);
@@ -971,6 +1144,48 @@ void ScriptContext::BindLocalColor(ScriptSymbol *sym,sU32 *ptr)
 }
 
 
+ScriptValue *ScriptContext::MakeBatchValue(sInt type,sInt dim,sInt lanes)
+{
+  ScriptValue *val = MakeValue(type,-dim);
+  val->IntPtr = Pool->Alloc<sInt>(dim*lanes);
+  val->LaneStride = dim;
+  for(sInt i=0;i<dim*lanes;i++)
+    val->IntPtr[i] = 0;
+  return val;
+}
+
+void ScriptContext::BindBatchFloat(ScriptSymbol *sym,sInt dim,sF32 *ptr,sInt stride)
+{
+  sVERIFY(stride%sizeof(sF32)==0);
+  ScriptValue *val = MakeFloat(-dim);
+  val->FloatPtr = ptr;
+  val->LaneStride = stride/sizeof(sF32);
+  BindLocal(sym,val);
+}
+
+void ScriptContext::BindBatchInt(ScriptSymbol *sym,sInt dim,sInt *ptr,sInt stride)
+{
+  sVERIFY(stride%sizeof(sInt)==0);
+  ScriptValue *val = MakeInt(-dim);
+  val->IntPtr = ptr;
+  val->LaneStride = stride/sizeof(sInt);
+  BindLocal(sym,val);
+}
+
+void ScriptContext::BeginLane()
+{
+  LaneLocals = Locals;
+  LaneGlobals = *Scope;
+}
+
+void ScriptContext::EndLane()
+{
+  Unlink(Locals,LaneLocals);
+  Locals = LaneLocals;
+  Unlink(*Scope,LaneGlobals);
+  *Scope = LaneGlobals;
+}
+
 /*
 void ScriptContext::UnbindLocalColor(ScriptSymbol *sym,sU32 *ptr)
 {
@@ -999,34 +1214,49 @@ static void *readptr(const sU32 *&ptr)
 }
 
 
-sBool ScriptCode::Exe(ScriptContext *ctx)
-{
-  return ScriptExecute(Code,ctx,ErrorMsg);
-}
+void ScriptDump(const sU32 *code,sTextBuffer &tb);
 
+union ScriptStackValue
+{
+  sS32 i;
+  sF32 f;
+  sU32 c;
+  const sChar *s;
+};
 
-void ScriptDump(const sU32 *code,sTextBuffer &tb);
+static sBool ScriptRun(const sU32 *Code,ScriptContext *ctx,sString<1024> &ErrorMsg,ScriptStackValue *Stack,sInt index,sInt lane);
 
 sBool ScriptExecute(const sU32 *Code,ScriptContext *ctx,sString<1024> &ErrorMsg)
 {
-  union value
-  {
-    sS32 i;
-    sF32 f;
-    sU32 c;
-    const sChar *s;
-  };
+  if(!Code)
+    return 0;
 
-static  value Stack[0x10000];
-  sInt index = 0;
+  // every call gets its own stack, sized by the compiler. this way different
+  // contexts can be executed on different threads at the same time.
+
+  sVERIFY((Code[0]&0xffff)==SC_STACK);
+  sInt size = sMax<sInt>((Code[0]>>16)&0xffff,1);
+  ScriptStackValue *heap = 0;
+  ScriptStackValue *Stack;
+  if(size<=0x400)
+    Stack = sALLOCSTACK(ScriptStackValue,size);
+  else
+    Stack = heap = new ScriptStackValue[size];
 
 #if !sRELEASE
-  sSetMem(Stack,0x11,sizeof(Stack));
+  sSetMem(Stack,0x11,sizeof(ScriptStackValue)*size);
 #endif
- 
-  if(!Code)
-    return 0;
 
+  sBool ok = ScriptRun(Code,ctx,ErrorMsg,Stack,0,0);
+  delete[] heap;
+  return ok;
+}
+
+// runs the code starting at Code with index values already on the stack.
+// lane selects the instance for values bound with a LaneStride.
+
+static sBool ScriptRun(const sU32 *Code,ScriptContext *ctx,sString<1024> &ErrorMsg,ScriptStackValue *Stack,sInt index,sInt lane)
+{
   if(0)                           // debug: disassemble the code before execution
   {
     sTextBuffer tb;
@@ -1267,6 +1497,8 @@ static  value Stack[0x10000];
         return 0;
       }
       return 1;
+    case SC_STACK:
+      break;
 
     case SC_LITERAL|SC_INT:
     case SC_LITERAL|SC_FLOAT:
@@ -1403,12 +1635,12 @@ static  value Stack[0x10000];
         if(type==ScriptTypeString)
         {
           for(sInt i=range0;i<range1;i++)
-            Stack[index++].s = val->StringPtr[i];
+            Stack[index++].s = val->StringPtr[lane*val->LaneStride+i];
         }
         else
         {
           for(sInt i=range0;i<range1;i++)
-            Stack[index++].i = val->IntPtr[i];
+            Stack[index++].i = val->IntPtr[lane*val->LaneStride+i];
         }
       }
       break;
@@ -1430,12 +1662,12 @@ static  value Stack[0x10000];
         if(type==ScriptTypeString)
         {
           for(sInt i=range0;i<range1;i++)
-            Stack[index++].s = val->StringPtr[i];
+            Stack[index++].s = val->StringPtr[lane*val->LaneStride+i];
         }
         else
         {
           for(sInt i=range0;i<range1;i++)
-            Stack[index++].i = val->IntPtr[i];
+            Stack[index++].i = val->IntPtr[lane*val->LaneStride+i];
         }
       }
       break;
@@ -1459,12 +1691,12 @@ static  value Stack[0x10000];
         if(type==ScriptTypeString)
         {
           for(sInt i=range0;i<range1;i++)
-            val->StringPtr[i] = Stack[index+i-range0].s;
+            val->StringPtr[lane*val->LaneStride+i] = Stack[index+i-range0].s;
         }
         else
         {
           for(sInt i=range0;i<range1;i++)
-            val->IntPtr[i] = Stack[index+i-range0].i;
+            val->IntPtr[lane*val->LaneStride+i] = Stack[index+i-range0].i;
         }
       }
       break;
@@ -1487,12 +1719,12 @@ static  value Stack[0x10000];
         if(type==ScriptTypeString)
         {
           for(sInt i=range0;i<range1;i++)
-            val->StringPtr[i] = Stack[index+i-range0].s;
+            val->StringPtr[lane*val->LaneStride+i] = Stack[index+i-range0].s;
         }
         else
         {
           for(sInt i=range0;i<range1;i++)
-            val->IntPtr[i] = Stack[index+i-range0].i;
+            val->IntPtr[lane*val->LaneStride+i] = Stack[index+i-range0].i;
         }
       }
       break;
@@ -1515,12 +1747,12 @@ static  value Stack[0x10000];
         if(type==ScriptTypeString)
         {
           for(sInt i=range0;i<range1;i++)
-            val->StringPtr[i] = L"";
+            val->StringPtr[lane*val->LaneStride+i] = L"";
         }
         else
         {
           for(sInt i=range0;i<range1;i++)
-            val->IntPtr[i] = 0;
+            val->IntPtr[lane*val->LaneStride+i] = 0;
         }
       }
       break;
@@ -1542,12 +1774,12 @@ static  value Stack[0x10000];
         if(type==ScriptTypeString)
         {
           for(sInt i=range0;i<range1;i++)
-            val->StringPtr[i] = L"";
+            val->StringPtr[lane*val->LaneStride+i] = L"";
         }
         else
         {
           for(sInt i=range0;i<range1;i++)
-            val->IntPtr[i] = 0;
+            val->IntPtr[lane*val->LaneStride+i] = 0;
         }
       }
       break;
@@ -1655,278 +1887,1050 @@ static  value Stack[0x10000];
       Stack[index-1].f = sSin(Stack[index-1].f*sPI2F);
       break;
     case SC_COS1|SC_FLOAT:
-      Stack[index-1].f = sCos(Stack[index-1].f*sPI2F);
-      break;
+      Stack[index-1].f = sCos(Stack[index-1].f*sPI2F);
+      break;
+    case SC_TAN|SC_FLOAT:
+      Stack[index-1].f = sTan(Stack[index-1].f);
+      break;
+    case SC_ATAN|SC_FLOAT:
+      Stack[index-1].f = sATan(Stack[index-1].f);
+      break;
+    case SC_ATAN2|SC_FLOAT:
+      index--;
+      Stack[index-1].f = sATan2(Stack[index-1].f,Stack[index].f);
+      break;
+    case SC_SQRT|SC_FLOAT:
+      Stack[index-1].f = sSqrt(Stack[index-1].f);
+      break;
+    case SC_POW|SC_FLOAT:
+      index--;
+      Stack[index-1].f = sPow(Stack[index-1].f,Stack[index].f);
+      break;
+    case SC_EXP|SC_FLOAT:
+      Stack[index-1].f = sExp(Stack[index-1].f);
+      break;
+    case SC_LOG|SC_FLOAT:
+      Stack[index-1].f = sLog(Stack[index-1].f);
+      break;
+    case SC_SMOOTHSTEP|SC_FLOAT:
+      Stack[index-1].f = sSmoothStep(Stack[index-1].f);
+      break;
+    case SC_RAMPUP|SC_FLOAT:
+      Stack[index-1].f = sAbsMod(Stack[index-1].f,1.0f)*2-1;
+      break;
+    case SC_RAMPDOWN|SC_FLOAT:
+      Stack[index-1].f = (1-sAbsMod(Stack[index-1].f,1.0f))*2-1;
+      break;
+    case SC_TRIANGLE|SC_FLOAT:
+      {
+        sF32 f = sAbsMod(Stack[index-1].f+0.25f,1.0f)*2;
+        if(f>1) f=2-f;
+        Stack[index-1].f = f*2-1;
+      }
+      break;
+    case SC_PULSE|SC_FLOAT:
+      index--;
+      Stack[index-1].f = sAbsMod(Stack[index-1].f,1.0f)>Stack[index].f ? 1 : -1;
+      break;
+    case SC_EXPEASE|SC_FLOAT:
+      index--;
+      {
+        sF32 ratio = Stack[index].f;
+        sF32 f = Stack[index-1].f;
+        if(f <= 0.0f)
+          Stack[index-1].f = 0.0f;
+        else if(f >= 1.0f)
+          Stack[index-1].f = 1.0f;
+        else
+          Stack[index-1].f = ExpEase(f * ratio) / ExpEase(ratio);
+      }
+      break;
+    case SC_FADEINOUT|SC_FLOAT:
+      {
+        index-=4;
+        sF32 t = Stack[index+0].f;
+        sF32 ti = Stack[index+1].f;
+        sF32 to = Stack[index+2].f;
+        sF32 s = Stack[index+3].f;
+        sF32 v = 0;
+        sF32 t0 = ti-s;
+        sF32 t1 = ti+s;
+        sF32 t2 = to-s;
+        sF32 t3 = to+s;
+
+        if(t<t0)
+          v = 0;
+        else if(t<t1)
+          v = sSmoothStep((t-t0)/(t1-t0));
+        else if(t<t2)
+          v = 1;
+        else if(t<t3)
+          v = 1-sSmoothStep((t-t2)/(t3-t2));
+        else
+          v = 0;
+
+        Stack[index++].f = v;
+      }
+      break;
+    case SC_NOISE|SC_FLOAT:
+      index--;
+      {
+        // hash time value to get a repeatable "random" value
+        // intentionally use .c even though input is float!
+        sU32 hash = sChecksumMurMur(&Stack[index+0].c,1);
+        static const sU32 mask = 0xffffff; // 24 bits is enough for float
+        sF32 v = 2.0f * sInt(hash & mask) / sF32(mask) - 1.0f;
+        
+        Stack[index++].f = v;
+      }
+      break;
+    case SC_PERLINNOISE|SC_FLOAT:
+      index-=2;
+      {
+        sInt time = sInt(Stack[index+0].f * 65536.0f);
+        sInt curve = sInt(Stack[index+1].f * 65536.0f);
+        sF32 v = sPerlin2D(time,curve);
+        Stack[index++].f = v;
+      }
+      break;
+
+    case SC_CLAMP|SC_FLOAT:
+      {
+        index-=2;
+        sF32 min = Stack[index].f;
+        sF32 max = Stack[index+1].f;
+        for(sInt i=0;i<count;i++)
+          Stack[index-count+i].f = sClamp(Stack[index-count+i].f,min,max);
+      }
+      break;
+    case SC_LENGTH|SC_FLOAT:
+      {
+        index -=count;
+        sF32 accu=0;
+        for(sInt i=0;i<count;i++)
+          accu += Stack[index+i].f*Stack[index+i].f;
+        Stack[index++].f = sSqrt(accu);
+      }
+      break;
+    case SC_NORMALIZE|SC_FLOAT:
+      {
+        sF32 accu=0;
+        for(sInt i=0;i<count;i++)
+          accu += Stack[index-count+i].f*Stack[index-count+i].f;
+        if(accu<1e-20)
+        {
+          Stack[index-count].f = 1;
+          for(sInt i=1;i<count;i++)
+            Stack[index-count+i].f = 0;
+        }
+        else
+        {
+          accu = sRSqrt(accu);
+          for(sInt i=0;i<count;i++)
+            Stack[index-count+i].f *= accu;
+        }
+      }
+      break;
+    case SC_MAP|SC_FLOAT:
+      {
+        index-=2;
+        sF32 min = Stack[index].f;
+        sF32 max = Stack[index+1].f;
+        for(sInt i=0;i<count;i++)
+        {
+          sF32 f = Stack[index-count+i].f*0.5+0.5;
+          f = sClamp<sF32>(f,0,1);
+          Stack[index-count+i].f = min + f*(max-min);
+        }
+      }
+      break;
+
+
+    case SC_ADD|SC_STRING:
+      for(sInt i=0;i<count;i++)
+      {
+        sPoolString p;
+        p.Add(Stack[index-count*2+i].s,Stack[index-count+i].s);
+        Stack[index-count*2+i].s = p;
+      }
+      index-=count;
+      break;
+
+    case SC_PRINT|SC_INT:
+      {
+        sTextBuffer tb;
+        const sChar *p = Stack[index-count-2].s;
+        const sChar *fmt = Stack[index-1].s;
+        if (fmt==0||fmt[0]==0)
+          fmt=L"%d";
+        tb.Print(p);
+        tb.PrintF(fmt,Stack[index-count-1].i);
+        for(sInt i=1;i<count;i++)
+        {
+          tb.Print(L" ");
+          tb.PrintF(fmt,Stack[index-count-1+i].i);
+        }
+        Stack[index-count-2].s = sPoolString(tb.Get());
+        index-=count+1;
+      }
+      break;
+
+    case SC_PRINT|SC_FLOAT:
+      {
+        sTextBuffer tb;
+        const sChar *p = Stack[index-count-2].s;
+        const sChar *fmt = Stack[index-1].s;
+        if (fmt==0||fmt[0]==0)
+          fmt=L"%f";
+        tb.Print(p);
+        tb.PrintF(fmt,Stack[index-count-1].f);
+        for(sInt i=1;i<count;i++)
+        {
+          tb.Print(L" ");
+          tb.PrintF(fmt,Stack[index-count-1+i].f);
+        }
+        Stack[index-count-2].s = sPoolString(tb.Get());
+        index-=count+1;
+      }
+      break;
+
+    case SC_PRINT|SC_STRING:
+      {
+        sTextBuffer tb;
+        const sChar *p = Stack[index-count-2].s;
+        const sChar *fmt = Stack[index-1].s;
+        if (fmt==0||fmt[0]==0)
+          fmt=L"%s";
+        tb.Print(p);
+        tb.PrintF(fmt,Stack[index-count-1].s);
+        for(sInt i=1;i<count;i++)
+        {
+          tb.Print(L" ");
+          tb.PrintF(fmt,Stack[index-count-1+i].s);
+        }
+        Stack[index-count-2].s = sPoolString(tb.Get());
+        index-=count+1;
+      }
+      break;
+
+    case SC_PRINT|SC_COLOR:
+      {
+        sTextBuffer tb;
+        const sChar *p = Stack[index-count-2].s;
+        const sChar *fmt = Stack[index-1].s;
+        if (fmt==0||fmt[0]==0)
+          fmt=L"%08x";
+        tb.Print(p);
+        tb.PrintF(fmt,Stack[index-count-1].c);
+        for(sInt i=1;i<count;i++)
+        {
+          tb.Print(L" ");
+          tb.PrintF(fmt,Stack[index-count-1+i].c);
+        }
+        Stack[index-count-2].s = sPoolString(tb.Get());
+        index-=count+1;
+      }
+      break;
+
+    case SC_FTOC|SC_COLOR:
+      {
+        sVector4 c(Stack[index-4].f,Stack[index-3].f,Stack[index-2].f,Stack[index-1].f);
+        index -= 3;
+        Stack[index-1].c = c.GetColor();
+      }
+      break;
+    case SC_CTOF|SC_FLOAT:
+      {
+        sVector4  c;
+        c.InitColor(Stack[index-1].c);
+        index += 3;
+        Stack[index-4].f = c.x;
+        Stack[index-3].f = c.y;
+        Stack[index-2].f = c.z;
+        Stack[index-1].f = c.w;
+      }
+      break;
+
+
+    default:
+      sFatal(L"unknown opcode");
+    }
+  }
+}
+
+
+
+
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Batch Execution                                                    ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// the batch vm runs the code for many lanes (instances) in lockstep. every
+// stack slot holds one value per lane, so the instructions are decoded only
+// once and the float arithmetic works on whole vectors. when the lanes take
+// different branches, or on instructions not supported here (strings,
+// imports), every lane continues on its own in the scalar vm.
+
+union ScriptBatchValue
+{
+  sS32 i;
+  sF32 f;
+  sU32 c;
+};
+
+// a = a op b for all lanes. the int operations stop at the last lane, the
+// float operations process the padding of the slot too.
+
+static void BatchInt(sInt op,ScriptBatchValue *a,const ScriptBatchValue *b,sInt lanes)
+{
+  switch(op)
+  {
+  case SC_ADD:    for(sInt l=0;l<lanes;l++) a[l].i = a[l].i + b[l].i; break;
+  case SC_SUB:    for(sInt l=0;l<lanes;l++) a[l].i = a[l].i - b[l].i; break;
+  case SC_MUL:    for(sInt l=0;l<lanes;l++) a[l].i = a[l].i * b[l].i; break;
+  case SC_DIV:    for(sInt l=0;l<lanes;l++) a[l].i = a[l].i / b[l].i; break;
+  case SC_MOD:    for(sInt l=0;l<lanes;l++) a[l].i = a[l].i % b[l].i; break;
+  case SC_SHIFTL: for(sInt l=0;l<lanes;l++) a[l].i = a[l].i << b[l].i; break;
+  case SC_SHIFTR: for(sInt l=0;l<lanes;l++) a[l].i = a[l].i >> b[l].i; break;
+  case SC_ROLL:   for(sInt l=0;l<lanes;l++) a[l].i = (a[l].i << b[l].i) | (a[l].i >> (32-b[l].i)); break;
+  case SC_ROLR:   for(sInt l=0;l<lanes;l++) a[l].i = (a[l].i >> b[l].i) | (a[l].i << (32-b[l].i)); break;
+  case SC_LOGAND: for(sInt l=0;l<lanes;l++) a[l].i = a[l].i && b[l].i; break;
+  case SC_LOGOR:  for(sInt l=0;l<lanes;l++) a[l].i = a[l].i || b[l].i; break;
+  case SC_BINAND: for(sInt l=0;l<lanes;l++) a[l].i = a[l].i & b[l].i; break;
+  case SC_BINOR:  for(sInt l=0;l<lanes;l++) a[l].i = a[l].i | b[l].i; break;
+  case SC_BINXOR: for(sInt l=0;l<lanes;l++) a[l].i = a[l].i ^ b[l].i; break;
+  case SC_EQ:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].i == b[l].i; break;
+  case SC_NE:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].i != b[l].i; break;
+  case SC_GT:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].i > b[l].i; break;
+  case SC_GE:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].i >= b[l].i; break;
+  case SC_LT:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].i < b[l].i; break;
+  case SC_LE:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].i <= b[l].i; break;
+  default:        sFatal(L"unknown batch opcode");
+  }
+}
+
+static void BatchCompare(sInt op,ScriptBatchValue *a,const ScriptBatchValue *b,sInt lanes)
+{
+  switch(op)
+  {
+  case SC_EQ:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].f == b[l].f; break;
+  case SC_NE:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].f != b[l].f; break;
+  case SC_GT:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].f > b[l].f; break;
+  case SC_GE:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].f >= b[l].f; break;
+  case SC_LT:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].f < b[l].f; break;
+  case SC_LE:     for(sInt l=0;l<lanes;l++) a[l].i = a[l].f <= b[l].f; break;
+  default:        sFatal(L"unknown batch opcode");
+  }
+}
+
+static void BatchFloat(sInt op,ScriptBatchValue *a,const ScriptBatchValue *b,sInt stride)
+{
+#if sSIMD_INTRINSICS
+  sF32 *af = &a[0].f;
+  const sF32 *bf = &b[0].f;
+  switch(op)
+  {
+  case SC_ADD:
+    for(sInt l=0;l<stride;l+=4)
+      sVecStore(sVecAdd(sVecLoad(af+l),sVecLoad(bf+l)),af+l);
+    return;
+  case SC_SUB:
+    for(sInt l=0;l<stride;l+=4)
+      sVecStore(sVecSub(sVecLoad(af+l),sVecLoad(bf+l)),af+l);
+    return;
+  case SC_MUL:
+    for(sInt l=0;l<stride;l+=4)
+      sVecStore(sVecMul(sVecLoad(af+l),sVecLoad(bf+l)),af+l);
+    return;
+  case SC_MAX:
+    for(sInt l=0;l<stride;l+=4)
+      sVecStore(sVecMax(sVecLoad(af+l),sVecLoad(bf+l)),af+l);
+    return;
+  case SC_MIN:
+    for(sInt l=0;l<stride;l+=4)
+      sVecStore(sVecMin(sVecLoad(af+l),sVecLoad(bf+l)),af+l);
+    return;
+  }
+#endif
+  switch(op)
+  {
+  case SC_ADD:    for(sInt l=0;l<stride;l++) a[l].f = a[l].f + b[l].f; break;
+  case SC_SUB:    for(sInt l=0;l<stride;l++) a[l].f = a[l].f - b[l].f; break;
+  case SC_MUL:    for(sInt l=0;l<stride;l++) a[l].f = a[l].f * b[l].f; break;
+  case SC_DIV:    for(sInt l=0;l<stride;l++) a[l].f = a[l].f / b[l].f; break;
+  case SC_MOD:    for(sInt l=0;l<stride;l++) a[l].f = sMod(a[l].f,b[l].f); break;
+  case SC_MAX:    for(sInt l=0;l<stride;l++) a[l].f = sMax(a[l].f,b[l].f); break;
+  case SC_MIN:    for(sInt l=0;l<stride;l++) a[l].f = sMin(a[l].f,b[l].f); break;
+  case SC_ATAN2:  for(sInt l=0;l<stride;l++) a[l].f = sATan2(a[l].f,b[l].f); break;
+  case SC_POW:    for(sInt l=0;l<stride;l++) a[l].f = sPow(a[l].f,b[l].f); break;
+  case SC_PULSE:  for(sInt l=0;l<stride;l++) a[l].f = sAbsMod(a[l].f,1.0f)>b[l].f ? 1 : -1; break;
+  case SC_EXPEASE:
+    for(sInt l=0;l<stride;l++)
+    {
+      sF32 f = a[l].f;
+      if(f <= 0.0f)
+        a[l].f = 0.0f;
+      else if(f >= 1.0f)
+        a[l].f = 1.0f;
+      else
+        a[l].f = ExpEase(f * b[l].f) / ExpEase(b[l].f);
+    }
+    break;
+  default:        sFatal(L"unknown batch opcode");
+  }
+}
+
+static void BatchFunc(sInt op,ScriptBatchValue *a,sInt stride)
+{
+  switch(op)
+  {
+  case SC_ABS:        for(sInt l=0;l<stride;l++) a[l].f = sAbs(a[l].f); break;
+  case SC_SIGN:       for(sInt l=0;l<stride;l++) a[l].f = sSign(a[l].f); break;
+  case SC_SIN:        for(sInt l=0;l<stride;l++) a[l].f = sSin(a[l].f); break;
+  case SC_COS:        for(sInt l=0;l<stride;l++) a[l].f = sCos(a[l].f); break;
+  case SC_SIN1:       for(sInt l=0;l<stride;l++) a[l].f = sSin(a[l].f*sPI2F); break;
+  case SC_COS1:       for(sInt l=0;l<stride;l++) a[l].f = sCos(a[l].f*sPI2F); break;
+  case SC_TAN:        for(sInt l=0;l<stride;l++) a[l].f = sTan(a[l].f); break;
+  case SC_ATAN:       for(sInt l=0;l<stride;l++) a[l].f = sATan(a[l].f); break;
+  case SC_SQRT:       for(sInt l=0;l<stride;l++) a[l].f = sSqrt(a[l].f); break;
+  case SC_EXP:        for(sInt l=0;l<stride;l++) a[l].f = sExp(a[l].f); break;
+  case SC_LOG:        for(sInt l=0;l<stride;l++) a[l].f = sLog(a[l].f); break;
+  case SC_SMOOTHSTEP: for(sInt l=0;l<stride;l++) a[l].f = sSmoothStep(a[l].f); break;
+  case SC_RAMPUP:     for(sInt l=0;l<stride;l++) a[l].f = sAbsMod(a[l].f,1.0f)*2-1; break;
+  case SC_RAMPDOWN:   for(sInt l=0;l<stride;l++) a[l].f = (1-sAbsMod(a[l].f,1.0f))*2-1; break;
+  case SC_TRIANGLE:
+    for(sInt l=0;l<stride;l++)
+    {
+      sF32 f = sAbsMod(a[l].f+0.25f,1.0f)*2;
+      if(f>1) f=2-f;
+      a[l].f = f*2-1;
+    }
+    break;
+  default:            sFatal(L"unknown batch opcode");
+  }
+}
+
+// continue every lane on its own in the scalar vm, starting with the
+// instruction at Code.
+
+static sBool ScriptRunLanes(const sU32 *Code,ScriptContext *ctx,sString<1024> &ErrorMsg,ScriptBatchValue *Stack,sInt stride,sInt lanes,ScriptStackValue *Scalar,sInt index)
+{
+  for(sInt l=0;l<lanes;l++)
+  {
+    for(sInt i=0;i<index;i++)
+      Scalar[i].i = Stack[i*stride+l].i;
+    ctx->BeginLane();
+    sBool ok = ScriptRun(Code,ctx,ErrorMsg,Scalar,index,l);
+    ctx->EndLane();
+    if(!ok)
+      return 0;
+  }
+  return 1;
+}
+
+static sBool ScriptRunBatch(const sU32 *Code,ScriptContext *ctx,sString<1024> &ErrorMsg,ScriptBatchValue *Stack,sInt stride,sInt lanes,ScriptStackValue *Scalar)
+{
+  sInt index = 0;
+  const sU32 *ptr = Code;
+
+  sInt timeout = 0x10000;
+  for(;;)
+  {
+    timeout--;
+    if(timeout<=0)
+    {
+      ErrorMsg.PrintF(L"endless loop (or at least a very long one)");
+      return 0;
+    }
+
+    const sU32 *start = ptr;
+    sU32 cmd = *ptr++;
+    sInt count = (cmd>>16)&0xffff;
+    sInt type = (cmd>>8)&0xff;
+    switch(cmd&0xffff)
+    {
+    case SC_ADD|SC_INT:
+    case SC_SUB|SC_INT:
+    case SC_MUL|SC_INT:
+    case SC_DIV|SC_INT:
+    case SC_MOD|SC_INT:
+    case SC_SHIFTL|SC_INT:
+    case SC_SHIFTR|SC_INT:
+    case SC_ROLL|SC_INT:
+    case SC_ROLR|SC_INT:
+    case SC_LOGAND|SC_INT:
+    case SC_LOGOR|SC_INT:
+    case SC_BINAND|SC_INT:
+    case SC_BINOR|SC_INT:
+    case SC_BINXOR|SC_INT:
+    case SC_EQ|SC_INT:
+    case SC_NE|SC_INT:
+    case SC_GT|SC_INT:
+    case SC_GE|SC_INT:
+    case SC_LT|SC_INT:
+    case SC_LE|SC_INT:
+      for(sInt i=0;i<count;i++)
+        BatchInt(cmd&0xff,Stack+(index-count*2+i)*stride,Stack+(index-count+i)*stride,lanes);
+      index-=count;
+      break;
+
+    case SC_ADD|SC_FLOAT:
+    case SC_SUB|SC_FLOAT:
+    case SC_MUL|SC_FLOAT:
+    case SC_DIV|SC_FLOAT:
+    case SC_MOD|SC_FLOAT:
+    case SC_MAX|SC_FLOAT:
+    case SC_MIN|SC_FLOAT:
+    case SC_ATAN2|SC_FLOAT:
+    case SC_POW|SC_FLOAT:
+    case SC_PULSE|SC_FLOAT:
+    case SC_EXPEASE|SC_FLOAT:
+      for(sInt i=0;i<count;i++)
+        BatchFloat(cmd&0xff,Stack+(index-count*2+i)*stride,Stack+(index-count+i)*stride,stride);
+      index-=count;
+      break;
+
+    case SC_EQ|SC_FLOAT:
+    case SC_NE|SC_FLOAT:
+    case SC_GT|SC_FLOAT:
+    case SC_GE|SC_FLOAT:
+    case SC_LT|SC_FLOAT:
+    case SC_LE|SC_FLOAT:
+      sVERIFY(count==1);
+      BatchCompare(cmd&0xff,Stack+(index-2)*stride,Stack+(index-1)*stride,lanes);
+      index--;
+      break;
+
+    case SC_DOT|SC_FLOAT:
+      {
+        ScriptBatchValue *a = Stack+(index-count*2)*stride;
+        ScriptBatchValue *b = Stack+(index-count)*stride;
+        for(sInt i=0;i<count;i++)
+          BatchFloat(SC_MUL,a+i*stride,b+i*stride,stride);
+        for(sInt i=1;i<count;i++)
+          BatchFloat(SC_ADD,a,a+i*stride,stride);
+        index-=count*2;
+        index++;
+      }
+      break;
+    case SC_NEG|SC_INT:
+      for(sInt i=0;i<count;i++)
+      {
+        ScriptBatchValue *a = Stack+(index-count+i)*stride;
+        for(sInt l=0;l<lanes;l++)
+          a[l].i = -a[l].i;
+      }
+      break;
+    case SC_NEG|SC_FLOAT:
+      for(sInt i=0;i<count;i++)
+      {
+        ScriptBatchValue *a = Stack+(index-count+i)*stride;
+        for(sInt l=0;l<stride;l++)
+          a[l].f = -a[l].f;
+      }
+      break;
+    case SC_FTOI|SC_INT:
+      for(sInt i=0;i<count;i++)
+      {
+        ScriptBatchValue *a = Stack+(index-count+i)*stride;
+        for(sInt l=0;l<lanes;l++)
+          a[l].i = sInt(a[l].f);
+      }
+      break;
+    case SC_ITOF|SC_FLOAT:
+      for(sInt i=0;i<count;i++)
+      {
+        ScriptBatchValue *a = Stack+(index-count+i)*stride;
+        for(sInt l=0;l<stride;l++)
+          a[l].f = sF32(a[l].i);
+      }
+      break;
+
+    case SC_NOT|SC_INT:
+      {
+        sVERIFY(count==1);
+        ScriptBatchValue *a = Stack+(index-1)*stride;
+        for(sInt l=0;l<lanes;l++)
+          a[l].i = !a[l].i;
+      }
+      break;
+    case SC_NOTNOT|SC_INT:
+      {
+        sVERIFY(count==1);
+        ScriptBatchValue *a = Stack+(index-1)*stride;
+        for(sInt l=0;l<lanes;l++)
+          a[l].i = !!a[l].i;
+      }
+      break;
+
+    case SC_B:
+      ptr += sS16((cmd>>16)&0xffff);
+      break;
+    case SC_BT:
+    case SC_BF:
+      {
+        ScriptBatchValue *c = Stack+(index-1)*stride;
+        sInt n = 0;
+        for(sInt l=0;l<lanes;l++)
+          if(c[l].i)
+            n++;
+        if(n!=0 && n!=lanes)      // lanes diverge
+          return ScriptRunLanes(start,ctx,ErrorMsg,Stack,stride,lanes,Scalar,index);
+        index--;
+        if((n!=0) == ((cmd&0xffff)==SC_BT))
+          ptr += sS16((cmd>>16)&0xffff);
+      }
+      break;
+    case SC_STOP:
+      if(index!=0)
+      {
+        ErrorMsg.PrintF(L"stack error");
+        return 0;
+      }
+      return 1;
+    case SC_STACK:
+      break;
+
+    case SC_LITERAL|SC_INT:
+    case SC_LITERAL|SC_FLOAT:
+    case SC_LITERAL|SC_COLOR:
+      for(sInt i=0;i<count;i++)
+      {
+        ScriptBatchValue *a = Stack+(index++)*stride;
+        sU32 v = *ptr++;
+        for(sInt l=0;l<stride;l++)
+          a[l].c = v;
+      }
+      break;
+
+    case SC_MAKELOCAL|SC_INT:
+    case SC_MAKELOCAL|SC_FLOAT:
+    case SC_MAKELOCAL|SC_COLOR:
+      {
+        ScriptSymbol *sym = (ScriptSymbol *) readptr(ptr);
+        ScriptValue *val = ctx->MakeBatchValue(type,count,lanes);
+        ctx->BindLocal(sym,val);
+      }
+      break;
+
+    case SC_MAKEGLOBAL|SC_INT:
+    case SC_MAKEGLOBAL|SC_FLOAT:
+    case SC_MAKEGLOBAL|SC_COLOR:
+      {
+        ScriptSymbol *sym = (ScriptSymbol *) readptr(ptr);
+        ScriptValue *val = ctx->MakeBatchValue(type,count,lanes);
+        ctx->BindGlobal(sym,val);
+      }
+      break;
+
+    case SC_GETVARR|SC_INT:
+    case SC_GETVARR|SC_FLOAT:
+    case SC_GETVARR|SC_COLOR:
+    case SC_GETVAR|SC_INT:
+    case SC_GETVAR|SC_FLOAT:
+    case SC_GETVAR|SC_COLOR:
+      {
+        sInt range0 = 0;
+        sInt range1 = count;
+        if((cmd&0xff)==SC_GETVARR)
+        {
+          sU32 cmd2 = *ptr++;
+          range0 = cmd2&0xffff;
+          range1 = cmd2>>16;
+        }
+        ScriptSymbol *sym = (ScriptSymbol *) readptr(ptr);
+        ScriptValue *val = sym->Value;
+        if(val==0 || (range1-range0)!=count || val->Type!=type || range1>val->Count)
+        {
+          ErrorMsg.PrintF(L"type error");
+          return 0;
+        }
+        for(sInt i=range0;i<range1;i++)
+        {
+          ScriptBatchValue *a = Stack+(index++)*stride;
+          const sInt *p = val->IntPtr+i;
+          if(val->LaneStride==0)
+            for(sInt l=0;l<stride;l++)
+              a[l].i = *p;
+          else
+            for(sInt l=0;l<lanes;l++)
+              a[l].i = p[l*val->LaneStride];
+        }
+      }
+      break;
+
+    case SC_SETVARR|SC_INT:
+    case SC_SETVARR|SC_FLOAT:
+    case SC_SETVARR|SC_COLOR:
+    case SC_SETVAR|SC_INT:
+    case SC_SETVAR|SC_FLOAT:
+    case SC_SETVAR|SC_COLOR:
+      {
+        sInt range0 = 0;
+        sInt range1 = count;
+        if((cmd&0xff)==SC_SETVARR)
+        {
+          sU32 cmd2 = *ptr++;
+          range0 = cmd2&0xffff;
+          range1 = cmd2>>16;
+        }
+        ScriptSymbol *sym = (ScriptSymbol *) readptr(ptr);
+        ScriptValue *val = sym->Value;
+        if(val==0 || (range1-range0)!=count || val->Type!=type || range1>val->Count)
+        {
+          ErrorMsg.PrintF(L"type error");
+          return 0;
+        }
+        index -= (range1-range0);
+        for(sInt i=range0;i<range1;i++)
+        {
+          ScriptBatchValue *a = Stack+(index+i-range0)*stride;
+          sInt *p = val->IntPtr+i;
+          if(val->LaneStride==0)    // shared by all lanes: the last one wins
+            *p = a[lanes-1].i;
+          else
+            for(sInt l=0;l<lanes;l++)
+              p[l*val->LaneStride] = a[l].i;
+        }
+      }
+      break;
+
+    case SC_CLEARVARR|SC_INT:
+    case SC_CLEARVARR|SC_FLOAT:
+    case SC_CLEARVARR|SC_COLOR:
+    case SC_CLEARVAR|SC_INT:
+    case SC_CLEARVAR|SC_FLOAT:
+    case SC_CLEARVAR|SC_COLOR:
+      {
+        sInt range0 = 0;
+        sInt range1 = count;
+        if((cmd&0xff)==SC_CLEARVARR)
+        {
+          sU32 cmd2 = *ptr++;
+          range0 = cmd2&0xffff;
+          range1 = cmd2>>16;
+        }
+        ScriptSymbol *sym = (ScriptSymbol *) readptr(ptr);
+        ScriptValue *val = sym->Value;
+        if(val==0 || (range1-range0)!=count || val->Type!=type || range1>val->Count)
+        {
+          ErrorMsg.PrintF(L"type error");
+          return 0;
+        }
+        for(sInt i=range0;i<range1;i++)
+        {
+          sInt *p = val->IntPtr+i;
+          if(val->LaneStride==0)
+            *p = 0;
+          else
+            for(sInt l=0;l<lanes;l++)
+              p[l*val->LaneStride] = 0;
+        }
+      }
+      break;
+
+    case SC_SPLINE|SC_FLOAT:
+      {
+        ScriptSymbol *sym = (ScriptSymbol *) readptr(ptr);
+        ScriptValue *val = sym->Value;
+        if(val==0 || val->Spline==0 || val->Count!=count || val->Type!=2)
+        {
+          ErrorMsg.PrintF(L"type error (spline)");
+          return 0;
+        }
+        index--;
+        ScriptBatchValue *a = Stack+index*stride;
+        sF32 result[8];
+        sVERIFY(count<=8);
+        ScriptSplineCursor cursor;  // lanes tend to sample nearby times
+        for(sInt l=0;l<lanes;l++)
+        {
+          val->Spline->Eval(a[l].f,result,count,&cursor);
+          for(sInt i=0;i<count;i++)
+            a[i*stride+l].f = result[i];
+        }
+        index += count;
+      }
+      break;
+
+    case SC_CAT|SC_INT:
+    case SC_CAT|SC_FLOAT:
+    case SC_CAT|SC_COLOR:
+      break;
+
+    case SC_INDEX|SC_INT:
+    case SC_INDEX|SC_FLOAT:
+    case SC_INDEX|SC_COLOR:
+      {
+        index--;
+        ScriptBatchValue *n = Stack+index*stride;
+        index -= count;
+        ScriptBatchValue *a = Stack+index*stride;
+        for(sInt l=0;l<lanes;l++)
+        {
+          if(n[l].i<0 || n[l].i>=count)
+          {
+            ErrorMsg.PrintF(L"array out of bounds");
+            return 0;
+          }
+          a[l] = a[n[l].i*stride+l];
+        }
+        index++;
+      }
+      break;
+
+    case SC_SPLICE|SC_INT:
+    case SC_SPLICE|SC_FLOAT:
+    case SC_SPLICE|SC_COLOR:
+      {
+        sU32 cmd2 = *ptr++;
+        sInt range0 = cmd2&0xffff;
+        sInt range1 = cmd2>>16;
+        index -= count;
+        sInt old = index;
+        for(sInt i=range0;i<range1;i++)
+        {
+          ScriptBatchValue *a = Stack+(index++)*stride;
+          ScriptBatchValue *b = Stack+(old+i)*stride;
+          if(a!=b)
+            for(sInt l=0;l<stride;l++)
+              a[l] = b[l];
+        }
+      }
+      break;
+
+    case SC_DUP|SC_INT:
+    case SC_DUP|SC_FLOAT:
+    case SC_DUP|SC_COLOR:
+      {
+        ScriptBatchValue *b = Stack+(index-1)*stride;
+        for(sInt i=1;i<count;i++)
+        {
+          ScriptBatchValue *a = Stack+(index+i-1)*stride;
+          for(sInt l=0;l<stride;l++)
+            a[l] = b[l];
+        }
+        index += count-1;
+      }
+      break;
+
+    case SC_COND:     // c ? a : b, chosen per lane
+      {
+        index--;
+        ScriptBatchValue *c = Stack+index*stride;
+        index -= count*2;
+        for(sInt i=0;i<count;i++)
+        {
+          ScriptBatchValue *a = Stack+(index+i)*stride;
+          ScriptBatchValue *b = Stack+(index+i+count)*stride;
+          for(sInt l=0;l<lanes;l++)
+            if(c[l].i==0)
+              a[l] = b[l];
+        }
+        index+=count;
+      }
+      break;
+
+    case SC_ABS|SC_FLOAT:
+    case SC_SIGN|SC_FLOAT:
+    case SC_SIN|SC_FLOAT:
+    case SC_COS|SC_FLOAT:
+    case SC_SIN1|SC_FLOAT:
+    case SC_COS1|SC_FLOAT:
     case SC_TAN|SC_FLOAT:
-      Stack[index-1].f = sTan(Stack[index-1].f);
-      break;
     case SC_ATAN|SC_FLOAT:
-      Stack[index-1].f = sATan(Stack[index-1].f);
-      break;
-    case SC_ATAN2|SC_FLOAT:
-      index--;
-      Stack[index-1].f = sATan2(Stack[index-1].f,Stack[index].f);
-      break;
     case SC_SQRT|SC_FLOAT:
-      Stack[index-1].f = sSqrt(Stack[index-1].f);
-      break;
-    case SC_POW|SC_FLOAT:
-      index--;
-      Stack[index-1].f = sPow(Stack[index-1].f,Stack[index].f);
-      break;
     case SC_EXP|SC_FLOAT:
-      Stack[index-1].f = sExp(Stack[index-1].f);
-      break;
     case SC_LOG|SC_FLOAT:
-      Stack[index-1].f = sLog(Stack[index-1].f);
-      break;
     case SC_SMOOTHSTEP|SC_FLOAT:
-      Stack[index-1].f = sSmoothStep(Stack[index-1].f);
-      break;
     case SC_RAMPUP|SC_FLOAT:
-      Stack[index-1].f = sAbsMod(Stack[index-1].f,1.0f)*2-1;
-      break;
     case SC_RAMPDOWN|SC_FLOAT:
-      Stack[index-1].f = (1-sAbsMod(Stack[index-1].f,1.0f))*2-1;
-      break;
     case SC_TRIANGLE|SC_FLOAT:
-      {
-        sF32 f = sAbsMod(Stack[index-1].f+0.25f,1.0f)*2;
-        if(f>1) f=2-f;
-        Stack[index-1].f = f*2-1;
-      }
-      break;
-    case SC_PULSE|SC_FLOAT:
-      index--;
-      Stack[index-1].f = sAbsMod(Stack[index-1].f,1.0f)>Stack[index].f ? 1 : -1;
-      break;
-    case SC_EXPEASE|SC_FLOAT:
-      index--;
-      {
-        sF32 ratio = Stack[index].f;
-        sF32 f = Stack[index-1].f;
-        if(f <= 0.0f)
-          Stack[index-1].f = 0.0f;
-        else if(f >= 1.0f)
-          Stack[index-1].f = 1.0f;
-        else
-          Stack[index-1].f = ExpEase(f * ratio) / ExpEase(ratio);
-      }
+      BatchFunc(cmd&0xff,Stack+(index-1)*stride,stride);
       break;
+
     case SC_FADEINOUT|SC_FLOAT:
       {
         index-=4;
-        sF32 t = Stack[index+0].f;
-        sF32 ti = Stack[index+1].f;
-        sF32 to = Stack[index+2].f;
-        sF32 s = Stack[index+3].f;
-        sF32 v = 0;
-        sF32 t0 = ti-s;
-        sF32 t1 = ti+s;
-        sF32 t2 = to-s;
-        sF32 t3 = to+s;
-
-        if(t<t0)
-          v = 0;
-        else if(t<t1)
-          v = sSmoothStep((t-t0)/(t1-t0));
-        else if(t<t2)
-          v = 1;
-        else if(t<t3)
-          v = 1-sSmoothStep((t-t2)/(t3-t2));
-        else
-          v = 0;
+        ScriptBatchValue *a = Stack+index*stride;
+        for(sInt l=0;l<lanes;l++)
+        {
+          sF32 t = a[l].f;
+          sF32 ti = a[l+stride].f;
+          sF32 to = a[l+stride*2].f;
+          sF32 s = a[l+stride*3].f;
+          sF32 v = 0;
+          sF32 t0 = ti-s;
+          sF32 t1 = ti+s;
+          sF32 t2 = to-s;
+          sF32 t3 = to+s;
+
+          if(t<t0)
+            v = 0;
+          else if(t<t1)
+            v = sSmoothStep((t-t0)/(t1-t0));
+          else if(t<t2)
+            v = 1;
+          else if(t<t3)
+            v = 1-sSmoothStep((t-t2)/(t3-t2));
+          else
+            v = 0;
 
-        Stack[index++].f = v;
+          a[l].f = v;
+        }
+        index++;
       }
       break;
     case SC_NOISE|SC_FLOAT:
-      index--;
       {
-        // hash time value to get a repeatable "random" value
-        // intentionally use .c even though input is float!
-        sU32 hash = sChecksumMurMur(&Stack[index+0].c,1);
-        static const sU32 mask = 0xffffff; // 24 bits is enough for float
-        sF32 v = 2.0f * sInt(hash & mask) / sF32(mask) - 1.0f;
-        
-        Stack[index++].f = v;
+        ScriptBatchValue *a = Stack+(index-1)*stride;
+        static const sU32 mask = 0xffffff;
+        for(sInt l=0;l<lanes;l++)
+        {
+          sU32 hash = sChecksumMurMur(&a[l].c,1);
+          a[l].f = 2.0f * sInt(hash & mask) / sF32(mask) - 1.0f;
+        }
       }
       break;
     case SC_PERLINNOISE|SC_FLOAT:
-      index-=2;
       {
-        sInt time = sInt(Stack[index+0].f * 65536.0f);
-        sInt curve = sInt(Stack[index+1].f * 65536.0f);
-        sF32 v = sPerlin2D(time,curve);
-        Stack[index++].f = v;
+        index-=2;
+        ScriptBatchValue *a = Stack+index*stride;
+        for(sInt l=0;l<lanes;l++)
+        {
+          sInt time = sInt(a[l].f * 65536.0f);
+          sInt curve = sInt(a[l+stride].f * 65536.0f);
+          a[l].f = sPerlin2D(time,curve);
+        }
+        index++;
       }
       break;
 
     case SC_CLAMP|SC_FLOAT:
       {
         index-=2;
-        sF32 min = Stack[index].f;
-        sF32 max = Stack[index+1].f;
+        ScriptBatchValue *min = Stack+index*stride;
+        ScriptBatchValue *max = Stack+(index+1)*stride;
         for(sInt i=0;i<count;i++)
-          Stack[index-count+i].f = sClamp(Stack[index-count+i].f,min,max);
+        {
+          ScriptBatchValue *a = Stack+(index-count+i)*stride;
+          for(sInt l=0;l<lanes;l++)
+            a[l].f = sClamp(a[l].f,min[l].f,max[l].f);
+        }
       }
       break;
     case SC_LENGTH|SC_FLOAT:
       {
-        index -=count;
-        sF32 accu=0;
+        index -= count;
+        ScriptBatchValue *a = Stack+index*stride;
         for(sInt i=0;i<count;i++)
-          accu += Stack[index+i].f*Stack[index+i].f;
-        Stack[index++].f = sSqrt(accu);
+          BatchFloat(SC_MUL,a+i*stride,a+i*stride,stride);
+        for(sInt i=1;i<count;i++)
+          BatchFloat(SC_ADD,a,a+i*stride,stride);
+        BatchFunc(SC_SQRT,a,stride);
+        index++;
       }
       break;
     case SC_NORMALIZE|SC_FLOAT:
       {
-        sF32 accu=0;
-        for(sInt i=0;i<count;i++)
-          accu += Stack[index-count+i].f*Stack[index-count+i].f;
-        if(accu<1e-20)
-        {
-          Stack[index-count].f = 1;
-          for(sInt i=1;i<count;i++)
-            Stack[index-count+i].f = 0;
-        }
-        else
+        ScriptBatchValue *a = Stack+(index-count)*stride;
+        for(sInt l=0;l<lanes;l++)
         {
-          accu = sRSqrt(accu);
+          sF32 accu=0;
           for(sInt i=0;i<count;i++)
-            Stack[index-count+i].f *= accu;
+            accu += a[i*stride+l].f*a[i*stride+l].f;
+          if(accu<1e-20)
+          {
+            a[l].f = 1;
+            for(sInt i=1;i<count;i++)
+              a[i*stride+l].f = 0;
+          }
+          else
+          {
+            accu = sRSqrt(accu);
+            for(sInt i=0;i<count;i++)
+              a[i*stride+l].f *= accu;
+          }
         }
       }
       break;
     case SC_MAP|SC_FLOAT:
       {
         index-=2;
-        sF32 min = Stack[index].f;
-        sF32 max = Stack[index+1].f;
+        ScriptBatchValue *min = Stack+index*stride;
+        ScriptBatchValue *max = Stack+(index+1)*stride;
         for(sInt i=0;i<count;i++)
         {
-          sF32 f = Stack[index-count+i].f*0.5+0.5;
-          f = sClamp<sF32>(f,0,1);
-          Stack[index-count+i].f = min + f*(max-min);
-        }
-      }
-      break;
-
-
-    case SC_ADD|SC_STRING:
-      for(sInt i=0;i<count;i++)
-      {
-        sPoolString p;
-        p.Add(Stack[index-count*2+i].s,Stack[index-count+i].s);
-        Stack[index-count*2+i].s = p;
-      }
-      index-=count;
-      break;
-
-    case SC_PRINT|SC_INT:
-      {
-        sTextBuffer tb;
-        const sChar *p = Stack[index-count-2].s;
-        const sChar *fmt = Stack[index-1].s;
-        if (fmt==0||fmt[0]==0)
-          fmt=L"%d";
-        tb.Print(p);
-        tb.PrintF(fmt,Stack[index-count-1].i);
-        for(sInt i=1;i<count;i++)
-        {
-          tb.Print(L" ");
-          tb.PrintF(fmt,Stack[index-count-1+i].i);
-        }
-        Stack[index-count-2].s = sPoolString(tb.Get());
-        index-=count+1;
-      }
-      break;
-
-    case SC_PRINT|SC_FLOAT:
-      {
-        sTextBuffer tb;
-        const sChar *p = Stack[index-count-2].s;
-        const sChar *fmt = Stack[index-1].s;
-        if (fmt==0||fmt[0]==0)
-          fmt=L"%f";
-        tb.Print(p);
-        tb.PrintF(fmt,Stack[index-count-1].f);
-        for(sInt i=1;i<count;i++)
-        {
-          tb.Print(L" ");
-          tb.PrintF(fmt,Stack[index-count-1+i].f);
-        }
-        Stack[index-count-2].s = sPoolString(tb.Get());
-        index-=count+1;
-      }
-      break;
-
-    case SC_PRINT|SC_STRING:
-      {
-        sTextBuffer tb;
-        const sChar *p = Stack[index-count-2].s;
-        const sChar *fmt = Stack[index-1].s;
-        if (fmt==0||fmt[0]==0)
-          fmt=L"%s";
-        tb.Print(p);
-        tb.PrintF(fmt,Stack[index-count-1].s);
-        for(sInt i=1;i<count;i++)
-        {
-          tb.Print(L" ");
-          tb.PrintF(fmt,Stack[index-count-1+i].s);
+          ScriptBatchValue *a = Stack+(index-count+i)*stride;
+          for(sInt l=0;l<lanes;l++)
+          {
+            sF32 f = a[l].f*0.5+0.5;
+            f = sClamp<sF32>(f,0,1);
+            a[l].f = min[l].f + f*(max[l].f-min[l].f);
+          }
         }
-        Stack[index-count-2].s = sPoolString(tb.Get());
-        index-=count+1;
       }
       break;
 
-    case SC_PRINT|SC_COLOR:
+    case SC_FTOC|SC_COLOR:
       {
-        sTextBuffer tb;
-        const sChar *p = Stack[index-count-2].s;
-        const sChar *fmt = Stack[index-1].s;
-        if (fmt==0||fmt[0]==0)
-          fmt=L"%08x";
-        tb.Print(p);
-        tb.PrintF(fmt,Stack[index-count-1].c);
-        for(sInt i=1;i<count;i++)
+        ScriptBatchValue *a = Stack+(index-4)*stride;
+        for(sInt l=0;l<lanes;l++)
         {
-          tb.Print(L" ");
-          tb.PrintF(fmt,Stack[index-count-1+i].c);
+          sVector4 c(a[l].f,a[l+stride].f,a[l+stride*2].f,a[l+stride*3].f);
+          a[l].c = c.GetColor();
         }
-        Stack[index-count-2].s = sPoolString(tb.Get());
-        index-=count+1;
-      }
-      break;
-
-    case SC_FTOC|SC_COLOR:
-      {
-        sVector4 c(Stack[index-4].f,Stack[index-3].f,Stack[index-2].f,Stack[index-1].f);
         index -= 3;
-        Stack[index-1].c = c.GetColor();
       }
       break;
     case SC_CTOF|SC_FLOAT:
       {
-        sVector4  c;
-        c.InitColor(Stack[index-1].c);
+        ScriptBatchValue *a = Stack+(index-1)*stride;
+        for(sInt l=0;l<lanes;l++)
+        {
+          sVector4 c;
+          c.InitColor(a[l].c);
+          a[l].f = c.x;
+          a[l+stride].f = c.y;
+          a[l+stride*2].f = c.z;
+          a[l+stride*3].f = c.w;
+        }
         index += 3;
-        Stack[index-4].f = c.x;
-        Stack[index-3].f = c.y;
-        Stack[index-2].f = c.z;
-        Stack[index-1].f = c.w;
       }
       break;
 
-
-    default:
-      sFatal(L"unknown opcode");
+    default:          // strings, imports, printing: leave it to the scalar vm
+      return ScriptRunLanes(start,ctx,ErrorMsg,Stack,stride,lanes,Scalar,index);
     }
   }
 }
 
+sBool ScriptExecuteBatch(const sU32 *Code,ScriptContext *ctx,sInt lanes,sString<1024> &ErrorMsg)
+{
+  if(!Code)
+    return 0;
+  if(lanes<=0)
+    return 1;
+  if(lanes==1)
+    return ScriptExecute(Code,ctx,ErrorMsg);
+
+  sVERIFY((Code[0]&0xffff)==SC_STACK);
+  sInt size = sMax<sInt>((Code[0]>>16)&0xffff,1);
+  sInt stride = sAlign(lanes,4);  // every slot is made of whole vectors
+
+  ScriptBatchValue *stack = (ScriptBatchValue *) sAllocMem(sizeof(ScriptBatchValue)*stride*size,16,0);
+  sSetMem(stack,0,sizeof(ScriptBatchValue)*stride*size);
+  ScriptStackValue *scalar = new ScriptStackValue[size];
 
+  sBool ok = ScriptRunBatch(Code,ctx,ErrorMsg,stack,stride,lanes,scalar);
+
+  delete[] scalar;
+  sFreeMem(stack);
+  return ok;
+}
 
 
 
@@ -2109,6 +3113,9 @@ void ScriptDump(const sU32 *code,sTextBuffer &tb)
       if(index!=0)
         tb.PrintF(L"(stack error, %d left)\n",index); 
       return;
+    case SC_STACK:
+      tb.PrintF(L"STACK(%d) ",count);
+      break;
 
     case SC_LITERAL|SC_INT:
       tb.PrintF(L"[ ");
@@ -2470,7 +3477,7 @@ static sBool iswhite(const sChar *s)
   return 1;
 }
 
-sBool ScriptCode::Execute(ScriptContext *ctx)
+sBool ScriptCode::Exe(ScriptContext *ctx,sInt lanes)
 {
   ErrorMsg[0] = 0;
   if(Code==0)
@@ -2487,12 +3494,25 @@ sBool ScriptCode::Execute(ScriptContext *ctx)
   }
   if(Code)
   {
-    if(!Exe(ctx))
+    sBool ok = lanes ? ScriptExecuteBatch(Code,ctx,lanes,ErrorMsg) : ScriptExecute(Code,ctx,ErrorMsg);
+    if(!ok)
       sDeleteArray(Code);
   }
   return Code!=0;
 }
 
+sBool ScriptCode::Execute(ScriptContext *ctx)
+{
+  return Exe(ctx,0);
+}
+
+sBool ScriptCode::ExecuteBatch(ScriptContext *ctx,sInt lanes)
+{
+  if(lanes<=0)
+    return 1;
+  return Exe(ctx,lanes);
+}
+
 /****************************************************************************/
 /***                                                                      ***/
 /***   Compiler                                                           ***/
@@ -3791,12 +4811,23 @@ static void writeptr(sU32 *code,sInt &index,void *ptr)
   index += sizeof(void *)/sizeof(sU32);
 }
 
-void ScriptCompiler::OutputExpr(Expression *expr)
+sInt ScriptCompiler::OutputExpr(Expression *expr)
 {
-  if(expr->a) OutputExpr(expr->a);
-  if(expr->b) OutputExpr(expr->b);
-  if(expr->c) OutputExpr(expr->c);
-  if(expr->d) OutputExpr(expr->d);
+  // stack needed: the inputs are evaluated in order, each leaving at most
+  // Count values on the stack for the following ones.
+
+  Expression *in[4] = { expr->a,expr->b,expr->c,expr->d };
+  sInt depth = 0;
+  sInt need = 0;
+  for(sInt i=0;i<4;i++)
+  {
+    if(in[i])
+    {
+      need = sMax(need,depth+OutputExpr(in[i]));
+      depth += in[i]->Count;
+    }
+  }
+  need = sMax(need,sMax(depth,expr->Count));
 
   switch(expr->Kind)
   {
@@ -3919,6 +4950,7 @@ void ScriptCompiler::OutputExpr(Expression *expr)
   default:
     sFatal(L"unknown opcode");
   }
+  return need;
 }
 
 void ScriptCompiler::OutputStat(Statement *stat)
@@ -3938,29 +4970,29 @@ void ScriptCompiler::OutputStat(Statement *stat)
     Code[Index++] = makecmd(SC_MAKELOCAL,stat->Expr->Type,stat->Expr->Count);
     writeptr(Code,Index,stat->Expr->Symbol);
     if(stat->Expr->a)
-      OutputExpr(stat->Expr->a);
+      StackSize = sMax(StackSize,OutputExpr(stat->Expr->a));
     break;
 
   case STAT_GLOBAL:
     Code[Index++] = makecmd(SC_MAKEGLOBAL,stat->Expr->Type,stat->Expr->Count);
     writeptr(Code,Index,stat->Expr->Symbol);
     if(stat->Expr->a)
-      OutputExpr(stat->Expr->a);
+      StackSize = sMax(StackSize,OutputExpr(stat->Expr->a));
     break;
 
   case STAT_IMPORT:
     if(stat->Expr->a)
-      OutputExpr(stat->Expr->a);
+      StackSize = sMax(StackSize,OutputExpr(stat->Expr->a));
     Code[Index++] = makecmd(stat->Expr->Kind,stat->Expr->Type,stat->Expr->Count);
     writeptr(Code,Index,(void *)(const sChar *)stat->Expr->Symbol->Name);
     break;
 
   case STAT_ASSIGN:
-    OutputExpr(stat->Expr);
+    StackSize = sMax(StackSize,OutputExpr(stat->Expr));
     break;
 
   case STAT_IF:
-    OutputExpr(stat->Expr);
+    StackSize = sMax(StackSize,OutputExpr(stat->Expr));
 
     if(stat->Alt)
     {
@@ -3986,7 +5018,7 @@ void ScriptCompiler::OutputStat(Statement *stat)
     {
       sInt p0 = Index;
       OutputStat(stat->Child);
-      OutputExpr(stat->Expr);
+      StackSize = sMax(StackSize,OutputExpr(stat->Expr));
       Code[Index] = makecmd(SC_BT,0,1);
       PatchCmd(Index++,p0);
     }
@@ -3999,7 +5031,7 @@ void ScriptCompiler::OutputStat(Statement *stat)
       sInt p0 = Index;
       OutputStat(stat->Child);
       PatchCmd(p1,Index);
-      OutputExpr(stat->Expr);
+      StackSize = sMax(StackSize,OutputExpr(stat->Expr));
       Code[Index] = makecmd(SC_BT,0,1);
       PatchCmd(Index++,p0);
     }
@@ -4338,8 +5370,17 @@ sU32 *ScriptCompiler::Parse(ScriptContext *ctx_,const sChar *src,sInt line)
   // write code
 
 //  if(!sRELEASE) PrintStat(stat,0);
+  StackSize = 0;
+  Index = 1;
   OutputStat(stat);
   Code[Index++] = makecmd(SC_STOP,0,1);
+  if(StackSize>0xffff)
+  {
+    ErrorMsg = L"expression too complex";
+    delete[] Code;
+    return 0;
+  }
+  Code[0] = makecmd(SC_STACK,0,StackSize);
 
   sU32 *code = new sU32[Index];
   sCopyMem(code,Code,Index*4);
@@ -48,6 +48,20 @@ enum ScriptSplineEnum
   SSF_BoundExtrapolate = 0x0003,
 };
 
+struct ScriptSplineSegment        // one cubic per pair of keys, see ScriptSpline::Prepare()
+{
+  sF32 Time;                      // time of the first key
+  sF32 InvLength;                 // 1 / distance to the next key
+  sF32 c0,c1,c2,c3;               // value = c0 + c1*t + c2*t^2 + c3*t^3, t = 0..1 within the segment
+};
+
+struct ScriptSplineCursor         // remembers the segment of the last evaluation. one per caller, don't share between threads
+{
+  enum { MaxCurves = 16 };
+  sInt Key[MaxCurves];
+  ScriptSplineCursor() { sClear(Key); }
+};
+
 class ScriptSpline                // owned by rendernodes
 {
 public:
@@ -61,14 +75,17 @@ public:
   sF32 MaxTime;
   sInt RotClampMask;              // for interpolating angles in the 0..1 range
   sArray<ScriptSplineKey> **Curves;
+  sArray<ScriptSplineSegment> *Segments;  // per curve, empty if the curve was not prepared
 
   void Init(sInt count);
-  void Eval(sF32 time,sF32 *result,sInt count);
+  void Prepare();                 // call after setting keys, Mode and RotClampMask. makes Eval() faster
+  void Eval(sF32 time,sF32 *result,sInt count,ScriptSplineCursor *cursor=0);
   void EvalD(sF32 time,sF32 *result,sInt count);
   sF32 Length();
   sF32 ArcLength(sF32 startTime,sF32 endTime) const;
 
 private:
+  sInt FindKey(sInt curve,sF32 time,sInt hint) const;
   static sF64 ArcLengthIntegrand(sF64 x,void *user);
 };
 
@@ -112,6 +129,7 @@ struct ScriptValue                // a value that might be bound to a symbol
   ScriptValue *OldValue;          // value that was linked to the symbol in previous scope
   ScriptFunc *Func;               // this is actually a function..
   ScriptSpline *Spline;           // this is actually a spline..
+  sInt LaneStride;                // batch execution: distance between lanes in elements, 0 = same value for all lanes
   union                           // pointer to actual data
   {
     sInt *IntPtr;
@@ -143,6 +161,8 @@ class ScriptContext               // a symbol table
   sArray<ScriptImport *> Imports; // imports
   ScriptValue **Scope;            // current scope
   ScriptValue *Locals;            // first local
+  ScriptValue *LaneLocals;        // bindings before the current lane started
+  ScriptValue *LaneGlobals;
   sMemoryPool *Pool;
 
   sU32 *Code;
@@ -189,6 +209,14 @@ public:
   void BindLocalColor(ScriptSymbol *sym,sU32 *ptr);
   ScriptValue *GetFirstFromScope() { if(Scope) return *Scope; else return 0; }
 //  void UnbindLocalColor(ScriptSymbol *sym,sU32 *ptr);
+
+  // batch execution
+
+  ScriptValue *MakeBatchValue(sInt type,sInt dim,sInt lanes); // one value per lane, zeroed
+  void BindBatchFloat(ScriptSymbol *sym,sInt dim,sF32 *ptr,sInt stride); // value of lane n at (sU8 *)ptr+n*stride
+  void BindBatchInt(ScriptSymbol *sym,sInt dim,sInt *ptr,sInt stride);
+  void BeginLane();               // when a batch diverges, the lanes run one by one.
+  void EndLane();                 // bindings made by one lane are undone before the next
 };
 
 /****************************************************************************/
@@ -198,16 +226,18 @@ class ScriptCode
   sU32 *Code;
   sChar *Source;
   sInt SourceLine;
-  sBool Exe(ScriptContext *ctx);
+  sBool Exe(ScriptContext *ctx,sInt lanes);  // lanes==0: not batched
 public:
   ScriptCode(const sChar *txt,sInt line=0);
   ~ScriptCode();
 
   sBool Execute(ScriptContext *ctx);
+  sBool ExecuteBatch(ScriptContext *ctx,sInt lanes); // run once for each of lanes instances
   sString<1024> ErrorMsg;
 };
 
 sBool ScriptExecute(const sU32 *Data,ScriptContext *ctx,sString<1024> &ErrorMsg);
+sBool ScriptExecuteBatch(const sU32 *Data,ScriptContext *ctx,sInt lanes,sString<1024> &ErrorMsg);
 
 /****************************************************************************/
 
@@ -246,6 +276,7 @@ class ScriptCompiler
   sMemoryPool *Pool;
   sU32 *Code;
   sInt Index;
+  sInt StackSize;                 // maximum stack depth of the code, for ScriptExecute()
 
   void InitScanner();
   Statement *NewStat(sInt code);
@@ -283,7 +314,7 @@ class ScriptCompiler
 
   void PatchCmd(sInt cmdindex,sInt target);
   void OutputStat(Statement *);
-  void OutputExpr(Expression *);
+  sInt OutputExpr(Expression *);  // returns stack size needed
 
 public:
   ScriptCompiler();
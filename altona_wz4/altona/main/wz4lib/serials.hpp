@@ -56,6 +56,7 @@ namespace sSerId
     Wz4Mesh               = Werkkzeug4+0x002c,
     Wz4Texture2D          = Werkkzeug4+0x002d,
     Wz4SimpleMtrl         = Werkkzeug4+0x002e,
+    Wz4GenBitmap          = Werkkzeug4+0x002f,
 
 // these numbers were allocated badly
 
@@ -189,7 +189,7 @@ void Document::_Type()
     else if(Scan.IfName(L"flags"))
     {
       Scan.Match('=');
-      type->Flags |= _Choice(L"notab|render3d|uncache");
+      type->Flags |= _Choice(L"notab|render3d|uncache|serial");
       Scan.Match(';');
     }
     else if(Scan.IfName(L"gui"))
@@ -379,7 +379,7 @@ void Document::_Operator()
       Scan.Match('=');
       op->Flags |= _Choice(L"||load|store|delete_import|delete_array_import|hide|conversion"
         L"|logging|slow|blockhandles|passinput|passoutput|curve|clip|obsolete|verticalresize|comment"
-        L"|call|input|loop|endloop|shellswitch|typefrominput|blockchange");
+        L"|call|input|loop|endloop|shellswitch|typefrominput|blockchange|serial");
       Scan.Match(';');
     }
     else if(Scan.IfName(L"tab"))
@@ -320,6 +320,15 @@ ChaosMesh::~ChaosMesh()
   Skeleton->Release();
 }
 
+sPtr ChaosMesh::GetByteSize()
+{
+  return sPtr(Positions.GetSize())*sizeof(ChaosMeshVertexPosition)
+       + sPtr(Normals.GetSize())*sizeof(ChaosMeshVertexNormal)
+       + sPtr(Tangents.GetSize())*sizeof(ChaosMeshVertexTangent)
+       + sPtr(Properties.GetSize())*sizeof(ChaosMeshVertexProperty)
+       + sPtr(Faces.GetSize())*sizeof(ChaosMeshFace);
+}
+
 template <class streamer> void ChaosMesh::Serialize_(streamer &stream,sTexture2D *shadow)
 {    
   ChaosMeshVertexPosition *pos;
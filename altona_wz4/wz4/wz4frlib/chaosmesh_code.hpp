@@ -166,6 +166,7 @@ class ChaosMesh : public wObject
 public:
   ChaosMesh();
   ~ChaosMesh();
+  sPtr GetByteSize();
   sString<64> Name;
   template <class streamer> void Serialize_(streamer &s,sTexture2D *shadow=0);
   void Serialize(sWriter &,sTexture2D *shadow=0);
@@ -501,21 +501,14 @@ void RPSPH::Reset()
   LastTimeF = 0;
 }
 
+// particles are sorted by the cell of the grid, in morton order. the grid
+// and the scratch arrays live as long as the simulator.
+
 void RPSPH::Hash()
 {
-  sVector30 d;
-
-  sF32 r = Para.InteractRadius;
-  sF32 rr = 1.0f/r;
-
   sInt max = Parts[0]->GetCount();
   Particle *parts = Parts[0]->GetData();
 
-  sU32 *hashes = new sU32[max];
-  sInt *remap = new sInt[max];
-  for(sInt i=0;i<max;i++)
-    remap[i] = 0x10000000;
-
   // get rid of springs when the particle died
 
   sInt sm = Springs.GetCount();
@@ -529,61 +522,29 @@ void RPSPH::Hash()
   }
   Springs.Resize(sm);
 
-  // reset table
-
-  for(sInt i=0;i<HASHSIZE;i++)      
-  {
-    HashTable[i].Count = 0;
-    HashTable[i].Start = 0;
-  }
-
-  // calculate hash and figure out allocation
+  // sort by cell
 
-  for(sInt i=0;i<max;i++)           
-  {
+  Grid.Begin(max,Para.InteractRadius);
+  for(sInt i=0;i<max;i++)
     if(parts[i].Color!=0)           // elements with color==0 will be killed!
-    {
-      sInt x = sInt((parts[i].NewPos.x+1024.0f)*rr);
-      sInt y = sInt((parts[i].NewPos.y+1024.0f)*rr);
-      sInt z = sInt((parts[i].NewPos.z+1024.0f)*rr);
-      sU32 hash = (x*STEPX + y*STEPY + z*STEPZ) & HASHMASK;
-      hashes[i] = hash;
-      HashTable[hash].Count++;
-    }
-  }
+      Grid.Add(i,parts[i].NewPos);
+  Grid.Sort(Para.Multithreading);
 
-  // allocate space for new layout
-
-  sInt nmax = 0;
-  for(sInt i=0;i<HASHSIZE;i++)  
-  {
-    HashTable[i].Start = nmax;
-    nmax += HashTable[i].Count;
-  }
+  // copy to new layout
 
+  sInt nmax = Grid.GetCount();
+  const sU32 *order = Grid.GetOrder();
   Parts[1]->Resize(nmax);
   Particle *parts1 = Parts[1]->GetData();
-
-   // copy to new layout
-
-  for(sInt i=0;i<max;i++)          
-  {
-    if(parts[i].Color!=0)           // elements with color==0 will be killed!
-    {
-      sU32 hash = hashes[i];
-      sInt n = HashTable[hash].Start++;
-      sVERIFY(n<nmax);
-      parts1[n] = parts[i];
-      parts1[n].Hash = hash;
-      remap[i] = n;
-    }
-  }
-
-  // we changed the start index. undo that!
-
-  for(sInt i=0;i<HASHSIZE;i++)      
+  Remap.Resize(max);
+  sInt *remap = Remap.GetData();
+  for(sInt i=0;i<max;i++)
+    remap[i] = 0x10000000;
+  for(sInt n=0;n<nmax;n++)
   {
-    HashTable[i].Start -= HashTable[i].Count;
+    parts1[n] = parts[order[n]];
+    parts1[n].Hash = Grid.GetSortedKey(n);
+    remap[order[n]] = n;
   }
 
   // fix springs
@@ -598,11 +559,6 @@ void RPSPH::Hash()
     s->Part1 = remap[s->Part1];
   }
 
-  // done;
-
-  delete[] hashes;
-  delete[] remap;
-
   sSwap(Parts[0],Parts[1]);
 }
 
@@ -616,8 +572,8 @@ void RPSPH::Inter(sInt n0,sInt n1)
   sInt max = Parts[0]->GetCount();
   parts = Parts[0]->GetData();
   sU32 oldhash = ~0UL;
-  sInt rangestart[10];
-  sInt rangecount[10];
+  sInt rangestart[27];
+  sInt rangecount[27];
   sInt ranges=0;
 
   sBool color = Para.ColorSmooth>0.00001f;
@@ -631,53 +587,8 @@ void RPSPH::Inter(sInt n0,sInt n1)
     sU32 hash = p->Hash;
     if(hash!=oldhash)
     {
-      sU32 h0;
       oldhash = hash;
-
-      h0 = (hash - STEPX - STEPY - STEPZ)&HASHMASK;
-      rangestart[0] = HashTable[h0].Start;
-      rangecount[0] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-      h0 = (hash - STEPX         - STEPZ)&HASHMASK;
-      rangestart[1] = HashTable[h0].Start;
-      rangecount[1] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-      h0 = (hash - STEPX + STEPY - STEPZ)&HASHMASK;
-      rangestart[2] = HashTable[h0].Start;
-      rangecount[2] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-
-      h0 = (hash - STEPX - STEPY        )&HASHMASK;
-      rangestart[3] = HashTable[h0].Start;
-      rangecount[3] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-      h0 = (hash - STEPX                )&HASHMASK;
-      rangestart[4] = HashTable[h0].Start;
-      rangecount[4] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-      h0 = (hash - STEPX + STEPY        )&HASHMASK;
-      rangestart[5] = HashTable[h0].Start;
-      rangecount[5] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-
-      h0 = (hash - STEPX - STEPY + STEPZ)&HASHMASK;
-      rangestart[6] = HashTable[h0].Start;
-      rangecount[6] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-      h0 = (hash - STEPX         + STEPZ)&HASHMASK;
-      rangestart[7] = HashTable[h0].Start;
-      rangecount[7] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-      h0 = (hash - STEPX + STEPY + STEPZ)&HASHMASK;
-      rangestart[8] = HashTable[h0].Start;
-      rangecount[8] = HashTable[h0].Count+HashTable[(h0+1)&HASHMASK].Count+HashTable[(h0+2)&HASHMASK].Count;
-
-      // one range may unfortunatly wrap from the end of the array to the start!
-
-      ranges = 9;
-      for(sInt i=0;i<9;i++)
-      {
-        if(rangestart[i]+rangecount[i]>max)
-        {
-          sVERIFY(ranges<10);   // this should only happen once per particle!
-          rangestart[ranges] = 0;
-          rangecount[ranges] = rangestart[i]+rangecount[i] - max;
-          rangecount[i] = max-rangestart[i];
-          ranges++;
-        }
-      }
+      ranges = Grid.GetNeighbours(hash,rangestart,rangecount);
     }
 
     // find near particles
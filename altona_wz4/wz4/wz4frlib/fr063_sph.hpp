@@ -11,16 +11,10 @@
 #include "wz4frlib/fr063_sph_ops.hpp"
 #include "wz4frlib/wz4_demo2.hpp"
 #include "wz4frlib/wz4_demo2_ops.hpp"
+#include "util/spatialgrid.hpp"
 
 enum Constants
 {
-  HASHSIZE = 0x400,
-  HASHMASK = HASHSIZE-1,
-
-  STEPX = 1,
-  STEPY = 17,
-  STEPZ = 23,
-
   BATCH = 0x1000000,
   MAXNEAR = 512,
 };
@@ -134,7 +128,7 @@ public:
     sVector31 NewPos;
     sVector31 OldPos;
     sU32 Color;
-    sU32 Hash;
+    sU32 Hash;                    // cell in Grid
   };
 
   struct Spring
@@ -144,19 +138,14 @@ public:
     sF32 RestLength;
   };
 
-  struct HashIndex
-  {
-    sInt Start;
-    sInt Count;
-  };
-
   sInt SimStep;
   sF32 LastTimeF;
   sF32 CurrentTime;
   sF32 SimTimeStep;
 //  sArray<Particle> Parts;
 
-  HashIndex HashTable[HASHSIZE];
+  sSpatialGrid Grid;
+  sArray<sInt> Remap;
   sArray<Particle> *Parts[2];
   sArray<Spring> Springs;
 };
@@ -11,6 +11,7 @@
 #include "wz4frlib/wz4_bsp.hpp"
 #include "base/graphics.hpp"
 #include "util/algorithms.hpp"
+#include "util/simd_batch.hpp"
 
 /****************************************************************************/
 /****************************************************************************/
@@ -672,6 +673,7 @@ void RNSprites::Init()
     p->Dist = 0;
   }
   PartOrder.HintSize(PInfo.Alloc);
+  Dists.HintSize(PInfo.Alloc);
 }
 
 
@@ -702,6 +704,9 @@ void RNSprites::Prepare(Wz4RenderContext *ctx)
   if(PInfo.Alloc==0) return;
 
   PartOrder.Clear();
+  sBool sort = (Para.Mode & 0x0100)!=0;
+  if(sort)
+    Sorter.Begin(PInfo.Alloc);
 
   // texture might have changed, recalculate atlas uv
 
@@ -746,20 +751,31 @@ void RNSprites::Prepare(Wz4RenderContext *ctx)
   if((Para.Mode & 0x2000) && (PInfo.Flags & wPNF_Color))
     usecolor = 1;
 
+  if(!(Para.Mode & 0x800) && dist>Para.FarFadeDistance)
+    return;
+
+  // get all positions first, so the distances can be done in one batch
+
+  sInt max = PInfo.GetCount();
+  for(sInt i=0;i<max;i++)
+  {
+    PInfo.Parts[i].Get(p,t);
+    Particles[i].Pos = p+sVector30(Para.Trans);
+    Particles[i].Time = t;
+  }
+  Dists.Resize(max);
+  if(max>0)
+    sBatchPlaneDist(plane,view.Model,&Particles[0].Pos,sizeof(Particle),Dists.GetData(),max);
+
   if(Para.Mode & 0x800)
   {
-    sInt max = PInfo.GetCount();
     for(sInt i=0;i<max;i++)
     {
       part = &Particles[i];
-      PInfo.Parts[i].Get(p,t);
-      if (t<0) continue;
+      if (part->Time<0) continue;
 
-      p+=sVector30(Para.Trans);
-      dist=-(plane ^ (p*view.Model));
+      dist = -Dists[i];
 
-      part->Time = t;
-      part->Pos = p;
       part->Dist = dist;
       part->DistFade = 1;
       if(usecolor)
@@ -768,31 +784,26 @@ void RNSprites::Prepare(Wz4RenderContext *ctx)
         part->Color = 0xffffffff;
 
       PartOrder.AddTail(part);
+      if(sort)
+        Sorter.Add(i,dist);
     }
   }
   else
   {
-    if (dist>Para.FarFadeDistance) return;
-
     sF32 distfade=1.0f/Para.NearFadeDistance;
     sF32 globalfade=1.0f;
     if (dist>=(Para.FarFadeDistance-Para.FarFadeRange))
       globalfade=sClamp((Para.FarFadeDistance-dist)/Para.FarFadeRange,0.0f,1.0f);
 
-    sInt max = PInfo.GetCount();
     for(sInt i=0;i<max;i++)
     {
       part = &Particles[i];
-      PInfo.Parts[i].Get(p,t);
-      if (t<0) continue;
+      if (part->Time<0) continue;
 
-      p+=sVector30(Para.Trans);
-      dist=-(plane ^ (p*view.Model));
+      dist = -Dists[i];
 
       if (dist<=-view.ClipNear)
       {
-        part->Time = t;
-        part->Pos = p;
         part->Dist = dist;
 
         sF32 df=sClamp(-(part->Dist+view.ClipNear)*distfade,0.0f,1.0f)*globalfade;
@@ -804,6 +815,8 @@ void RNSprites::Prepare(Wz4RenderContext *ctx)
           part->Color = 0xffffffff;
 
         PartOrder.AddTail(part);
+        if(sort)
+          Sorter.Add(i,dist);
       }
     }
   }
@@ -811,8 +824,14 @@ void RNSprites::Prepare(Wz4RenderContext *ctx)
   if (PartOrder.IsEmpty())
     return;
 
-  if(Para.Mode & 0x0100)
-    sHeapSortUp(PartOrder,&Particle::Dist);
+  if(sort)
+  {
+    static const sInt modes[4] = { sDSM_HEAP,sDSM_COHERENT,sDSM_RADIX,sDSM_PARALLEL };
+    Sorter.Sort(modes[(Para.Mode>>21)&3]);
+    const sU32 *order = Sorter.GetOrder();
+    for(sInt i=0;i<PartOrder.GetCount();i++)
+      PartOrder[i] = &Particles[order[i]];
+  }
 
 
   // prepare instance data
@@ -2952,6 +2971,7 @@ void RPSplinedParticles::Func(Wz4PartInfo &pinfo,sF32 time,sF32 dt)
   vala[2][4] = 1;
 
   sF32 e=Para.Epsilon;
+  ScriptSplineCursor splcursor,altcursor;
 
   sFORALL(Parts,p)
   {
@@ -2968,10 +2988,10 @@ void RPSplinedParticles::Func(Wz4PartInfo &pinfo,sF32 time,sF32 dt)
 
     for(sInt i=0;i<3;i++)
     {
-      spl->Eval((t + dt + e*(i-1))*length,val[i],channels);
+      spl->Eval((t + dt + e*(i-1))*length,val[i],channels,&splcursor);
       if(alt)
       {
-        alt->Eval((t + dt + e*(i-1))*altlength+Para.AltShift,vala[i],altchannels);
+        alt->Eval((t + dt + e*(i-1))*altlength+Para.AltShift,vala[i],altchannels,&altcursor);
       }
     }
     
@@ -15,6 +15,7 @@
 #include "wz4frlib/wz4_mtrl2.hpp"
 #include "wz4frlib/fxparticle_ops.hpp"
 #include "util/shaders.hpp"
+#include "util/depthsort.hpp"
 #include "extra/mcubes.hpp"
 
 /****************************************************************************/
@@ -166,6 +167,8 @@ class RNSprites : public Wz4RenderNode
 
   sArray<Particle> Particles;
   sArray<Particle *> PartOrder;
+  sArray<sF32> Dists;
+  sDepthSort Sorter;
   Wz4PartInfo PInfo;
   sF32 Time;
 
@@ -25,47 +25,60 @@ struct sDemoPackFile::PackHeader
   sInt dummy;
 };
 
+// base and lock are shared by all files of the pack. when map is set,
+// base is never touched.
+
 class DPFUnpacked : public sFile
 {
   sFile *BaseFile;
+  sThreadLock *BaseLock;
+  const sU8 *BaseMap;
   sS64 BaseOffset;
   sS64 BaseSize;
   sS64 Offset;
   sS64 Size;
 public:
-  DPFUnpacked(sFile *base,sS64 offset,sS64 size);
+  DPFUnpacked(sFile *base,sThreadLock *lock,const sU8 *map,sS64 offset,sS64 size);
   ~DPFUnpacked();
   sBool Read(void *data,sDInt size);
+  sU8 *Map(sS64 offset,sDInt size);   // zero copy when the pack is mapped
   sBool SetOffset(sS64 offset);       // seek to offset
   sS64 GetOffset();                   // get offset
   sS64 GetSize();                     // get size
 };
 
 
+struct DepackState;
+
 class DPFPacked : public sFile
 {
   sInt SeekSize;
   sInt ChunkSize;
 
   sFile *BaseFile;
+  sThreadLock *BaseLock;
+  const sU8 *BaseMap;
   sS64 BaseOffset;
   sS64 BaseSize;
   sS64 ReadOffset;
+  sBool ReadMapped;
   sInt DepackStart;
   sS64 Size;
   sS64 Offset;
 
+  DepackState *State;
   sU8 *DestBuffer;
   sU8 *DestEnd;
   sU8 *DestPtr;
 public:
-  DPFPacked(sFile *base,sS64 offset,sS64 size);
+  DPFPacked(sFile *base,sThreadLock *lock,const sU8 *map,sS64 offset,sS64 size);
   ~DPFPacked();
   sBool Read(void *data,sDInt size);
   sBool SetOffset(sS64 offset);       // seek to offset
   sS64 GetOffset();                   // get offset
   sS64 GetSize();                     // get size
 
+  sBool MapChunk(const sU8 *&start,const sU8 *&end);
   void LoadChunk(sU8 *,sInt size);
 };
 
@@ -76,7 +89,24 @@ sU32 CCADepacker(sU8 *dst,const sU8 *src);
 
 /****************************************************************************/
 
-sDemoPackFile::sDemoPackFile(const sChar *name)
+sU32 sDemoPackFile::NameKey::Hash() const
+{
+  sU32 hash = 0x811c9dc5;         // fnv-1a over the upper case name, like sCmpStringI
+  for(const sChar *s=Name;*s;s++)
+  {
+    sInt c = *s;
+    if(c>='a' && c<='z') c = c-'a'+'A';
+    hash = (hash^c)*0x01000193;
+  }
+  return hash;
+}
+
+sBool sDemoPackFile::NameKey::operator==(const NameKey &k) const
+{
+  return sCmpStringI(Name,k.Name)==0;
+}
+
+sDemoPackFile::sDemoPackFile(const sChar *name,sBool map)
 {
   sU32 Header[4];
   sClear(Header);
@@ -109,6 +139,22 @@ sDemoPackFile::sDemoPackFile(const sChar *name)
   for(sU16 *ptr=string0;ptr<string1;ptr++)
     *ptr = (*ptr>>8)|(*ptr<<8);
 #endif
+
+  Index.HintSize(Count);
+  for(sInt i=0;i<Count;i++)
+  {
+    NameKey key;
+    key.Name = (const sChar *)(Data+Dir[i].NameOffset);
+    if(!Index.Find(key))          // first entry wins, like the old linear search
+      Index.Add(key,i);
+  }
+
+  Map = 0;
+  sS64 size = File->GetSize();
+  if(map && size<0x7fffffff)
+    Map = File->Map(0,sDInt(size));   // not MapAll(), that would fall back to loading everything
+  if(!Map)
+    sLogF(L"file",L"packfile not mapped, reading through file\n");
 }
 
 sDemoPackFile::~sDemoPackFile()
@@ -125,20 +171,18 @@ sFile *sDemoPackFile::Create(const sChar *name,sFileAccess access)
 
   if(access!=sFA_READ && access!=sFA_READRANDOM) return 0;
 
-  name = sFindFileWithoutPath(name);
-  for(sInt i=0;i<Count;i++)
-  {
-    file = &Dir[i];
-    if(sCmpStringI(name,(const sChar *)(Data+file->NameOffset))==0)
-    {
-      sLogF(L"file",L"open packfile offset %08x:%08x file <%s>\n",file->FileOffset,file->OriginalSize,name);
-      if(file->OriginalSize==file->PackedSize)
-        return new DPFUnpacked(File,file->FileOffset,file->OriginalSize);
-      else
-        return new DPFPacked(File,file->FileOffset,file->OriginalSize);
-    }
-  }
-  return 0;
+  NameKey key;
+  key.Name = sFindFileWithoutPath(name);
+  sInt *index = Index.Find(key);
+  if(!index)
+    return 0;
+
+  file = &Dir[*index];
+  sLogF(L"file",L"open packfile offset %08x:%08x file <%s>\n",file->FileOffset,file->OriginalSize,key.Name);
+  if(file->OriginalSize==file->PackedSize)
+    return new DPFUnpacked(File,&Lock,Map,file->FileOffset,file->OriginalSize);
+  else
+    return new DPFPacked(File,&Lock,Map,file->FileOffset,file->OriginalSize);
 }
 
 /****************************************************************************/
@@ -232,9 +276,11 @@ void sProgressEnd()
 /****************************************************************************/
 /****************************************************************************/
 
-DPFUnpacked::DPFUnpacked(sFile *base,sS64 offset,sS64 size)
+DPFUnpacked::DPFUnpacked(sFile *base,sThreadLock *lock,const sU8 *map,sS64 offset,sS64 size)
 {
   BaseFile = base;
+  BaseLock = lock;
+  BaseMap = map;
   BaseOffset = offset;
   BaseSize = BaseFile->GetSize();
   Size = size;
@@ -248,12 +294,28 @@ DPFUnpacked::~DPFUnpacked()
 sBool DPFUnpacked::Read(void *data,sDInt size)
 {
   sVERIFY(Offset+size<=Size);
-  BaseFile->SetOffset(Offset+BaseOffset);
+  sS64 offset = Offset+BaseOffset;
   Offset += size;
 
 //  sProgress(Offset+BaseOffset,BaseSize);
-  
-  return BaseFile->Read(data,size);
+
+  if(BaseMap)
+  {
+    sCopyMem(data,BaseMap+offset,size);
+    return 1;
+  }
+
+  BaseLock->Lock();
+  sBool ok = BaseFile->SetOffset(offset) && BaseFile->Read(data,size);
+  BaseLock->Unlock();
+  return ok;
+}
+
+sU8 *DPFUnpacked::Map(sS64 offset,sDInt size)
+{
+  if(!BaseMap || offset<0 || offset+size>Size)
+    return 0;
+  return (sU8 *)BaseMap+BaseOffset+offset;
 }
 
 sBool DPFUnpacked::SetOffset(sS64 offset)
@@ -311,10 +373,10 @@ struct DepackState
   sU8 SourceBuffer[SrcBufferSize];
 };
 
-static DepackState stx;
-
 static void DecodeLoadSrcBuffer(DepackState &st)
 {
+  if(st.pf->MapChunk(st.Src,st.End))
+    return;
   st.pf->LoadChunk(st.SourceBuffer,SrcBufferSize);
   st.Src = st.SourceBuffer;
   st.End = st.Src + SrcBufferSize;
@@ -513,16 +575,20 @@ sU32 DecodeChunkAll(sU8 *dst)
 /****************************************************************************/
 /****************************************************************************/
 
-DPFPacked::DPFPacked(sFile *base,sS64 offset,sS64 size)
+DPFPacked::DPFPacked(sFile *base,sThreadLock *lock,const sU8 *map,sS64 offset,sS64 size)
 {
   SeekSize = 640*1024;
   ChunkSize = 128*1024;
+  State = new DepackState;        // one per file, so packed files can be read in parallel
   DestBuffer = new sU8[SeekSize+ChunkSize];
   BaseFile = base;
+  BaseLock = lock;
+  BaseMap = map;
   BaseOffset = offset;
   BaseSize = base->GetSize();
   Size = size;
   ReadOffset = 0;
+  ReadMapped = 0;
   DestPtr = DestEnd = DestBuffer + SeekSize + ChunkSize;
   DepackStart = 1;
   Offset = 0;
@@ -530,7 +596,8 @@ DPFPacked::DPFPacked(sFile *base,sS64 offset,sS64 size)
 
 DPFPacked::~DPFPacked()
 {
-  delete DestBuffer;
+  delete State;
+  delete[] DestBuffer;
 }
 
 sBool DPFPacked::Read(void *datav,sDInt size)
@@ -544,7 +611,7 @@ sBool DPFPacked::Read(void *datav,sDInt size)
     if(chunk==0)
     {
       sCopyMem(DestBuffer,DestBuffer+ChunkSize,SeekSize);
-      DecodeChunk(&stx,DestBuffer+SeekSize,DestEnd,DepackStart,this);
+      DecodeChunk(State,DestBuffer+SeekSize,DestEnd,DepackStart,this);
       DepackStart = 0;
       DestPtr = DestBuffer+SeekSize;
     }
@@ -577,10 +644,30 @@ sS64 DPFPacked::GetSize()
   return Size;
 }
 
+// when mapped, the depacker reads straight from the mapping up to the end
+// of the pack. it only gets past that on broken data.
+
+sBool DPFPacked::MapChunk(const sU8 *&start,const sU8 *&end)
+{
+  if(!BaseMap || ReadMapped)
+    return 0;
+  start = BaseMap+BaseOffset;
+  end = BaseMap+BaseSize;
+  ReadMapped = 1;
+  return 1;
+}
+
 void DPFPacked::LoadChunk(sU8 *ptr,sInt size)
 {
+  if(BaseMap)
+  {
+    sSetMem(ptr,0,size);
+    return;
+  }
+  BaseLock->Lock();
   BaseFile->SetOffset(ReadOffset+BaseOffset);
   BaseFile->Read(ptr,size);
+  BaseLock->Unlock();
   ReadOffset += size;
 }
 
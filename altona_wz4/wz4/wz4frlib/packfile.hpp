@@ -9,21 +9,36 @@
 #define FILE_WZ4FRLIB_PACKFILE_HPP
 
 #include "base/types.hpp"
+#include "base/types2.hpp"
 #include "base/system.hpp"
 
 /****************************************************************************/
 
+// files are looked up by hashed name. when the pack can be mapped, all
+// readers work on the mapping: uncompressed files are not copied, and
+// several threads can load from the pack at the same time. otherwise reads
+// go through one shared file, serialized by a lock.
+
 class sDemoPackFile : public sFileHandler
 {
   struct PackHeader;
+  struct NameKey
+  {
+    const sChar *Name;
+    sU32 Hash() const;
+    sBool operator==(const NameKey &k) const;
+  };
 
   sInt Count;
   PackHeader *Dir;
   sU8 *Data;
   sFile *File;
+  const sU8 *Map;                 // whole pack, or 0 if not mapped
+  sThreadLock Lock;               // for File when not mapped
+  sHashMap<NameKey,sInt> Index;   // name -> Dir entry
 
 public:
-  sDemoPackFile(const sChar *name);
+  sDemoPackFile(const sChar *name,sBool map=1);
   ~sDemoPackFile();
 
   sFile *Create(const sChar *name,sFileAccess access);
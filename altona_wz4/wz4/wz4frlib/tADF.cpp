@@ -50,18 +50,17 @@ unsigned int tAABBoxOctree::FindAddEdge(unsigned int _i1, unsigned int _i2)
     e.key.i2 = _i1;
   }
   
-  tAABBoxOctreeEdge *ptr = edgehash.Find(&e.key);
+  unsigned int *ep = edgehash.Find(e.key);
 
-  if (ptr==0)
+  if (ep==0)
   {    
     e.n  = sVector30(0,0,0);
     e.ep = (unsigned int)edges.GetCount();    
     edges.AddTail(e);
-    ptr = &edges[e.ep];
-    edgehash.Add(&ptr->key,ptr);
+    ep = edgehash.Add(e.key,e.ep);
   }
 
-  return ptr->ep; 
+  return *ep; 
 }
 
 Wz4BSPError tAABBoxOctree::FromMesh(Wz4Mesh *in, sF32 planeThickness, sBool ForceCubeSampling, sBool UserBox, const sVector31 &BoxPos, const sVector30 &BoxDimH, sBool BruteForce, sF32 GuardBand)
@@ -891,6 +890,7 @@ void tAABBoxOctree::FinishVertices(sF32 _guardband, sBool _cube, sBool UserBox,
   head = InitChild(0,aabb);
 
   edges.HintSize(vertices.GetCount()*4);
+  edgehash.HintSize(vertices.GetCount()*3);
 }
 
 void tAABBoxOctree::NormVertex()
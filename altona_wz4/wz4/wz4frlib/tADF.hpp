@@ -83,7 +83,7 @@ struct tAABBoxOctreeTri
 };
 
 
-class sEdgeHash : public sHashTable < tAABBoxOctreeEdgeKey , tAABBoxOctreeEdge >
+class sEdgeHash : public sHashMap < tAABBoxOctreeEdgeKey , unsigned int >
 {
 };
 
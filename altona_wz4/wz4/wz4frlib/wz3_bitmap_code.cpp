@@ -8,6 +8,8 @@
 #include "wz4frlib/wz3_bitmap_code.hpp"
 #include "wz4frlib/wz3_bitmap_ops.hpp"
 #include "genvector.hpp"
+#include "wz4lib/serials.hpp"
+#include "util/taskscheduler.hpp"
 #include <emmintrin.h>
 
 /****************************************************************************/
@@ -262,11 +264,8 @@ static sINLINE void FadeOver(sU64 &r,__m128i col,sInt fade)
   _mm_storel_epi64((__m128i *) &r,faded);
 }
 
-static void AddScalePix(sU64 &r,sU64 &c0,sU64 &c1,sInt fade)
+static sINLINE void AddScalePix(sU64 &r,__m128i col0,__m128i col1,sInt fade)
 {
-  __m128i col0  = _mm_loadl_epi64((const __m128i *) &c0);
-  __m128i col1  = _mm_loadl_epi64((const __m128i *) &c1);
-
   __m128i fadei = _mm_cvtsi32_si128(sMin(fade >> 1,32768));
   __m128i fadem = _mm_shufflelo_epi16(fadei,0x00);
 
@@ -367,6 +366,165 @@ static sInt GetGamma(const sInt *table,sInt value)
   return table[vi] + (((table[vi+1]-table[vi]) * (value & 31)) >> 5);
 }
 
+/****************************************************************************/
+/***                                                                      ***/
+/***   Bands and timing                                                   ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// most filters calculate each row of the output on its own. these are
+// split into bands of rows, and when the op runs on the main thread, the
+// bands are calculated with sSched. when the executive calculates ops in
+// parallel, the op is already on a worker thread and does all bands
+// itself. every pixel is calculated exactly as before, the result does not
+// depend on the number of bands.
+
+typedef void (*GenBitmapBandCode)(void *data,sInt y0,sInt y1);
+
+struct GenBitmapBands
+{
+  GenBitmapBandCode Code;
+  void *Data;
+  sInt Rows;
+  sInt Count;
+};
+
+static void GenBitmapBandTask(sStsManager *,sStsThread *,sInt start,sInt count,void *data)
+{
+  GenBitmapBands *b = (GenBitmapBands *) data;
+  for(sInt i=start;i<start+count;i++)
+    (*b->Code)(b->Data,sMulDiv(b->Rows,i,b->Count),sMulDiv(b->Rows,i+1,b->Count));
+}
+
+// bands for <rows> rows of <pixels> pixels. small bitmaps are not split.
+// ops already running inside a workload (worker threads, but also the
+// master thread helping out in wExecutive::ExecuteParallel) stay serial,
+// workloads can not be nested.
+
+static sInt GetBandCount(sInt rows,sInt pixels,sInt perthread=4)
+{
+  if(!sSched || sSched->GetThreadCount()<2 || sSched->IsWorkloadActive())
+    return 1;
+  if(sS64(rows)*pixels<0x4000)
+    return 1;
+  return sClamp(sSched->GetThreadCount()*perthread,1,rows);
+}
+
+static void RunBands(GenBitmapBandCode code,void *data,sInt rows,sInt bands)
+{
+  if(bands>1)
+  {
+    GenBitmapBands b;
+    b.Code = code;
+    b.Data = data;
+    b.Rows = rows;
+    b.Count = bands;
+
+    sStsWorkload *wl = sSched->BeginWorkload();
+    wl->AddTask(wl->NewTask(GenBitmapBandTask,&b,bands,0));
+    wl->Start();
+    wl->Sync();
+    wl->End();
+  }
+  else if(rows>0)
+  {
+    (*code)(data,0,rows);
+  }
+}
+
+static void RunRows(GenBitmapBandCode code,void *data,sInt rows,sInt pixels)
+{
+  RunBands(code,data,rows,GetBandCount(rows,pixels));
+}
+
+/****************************************************************************/
+
+// each op adds its time to a counter. GenBitmapLogTimes() logs them, the
+// slowest first. ops that call other ops (like RotateMul) include the time
+// of these calls.
+
+struct GenBitmapTime
+{
+  const sChar *Name;
+  volatile sU64 Time;             // microseconds
+  volatile sU32 Calls;
+  GenBitmapTime *Next;
+
+  GenBitmapTime(const sChar *name);
+};
+
+static GenBitmapTime *GenBitmapTimes;
+
+GenBitmapTime::GenBitmapTime(const sChar *name)
+{
+  Name = name;
+  Time = 0;
+  Calls = 0;
+  Next = GenBitmapTimes;
+  GenBitmapTimes = this;
+}
+
+class GenBitmapTimer
+{
+  GenBitmapTime &Slot;
+  sU64 Start;
+public:
+  GenBitmapTimer(GenBitmapTime &slot) : Slot(slot) { Start = sGetTimeUS(); }
+  ~GenBitmapTimer() { sAtomicAdd(&Slot.Time,sInt(sGetTimeUS()-Start)); sAtomicInc(&Slot.Calls); }
+};
+
+#define GENBITMAP_TIME(name) static GenBitmapTime GenBitmapTime##name(L ## #name);
+#define GENBITMAP_TIMER(name) GenBitmapTimer timer(GenBitmapTime##name);
+
+GENBITMAP_TIME(Flat)
+GENBITMAP_TIME(Perlin)
+GENBITMAP_TIME(GlowRect)
+GENBITMAP_TIME(Dots)
+GENBITMAP_TIME(Cell)
+GENBITMAP_TIME(Gradient)
+GENBITMAP_TIME(Merge)
+GENBITMAP_TIME(Color)
+GENBITMAP_TIME(HSCB)
+GENBITMAP_TIME(ColorBalance)
+GENBITMAP_TIME(Blur)
+GENBITMAP_TIME(Sharpen)
+GENBITMAP_TIME(Rotate)
+GENBITMAP_TIME(RotateMul)
+GENBITMAP_TIME(Twirl)
+GENBITMAP_TIME(Distort)
+GENBITMAP_TIME(Normals)
+GENBITMAP_TIME(Unwrap)
+GENBITMAP_TIME(Bulge)
+GENBITMAP_TIME(Bump)
+GENBITMAP_TIME(Downsample)
+GENBITMAP_TIME(Text)
+GENBITMAP_TIME(Bricks)
+GENBITMAP_TIME(Vector)
+
+void GenBitmapLogTimes()
+{
+  sArray<GenBitmapTime *> list;
+  for(GenBitmapTime *t=GenBitmapTimes;t;t=t->Next)
+    if(t->Calls>0)
+      list.AddTail(t);
+
+  for(sInt i=1;i<list.GetCount();i++)
+    for(sInt j=i;j>0 && list[j-1]->Time<list[j]->Time;j--)
+      sSwap(list[j-1],list[j]);
+
+  sU64 total = 0;
+  GenBitmapTime *t;
+  sFORALL(list,t)
+    total += t->Time;
+  sLogF(L"bitmap",L"%d ms in bitmap ops\n",sInt(total/1000));
+  sFORALL(list,t)
+  {
+    sLogF(L"bitmap",L"%-14s %5d calls %7d ms %5.1f%%\n",t->Name,t->Calls,sInt(t->Time/1000),t->Time*100.0f/sMax<sU64>(total,1));
+    t->Time = 0;
+    t->Calls = 0;
+  }
+}
+
 /****************************************************************************/
 /***                                                                      ***/
 /***   Generator                                                          ***/
@@ -443,6 +601,31 @@ void GenBitmap::Init(sInt x,sInt y)
   }
 }
 
+template <class streamer> void GenBitmap::Serialize_(streamer &s)
+{
+  sInt version = s.Header(sSerId::Wz4GenBitmap,1); version;
+
+  sInt x = XSize;
+  sInt y = YSize;
+  s | x | y;
+  if(s.IsReading())
+  {
+    if(x<0 || y<0 || x>0x4000 || y>0x4000)
+    {
+      s.Fail();
+      return;
+    }
+    Init(x,y);
+  }
+  s.ArrayU64(Data,Size);
+  Atlas.Serialize(s);
+
+  s.Footer();
+}
+
+void GenBitmap::Serialize(sWriter &s) { Serialize_(s); }
+void GenBitmap::Serialize(sReader &s) { Serialize_(s); }
+
 void GenBitmap::Init(const sImage *img)
 {
   Init(img->SizeX,img->SizeY);
@@ -484,6 +667,7 @@ void GenBitmap::Blit(sInt x,sInt y,GenBitmap *src)
 
 void GenBitmap::Flat(sU32 color)
 {
+  GENBITMAP_TIMER(Flat)
   sU64 col = GetColor64(color);
   for(sInt i=0;i<Size;i++)
     Data[i] = col;
@@ -519,65 +703,43 @@ static sF32 noise2(sInt x,sInt y,sInt mask,sInt seed)
   return f;
 }
 
-void GenBitmap::Perlin(sInt freq,sInt oct,sF32 fadeoff,sInt seed,sInt mode,sF32 amp,sF32 gamma,sU32 col0,sU32 col1)
+struct PerlinBand
 {
-  sInt i;
-  sInt x,y,noffs;
-  sInt shiftx,shifty;
-  sF32 s;
-  sU64 *tile;
-  sInt gammaTable[1025];
-
-  GenBitmap *bm = this;
-
-  __m128i c0 = GetColor128(col0);
-  __m128i c1 = GetColor128(col1);
-
-  shiftx = 16-sFindLowerPower(bm->XSize);
-  shifty = 16-sFindLowerPower(bm->YSize);
-  tile = bm->Data;
-  seed &= 255;
-  mode &= 3;
-
-  for(i=0;i<1025;i++)
-    gammaTable[i] = sRange7fff(sFPow(i/1024.0f,gamma)*0x8000)*2;
-
-  if(mode & 1)
-  {
-    amp *= 0x8000;
-    noffs = 0;
-  }
-  else
-  {
-    amp *= 0x4000;
-    noffs = 0x4000;
-  }
-
-  sInt ampi = sInt(amp);
+  GenBitmap *Bitmap;
+  sInt Freq,Oct,Seed,Mode;
+  sF32 FadeOff;
+  sInt ShiftX,ShiftY;
+  sInt NOffs,AmpI;
+  sU32 Col0,Col1;
+  const sInt *GammaTable;
+  const sInt *SinTab;
+  const sInt *Poly;
+};
 
-  sInt sinTab[257];
-  if(mode & 2)
-  {
-    for(x=0;x<257;x++)
-      sinTab[x] = sInt(sFSin(sPI2F * x / 256.0f) * 0.5f * 65536.0f);
-  }
-#if 1
+static void PerlinRows(void *data,sInt y0,sInt y1)
+{
+  const PerlinBand *pb = (const PerlinBand *) data;
+  GenBitmap *bm = pb->Bitmap;
+  const sInt freq = pb->Freq;
+  const sInt oct = pb->Oct;
+  const sInt seed = pb->Seed;
+  const sInt mode = pb->Mode;
+  const sInt shiftx = pb->ShiftX;
+  const sInt shifty = pb->ShiftY;
+  const sInt *sinTab = pb->SinTab;
+  const sInt *poly = pb->Poly;
+  __m128i c0 = GetColor128(pb->Col0);
+  __m128i c1 = GetColor128(pb->Col1);
+  sU64 *tile = bm->Data + y0*bm->XSize;
   sInt *nrow = new sInt[bm->XSize];
-  sInt *poly = new sInt[bm->XSize>>freq];
-
-  for(x=0;x<(bm->XSize>>freq);x++)
-  {
-    sF32 f = 1.0f * x / (bm->XSize>>freq);
-    poly[x] = sInt(f*f*f*(10+f*(6*f-15))*16384.0f);
-  }
 
-  for(y=0;y<bm->YSize;y++)
+  for(sInt y=y0;y<y1;y++)
   {
     sSetMem(nrow,0,sizeof(sInt)*bm->XSize);
-    s = 1.0f;
+    sF32 s = 1.0f;
 
     // make some noise
-    for(i=freq;i<freq+oct;i++)
+    for(sInt i=freq;i<freq+oct;i++)
     {
       sInt xGrpSize = (shiftx+i < 16) ? sMin(bm->XSize,1<<(16-shiftx-i)) : 1;
       sInt groups = (shiftx+i < 16) ? bm->XSize>>(16-shiftx-i) : bm->XSize;
@@ -639,17 +801,88 @@ void GenBitmap::Perlin(sInt freq,sInt oct,sF32 fadeoff,sInt seed,sInt mode,sF32
         }
       }
 
-      s *= fadeoff;
+      s *= pb->FadeOff;
     }
 
     // resolve
-    for(x=0;x<bm->XSize;x++)
-      FadeColStore(*tile++,c0,c1,GetGamma(gammaTable,sRange7fff(sMulShift(nrow[x],ampi)+noffs)));
+    for(sInt x=0;x<bm->XSize;x++)
+      FadeColStore(*tile++,c0,c1,GetGamma(pb->GammaTable,sRange7fff(sMulShift(nrow[x],pb->AmpI)+pb->NOffs)));
   }
 
   delete[] nrow;
+}
+
+void GenBitmap::Perlin(sInt freq,sInt oct,sF32 fadeoff,sInt seed,sInt mode,sF32 amp,sF32 gamma,sU32 col0,sU32 col1)
+{
+  GENBITMAP_TIMER(Perlin)
+  sInt i;
+  sInt x;
+  sInt noffs;
+  sInt shiftx,shifty;
+  sInt gammaTable[1025];
+
+  GenBitmap *bm = this;
+
+  shiftx = 16-sFindLowerPower(bm->XSize);
+  shifty = 16-sFindLowerPower(bm->YSize);
+  seed &= 255;
+  mode &= 3;
+
+  for(i=0;i<1025;i++)
+    gammaTable[i] = sRange7fff(sFPow(i/1024.0f,gamma)*0x8000)*2;
+
+  if(mode & 1)
+  {
+    amp *= 0x8000;
+    noffs = 0;
+  }
+  else
+  {
+    amp *= 0x4000;
+    noffs = 0x4000;
+  }
+
+  sInt ampi = sInt(amp);
+
+  sInt sinTab[257];
+  if(mode & 2)
+  {
+    for(x=0;x<257;x++)
+      sinTab[x] = sInt(sFSin(sPI2F * x / 256.0f) * 0.5f * 65536.0f);
+  }
+#if 1
+  sInt *poly = new sInt[bm->XSize>>freq];
+
+  for(x=0;x<(bm->XSize>>freq);x++)
+  {
+    sF32 f = 1.0f * x / (bm->XSize>>freq);
+    poly[x] = sInt(f*f*f*(10+f*(6*f-15))*16384.0f);
+  }
+
+  PerlinBand pb;
+  pb.Bitmap = bm;
+  pb.Freq = freq;
+  pb.Oct = oct;
+  pb.Seed = seed;
+  pb.Mode = mode;
+  pb.FadeOff = fadeoff;
+  pb.ShiftX = shiftx;
+  pb.ShiftY = shifty;
+  pb.NOffs = noffs;
+  pb.AmpI = ampi;
+  pb.Col0 = col0;
+  pb.Col1 = col1;
+  pb.GammaTable = gammaTable;
+  pb.SinTab = sinTab;
+  pb.Poly = poly;
+  RunRows(PerlinRows,&pb,bm->YSize,bm->XSize);
+
   delete[] poly;
 #else
+  __m128i c0 = GetColor128(col0);
+  __m128i c1 = GetColor128(col1);
+  sU64 *tile = bm->Data;
+
   for(y=0;y<bm->YSize;y++)
   {
     for(x=0;x<bm->XSize;x++)
@@ -1261,6 +1494,7 @@ void __stdcall Bitmap_Inner(sU64 *d,sU64 *s,sInt count,sInt mode,sU64 *x)
 
 void GenBitmap::Merge(sInt mode,GenBitmap *other)
 {
+  GENBITMAP_TIMER(Merge)
   static sU8 modes[] = 
   {
     BI_ADD,BI_SUB,BI_MUL,BI_DIFF,BI_ALPHA,
@@ -1274,6 +1508,7 @@ void GenBitmap::Merge(sInt mode,GenBitmap *other)
 
 void GenBitmap::Color(sInt mode,sU32 col)
 {
+  GENBITMAP_TIMER(Color)
   sU64 color;
   
   color = GetColor64(col);
@@ -1284,6 +1519,7 @@ void GenBitmap::Color(sInt mode,sU32 col)
 
 void GenBitmap::GlowRect(sF32 cx,sF32 cy,sF32 rx,sF32 ry,sF32 sx,sF32 sy,sU32 color,sF32 alpha,sF32 power,sInt wrap,sInt bug)
 {
+  GENBITMAP_TIMER(GlowRect)
   sU64 *d;
   sInt x,y;
   sF32 a;
@@ -1377,6 +1613,7 @@ void GenBitmap::GlowRect(sF32 cx,sF32 cy,sF32 rx,sF32 ry,sF32 sx,sF32 sy,sU32 co
 
 void GenBitmap::Dots(sU32 color0,sU32 color1,sInt count,sInt seed)
 {
+  GENBITMAP_TIMER(Dots)
   sU64 *d;
   sInt f;
   sInt x;
@@ -1406,28 +1643,29 @@ void GenBitmap::Dots(sU32 color0,sU32 color1,sInt count,sInt seed)
 /***                                                                      ***/
 /****************************************************************************/
 
-void GenBitmap::HSCB(sF32 fh,sF32 fs,sF32 fc,sF32 fb)
+struct HSCBBand
 {
-  sU16 *d,*s;
-  sInt i;
-  sInt ch,ffh,ffs;  
-  sInt cr,cg,cb,min,max,mm;
-  sInt gammaTable[1025];
-  sBool adjustHSV;
+  GenBitmap *Bitmap;
+  const sInt *GammaTable;
+  sInt ffh,ffs;
+  sBool AdjustHSV;
+};
 
-  d = (sU16 *) Data;
-  s = (sU16 *) Data;
-  
-  fc = fc*fc;
-  for(i=0;i<1025;i++)
-    gammaTable[i] = sFPow((i*32+0.01)/32768.0f,fc)*32768.0f*fb;
+static void HSCBRows(void *data,sInt y0,sInt y1)
+{
+  const HSCBBand *hb = (const HSCBBand *) data;
+  const sInt *gammaTable = hb->GammaTable;
+  sInt ffh = hb->ffh;
+  sInt ffs = hb->ffs;
+  sBool adjustHSV = hb->AdjustHSV;
+  sInt ch;
+  sInt cr,cg,cb,min,max,mm;
 
-  ffh = sInt(fh * 6 * 65536) % (6*65536);
-  if(ffh<-0) ffh+=(6*65536);
-  ffs = fs * 65536;
-  adjustHSV = ffh != 0 || ffs != 65536;
+  sU16 *d = (sU16 *) (hb->Bitmap->Data + y0*hb->Bitmap->XSize);
+  sU16 *s = d;
+  sInt count = (y1-y0)*hb->Bitmap->XSize;
 
-  for(i=0;i<Size;i++)
+  for(sInt i=0;i<count;i++)
   {
 
 // read, gamma, brightness
@@ -1506,6 +1744,30 @@ void GenBitmap::HSCB(sF32 fh,sF32 fs,sF32 fc,sF32 fb)
   }
 }
 
+void GenBitmap::HSCB(sF32 fh,sF32 fs,sF32 fc,sF32 fb)
+{
+  GENBITMAP_TIMER(HSCB)
+  sInt i;
+  sInt ffh,ffs;  
+  sInt gammaTable[1025];
+  
+  fc = fc*fc;
+  for(i=0;i<1025;i++)
+    gammaTable[i] = sFPow((i*32+0.01)/32768.0f,fc)*32768.0f*fb;
+
+  ffh = sInt(fh * 6 * 65536) % (6*65536);
+  if(ffh<-0) ffh+=(6*65536);
+  ffs = fs * 65536;
+
+  HSCBBand hb;
+  hb.Bitmap = this;
+  hb.GammaTable = gammaTable;
+  hb.ffh = ffh;
+  hb.ffs = ffs;
+  hb.AdjustHSV = ffh != 0 || ffs != 65536;
+  RunRows(HSCBRows,&hb,YSize,XSize);
+}
+
 /****************************************************************************/
 
 GenBitmap * __stdcall Bitmap_Wavelet(GenBitmap *bm,sInt mode,sInt count)
@@ -1617,18 +1879,154 @@ GenBitmap * __stdcall Bitmap_Wavelet(GenBitmap *bm,sInt mode,sInt count)
 /***                                                                      ***/
 /****************************************************************************/
 
+struct BlurBand
+{
+  sU16 *Src;                      // image, and the row buffer for the passes
+  sU16 *Dest;
+  sInt XSize,YSize;
+  sInt Order;
+  sInt Size;
+  sInt f0,f1;
+  sInt Amp,AmpC;
+};
+
+// all passes of the box filter, row by row
+
+static void BlurRows(void *data,sInt y0,sInt y1)
+{
+  const BlurBand *bb = (const BlurBand *) data;
+  sInt size = bb->Size;
+  sInt f0 = bb->f0;
+  sInt f1 = bb->f1;
+  sInt amp = bb->Amp;
+  sInt ampc = bb->AmpC;
+  sInt XSize = bb->XSize;
+  sU16 *p,*q,*pp,*qq;
+  sInt s1,s2,d;
+  sInt ordercount;
+
+  sU32 mask = XSize * 4 - 1;
+  __m128i f1mf0   = _mm_set_epi16(0,f1-f0,0,f1-f0,0,f1-f0,0,f1-f0);
+  __m128i f0f1    = _mm_set_epi16(f1,f0,f1,f0,f1,f0,f1,f0);
+  __m128i amplo   = _mm_set1_epi16(amp);
+  __m128i amphi   = _mm_set1_epi16(amp>>16);
+  __m128i ampclip = _mm_set1_epi32(ampc);
+  __m128i add     = _mm_set1_epi16(-0x8000);
+
+  for(sInt y=y0;y<y1;y++)
+  {
+    pp = bb->Src + y*XSize*4;
+    qq = bb->Dest + y*XSize*4;
+    ordercount = bb->Order;
+
+    do
+    {
+      p = pp;
+      q = qq;
+      pp = q;
+      qq = p;
+
+      s2 = s1 = -((size+1)/2)*4;
+      d = 0;
+
+      __m128i pix1    = _mm_loadl_epi64((const __m128i *) (p + ((s2+0) & mask)));
+      __m128i pix1u   = _mm_unpacklo_epi16(pix1,pix1);
+      __m128i akku    = _mm_madd_epi16(pix1u,f1mf0);
+      for(sInt x=0;x<size;x++)
+      {
+        __m128i pix1    = _mm_loadl_epi64((const __m128i *) (p + ((s1+0) & mask)));
+        __m128i pix2    = _mm_loadl_epi64((const __m128i *) (p + ((s1+4) & mask)));
+        __m128i mixed   = _mm_unpacklo_epi16(pix1,pix2);
+        __m128i mult    = _mm_madd_epi16(mixed,f0f1);
+        akku            = _mm_add_epi32(akku,mult);
+        s1              = s1 + 4;
+      }
+
+      for(sInt x=0;x<XSize;x++)
+      {
+        __m128i pix1    = _mm_loadl_epi64((const __m128i *) (p + ((s1+0) & mask)));
+        __m128i pix2    = _mm_loadl_epi64((const __m128i *) (p + ((s1+4) & mask)));
+        __m128i mixed   = _mm_unpacklo_epi16(pix1,pix2);
+        __m128i mult    = _mm_madd_epi16(mixed,f0f1);
+        akku            = _mm_add_epi32(akku,mult);
+        s1              = s1 + 4;
+
+        __m128i akkugt  = _mm_cmpgt_epi32(akku,ampclip);
+        __m128i akkuhi  = _mm_srli_epi32(akku,22);
+        __m128i akkulo  = _mm_srai_epi32(_mm_slli_epi32(akku,10),16);
+        __m128i out     = _mm_packs_epi32(akkugt,akkugt);
+        __m128i akhi    = _mm_packs_epi32(akkuhi,akkuhi);
+        __m128i aklo    = _mm_packs_epi32(akkulo,akkulo);
+        out             = _mm_adds_epu16(out,_mm_mullo_epi16(akhi,amplo));
+        out             = _mm_adds_epu16(out,_mm_mullo_epi16(aklo,amphi));
+        out             = _mm_adds_epu16(out,_mm_mulhi_epu16(aklo,amplo));
+        out             = _mm_add_epi16(out,add);
+        out             = _mm_subs_epi16(out,add);
+
+        _mm_storel_epi64((__m128i *) (q+d),out);
+        d               = d + 4;
+
+        pix1            = _mm_loadl_epi64((const __m128i *) (p + ((s2+0) & mask)));
+        pix2            = _mm_loadl_epi64((const __m128i *) (p + ((s2+4) & mask)));
+        mixed           = _mm_unpacklo_epi16(pix2,pix1);
+        mult            = _mm_madd_epi16(mixed,f0f1);
+        akku            = _mm_sub_epi32(akku,mult);
+        s2              = s2 + 4;
+      }
+
+      ordercount--;
+    }
+    while(ordercount);
+  }
+}
+
+// transpose Src to Dest, in strips of 8 columns
+
+static void BlurTranspose(void *data,sInt x0,sInt x1)
+{
+  const BlurBand *bb = (const BlurBand *) data;
+  sInt s1 = bb->YSize * 4;
+  sInt s2 = bb->XSize * 4;
+
+  for(sInt x=x0*8;x<x1*8;x+=8)
+  {
+    sU16 *p = bb->Src + x*4;
+    sU16 *q = bb->Dest + x*s1;
+    for(sInt y=0;y<bb->YSize;y++)
+    {
+      // no point using aligned 128-bit loads here, we scatter on store.
+      __m128i m0    = _mm_loadl_epi64((const __m128i *) (p+ 0));
+      __m128i m1    = _mm_loadl_epi64((const __m128i *) (p+ 4));
+      __m128i m2    = _mm_loadl_epi64((const __m128i *) (p+ 8));
+      __m128i m3    = _mm_loadl_epi64((const __m128i *) (p+12));
+      __m128i m4    = _mm_loadl_epi64((const __m128i *) (p+16));
+      __m128i m5    = _mm_loadl_epi64((const __m128i *) (p+20));
+      __m128i m6    = _mm_loadl_epi64((const __m128i *) (p+24));
+      __m128i m7    = _mm_loadl_epi64((const __m128i *) (p+28));
+      _mm_storel_epi64((__m128i *) (q + 0*s1),m0);
+      _mm_storel_epi64((__m128i *) (q + 1*s1),m1);
+      _mm_storel_epi64((__m128i *) (q + 2*s1),m2);
+      _mm_storel_epi64((__m128i *) (q + 3*s1),m3);
+      _mm_storel_epi64((__m128i *) (q + 4*s1),m4);
+      _mm_storel_epi64((__m128i *) (q + 5*s1),m5);
+      _mm_storel_epi64((__m128i *) (q + 6*s1),m6);
+      _mm_storel_epi64((__m128i *) (q + 7*s1),m7);
+
+      q += 4;
+      p += s2;
+    }
+  }
+}
+
 void GenBitmap::Blur(sInt flags,sF32 sx,sF32 sy,sF32 _amp)
 {
- 
-  sInt x,y;
+  GENBITMAP_TIMER(Blur)
   sInt size,size2;
-  sU32 mask;
-  sInt s1,s2,d;
   sU16 *p,*q,*pp,*qq,*po,*qo;
-  sInt ordercount;
   sInt amp,ampc,famp;
   sInt f0,f1;
   sInt order;
+  BlurBand bb;
 
 // prepare
 
@@ -1657,84 +2055,21 @@ void GenBitmap::Blur(sInt flags,sF32 sx,sF32 sy,sF32 _amp)
     else
       ampc = 0x7fffffff;
 
-    mask = XSize * 4 - 1;
     po = pp;
     qo = qq;
-    y = 0;
-    __m128i f1mf0   = _mm_set_epi16(0,f1-f0,0,f1-f0,0,f1-f0,0,f1-f0);
-    __m128i f0f1    = _mm_set_epi16(f1,f0,f1,f0,f1,f0,f1,f0);
-    __m128i amplo   = _mm_set1_epi16(amp);
-    __m128i amphi   = _mm_set1_epi16(amp>>16);
-    __m128i ampclip = _mm_set1_epi32(ampc);
-    __m128i add     = _mm_set1_epi16(-0x8000);
-
-    do
-    {
-      pp = po + y*XSize*4;
-      qq = qo + y*XSize*4;
-      ordercount = order;
-
-      do
-      {
-        p = pp;
-        q = qq;
-        pp = q;
-        qq = p;
 
-        s2 = s1 = -((size+1)/2)*4;
-        d = 0;
+    bb.Src = po;
+    bb.Dest = qo;
+    bb.XSize = XSize;
+    bb.YSize = YSize;
+    bb.Order = order;
+    bb.Size = size;
+    bb.f0 = f0;
+    bb.f1 = f1;
+    bb.Amp = amp;
+    bb.AmpC = ampc;
+    RunRows(BlurRows,&bb,YSize,XSize*order);
 
-        __m128i pix1    = _mm_loadl_epi64((const __m128i *) (p + ((s2+0) & mask)));
-        __m128i pix1u   = _mm_unpacklo_epi16(pix1,pix1);
-        __m128i akku    = _mm_madd_epi16(pix1u,f1mf0);
-        for(sInt x=0;x<size;x++)
-        {
-          __m128i pix1    = _mm_loadl_epi64((const __m128i *) (p + ((s1+0) & mask)));
-          __m128i pix2    = _mm_loadl_epi64((const __m128i *) (p + ((s1+4) & mask)));
-          __m128i mixed   = _mm_unpacklo_epi16(pix1,pix2);
-          __m128i mult    = _mm_madd_epi16(mixed,f0f1);
-          akku            = _mm_add_epi32(akku,mult);
-          s1              = s1 + 4;
-        }
-
-        for(sInt x=0;x<XSize;x++)
-        {
-          __m128i pix1    = _mm_loadl_epi64((const __m128i *) (p + ((s1+0) & mask)));
-          __m128i pix2    = _mm_loadl_epi64((const __m128i *) (p + ((s1+4) & mask)));
-          __m128i mixed   = _mm_unpacklo_epi16(pix1,pix2);
-          __m128i mult    = _mm_madd_epi16(mixed,f0f1);
-          akku            = _mm_add_epi32(akku,mult);
-          s1              = s1 + 4;
-
-          __m128i akkugt  = _mm_cmpgt_epi32(akku,ampclip);
-          __m128i akkuhi  = _mm_srli_epi32(akku,22);
-          __m128i akkulo  = _mm_srai_epi32(_mm_slli_epi32(akku,10),16);
-          __m128i out     = _mm_packs_epi32(akkugt,akkugt);
-          __m128i akhi    = _mm_packs_epi32(akkuhi,akkuhi);
-          __m128i aklo    = _mm_packs_epi32(akkulo,akkulo);
-          out             = _mm_adds_epu16(out,_mm_mullo_epi16(akhi,amplo));
-          out             = _mm_adds_epu16(out,_mm_mullo_epi16(aklo,amphi));
-          out             = _mm_adds_epu16(out,_mm_mulhi_epu16(aklo,amplo));
-          out             = _mm_add_epi16(out,add);
-          out             = _mm_subs_epi16(out,add);
-
-          _mm_storel_epi64((__m128i *) (q+d),out);
-          d               = d + 4;
-
-          pix1            = _mm_loadl_epi64((const __m128i *) (p + ((s2+0) & mask)));
-          pix2            = _mm_loadl_epi64((const __m128i *) (p + ((s2+4) & mask)));
-          mixed           = _mm_unpacklo_epi16(pix2,pix1);
-          mult            = _mm_madd_epi16(mixed,f0f1);
-          akku            = _mm_sub_epi32(akku,mult);
-          s2              = s2 + 4;
-        }
-
-        ordercount--;
-      }
-      while(ordercount);
-      y++;
-    }
-    while(y<YSize);
     pp = po;
     qq = qo;
     if(order&1)
@@ -1744,36 +2079,12 @@ void GenBitmap::Blur(sInt flags,sF32 sx,sF32 sy,sF32 _amp)
     q = qq;
     pp = q;
     qq = p;
-    s1 = YSize * 4;
-    s2 = XSize * 4;
-    for(x=0;x<XSize;x+=8)
-    {
-      p = qq + x*4;
-      for(y=0;y<YSize;y++)
-      {
-        // no point using aligned 128-bit loads here, we scatter on store.
-        __m128i m0    = _mm_loadl_epi64((const __m128i *) (p+ 0));
-        __m128i m1    = _mm_loadl_epi64((const __m128i *) (p+ 4));
-        __m128i m2    = _mm_loadl_epi64((const __m128i *) (p+ 8));
-        __m128i m3    = _mm_loadl_epi64((const __m128i *) (p+12));
-        __m128i m4    = _mm_loadl_epi64((const __m128i *) (p+16));
-        __m128i m5    = _mm_loadl_epi64((const __m128i *) (p+20));
-        __m128i m6    = _mm_loadl_epi64((const __m128i *) (p+24));
-        __m128i m7    = _mm_loadl_epi64((const __m128i *) (p+28));
-        _mm_storel_epi64((__m128i *) (q + 0*s1),m0);
-        _mm_storel_epi64((__m128i *) (q + 1*s1),m1);
-        _mm_storel_epi64((__m128i *) (q + 2*s1),m2);
-        _mm_storel_epi64((__m128i *) (q + 3*s1),m3);
-        _mm_storel_epi64((__m128i *) (q + 4*s1),m4);
-        _mm_storel_epi64((__m128i *) (q + 5*s1),m5);
-        _mm_storel_epi64((__m128i *) (q + 6*s1),m6);
-        _mm_storel_epi64((__m128i *) (q + 7*s1),m7);
-
-        q += 4;
-        p += s2;
-      }
-      q += 7*s1;
-    }
+
+    bb.Src = qq;
+    bb.Dest = q;
+    sInt strips = (XSize+7)/8;
+    RunBands(BlurTranspose,&bb,strips,GetBandCount(strips,YSize*8));
+
     sSwap(XSize,YSize);
     size = size2;
   }
@@ -1828,23 +2139,64 @@ GenBitmap * __stdcall Bitmap_Mask(GenBitmap *bm,GenBitmap *bb,GenBitmap *bc,sInt
 /***                                                                      ***/
 /****************************************************************************/
 
-void GenBitmap::Rotate(GenBitmap *in,sF32 cx,sF32 cy,sF32 angle,sF32 sx,sF32 sy,sF32 tx,sF32 ty,sInt border)
+struct RotateBand
 {
-  sInt x,y;
-  sU16 *d;
-  sU64 *s;
-  sInt xs,ys;
-  sInt txs,tys;
+  BilinearContext *Ctx;
+  sU64 *Dest;
+  sInt XSize;
   sInt m00,m01,m10,m11,m20,m21;
-  sF32 rotangle;
-  BilinearContext ctx;
+  sInt Border;
+};
 
-// prepare
-  xs = in->XSize;
-  ys = in->YSize;
-  txs = XSize;
-  tys = YSize;
-  d = (sU16 *)Data;
+static void RotateRows(void *data,sInt y0,sInt y1)
+{
+  const RotateBand *rb = (const RotateBand *) data;
+  BilinearContext *ctx = rb->Ctx;
+  sU64 *d = rb->Dest + y0*rb->XSize;
+
+  for(sInt y=y0;y<y1;y++)
+  {
+    sInt u = y*rb->m10+rb->m20;
+    sInt v = y*rb->m11+rb->m21;
+
+    if(rb->Border & 4)
+    {
+      for(sInt x=0;x<rb->XSize;x++)
+      {
+        PointFilter(ctx,d,u,v);
+        u += rb->m00;
+        v += rb->m01;
+        d++;
+      }
+    }
+    else
+    {
+      for(sInt x=0;x<rb->XSize;x++)
+      {
+        BilinearFilter(ctx,d,u,v);
+        u += rb->m00;
+        v += rb->m01;
+        d++;
+      }
+    }
+  }
+}
+
+void GenBitmap::Rotate(GenBitmap *in,sF32 cx,sF32 cy,sF32 angle,sF32 sx,sF32 sy,sF32 tx,sF32 ty,sInt border)
+{
+  GENBITMAP_TIMER(Rotate)
+  sU64 *s;
+  sInt xs,ys;
+  sInt txs,tys;
+  sInt m00,m01,m10,m11,m20,m21;
+  sF32 rotangle;
+  BilinearContext ctx;
+
+// prepare
+  xs = in->XSize;
+  ys = in->YSize;
+  txs = XSize;
+  tys = YSize;
   s = in->Data;
 
   if(in==this)
@@ -1866,33 +2218,16 @@ void GenBitmap::Rotate(GenBitmap *in,sF32 cx,sF32 cy,sF32 angle,sF32 sx,sF32 sy,
 //  m20 = sInt( tx*xs*0x10000 - ((txs-1)*m00+(tys-1)*m10)/2);
 //  m21 = sInt( ty*ys*0x10000 - ((txs-1)*m01+(tys-1)*m11)/2);
   BilinearSetup(&ctx,s,xs,ys,border);
-  
-  for(y=0;y<tys;y++)
-  {
-    sInt u = y*m10+m20;
-    sInt v = y*m11+m21;
 
-    if(border & 4)
-    {
-      for(x=0;x<txs;x++)
-      {
-        PointFilter(&ctx,(sU64 *)d,u,v);
-        u += m00;
-        v += m01;
-        d += 4;
-      }
-    }
-    else
-    {
-      for(x=0;x<txs;x++)
-      {
-        BilinearFilter(&ctx,(sU64 *)d,u,v);
-        u += m00;
-        v += m01;
-        d += 4;
-      }
-    }
-  }
+  RotateBand rb;
+  rb.Ctx = &ctx;
+  rb.Dest = Data;
+  rb.XSize = txs;
+  rb.m00 = m00; rb.m01 = m01;
+  rb.m10 = m10; rb.m11 = m11;
+  rb.m20 = m20; rb.m21 = m21;
+  rb.Border = border;
+  RunRows(RotateRows,&rb,tys,txs);
 
   if(s!=in->Data)
     delete[] s;
@@ -1904,13 +2239,72 @@ static sInt CSLookup(const sInt *table,sInt value)
   return table[ind] + (((table[ind+1] - table[ind]) * (value & 63)) >> 6);
 }
 
+struct TwirlBand
+{
+  BilinearContext *Ctx;
+  sU64 *Dest;
+  sInt XSize,YSize;
+  const sInt (*CSTable)[1025];
+  sInt fcx,fcy,frx,fry;
+  sInt xstep,ystep;
+};
+
+static void TwirlRows(void *data,sInt y0,sInt y1)
+{
+  const TwirlBand *tb = (const TwirlBand *) data;
+  sInt xs = tb->XSize;
+  sInt ys = tb->YSize;
+  sInt fcx = tb->fcx;
+  sInt fcy = tb->fcy;
+  sInt px,py,dx,dy,u,v;
+  sU64 *d = tb->Dest + y0*xs;
+
+  py = y0*tb->ystep;
+
+  for(sInt y=y0;y<y1;y++)
+  {
+    dy = py - fcy;
+    sInt distb = 0x10000 - sMulDiv(dy,dy,tb->fry);
+
+    px = 0;
+
+    for(sInt x=0;x<xs;x++)
+    {
+      dx = px - fcx;
+      sInt dist = distb - sMulDiv(dx,dx,tb->frx);
+      
+      if(dist>0)
+      {
+        sInt fsin = CSLookup(tb->CSTable[0],dist);
+        sInt fcos = CSLookup(tb->CSTable[1],dist);
+
+        u = fcx + sMulShift(dx,fcos) + sMulShift(dy,fsin);
+        v = fcy - sMulShift(dx,fsin) + sMulShift(dy,fcos);
+      }
+      else
+      {
+        u = px;
+        v = py;
+      }
+      
+      //BilinearFilter((sU64*)d,(sU64*)s,xs,ys,sInt(u*0x10000*xs),sInt(v*0x10000*ys),border);
+      //BilinearFilter(&ctx,(sU64 *)d,sInt(u*0x10000*xs),sInt(v*0x10000*ys));
+      BilinearFilter(tb->Ctx,d,u*xs,v*ys);
+      d++;
+
+      px += tb->xstep;
+    }
+
+    py += tb->ystep;
+  }
+}
+
 void GenBitmap::Twirl(GenBitmap *src,sF32 strength,sF32 gamma,sF32 rx,sF32 ry,sF32 cx,sF32 cy,sInt border)
 {
+  GENBITMAP_TIMER(Twirl)
   sInt CSTable[2][1025];
-  sInt x,y;
-  sU16 *s,*d;
+  sInt x;
   sInt xs,ys;
-  sInt px,py,dx,dy,u,v;
   BilinearContext ctx;
 
   sVERIFY(Size==src->Size);
@@ -1919,9 +2313,6 @@ void GenBitmap::Twirl(GenBitmap *src,sF32 strength,sF32 gamma,sF32 rx,sF32 ry,sF
 
   if(rx!=0 && ry!=0)
   {
-    d = (sU16 *)Data;
-    s = (sU16 *)src->Data;
-
     xs = XSize;
     ys = YSize;
     rx = rx*rx;
@@ -1929,7 +2320,7 @@ void GenBitmap::Twirl(GenBitmap *src,sF32 strength,sF32 gamma,sF32 rx,sF32 ry,sF
 //    rx*=0.25f;
 //    ry*=0.25f;
     strength*=sPI2F;
-    BilinearSetup(&ctx,(sU64 *)s,xs,ys,border);
+    BilinearSetup(&ctx,src->Data,xs,ys,border);
 
   // calc table
     for(x=0;x<=1024;x++)
@@ -1942,53 +2333,21 @@ void GenBitmap::Twirl(GenBitmap *src,sF32 strength,sF32 gamma,sF32 rx,sF32 ry,sF
       CSTable[1][x] = 65536.0f * dcos;
     }
 
-    sInt fcx = cx * 65536.0f;
-    sInt fcy = cy * 65536.0f;
-    sInt frx = rx * 65536.0f;
-    sInt fry = ry * 65536.0f;
-    sInt xstep = 0x10000 / xs;
-    sInt ystep = 0x10000 / ys;
-
   // rotate
 
-    py = 0;
-
-    for(y=0;y<ys;y++)
-    {
-      dy = py - fcy;
-      sInt distb = 0x10000 - sMulDiv(dy,dy,fry);
-
-      px = 0;
-
-      for(x=0;x<xs;x++)
-      {
-        dx = px - fcx;
-        sInt dist = distb - sMulDiv(dx,dx,frx);
-        
-        if(dist>0)
-        {
-          sInt fsin = CSLookup(CSTable[0],dist);
-          sInt fcos = CSLookup(CSTable[1],dist);
-
-          u = fcx + sMulShift(dx,fcos) + sMulShift(dy,fsin);
-          v = fcy - sMulShift(dx,fsin) + sMulShift(dy,fcos);
-        }
-        else
-        {
-          u = px;
-          v = py;
-        }
-        
-        //BilinearFilter((sU64*)d,(sU64*)s,xs,ys,sInt(u*0x10000*xs),sInt(v*0x10000*ys),border);
-        //BilinearFilter(&ctx,(sU64 *)d,sInt(u*0x10000*xs),sInt(v*0x10000*ys));
-        BilinearFilter(&ctx,(sU64 *)d,u*xs,v*ys);
-        d+=4;
-
-        px += xstep;
-      }
-
-      py += ystep;
-    }
+    TwirlBand tb;
+    tb.Ctx = &ctx;
+    tb.Dest = Data;
+    tb.XSize = xs;
+    tb.YSize = ys;
+    tb.CSTable = CSTable;
+    tb.fcx = cx * 65536.0f;
+    tb.fcy = cy * 65536.0f;
+    tb.frx = rx * 65536.0f;
+    tb.fry = ry * 65536.0f;
+    tb.xstep = 0x10000 / xs;
+    tb.ystep = 0x10000 / ys;
+    RunRows(TwirlRows,&tb,ys,xs);
   }
   else
   {
@@ -1998,6 +2357,7 @@ void GenBitmap::Twirl(GenBitmap *src,sF32 strength,sF32 gamma,sF32 rx,sF32 ry,sF
 
 void GenBitmap::RotateMul(sF32 cx,sF32 cy,sF32 angle,sF32 sx,sF32 sy,sF32 tx,sF32 ty,sInt border,sU32 color,sInt mode,sInt count,sU32 fade)
 {
+  GENBITMAP_TIMER(RotateMul)
   GenBitmap *bb,*bo;
   sInt cr,cg,cb,ca,i;
   Color(0,color);
@@ -2076,13 +2436,41 @@ void GenBitmap::RotateMul(sF32 cx,sF32 cy,sF32 angle,sF32 sx,sF32 sy,sF32 tx,sF3
 
 /****************************************************************************/
 
+struct DistortBand
+{
+  BilinearContext *Ctx;
+  sU64 *Dest;
+  const sU16 *Map;
+  sInt XSize;
+  sInt bumpx,bumpy;
+};
+
+static void DistortRows(void *data,sInt y0,sInt y1)
+{
+  const DistortBand *db = (const DistortBand *) data;
+  sInt xs = db->XSize;
+  sU64 *t = db->Dest + y0*xs;
+  const sU16 *a = db->Map + y0*xs*4;
+  sInt u,v;
+
+  for(sInt y=y0;y<y1;y++)
+  {
+    for(sInt x=0;x<xs;x++)
+    {
+      u = ((x)<<16) + ((a[2]-0x4000)*db->bumpx);
+      v = ((y)<<16) + ((a[1]-0x4000)*db->bumpy);
+      BilinearFilter(db->Ctx,t,u,v);
+      //BilinearFilter((sU64*)t,(sU64*)d,xs,ys,u,v,border);
+      t++;
+      a+=4;
+    }
+  }
+}
+
 void GenBitmap::Distort(GenBitmap *src,GenBitmap *map,sF32 dist,sInt border)
 {
-  sInt x,y;
-  sU16 *t,*d,*a;
+  GENBITMAP_TIMER(Distort)
   sInt xs,ys;
-  sInt u,v;
-  sInt bumpx,bumpy;
   BilinearContext ctx;
 
   sVERIFY(Size==src->Size);
@@ -2090,29 +2478,20 @@ void GenBitmap::Distort(GenBitmap *src,GenBitmap *map,sF32 dist,sInt border)
 
 // prepare
 
-  t = (sU16 *)Data;
-  d = (sU16 *)src->Data;
-  a = (sU16 *)map->Data;
   xs = XSize;
   ys = YSize;
-  bumpx = (dist*xs)*4;
-  bumpy = (dist*ys)*4;
-  BilinearSetup(&ctx,(sU64 *)d,xs,ys,border);
+  BilinearSetup(&ctx,src->Data,xs,ys,border);
 
 // rotate 
 
-  for(y=0;y<ys;y++)
-  {
-    for(x=0;x<xs;x++)
-    {
-      u = ((x)<<16) + ((a[2]-0x4000)*bumpx);
-      v = ((y)<<16) + ((a[1]-0x4000)*bumpy);
-      BilinearFilter(&ctx,(sU64 *)t,u,v);
-      //BilinearFilter((sU64*)t,(sU64*)d,xs,ys,u,v,border);
-      t+=4;
-      a+=4;
-    }
-  }
+  DistortBand db;
+  db.Ctx = &ctx;
+  db.Dest = Data;
+  db.Map = (sU16 *)map->Data;
+  db.XSize = xs;
+  db.bumpx = (dist*xs)*4;
+  db.bumpy = (dist*ys)*4;
+  RunRows(DistortRows,&db,ys,xs);
 }
 
 /****************************************************************************/
@@ -2130,95 +2509,226 @@ static sInt filterbumpsharp(sU16 *s,sInt pos,sInt mask,sInt step)
   return 4*(s[(pos-step)&mask] - s[pos&mask]);
 }
 
-void GenBitmap::Normals(GenBitmap *src,sF32 _dist,sInt mode)
+struct NormalsBand
 {
-  sInt shiftx,shifty;
-  sInt xs,ys;
-  sInt x,y;
-  //sU64 *mem;
-  sU16 *sx,*sy,*s,*d;
+  const sU16 *Src;
+  sU16 *Dest;
+  sInt XSize,YSize;
+  sInt ShiftX,ShiftY;
+  sInt Dist;
+  sInt Mode;
+};
+
+static sINLINE void NormalsPixel(const NormalsBand *nb,sU16 *d,sInt x,sInt y)
+{
+  sInt xs = nb->XSize;
+  sInt ys = nb->YSize;
+  sU16 *sx = (sU16 *) nb->Src + y*xs*4;
+  sU16 *sy = (sU16 *) nb->Src + x*4;
   sInt vx,vy,vz;
   sF32 e;
-  sInt dist;
 
-  sVERIFY(Size==src->Size);
+  if(nb->Mode&4)
+  {
+    vx = filterbumpsharp(sx,x*4,(xs-1)*4,4);
+    vy = filterbumpsharp(sy,y*xs*4,(ys-1)*xs*4,xs*4);
+  }
+  else
+  {
+    vx = filterbump(sx,x*4,(xs-1)*4,4);
+    vy = filterbump(sy,y*xs*4,(ys-1)*xs*4,xs*4);
+  }
+/*
+  vx = sx[((x-2)&(xs-1))*4]*1
+     + sx[((x-1)&(xs-1))*4]*3
+     - sx[((x  )&(xs-1))*4]*3
+     - sx[((x+1)&(xs-1))*4]*1;      
+
+  vy = sy[((y-2)&(ys-1))*xs*4]*1
+     + sy[((y-1)&(ys-1))*xs*4]*3
+     - sy[((y  )&(ys-1))*xs*4]*3
+     - sy[((y+1)&(ys-1))*xs*4]*1;
+*/
+  vx = sRange7fff((((vx) * (nb->Dist>>4))>>(20-nb->ShiftX))+0x4000)-0x4000;
+  vy = sRange7fff((((vy) * (nb->Dist>>4))>>(20-nb->ShiftY))+0x4000)-0x4000;
+  vz = 0;
+
+  if(nb->Mode&1)
+  {
+    vz = (0x3fff*0x3fff)-vx*vx-vy*vy;
+    if(vz>0)
+    {
+//      vz = sFSqrt(vz/16384.0f/16384.0f)*0x3fff;
+      vz = sFSqrt(vz);
+    }
+    else
+    {
+      e = sFInvSqrt(vx*vx+vy*vy)*0x3fff;
+      vx *= e;
+      vy *= e;
+      vz = 0;
+    }
+  }
+  if(nb->Mode&2)
+  {
+    sSwap(vx,vy);
+    vy=-vy;
+  }
+
+  d[0] = vz+0x4000;
+  d[1] = vy+0x4000;
+  d[2] = vx+0x4000;
+  d[3] = 0xffff;
+}
+
+// channel 0 of 4 pixels, as 32 bit
+
+static sINLINE __m128i LoadChannel0(const sU16 *s)
+{
+  __m128i mask = _mm_set1_epi32(0xffff);
+  __m128i p01 = _mm_and_si128(_mm_loadu_si128((const __m128i *) (s+0)),mask);
+  __m128i p23 = _mm_and_si128(_mm_loadu_si128((const __m128i *) (s+8)),mask);
+  return _mm_unpacklo_epi64(_mm_shuffle_epi32(p01,0x08),_mm_shuffle_epi32(p23,0x08));
+}
 
-  dist = sInt(_dist*65536.0f);
-  d = (sU16 *) Data;
-  sx = sy = s = (sU16*) src->Data;
-  xs = src->XSize;
-  ys = src->YSize; 
-  shiftx = sFindLowerPower(src->XSize);
-  shifty = sFindLowerPower(src->YSize);
+// the low 32 bits of the products, like an int multiply
 
-  for(y=0;y<ys;y++)
+static sINLINE __m128i MulLo32(__m128i a,__m128i b)
+{
+  __m128i even = _mm_mul_epu32(a,b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a,32),_mm_srli_epi64(b,32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even,0x08),_mm_shuffle_epi32(odd,0x08));
+}
+
+// sRange7fff(v*dist>>shift + 0x4000)-0x4000
+
+static sINLINE __m128i NormalsScale(__m128i v,__m128i dist,__m128i shift)
+{
+  __m128i r = _mm_sra_epi32(MulLo32(v,dist),shift);
+  r = _mm_add_epi32(r,_mm_set1_epi32(0x4000));
+  r = _mm_packs_epi32(r,r);
+  r = _mm_max_epi16(r,_mm_setzero_si128());
+  r = _mm_unpacklo_epi16(r,_mm_setzero_si128());
+  return _mm_sub_epi32(r,_mm_set1_epi32(0x4000));
+}
+
+// the low 16 bits of 32 bit values
+
+static sINLINE __m128i Pack16(__m128i v)
+{
+  v = _mm_srai_epi32(_mm_slli_epi32(v,16),16);
+  return _mm_packs_epi32(v,v);
+}
+
+static void NormalsRows(void *data,sInt y0,sInt y1)
+{
+  const NormalsBand *nb = (const NormalsBand *) data;
+  sInt xs = nb->XSize;
+  sInt ys = nb->YSize;
+  sInt mode = nb->Mode;
+  __m128i dist = _mm_set1_epi32(nb->Dist>>4);
+  __m128i shiftx = _mm_cvtsi32_si128(20-nb->ShiftX);
+  __m128i shifty = _mm_cvtsi32_si128(20-nb->ShiftY);
+  __m128i offset = _mm_set1_epi32(0x4000);
+  __m128i ones = _mm_set1_epi32(-1);
+  __m128i zero = _mm_setzero_si128();
+
+  for(sInt y=y0;y<y1;y++)
   {
-    sy = s;
-    for(x=0;x<xs;x++)
+    const sU16 *sx = nb->Src + y*xs*4;
+    const sU16 *r0 = nb->Src + ((y-2)&(ys-1))*xs*4;
+    const sU16 *r1 = nb->Src + ((y-1)&(ys-1))*xs*4;
+    const sU16 *r3 = nb->Src + ((y+1)&(ys-1))*xs*4;
+    sU16 *d = nb->Dest + y*xs*4;
+    sInt x;
+
+    // the first pixels wrap around
+
+    for(x=0;x<4 && x<xs;x++)
+      NormalsPixel(nb,d+x*4,x,y);
+
+    // four pixels at once, where all taps are inside the row
+
+    for(;x+4<xs;x+=4)
     {
+      __m128i vx,vy,vz;
       if(mode&4)
       {
-        vx = filterbumpsharp(sx,x*4,(xs-1)*4,4);
-        vy = filterbumpsharp(sy,y*xs*4,(ys-1)*xs*4,xs*4);
+        vx = _mm_slli_epi32(_mm_sub_epi32(LoadChannel0(sx+x*4-4),LoadChannel0(sx+x*4)),2);
+        vy = _mm_slli_epi32(_mm_sub_epi32(LoadChannel0(r1+x*4),LoadChannel0(sx+x*4)),2);
       }
       else
       {
-        vx = filterbump(sx,x*4,(xs-1)*4,4);
-        vy = filterbump(sy,y*xs*4,(ys-1)*xs*4,xs*4);
+        __m128i a = LoadChannel0(sx+x*4-8);
+        __m128i b = LoadChannel0(sx+x*4-4);
+        __m128i c = LoadChannel0(sx+x*4);
+        __m128i e = LoadChannel0(sx+x*4+4);
+        b = _mm_sub_epi32(b,c);
+        vx = _mm_sub_epi32(_mm_add_epi32(a,_mm_add_epi32(b,_mm_add_epi32(b,b))),e);
+        a = LoadChannel0(r0+x*4);
+        b = LoadChannel0(r1+x*4);
+        e = LoadChannel0(r3+x*4);
+        b = _mm_sub_epi32(b,c);
+        vy = _mm_sub_epi32(_mm_add_epi32(a,_mm_add_epi32(b,_mm_add_epi32(b,b))),e);
       }
-/*
-      vx = sx[((x-2)&(xs-1))*4]*1
-         + sx[((x-1)&(xs-1))*4]*3
-         - sx[((x  )&(xs-1))*4]*3
-         - sx[((x+1)&(xs-1))*4]*1;      
-
-      vy = sy[((y-2)&(ys-1))*xs*4]*1
-         + sy[((y-1)&(ys-1))*xs*4]*3
-         - sy[((y  )&(ys-1))*xs*4]*3
-         - sy[((y+1)&(ys-1))*xs*4]*1;
-*/
-      vx = sRange7fff((((vx) * (dist>>4))>>(20-shiftx))+0x4000)-0x4000;
-      vy = sRange7fff((((vy) * (dist>>4))>>(20-shifty))+0x4000)-0x4000;
-      vz = 0;
+      vx = NormalsScale(vx,dist,shiftx);
+      vy = NormalsScale(vy,dist,shifty);
+      vz = zero;
 
       if(mode&1)
       {
-        vz = (0x3fff*0x3fff)-vx*vx-vy*vy;
-        if(vz>0)
-        {
-//          vz = sFSqrt(vz/16384.0f/16384.0f)*0x3fff;
-          vz = sFSqrt(vz);
-        }
-        else
-        {
-          e = sFInvSqrt(vx*vx+vy*vy)*0x3fff;
-          vx *= e;
-          vy *= e;
-          vz = 0;
-        }
+        __m128i xy = _mm_or_si128(_mm_and_si128(vx,_mm_set1_epi32(0xffff)),_mm_slli_epi32(vy,16));
+        __m128i sq = _mm_madd_epi16(xy,xy);
+        __m128i vzi = _mm_sub_epi32(_mm_set1_epi32(0x3fff*0x3fff),sq);
+        __m128i pos = _mm_cmpgt_epi32(vzi,zero);
+        __m128i root = _mm_cvttps_epi32(_mm_sqrt_ps(_mm_cvtepi32_ps(vzi)));
+        __m128 e = _mm_mul_ps(_mm_div_ps(_mm_set1_ps(1.0f),_mm_sqrt_ps(_mm_cvtepi32_ps(sq))),_mm_set1_ps(0x3fff));
+        __m128i nx = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(vx),e));
+        __m128i ny = _mm_cvttps_epi32(_mm_mul_ps(_mm_cvtepi32_ps(vy),e));
+        vx = _mm_or_si128(_mm_and_si128(pos,vx),_mm_andnot_si128(pos,nx));
+        vy = _mm_or_si128(_mm_and_si128(pos,vy),_mm_andnot_si128(pos,ny));
+        vz = _mm_and_si128(pos,root);
       }
       if(mode&2)
       {
-        sSwap(vx,vy);
-        vy=-vy;
+        __m128i t = vx;
+        vx = vy;
+        vy = _mm_sub_epi32(zero,t);
       }
 
-      d[0] = vz+0x4000;
-      d[1] = vy+0x4000;
-      d[2] = vx+0x4000;
-      d[3] = 0xffff;
-
-      d += 4;
-      sy += 4;
+      __m128i zy = _mm_unpacklo_epi16(Pack16(_mm_add_epi32(vz,offset)),Pack16(_mm_add_epi32(vy,offset)));
+      __m128i xa = _mm_unpacklo_epi16(Pack16(_mm_add_epi32(vx,offset)),ones);
+      _mm_storeu_si128((__m128i *) (d+x*4+0),_mm_unpacklo_epi32(zy,xa));
+      _mm_storeu_si128((__m128i *) (d+x*4+8),_mm_unpackhi_epi32(zy,xa));
     }
-    sx += xs*4;
+
+    for(;x<xs;x++)
+      NormalsPixel(nb,d+x*4,x,y);
   }
 }
 
+void GenBitmap::Normals(GenBitmap *src,sF32 _dist,sInt mode)
+{
+  GENBITMAP_TIMER(Normals)
+  sVERIFY(Size==src->Size);
+
+  NormalsBand nb;
+  nb.Src = (sU16 *) src->Data;
+  nb.Dest = (sU16 *) Data;
+  nb.XSize = src->XSize;
+  nb.YSize = src->YSize;
+  nb.ShiftX = sFindLowerPower(src->XSize);
+  nb.ShiftY = sFindLowerPower(src->YSize);
+  nb.Dist = sInt(_dist*65536.0f);
+  nb.Mode = mode;
+  RunRows(NormalsRows,&nb,nb.YSize,nb.XSize);
+}
+
 /****************************************************************************/
 
 void GenBitmap::Unwrap(GenBitmap *src,sInt mode)
 {
+  GENBITMAP_TIMER(Unwrap)
   BilinearContext ctx;
 
   BilinearSetup(&ctx,src->Data,src->XSize,src->YSize,(mode >> 4) & 3);
@@ -2282,6 +2792,7 @@ void GenBitmap::Unwrap(GenBitmap *src,sInt mode)
 
 void GenBitmap::Bulge(GenBitmap *src,sF32 warp)
 {
+  GENBITMAP_TIMER(Bulge)
   BilinearContext ctx;
 
   BilinearSetup(&ctx,src->Data,src->XSize,src->YSize,0);
@@ -2324,23 +2835,35 @@ void GenBitmap::Bulge(GenBitmap *src,sF32 warp)
 /****************************************************************************/
 /****************************************************************************/
 
-void GenBitmap::Bump(GenBitmap *bb,sInt subcode,sF32 px,sF32 py,sF32 pz,sF32 da,sF32 db,
-                     sU32 _diff,sU32 _ambi,sF32 outer,sF32 falloff,sF32 amp,
-                     sU32 _spec,sF32 spow,sF32 samp)
+struct BumpBand
 {
-  sInt xs,ys;
-  sInt x,y;
-  sU16 *d,*b,*s;
-  sInt i;
+  GenBitmap *Bitmap;
+  const sU16 *Normals;
+  sInt Subcode;
+  sF32 px,py,pz;
+  sF32 dx,dy,dz;
+  sF32 outer,falloff,amp;
+  sF32 spow,samp;
+  sU64 Diff,Ambi,Spec;
+};
+
+static void BumpRows(void *data,sInt y0,sInt y1)
+{
+  const BumpBand *bb = (const BumpBand *) data;
+  sInt subcode = bb->Subcode;
+  sInt xs = bb->Bitmap->XSize;
+  sU16 *d = (sU16 *) (bb->Bitmap->Data + y0*xs);
+  const sU16 *b = bb->Normals ? bb->Normals + y0*xs*4 : 0;
+  sF32 px = bb->px;
+  sF32 py = bb->py;
+  sF32 pz = bb->pz;
+  sF32 dx = bb->dx;
+  sF32 dy = bb->dy;
+  sF32 dz = bb->dz;
+  sF32 samp = bb->samp;
 
-  sU16 diff[4];
-  sU16 ambi[4];
-  sU16 spec[4];
-  sU16 buff[4];
-  sF32 dx,dy,dz;                  // spot direction
   sF32 e;
   sF32 f0;
-
   sF32 lx,ly,lz;                  // light -> material
   sF32 nx,ny,nz;                  // material normal
   sF32 hx,hy,hz;                  // halfway vector (specular)
@@ -2348,36 +2871,13 @@ void GenBitmap::Bump(GenBitmap *bb,sInt subcode,sF32 px,sF32 py,sF32 pz,sF32 da,
   sF32 lf;                        // light factor
   sF32 sf;                        // specular factor
 
-  xs = XSize;
-  ys = YSize;
-
-  *(sU64 *)diff = GetColor64(_diff);
-  *(sU64 *)ambi = GetColor64(_ambi);
-  *(sU64 *)spec = GetColor64(_spec);
-
-  px = px*xs;
-  py = py*ys;
-  pz = pz*xs;
-  da *= sPI2F;
-  db *= sPIF;
-
-  dx = dy = sFCos(db);
-  dx *= sFSin(da);
-  dy *= sFCos(da);
-  dz = sFSin(db);
-
-
-  s = (sU16 *)Data;
-  d = (sU16 *)Data;
-  if(bb)
-  {
-    b = (sU16 *)bb->Data;
-  }
-  else
-  {
-    b = 0;
-  }
+  // the 4 channels are scaled as floats, like s*(ambi+diff*f0)/0x8000
 
+  __m128i zero = _mm_setzero_si128();
+  __m128 ambi = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) &bb->Ambi),zero));
+  __m128 diff = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) &bb->Diff),zero));
+  __m128 scale = _mm_set1_ps(0x8000);
+  __m128i spec = _mm_loadl_epi64((const __m128i *) &bb->Spec);
 
   lf = 1.0f;
   sf = 0.0f;
@@ -2389,17 +2889,9 @@ void GenBitmap::Bump(GenBitmap *bb,sInt subcode,sF32 px,sF32 py,sF32 pz,sF32 da,
   ly = dy;
   lz = dz;
 
-  if(subcode==0)
+  for(sInt y=y0;y<y1;y++)
   {
-    px = px-dx*pz/dz;
-    py = py-dy*pz/dz;
-  }
-
-  samp *= 65536.0f;
-
-  for(y=0;y<YSize;y++)
-  {
-    for(x=0;x<XSize;x++)
+    for(sInt x=0;x<xs;x++)
     {
 
       if(subcode!=2)
@@ -2431,32 +2923,76 @@ void GenBitmap::Bump(GenBitmap *bb,sInt subcode,sF32 px,sF32 py,sF32 pz,sF32 da,
         e = sFRSqrt(hx*hx+hy*hy+hz*hz);
         sf = hx*nx+hy*ny+hz*nz;
         if(sf<0) sf=0;
-        sf = sPow(sf*e,spow);
+        sf = sPow(sf*e,bb->spow);
       }
 
       if(subcode==0)
       {
         df = (lx*dx+ly*dy+lz*dz);
-        if(df<outer)
+        if(df<bb->outer)
           df = 0;
         else
-          df = sPow((df-outer)/(1-outer),falloff);
+          df = sPow((df-bb->outer)/(1-bb->outer),bb->falloff);
       }
 
-      f0 = df*lf*amp;
-      for(i=0;i<4;i++)
-        buff[i] = sRange7fff(sInt(s[i]*(ambi[i]+diff[i]*f0)/0x8000));
-      AddScalePix(*(sU64 *)d,*(sU64 *)buff,*(sU64 *)spec,sInt(df*sf*samp));
-      s+=4;
+      f0 = df*lf*bb->amp;
+
+      __m128 col = _mm_cvtepi32_ps(_mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) d),zero));
+      col = _mm_div_ps(_mm_mul_ps(col,_mm_add_ps(ambi,_mm_mul_ps(diff,_mm_set1_ps(f0)))),scale);
+      __m128i buff = _mm_cvttps_epi32(col);
+      buff = _mm_max_epi16(_mm_packs_epi32(buff,buff),zero);
+      AddScalePix(*(sU64 *)d,buff,spec,sInt(df*sf*samp));
       d+=4;
     }
   }
 }
 
+void GenBitmap::Bump(GenBitmap *bb,sInt subcode,sF32 px,sF32 py,sF32 pz,sF32 da,sF32 db,
+                     sU32 _diff,sU32 _ambi,sF32 outer,sF32 falloff,sF32 amp,
+                     sU32 _spec,sF32 spow,sF32 samp)
+{
+  GENBITMAP_TIMER(Bump)
+  sF32 dx,dy,dz;                  // spot direction
+
+  px = px*XSize;
+  py = py*YSize;
+  pz = pz*XSize;
+  da *= sPI2F;
+  db *= sPIF;
+
+  dx = dy = sFCos(db);
+  dx *= sFSin(da);
+  dy *= sFCos(da);
+  dz = sFSin(db);
+
+  if(subcode==0)
+  {
+    px = px-dx*pz/dz;
+    py = py-dy*pz/dz;
+  }
+
+  BumpBand band;
+  band.Bitmap = this;
+  band.Normals = bb ? (sU16 *)bb->Data : 0;
+  band.Subcode = subcode;
+  band.px = px; band.py = py; band.pz = pz;
+  band.dx = dx; band.dy = dy; band.dz = dz;
+  band.outer = outer;
+  band.falloff = falloff;
+  band.amp = amp;
+  band.spow = spow;
+  band.samp = samp * 65536.0f;
+  band.Diff = GetColor64(_diff);
+  band.Ambi = GetColor64(_ambi);
+  band.Spec = GetColor64(_spec);
+  RunRows(BumpRows,&band,YSize,XSize);
+}
+
 /****************************************************************************/
 
 void GenBitmap::Downsample(GenBitmap *in,sInt flags)
 {
+  GENBITMAP_TIMER(Downsample)
   sInt stepx = 1;
   sInt stepy = 1;
   if(flags==1)
@@ -2500,6 +3036,7 @@ void GenBitmap::Downsample(GenBitmap *in,sInt flags)
 
 void GenBitmap::Text(sF32 x,sF32 y,sF32 width,sF32 height,sU32 col,sU32 flags,sF32 lineskip,const sChar *text,const sChar *fontname)
 {
+  GENBITMAP_TIMER(Text)
   sU32 *bitmem;
 
   sInt xi,yi,i;
@@ -2596,157 +3133,129 @@ void GenBitmap::Text(sF32 x,sF32 y,sF32 width,sF32 height,sU32 col,sU32 flags,sF
 
 /****************************************************************************/
 
-void GenBitmap::Cell(sU32 col0,sU32 col1,sU32 col2,sInt max,sInt seed,sF32 amp,sF32 gamma,sInt mode,sF32 mindistf,sInt percent,sF32 aspect)
+struct CellBand
 {
-  sInt cells[256][4];
-  sInt x,y,i,j,dist,best,best2,besti,best2i;
-  sInt dx,dy,px,py;
-  sInt shiftx,shifty;
-  sF32 v0,v1;
-  sInt val,mdist;
-  sU64 *tile;
-  sBool cut;
+  GenBitmap *Bitmap;
+  const sInt (*Cells)[4];
+  sInt Max;
+  sInt Mode;
+  sInt ShiftX,ShiftY;
+  sF32 Amp,Gamma;
+  sF32 AspDiv;
+  sInt AspF;
+  sBool FlipXY;
+  sU32 Col0,Col1,Col2;
+};
 
+static const int CellTileSize = 16;
 
-  sRandomMT rnd;
-  rnd.Seed(seed);
-  for(i=0;i<max;i++)
+// for all cells, calc distance lower bound, and sort by it. the order
+// depends on the previous tile when the bounds are equal.
+
+static sINLINE void CellSortTile(const CellBand *cb,sInt (*cells)[4],sInt bx,sInt by)
+{
+  sInt i,dx,dy;
+  sInt max = cb->Max;
+  sInt px0 = bx << cb->ShiftX, px1 = (bx+CellTileSize-1) << cb->ShiftX;
+  sInt py0 = by << cb->ShiftY, py1 = (by+CellTileSize-1) << cb->ShiftY;
+
+  if(cb->FlipXY)
   {
-    cells[i][0] = rnd.Int(0x4000);
-    cells[i][1] = rnd.Int(0x4000);
-    cells[i][2] = rnd.Int(0x4000);
-    cells[i][3] = 0;
+    sSwap(px0,py0);
+    sSwap(px1,py1);
   }
 
-  mdist = sInt(mindistf*0x4000);
-  mdist = mdist*mdist;
-  for(i=1;i<max;)
+  for(i=0;i<max;i++)
   {
-    if((mode&2) && (sInt)rnd.Int(255)<percent)
-      cells[i][2] = 0xffff;
-    px = ((cells[i][0])&0x3fff)-0x2000;
-    py = ((cells[i][1])&0x3fff)-0x2000; 
-    cut = sFALSE;
-    for(j=0;j<i && !cut;j++)
-    {
-      dx = ((cells[j][0]-px)&0x3fff)-0x2000;
-      dy = ((cells[j][1]-py)&0x3fff)-0x2000; 
-      dist = dx*dx+dy*dy;
-      if(dist<mdist)
-      {
-        cut = sTRUE;
-      }
-    }
-    if(cut)
-    {
-      max--;
-      cells[i][0] = cells[max][0];
-      cells[i][1] = cells[max][1];
-      cells[i][2] = cells[max][2];
-    }
+    dx = ((cells[i][0]-px0)&0x3fff)-0x2000;
+    dy = ((cells[i][0]-px1)&0x3fff)-0x2000;
+    if((dx ^ dy) <= 0)
+      cells[i][3] = 0;
     else
     {
-      i++;
+      dx = sMin(sAbs(dx),sAbs(dy));
+      cells[i][3] = sMulShift(dx*dx,cb->AspF);
     }
-  }
-
-  shiftx = 14-sFindLowerPower(XSize);
-  shifty = 14-sFindLowerPower(YSize);
-  __m128i c0 = GetColor128(col1);
-  __m128i c1 = GetColor128(col0);
-  __m128i cb = GetColor128(col2);
-  tile = Data;
-  aspect = sFPow(2,aspect);
 
-#if 1 // optimized cells code
-  sF32 aspdiv;
-  sInt aspf;
-  sBool flipxy;
-
-  if(aspect >= 1.0f)
-  {
-    aspf = 65536 / (aspect * aspect);
-    aspdiv = aspect / 16384.0f;
-    flipxy = sFALSE;
-  }
-  else
-  {
-    aspf = aspect * aspect * 65536;
-    aspdiv = 1.0f / (16384.0f * aspect);
-    flipxy = sTRUE;
+    dx = ((cells[i][1]-py0)&0x3fff)-0x2000;
+    dy = ((cells[i][1]-py1)&0x3fff)-0x2000;
+    if((dx ^ dy) > 0)
+    {
+      dy = sMin(sAbs(dx),sAbs(dy));
+      cells[i][3] += dy*dy;
+    }
   }
 
-  if(flipxy)
+  // (insertion) sort by it
+  for(i=1;i<max;i++)
   {
-    for(i=0;i<max;i++)
-      sSwap(cells[i][0],cells[i][1]);
-  }
+    sInt x = cells[i][0], y = cells[i][1], c = cells[i][2];
+    sInt dy = cells[i][3], j = i;
 
-  static const int tileSize = 16;
-  for(sInt by=0;by<YSize;by+=tileSize)
-  {
-    for(sInt bx=0;bx<XSize;bx+=tileSize)
+    while(j && cells[j-1][3] > dy)
     {
-      // for all cells, calc distance lower bound
-      sInt px0 = bx << shiftx, px1 = (bx+tileSize-1) << shiftx;
-      sInt py0 = by << shifty, py1 = (by+tileSize-1) << shifty;
+      cells[j][0] = cells[j-1][0];
+      cells[j][1] = cells[j-1][1];
+      cells[j][2] = cells[j-1][2];
+      cells[j][3] = cells[j-1][3];
+      j--;
+    }
 
-      if(flipxy)
-      {
-        sSwap(px0,py0);
-        sSwap(px1,py1);
-      }
+    cells[j][0] = x;
+    cells[j][1] = y;
+    cells[j][2] = c;
+    cells[j][3] = dy;
+  }
+}
 
-      for(i=0;i<max;i++)
-      {
-        dx = ((cells[i][0]-px0)&0x3fff)-0x2000;
-        dy = ((cells[i][0]-px1)&0x3fff)-0x2000;
-        if((dx ^ dy) <= 0)
-          cells[i][3] = 0;
-        else
-        {
-          dx = sMin(sAbs(dx),sAbs(dy));
-          cells[i][3] = sMulShift(dx*dx,aspf);
-        }
+// bands are rows of tiles. each band starts with the cells in their
+// initial order, and sorts them for all tiles before it, so that it sees
+// them in the same order as if all tiles were done in one go.
 
-        dx = ((cells[i][1]-py0)&0x3fff)-0x2000;
-        dy = ((cells[i][1]-py1)&0x3fff)-0x2000;
-        if((dx ^ dy) > 0)
-        {
-          dy = sMin(sAbs(dx),sAbs(dy));
-          cells[i][3] += dy*dy;
-        }
-      }
+static void CellRows(void *data,sInt ty0,sInt ty1)
+{
+  const CellBand *cb = (const CellBand *) data;
+  GenBitmap *bm = cb->Bitmap;
+  sInt XSize = bm->XSize;
+  sInt max = cb->Max;
+  sInt mode = cb->Mode;
+  sInt shiftx = cb->ShiftX;
+  sInt shifty = cb->ShiftY;
+  sInt aspf = cb->AspF;
+  sF32 aspdiv = cb->AspDiv;
+  sF32 amp = cb->Amp;
+  sF32 gamma = cb->Gamma;
+  sBool flipxy = cb->FlipXY;
+  sInt x,y,dist,best,best2,besti,best2i;
+  sInt dx,dy,px,py;
+  sF32 v0,v1;
+  sInt val;
+  sU64 *tile;
+  __m128i c0 = GetColor128(cb->Col1);
+  __m128i c1 = GetColor128(cb->Col0);
+  __m128i cbc = GetColor128(cb->Col2);
 
-      // (insertion) sort by it
-      for(i=1;i<max;i++)
-      {
-        sInt x = cells[i][0], y = cells[i][1], c = cells[i][2];
-        sInt dy = cells[i][3], j = i;
+  sInt cells[256][4];
+  sCopyMem(cells,cb->Cells,sizeof(sInt)*4*max);
 
-        while(j && cells[j-1][3] > dy)
-        {
-          cells[j][0] = cells[j-1][0];
-          cells[j][1] = cells[j-1][1];
-          cells[j][2] = cells[j-1][2];
-          cells[j][3] = cells[j-1][3];
-          j--;
-        }
+  for(sInt by=0;by<ty0*CellTileSize;by+=CellTileSize)
+    for(sInt bx=0;bx<XSize;bx+=CellTileSize)
+      CellSortTile(cb,cells,bx,by);
 
-        cells[j][0] = x;
-        cells[j][1] = y;
-        cells[j][2] = c;
-        cells[j][3] = dy;
-      }
+  for(sInt by=ty0*CellTileSize;by<ty1*CellTileSize;by+=CellTileSize)
+  {
+    for(sInt bx=0;bx<XSize;bx+=CellTileSize)
+    {
+      CellSortTile(cb,cells,bx,by);
 
       // render tile
-      tile = Data + by*XSize + bx;
+      tile = bm->Data + by*XSize + bx;
 
-      for(sInt ty=0;ty<tileSize;ty++)
+      for(sInt ty=0;ty<CellTileSize;ty++)
       {
         py = (by+ty) << shifty;
 
-        for(sInt tx=0;tx<tileSize;tx++)
+        for(sInt tx=0;tx<CellTileSize;tx++)
         {
           px = (bx+tx) << shiftx;
           
@@ -2796,19 +3305,126 @@ void GenBitmap::Cell(sU32 col0,sU32 col1,sU32 col2,sInt max,sInt seed,sF32 amp,s
           {
             __m128i cc = FadeCol(c0,c1,cells[besti][2]*4);
             if(cells[besti][2]==0xffff)
-              cc=cb;
-            FadeColStore(*tile,cc,cb,val);
+              cc=cbc;
+            FadeColStore(*tile,cc,cbc,val);
           }
           else
             FadeColStore(*tile,c0,c1,val);
           tile++;
         }
 
-        tile += XSize-tileSize;
+        tile += XSize-CellTileSize;
       }
     }
   }
+}
+
+void GenBitmap::Cell(sU32 col0,sU32 col1,sU32 col2,sInt max,sInt seed,sF32 amp,sF32 gamma,sInt mode,sF32 mindistf,sInt percent,sF32 aspect)
+{
+  GENBITMAP_TIMER(Cell)
+  sInt cells[256][4];
+  sInt i,j,dist;
+  sInt dx,dy,px,py;
+  sInt shiftx,shifty;
+  sInt mdist;
+  sBool cut;
+
+
+  sRandomMT rnd;
+  rnd.Seed(seed);
+  for(i=0;i<max;i++)
+  {
+    cells[i][0] = rnd.Int(0x4000);
+    cells[i][1] = rnd.Int(0x4000);
+    cells[i][2] = rnd.Int(0x4000);
+    cells[i][3] = 0;
+  }
+
+  mdist = sInt(mindistf*0x4000);
+  mdist = mdist*mdist;
+  for(i=1;i<max;)
+  {
+    if((mode&2) && (sInt)rnd.Int(255)<percent)
+      cells[i][2] = 0xffff;
+    px = ((cells[i][0])&0x3fff)-0x2000;
+    py = ((cells[i][1])&0x3fff)-0x2000; 
+    cut = sFALSE;
+    for(j=0;j<i && !cut;j++)
+    {
+      dx = ((cells[j][0]-px)&0x3fff)-0x2000;
+      dy = ((cells[j][1]-py)&0x3fff)-0x2000; 
+      dist = dx*dx+dy*dy;
+      if(dist<mdist)
+      {
+        cut = sTRUE;
+      }
+    }
+    if(cut)
+    {
+      max--;
+      cells[i][0] = cells[max][0];
+      cells[i][1] = cells[max][1];
+      cells[i][2] = cells[max][2];
+    }
+    else
+    {
+      i++;
+    }
+  }
+
+  shiftx = 14-sFindLowerPower(XSize);
+  shifty = 14-sFindLowerPower(YSize);
+  aspect = sFPow(2,aspect);
+
+#if 1 // optimized cells code
+  sF32 aspdiv;
+  sInt aspf;
+  sBool flipxy;
+
+  if(aspect >= 1.0f)
+  {
+    aspf = 65536 / (aspect * aspect);
+    aspdiv = aspect / 16384.0f;
+    flipxy = sFALSE;
+  }
+  else
+  {
+    aspf = aspect * aspect * 65536;
+    aspdiv = 1.0f / (16384.0f * aspect);
+    flipxy = sTRUE;
+  }
+
+  if(flipxy)
+  {
+    for(i=0;i<max;i++)
+      sSwap(cells[i][0],cells[i][1]);
+  }
+
+  CellBand cb;
+  cb.Bitmap = this;
+  cb.Cells = cells;
+  cb.Max = max;
+  cb.Mode = mode;
+  cb.ShiftX = shiftx;
+  cb.ShiftY = shifty;
+  cb.Amp = amp;
+  cb.Gamma = gamma;
+  cb.AspDiv = aspdiv;
+  cb.AspF = aspf;
+  cb.FlipXY = flipxy;
+  cb.Col0 = col0;
+  cb.Col1 = col1;
+  cb.Col2 = col2;
+  sInt tilerows = (YSize+CellTileSize-1)/CellTileSize;
+  RunBands(CellRows,&cb,tilerows,GetBandCount(tilerows,CellTileSize*XSize,1));
 #else
+  sInt x,y,best,best2,besti;
+  sF32 v0,v1;
+  sInt val;
+  __m128i c0 = GetColor128(col1);
+  __m128i c1 = GetColor128(col0);
+  __m128i cb = GetColor128(col2);
+  sU64 *tile = Data;
   sF32 aspsquare = aspect * aspect;
   sF32 aspdiv = 1.0f / (16384.0f * aspect);
 
@@ -2928,6 +3544,7 @@ GenBitmap * __stdcall Bitmap_Gradient(sInt xs,sInt ys,sU32 col0,sU32 col1,sF32 p
 
 void GenBitmap::Sharpen(GenBitmap *in,sInt order,sF32 sx,sF32 sy,sF32 amp)
 {
+  GENBITMAP_TIMER(Sharpen)
   sU64 color;
 
   color = sClamp<sInt>(amp*0x800,-0x7fff,0x7fff)&0xffff;
@@ -2950,6 +3567,7 @@ static sInt CBLookup(const sInt *table,sInt value)
 
 void GenBitmap::ColorBalance(sVector30 shadows,sVector30 midtones,sVector30 highlights)
 {
+  GENBITMAP_TIMER(ColorBalance)
   sInt i,j;
   sF32 x;
   sF32 vsha,vmid,vhil;
@@ -3004,6 +3622,7 @@ void GenBitmap::Bricks(
   sInt seed,sInt heads,sInt flags,
   sF32 side,sF32 colorbalance)
 {
+  GENBITMAP_TIMER(Bricks)
   sU64 *d;
   sInt fx,fy;
   sInt fugex,fugey;
@@ -3199,6 +3818,7 @@ void CalcGenBitmapVectorLoop(struct GenBitmapArrayVector *e,sInt count,sArray<Ge
 
 void GenBitmap::Vector(sU32 color,GenBitmapArrayVector *arr,sInt count)
 {
+  GENBITMAP_TIMER(Vector)
   Vectorizer::VectorRasterizer vec(this);
 
   sInt xs = XSize;
@@ -3362,6 +3982,7 @@ GenBitmap * __stdcall Bitmap_Paste(GenBitmap *bm,GenBitmap *bs,sF32 prex,sF32 pr
 
 void GenBitmap::Gradient(GenBitmapGradientPoint *g,sInt count,sInt flags)
 {
+  GENBITMAP_TIMER(Gradient)
   sU64 *row = new sU64[XSize];
   sVector4 c;
 
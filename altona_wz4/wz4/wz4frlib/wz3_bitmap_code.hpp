@@ -59,7 +59,11 @@ public:
   void CopyTo(sImage *);
   void CopyTo(sImageI16 *);
   sBool Incompatible(GenBitmap *b) { return XSize!=b->XSize || YSize!=b->YSize; }
+  sPtr GetByteSize() { return sPtr(Size)*sizeof(sU64); }
 
+  template <class streamer> void Serialize_(streamer &s);
+  void Serialize(sWriter &s);
+  void Serialize(sReader &s);
 
   sU64 *Data;                     // the bitmap itself
   sInt XSize;                     // xsize
@@ -134,6 +138,7 @@ struct GenBitmapVectorLoop
 
 void CalcGenBitmapVectorLoop(struct GenBitmapArrayVector *e,sInt count,sArray<GenBitmapVectorLoop>&a);
 sInt LoadAtlas(const sChar *name, GenBitmap *bmp);
+void GenBitmapLogTimes();       // time spent in each op since the last call
 
 /****************************************************************************/
 
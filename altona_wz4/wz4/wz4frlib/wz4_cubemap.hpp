@@ -25,6 +25,7 @@ public:
   Wz4Cubemap();
   ~Wz4Cubemap();
   void Init(sInt sizexy);
+  sPtr GetByteSize() { return sPtr(CubeSize)*sizeof(Pixel); }
   void CopyFrom(const Wz4Cubemap *);
   void CopyTo(sImage **cubefaces);
   void MakeCube(sInt pixel,sVector30 &n) const;
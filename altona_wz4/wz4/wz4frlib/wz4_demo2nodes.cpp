@@ -1298,6 +1298,7 @@ void RNSpline::Init(Wz4RenderParaSpline *para,sInt ac,Wz4RenderArraySpline *ar,c
       }
     }
   }
+  Spline->Prepare();
 }
 
 void RNSpline::Simulate(Wz4RenderContext *ctx)
@@ -1651,6 +1652,7 @@ void RNBeat::Init(Wz4RenderParaBeat *para,sInt ac,Wz4RenderArrayBeat *ar,const s
     dest[0].Time = t0 + v0*d0;
     dest[0].Value = bias;
   }
+  Spline->Prepare();
 
   delete[] bytes;
 }
@@ -1725,14 +1727,15 @@ void RNBoneTrain::Simulate(Wz4RenderContext *ctx)
     // calculate keys
 
     BendKey *bk = new BendKey[count];
+    ScriptSplineCursor cursor,cursort;
     for(sInt i=0;i<count;i++)
     {
       sF32 data[8];
       sF32 datat[8];
       sF32 fi = sF32(i)/count;
       bk[i].Time = t0+td*fi;
-      spline->Eval(bk[i].Time,data,sMin(5,spline->Count));
-      spline->Eval(bk[i].Time+0.01,datat,sMin(3,spline->Count));
+      spline->Eval(bk[i].Time,data,sMin(5,spline->Count),&cursor);
+      spline->Eval(bk[i].Time+0.01,datat,sMin(3,spline->Count),&cursort);
       bk[i].Pos.x = data[0];
       bk[i].Pos.y = data[1];
       bk[i].Pos.z = data[2];
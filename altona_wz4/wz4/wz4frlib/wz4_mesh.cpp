@@ -8,6 +8,7 @@
 #include "wz4frlib/wz4_mesh.hpp"
 #include "wz4frlib/wz4_mesh_ops.hpp"
 #include "util/algorithms.hpp"
+#include "util/simd_batch.hpp"
 #include "wz4frlib/wz4_mtrl2.hpp"
 //#include "wz4frlib/chaosmesh_code.hpp"
 
@@ -415,6 +416,12 @@ Wz4Mesh::~Wz4Mesh()
   Skeleton->Release();
 }
 
+sPtr Wz4Mesh::GetByteSize()
+{
+  return sPtr(Vertices.GetSize())*sizeof(Wz4MeshVertex)
+       + sPtr(Faces.GetSize())*sizeof(Wz4MeshFace);
+}
+
 /****************************************************************************/
 
 template <class streamer> void Wz4Mesh::Serialize_(streamer &s)
@@ -713,10 +720,17 @@ void Wz4Mesh::MergeClusters()
 
 /****************************************************************************/
 
+struct Wz4MeshVertexRef         // hash key for MergeVertices()
+{
+  const Wz4MeshVertex *Vertex;
+  sU32 Hash() const { return Vertex->Hash(); }
+  sBool operator==(const Wz4MeshVertexRef &r) const { return *Vertex==*r.Vertex; }
+};
+
 void Wz4Mesh::MergeVertices()
 {
   sInt max = Vertices.GetCount();
-  sHashTable<Wz4MeshVertex,Wz4MeshVertex> hash(1<<sFindLowerPower(max+0x1000),0x1000);
+  sHashMap<Wz4MeshVertexRef,sInt> hash(max);
   sInt *map = new sInt[max];    // new = map[old]
   sInt *remap = new sInt[max];  // old = map[new]
  
@@ -737,18 +751,19 @@ void Wz4Mesh::MergeVertices()
   {
     if(Vertices[i].Temp)
     {
-      Wz4MeshVertex *hit = hash.Find(&Vertices[i]);
+      Wz4MeshVertexRef key;
+      key.Vertex = &Vertices[i];
+      sInt *hit = hash.Find(key);
       if(hit)
       {
-        map[i] = hit->Temp;
+        map[i] = *hit;
       }
       else
       {
-        hit = &Vertices[i];
-        hit->Temp = vc;
+        Vertices[i].Temp = vc;
         map[i] = vc;
-        remap[vc++] = i;
-        hash.Add(hit,hit);
+        remap[vc] = i;
+        hash.Add(key,vc++);
       }
     }
     else
@@ -1696,9 +1711,17 @@ void Wz4Mesh::Transform(const sMatrix34 &mat)
   matInvT.Invert3();
   matInvT.Trans3();
 
-  Wz4MeshVertex *mv;
-  sFORALL(Vertices,mv)
-    mv->Transform(mat,matInvT);
+  // same as Wz4MeshVertex::Transform() for all vertices
+
+  sInt count = Vertices.GetCount();
+  if(count>0)
+  {
+    Wz4MeshVertex *mv = Vertices.GetData();
+    const sInt stride = sizeof(Wz4MeshVertex);
+    sBatchTransform(mat,&mv->Pos,stride,&mv->Pos,stride,count);
+    sBatchTransform(matInvT,&mv->Normal,stride,&mv->Normal,stride,count,1);
+    sBatchTransform(mat,&mv->Tangent,stride,&mv->Tangent,stride,count,1);
+  }
 
   if(mat.Determinant3x3() < 0.0f) // flips orientation
   {
@@ -1736,10 +1759,15 @@ void Wz4Mesh::BakeAnim(sF32 time)
   bonemat = new sMatrix34[max];
   basemat = new sMatrix34[max];
   Skeleton->Evaluate(time,bonemat,basemat);
-  
+
+  if(Vertices.GetCount()>0)
+  {
+    v = Vertices.GetData();
+    sBatchSkin(basemat,max,&v->Pos,v->Index,v->Weight,sizeof(Wz4MeshVertex),&v->Pos,sizeof(Wz4MeshVertex),Vertices.GetCount());
+  }
+
   sFORALL(Vertices,v)
   {
-    v->Skin(basemat,max,v->Pos);
     for(sInt i=0;i<4;i++)
     {
       v->Index[i] = -1;
@@ -149,6 +149,7 @@ public:
 
   Wz4Mesh();
   ~Wz4Mesh();
+  sPtr GetByteSize();
 
   template <class streamer> void Serialize_(streamer &stream);
   void Serialize(sWriter &stream);
@@ -9,6 +9,7 @@
 #include "wz4lib/doc.hpp"
 #include "wz4frlib/packfile.hpp"
 #include "wz4frlib/packfilegen.hpp"
+#include "wz4frlib/wz3_bitmap_code.hpp"
 #include "wz4lib/version.hpp"
 #include "util/painter.hpp"
 #include "util/taskscheduler.hpp"
@@ -247,6 +248,7 @@ public:
     sInt t3=sGetTime();
 
     sLogF(L"player",L"load timing: %dms load, %dms calc -> %ds\n",t2-t1,t3-t2,(t3-t1+500)/1000);
+    GenBitmapLogTimes();
 
     Loaded=sTRUE;
   };
@@ -888,6 +890,9 @@ void sMain()
   // .. and go!
   App=new MyApp(Selection);
   App->WZ4Name = wz4name;
+  const sChar *diskcache=sGetShellString(L"c",L"-cache");
+  if (diskcache)
+    Doc->EditOptions.DiskCache = diskcache;
   sSetApp(App);
 }
 
@@ -6,6 +6,8 @@
 #include "depacker.hpp"
 
 #include "_startconsole.hpp"
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
 
 /****************************************************************************/
 
@@ -323,6 +325,275 @@ GoodPackerFrontEnd::GoodPackerFrontEnd(PackerBackEnd *backEnd)
 
 /****************************************************************************/
 
+// Match candidates for the best packer frontend. Walking the hash chains and
+// measuring match lengths is most of the work in DoPack, and none of it
+// depends on the parse, so worker threads do it one block of positions ahead
+// of the pathfinding loop. Candidates are stored in chain order, so the
+// pathfinding loop sees exactly what it would see walking the chains itself.
+// Without workers, the pathfinding loop walks the chains like it used to.
+
+class BestMatchFinder
+{
+public:
+  static const sU32 MaxDepth = 2048;        // max. chain entries per position
+  static const sU32 BlockPos = 65536;       // max. positions per block
+  static const sU32 BlockMatches = 1<<21;   // max. candidates per block
+  static const sU32 ChunkPos = 256;         // positions per work item
+  static const sU32 MaxMeasure = 64;        // longest match measured byte by byte
+  static const sU32 Partial = 0x80000000;   // flag: match length is a lower bound
+  static const sInt MaxThreads = 16;
+
+  struct Block
+  {
+    sU32 Start,End;                         // positions [Start,End)
+    sU32 *First;                            // candidates of i are at First[i-Start]..First[i-Start+1]-1
+    sU32 *Ptr;
+    sU32 *Len;
+  };
+
+  sU32 *Links;
+  sU16 *Depth;                              // number of candidates per position
+  Block Blocks[2];
+  sInt nThreads;
+
+  BestMatchFinder(const sU8 *src,sU32 size);
+  ~BestMatchFinder();
+
+  void Find(Block *blk,sU32 end);           // start on the block that ends at end
+  void Wait();                              // help out and wait until it's done
+
+private:
+  struct Worker
+  {
+    BestMatchFinder *Finder;
+    HANDLE Thread;
+    HANDLE StartEv;
+  };
+
+  const sU8 *Source;
+  sU32 SourceSize;
+
+  Worker Workers[MaxThreads];
+  HANDLE DoneEv[MaxThreads];
+  sBool Busy;
+
+  Block *Current;
+  LONG nChunks;
+  volatile LONG NextChunk;
+  volatile LONG Exit;
+
+  void FindChunk(sU32 chunk);
+  void RunChunks();
+  static DWORD WINAPI WorkerFunc(void *param);
+};
+
+BestMatchFinder::BestMatchFinder(const sU8 *src,sU32 size)
+{
+  sU32 *head,*count,i,key;
+  sInt j;
+  SYSTEM_INFO si;
+
+  Source = src;
+  SourceSize = size;
+
+  // prepare match tables
+  head = new sU32[65536];
+  count = new sU32[65536];
+  Links = new sU32[SourceSize];
+  Depth = new sU16[SourceSize];
+  sSetMem(head,0xff,sizeof(sU32)*65536);
+  sSetMem(count,0,sizeof(sU32)*65536);
+
+  for(i=0;i<SourceSize-1;i++)
+  {
+    key = *(sU16 *) (Source + i);
+    Links[i] = head[key];
+    Depth[i] = sMin(count[key],MaxDepth);
+    head[key] = i;
+    count[key]++;
+  }
+
+  Links[SourceSize-1] = ~0U;
+  Depth[SourceSize-1] = 0;
+  delete[] count;
+  delete[] head;
+
+  // the pathfinding loop keeps one processor busy
+  GetSystemInfo(&si);
+  nThreads = sMin<sInt>(si.dwNumberOfProcessors - 1,MaxThreads);
+  Busy = sFALSE;
+  Current = 0;
+  Exit = 0;
+
+  for(j=0;j<2;j++)
+  {
+    Blocks[j].Start = Blocks[j].End = 0;
+    Blocks[j].First = nThreads ? new sU32[BlockPos+1] : 0;
+    Blocks[j].Ptr = nThreads ? new sU32[BlockMatches] : 0;
+    Blocks[j].Len = nThreads ? new sU32[BlockMatches] : 0;
+  }
+
+  for(j=0;j<nThreads;j++)
+  {
+    Worker &w = Workers[j];
+    DWORD id;
+
+    w.Finder = this;
+    w.StartEv = CreateEvent(0,FALSE,FALSE,0);
+    DoneEv[j] = CreateEvent(0,FALSE,FALSE,0);
+    w.Thread = CreateThread(0,0,WorkerFunc,&w,0,&id);
+  }
+}
+
+BestMatchFinder::~BestMatchFinder()
+{
+  sInt j;
+
+  Wait();
+
+  Exit = 1;
+  for(j=0;j<nThreads;j++)
+  {
+    SetEvent(Workers[j].StartEv);
+    WaitForSingleObject(Workers[j].Thread,INFINITE);
+    CloseHandle(Workers[j].Thread);
+    CloseHandle(Workers[j].StartEv);
+    CloseHandle(DoneEv[j]);
+  }
+
+  for(j=0;j<2;j++)
+  {
+    delete[] Blocks[j].First;
+    delete[] Blocks[j].Ptr;
+    delete[] Blocks[j].Len;
+  }
+
+  delete[] Depth;
+  delete[] Links;
+}
+
+void BestMatchFinder::Find(Block *blk,sU32 end)
+{
+  sU32 i,total;
+  sInt j;
+
+  // take positions until either limit is hit (but at least one)
+  total = Depth[end-1];
+  for(i=end-1;i && end-i<BlockPos && total+Depth[i-1]<=BlockMatches;i--)
+    total += Depth[i-1];
+
+  blk->Start = i;
+  blk->End = end;
+  blk->First[0] = 0;
+  for(i=blk->Start;i<end;i++)
+    blk->First[i-blk->Start+1] = blk->First[i-blk->Start] + Depth[i];
+
+  Current = blk;
+  nChunks = (end - blk->Start + ChunkPos - 1) / ChunkPos;
+  NextChunk = 0;
+  Busy = sTRUE;
+
+  for(j=0;j<nThreads;j++)
+    SetEvent(Workers[j].StartEv);
+}
+
+void BestMatchFinder::Wait()
+{
+  if(!Busy)
+    return;
+
+  RunChunks();
+  WaitForMultipleObjects(nThreads,DoneEv,TRUE,INFINITE);
+  Busy = sFALSE;
+}
+
+void BestMatchFinder::FindChunk(sU32 chunk)
+{
+  const sU8 *src1,*src2;
+  sU32 i,start,ptr,depth,count,maxs,limit;
+  sU32 *ptrs,*lens,*prevPtr,*prevLen,*prevEnd;
+
+  start = Current->Start + chunk*ChunkPos;
+  i = sMin(start+ChunkPos,Current->End);
+  prevPtr = prevLen = prevEnd = 0;
+
+  // go backwards: if the match at i+1 with ptr+1 is known, the one at i
+  // with ptr is just one longer (both start with the same two bytes).
+  while(i-- > start)
+  {
+    ptrs = Current->Ptr + Current->First[i-Current->Start];
+    lens = Current->Len + Current->First[i-Current->Start];
+    ptr = Links[i];
+    maxs = SourceSize-i;
+
+    for(depth=Depth[i];depth;depth--)
+    {
+      while(prevPtr != prevEnd && *prevPtr > ptr+1)
+      {
+        prevPtr++;
+        prevLen++;
+      }
+
+      if(prevPtr != prevEnd && *prevPtr == ptr+1)
+        count = *prevLen + 1;
+      else
+      {
+        // measure it, but don't spend time on long matches the pathfinding
+        // loop might never look at.
+        src1 = Source + i;
+        src2 = Source + ptr;
+        limit = sMin(maxs,MaxMeasure);
+        count = 0;
+
+        while(count+3<limit && *(sU32 *) (src1+count) == *(sU32 *) (src2+count))
+          count+=4;
+
+        while(count<limit && src1[count]==src2[count])
+          count++;
+
+        if(count == MaxMeasure && count < maxs)
+          count |= Partial;
+      }
+
+      *ptrs++ = ptr;
+      *lens++ = count;
+      ptr = Links[ptr];
+    }
+
+    prevPtr = Current->Ptr + Current->First[i-Current->Start];
+    prevLen = Current->Len + Current->First[i-Current->Start];
+    prevEnd = ptrs;
+  }
+}
+
+void BestMatchFinder::RunChunks()
+{
+  LONG chunk;
+
+  while((chunk = InterlockedIncrement(&NextChunk) - 1) < nChunks)
+    FindChunk(chunk);
+}
+
+DWORD WINAPI BestMatchFinder::WorkerFunc(void *param)
+{
+  Worker *w = (Worker *) param;
+  BestMatchFinder *finder = w->Finder;
+
+  for(;;)
+  {
+    WaitForSingleObject(w->StartEv,INFINITE);
+    if(finder->Exit)
+      break;
+
+    finder->RunChunks();
+    SetEvent(finder->DoneEv[w - finder->Workers]);
+  }
+
+  return 0;
+}
+
+/****************************************************************************/
+
 void BestPackerFrontEnd::DoPack(PackerCallback cb)
 {
   struct Token
@@ -333,31 +604,33 @@ void BestPackerFrontEnd::DoPack(PackerCallback cb)
   };
 
   Token *tk,*tokens;
-  sU32 *links;
-  sU32 *head,i,key,ptr,depth,bestOff,bestLen,count,maxs;
+  sU32 i,ptr,depth,bestOff,bestLen,count,maxs;
   sU32 lastBestLen,lastBestOff;
+  sU32 *ptrs,*lens;
   sF32 sz;
   const sU8 *src1,*src2;
   sU8 tick;
+  sInt cur;
+  BestMatchFinder::Block *blk;
 
   tokens = new Token[SourceSize+1];
   sSetMem(tokens,0,sizeof(Token)*(SourceSize+1));
 
-  // prepare match tables
-  head = new sU32[65536];
-  links = new sU32[SourceSize];
-  sSetMem(head,0xff,sizeof(sU32)*65536);
+  // prepare match tables, get the workers started on the first blocks
+  BestMatchFinder finder(Source,SourceSize);
 
-  for(i=0;i<SourceSize-1;i++)
+  cur = 0;
+  blk = 0;
+  ptrs = lens = 0;
+  if(finder.nThreads)
   {
-    key = *(sU16 *) (Source + i);
-    links[i] = head[key];
-    head[key] = i;
+    blk = &finder.Blocks[cur];
+    finder.Find(blk,SourceSize);
+    finder.Wait();
+    if(blk->Start)
+      finder.Find(&finder.Blocks[cur^1],blk->Start);
   }
 
-  links[SourceSize-1] = ~0U;
-  delete[] head;
-
   // pathfinding loop
   tick = 0;
   lastBestLen = 0;
@@ -372,8 +645,22 @@ void BestPackerFrontEnd::DoPack(PackerCallback cb)
     tk->Pos = i;
     tk->CodeSize = BackEnd->AvgLiteralLen + tk[1].CodeSize;
 
-    ptr = links[i];
-    depth = 0;
+    ptr = finder.Links[i];
+
+    if(blk)
+    {
+      if(i < blk->Start)
+      {
+        finder.Wait();
+        cur ^= 1;
+        blk = &finder.Blocks[cur];
+        if(blk->Start)
+          finder.Find(&finder.Blocks[cur^1],blk->Start);
+      }
+
+      ptrs = blk->Ptr + blk->First[i-blk->Start];
+      lens = blk->Len + blk->First[i-blk->Start];
+    }
 
     if(lastBestLen && i>=lastBestOff && Source[i] == Source[i-lastBestOff])
     {
@@ -399,19 +686,28 @@ void BestPackerFrontEnd::DoPack(PackerCallback cb)
     if(!++tick && cb)
       cb(sMin(maxs,SourceSize-1),SourceSize,0);
 
-    while(ptr != ~0U)
+    for(depth=0;depth<finder.Depth[i];depth++)
     {
+      if(ptrs)
+        ptr = ptrs[depth];
+
       src1 = Source + i;
       src2 = Source + ptr;
-      count = 0;
 
       if(src1[bestLen] == src2[bestLen])
       {
-        while(count+3<maxs && *(sU32 *) (src1+count) == *(sU32 *) (src2+count))
-          count+=4;
+        // only partially measured (or not at all)?
+        count = lens ? lens[depth] : BestMatchFinder::Partial;
+        if(count & BestMatchFinder::Partial)
+        {
+          count &= ~BestMatchFinder::Partial;
 
-        while(count<maxs && src1[count]==src2[count])
-          count++;
+          while(count+3<maxs && *(sU32 *) (src1+count) == *(sU32 *) (src2+count))
+            count+=4;
+
+          while(count<maxs && src1[count]==src2[count])
+            count++;
+        }
 
         if(count>1)
         {
@@ -428,10 +724,8 @@ void BestPackerFrontEnd::DoPack(PackerCallback cb)
         }
       }
 
-      if(++depth == 2048)
-        break;
-
-      ptr = links[ptr];
+      if(!ptrs)
+        ptr = finder.Links[ptr];
     }
 
     lastBestLen = bestLen;
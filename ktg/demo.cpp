@@ -9,6 +9,7 @@
 
 #include <stdio.h>
 #include "gentexture.hpp"
+#include "texgraph.hpp"
 
 #ifdef _WIN32
   #pragma comment(lib,"winmm.lib")
@@ -19,7 +20,7 @@
   {
       timeval tim;
       gettimeofday(&tim, NULL);
-      return tim.tv_sec * 1000000 + tim.tv_usec / 10;
+      return tim.tv_sec * 1000 + tim.tv_usec / 1000;
   }
   static int timeBeginPeriod(unsigned int period)
   {
@@ -84,12 +85,10 @@ static GenTexture LinearGradient(sU32 startCol,sU32 endCol)
   return tex;
 }
 
-// Create a pattern of randomly colored voronoi cells
-static void RandomVoronoi(GenTexture &dest,const GenTexture &grad,sInt intensity,sInt maxCount,sF32 minDist)
+// Create random cell centers with a given minimum distance between them,
+// returns the number of centers
+static sInt RandomCenters(CellCenter *centers,sInt intensity,sInt maxCount,sF32 minDist)
 {
-  sVERIFY(maxCount <= 256);
-  CellCenter centers[256];
-
   // generate random center points
   for(sInt i=0;i<maxCount;i++)
   {
@@ -130,14 +129,24 @@ static void RandomVoronoi(GenTexture &dest,const GenTexture &grad,sInt intensity
       i++;
   }
 
+  return maxCount;
+}
+
+// Create a pattern of randomly colored voronoi cells
+static void RandomVoronoi(GenTexture &dest,const GenTexture &grad,sInt intensity,sInt maxCount,sF32 minDist)
+{
+  sVERIFY(maxCount <= 256);
+  CellCenter centers[256];
+
+  sInt count = RandomCenters(centers,intensity,maxCount,minDist);
+
   // generate the image
-  dest.Cells(grad,centers,maxCount,0.0f,GenTexture::CellInner);
+  dest.Cells(grad,centers,count,0.0f,GenTexture::CellInner);
 }
 
-// Transforms a grayscale image to a colored one with a matrix transform
-static void Colorize(GenTexture &img,sU32 startCol,sU32 endCol)
+// Calculates the color matrix that maps black to startCol and white to endCol
+static void ColorizeMatrix(Matrix44 &m,sU32 startCol,sU32 endCol)
 {
-  Matrix44 m;
   Pixel s,e;
 
   s.Init(startCol);
@@ -152,11 +161,31 @@ static void Colorize(GenTexture &img,sU32 startCol,sU32 endCol)
   m[0][3] = s.r / 65535.0f;
   m[1][3] = s.g / 65535.0f;
   m[2][3] = s.b / 65535.0f;
+}
+
+// Transforms a grayscale image to a colored one with a matrix transform
+static void Colorize(GenTexture &img,sU32 startCol,sU32 endCol)
+{
+  Matrix44 m;
+  ColorizeMatrix(m,startCol,endCol);
 
   // transform
   img.ColorMatrixTransform(img,m,sTRUE);
 }
 
+// Transform matrix for the grid pattern (scale and rotate around the center)
+static void GridMatrix(Matrix44 &m3)
+{
+  Matrix44 m1,m2;
+  MatTranslate(m1,-0.5f,-0.5f,0.0f);
+  MatScale(m2,3.0f * sSQRT2F,3.0f * sSQRT2F,1.0f);
+  MatMult(m3,m2,m1);
+  MatRotateZ(m1,0.125f * sPI2F);
+  MatMult(m2,m1,m3);
+  MatTranslate(m1,0.5f,0.5f,0.0f);
+  MatMult(m3,m1,m2);
+}
+
 // Save an image as .TGA file
 static bool SaveImage(GenTexture &img,const char *filename)
 {
@@ -211,128 +240,465 @@ static bool SaveImage(GenTexture &img,const char *filename)
   return true;
 }
 
-int main(int argc,char **argv)
+// Generate the demo texture at the given size
+static void GenerateDemoTexture(GenTexture &finalTex,sInt size)
 {
-  // initialize generator
-  InitTexgen();
+  // colors
+  Pixel black,white;
+  black.Init(0,0,0,255);
+  white.Init(255,255,255,255);
+
+  // create gradients
+  GenTexture gradBW = LinearGradient(0xff000000,0xffffffff);
+  GenTexture gradWB = LinearGradient(0xffffffff,0xff000000);
+  GenTexture gradWhite = LinearGradient(0xffffffff,0xffffffff);
+
+  // simple noise test texture
+  GenTexture noise;
+  noise.Init(size,size);
+  noise.Noise(gradBW,2,2,6,0.5f,123,GenTexture::NoiseDirect|GenTexture::NoiseBandlimit|GenTexture::NoiseNormalize);
+
+  /*// save test image
+  if(!SaveImage(noise,"noise.tga"))
+  {
+    printf("Couldn't write 'noise.tga'!\n");
+    return 1;
+  }*/
+
+  // 4 "random voronoi" textures with different minimum distances
+  GenTexture voro[4];
+  static sInt voroIntens[4] = {     37,     42,     37,     37 };
+  static sInt voroCount[4]  = {     90,    132,    240,    255 };
+  static sF32 voroDist[4]   = { 0.125f, 0.063f, 0.063f, 0.063f };
+
+  for(sInt i=0;i<4;i++)
+  {
+    voro[i].Init(size,size);
+    RandomVoronoi(voro[i],gradWhite,voroIntens[i],voroCount[i],voroDist[i]);
+  }
 
+  // linear combination of them
+  LinearInput inputs[4];
+  for(sInt i=0;i<4;i++)
+  {
+    inputs[i].Tex = &voro[i];
+    inputs[i].Weight = 1.5f;
+    inputs[i].UShift = 0.0f;
+    inputs[i].VShift = 0.0f;
+    inputs[i].FilterMode = GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterNearest;
+  }
+
+  GenTexture baseTex;
+  baseTex.Init(size,size);
+  baseTex.LinearCombine(black,0.0f,inputs,4);
+
+  // blur it
+  baseTex.Blur(baseTex,0.0074f,0.0074f,1,GenTexture::WrapU|GenTexture::WrapV);
+
+  // add a noise layer
+  GenTexture noiseLayer;
+  noiseLayer.Init(size,size);
+  noiseLayer.Noise(LinearGradient(0xff000000,0xff646464),4,4,5,0.995f,3,GenTexture::NoiseDirect|GenTexture::NoiseNormalize|GenTexture::NoiseBandlimit);
+
+  baseTex.Paste(baseTex,noiseLayer,0.0f,0.0f,1.0f,0.0f,0.0f,1.0f,GenTexture::CombineAdd,0);
+
+  // colorize it
+  Colorize(baseTex,0xff747d8e,0xfff1feff);
+
+  // Create transform matrix for grid pattern
+  Matrix44 m3;
+  GridMatrix(m3);
+
+  // Grid pattern GlowRect
+  GenTexture rect1,rect1x,rect1n;
+  rect1.Init(size,size);
+  rect1.LinearCombine(black,1.0f,0,0); // black background
+  rect1.GlowRect(rect1,gradWB,0.5f,0.5f,0.41f,0.0f,0.0f,0.25f,0.7805f,0.64f);
+
+  rect1x.Init(size,size);
+  rect1x.CoordMatrixTransform(rect1,m3,GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterBilinear);
+
+  // Make a normalmap from it
+  rect1n.Init(size,size);
+  rect1n.Derive(rect1x,GenTexture::DeriveNormals,2.5f);
+
+  // Apply as bump map
+  Pixel amb,diff;
+
+  finalTex.Init(size,size);
+  amb.Init(0xff101010);
+  diff.Init(0xffffffff);
+  finalTex.Bump(baseTex,rect1n,0,0,0.0f,0.0f,0.0f,-2.518f,0.719f,-3.10f,amb,diff,sTRUE);
+
+  // Second grid pattern GlowRect
+  GenTexture rect2,rect2x;
+  rect2.Init(size,size);
+  rect2.LinearCombine(white,1.0f,0,0); // white background
+  rect2.GlowRect(rect2,gradBW,0.5f,0.5f,0.36f,0.0f,0.0f,0.20f,0.8805f,0.74f);
+
+  rect2x.Init(size,size);
+  rect2x.CoordMatrixTransform(rect2,m3,GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterBilinear);
+
+  // Multiply it over
+  finalTex.Paste(finalTex,rect2x,0.0f,0.0f,1.0f,0.0f,0.0f,1.0f,GenTexture::CombineMultiply,0);
+}
+
+// Declare the demo texture as a graph (same result as GenerateDemoTexture
+// with gridGlow=0.8805f), returns the output node
+static sInt BuildDemoGraph(TexGraph &g,sInt size,sF32 gridGlow)
+{
   // colors
   Pixel black,white;
   black.Init(0,0,0,255);
   white.Init(255,255,255,255);
 
-  timeBeginPeriod(1);
-  sInt startTime = timeGetTime();
+  // create gradients
+  sInt gradBW = g.Gradient(0xff000000,0xffffffff);
+  sInt gradWB = g.Gradient(0xffffffff,0xff000000);
+  sInt gradWhite = g.Gradient(0xffffffff,0xffffffff);
 
-  for(sInt i=0;i<100;i++)
+  // 4 "random voronoi" textures, combined
+  static sInt voroIntens[4] = {     37,     42,     37,     37 };
+  static sInt voroCount[4]  = {     90,    132,    240,    255 };
+  static sF32 voroDist[4]   = { 0.125f, 0.063f, 0.063f, 0.063f };
+
+  LinearNodeInput inputs[4];
+  for(sInt i=0;i<4;i++)
+  {
+    CellCenter centers[256];
+    sInt count = RandomCenters(centers,voroIntens[i],voroCount[i],voroDist[i]);
+
+    inputs[i].Node = g.Cells(size,size,gradWhite,centers,count,0.0f,GenTexture::CellInner);
+    inputs[i].Weight = 1.5f;
+    inputs[i].UShift = 0.0f;
+    inputs[i].VShift = 0.0f;
+    inputs[i].FilterMode = GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterNearest;
+  }
+
+  sInt baseTex = g.LinearCombine(size,size,black,0.0f,inputs,4);
+  baseTex = g.Blur(baseTex,0.0074f,0.0074f,1,GenTexture::WrapU|GenTexture::WrapV);
+
+  // add a noise layer and colorize
+  sInt noiseLayer = g.Noise(size,size,g.Gradient(0xff000000,0xff646464),4,4,5,0.995f,3,GenTexture::NoiseDirect|GenTexture::NoiseNormalize|GenTexture::NoiseBandlimit);
+  baseTex = g.Paste(baseTex,noiseLayer,0.0f,0.0f,1.0f,0.0f,0.0f,1.0f,GenTexture::CombineAdd,0);
+
+  Matrix44 colorize;
+  ColorizeMatrix(colorize,0xff747d8e,0xfff1feff);
+  baseTex = g.ColorMatrixTransform(baseTex,colorize,sTRUE);
+
+  // grid pattern as bump map
+  Matrix44 grid;
+  GridMatrix(grid);
+
+  sInt rect1 = g.LinearCombine(size,size,black,1.0f,0,0);
+  rect1 = g.GlowRect(rect1,gradWB,0.5f,0.5f,0.41f,0.0f,0.0f,0.25f,0.7805f,0.64f);
+  rect1 = g.CoordMatrixTransform(rect1,grid,GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterBilinear);
+  sInt rect1n = g.Derive(rect1,GenTexture::DeriveNormals,2.5f);
+
+  Pixel amb,diff;
+  amb.Init(0xff101010);
+  diff.Init(0xffffffff);
+  sInt finalTex = g.Bump(baseTex,rect1n,-1,-1,0.0f,0.0f,0.0f,-2.518f,0.719f,-3.10f,amb,diff,sTRUE);
+
+  // second grid pattern, multiplied over
+  sInt rect2 = g.LinearCombine(size,size,white,1.0f,0,0);
+  rect2 = g.GlowRect(rect2,gradBW,0.5f,0.5f,0.36f,0.0f,0.0f,0.20f,gridGlow,0.74f);
+  rect2 = g.CoordMatrixTransform(rect2,grid,GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterBilinear);
+
+  return g.Paste(finalTex,rect2,0.0f,0.0f,1.0f,0.0f,0.0f,1.0f,GenTexture::CombineMultiply,0);
+}
+
+// Generate the demo texture with a TexGraph, then change one parameter and
+// regenerate it
+static void GraphBenchmark(sInt size)
+{
+  GenTexture ref;
+  srand(1);
+  GenerateDemoTexture(ref,size);
+
+  TexGraph graph;
+  sF32 glows[2] = { 0.8805f, 0.5f };
+
+  for(sInt limit=0;limit<2;limit++)
   {
-    // create gradients
-    GenTexture gradBW = LinearGradient(0xff000000,0xffffffff);
-    GenTexture gradWB = LinearGradient(0xffffffff,0xff000000);
-    GenTexture gradWhite = LinearGradient(0xffffffff,0xffffffff);
-
-    // simple noise test texture
-    GenTexture noise;
-    noise.Init(256,256);
-    noise.Noise(gradBW,2,2,6,0.5f,123,GenTexture::NoiseDirect|GenTexture::NoiseBandlimit|GenTexture::NoiseNormalize);
-
-    /*// save test image
-    if(!SaveImage(noise,"noise.tga"))
+    // start from an empty cache
+    graph.Clear();
+    graph.FlushCache();
+    graph.SetCacheLimit(limit ? 256 << 20 : 0);
+
+    for(sInt i=0;i<2;i++)
     {
-      printf("Couldn't write 'noise.tga'!\n");
-      return 1;
-    }*/
+      graph.Clear();
+      srand(1);
 
-    // 4 "random voronoi" textures with different minimum distances
-    GenTexture voro[4];
-    static sInt voroIntens[4] = {     37,     42,     37,     37 };
-    static sInt voroCount[4]  = {     90,    132,    240,    255 };
-    static sF32 voroDist[4]   = { 0.125f, 0.063f, 0.063f, 0.063f };
+      sInt startTime = timeGetTime();
+      sInt out = BuildDemoGraph(graph,size,glows[i]);
+      const GenTexture *tex = graph.Evaluate(out);
+      sInt time = timeGetTime() - startTime;
 
-    for(sInt i=0;i<4;i++)
+      const char *check = "";
+      if(i == 0)
+        check = sCmpMem(tex->Data,ref.Data,ref.NPixels * sizeof(Pixel)) ? ", DIFFERS from eager result!" : ", same as eager";
+
+      printf("graph %4dx%-4d cache %3dMB, %s: %5d ms, %2d computed, %2d cached, peak %3dMB%s\n",
+        size,size,limit ? 256 : 0,i ? "changed" : "initial",time,graph.NodesComputed,graph.NodesCached,
+        sInt(graph.PeakBytes >> 20),check);
+    }
+  }
+}
+
+// Time generation of the demo texture with 1,2,4,... up to maxThreads threads,
+// returns false if any of them doesn't give exactly the single thread result
+static bool ScalingBenchmark(sInt size,sInt maxThreads)
+{
+  sInt baseTime = 0;
+  GenTexture ref;
+  bool ok = true;
+
+  for(sInt threads=1;;threads=sMin(threads*2,maxThreads))
+  {
+    GenTexture tex;
+
+    SetTexgenThreads(threads);
+    srand(1);
+
+    sInt startTime = timeGetTime();
+    GenerateDemoTexture(tex,size);
+    sInt time = timeGetTime() - startTime;
+
+    const char *check = "";
+    if(threads == 1)
     {
-      voro[i].Init(256,256);
-      RandomVoronoi(voro[i],gradWhite,voroIntens[i],voroCount[i],voroDist[i]);
+      baseTime = time;
+      ref = tex;
     }
+    else if(sCmpMem(tex.Data,ref.Data,ref.NPixels * sizeof(Pixel)))
+    {
+      check = ", DIFFERS from 1 thread result!";
+      ok = false;
+    }
+
+    printf("%4dx%-4d %2d threads: %5d ms (%.2fx)%s\n",size,size,threads,time,1.0f * baseTime / sMax(time,1),check);
+
+    if(threads == maxThreads)
+      break;
+  }
+
+  return ok;
+}
+
+// Cells with the texture itself as gradient: each pixel used to be colored
+// before the next one was sampled, and only the first row samples pixels of
+// the texture that were already written. Replay that row one pixel at a time
+// with separate gradients, then do the other rows with the finished first row.
+static bool CellsInPlaceCheck(sInt size)
+{
+  static const sInt maxCenters = 512;
+  CellCenter *centers = new CellCenter[maxCenters];
+  bool ok = true;
+
+  srand(1);
+  for(sInt i=0;i<maxCenters;i++)
+  {
+    centers[i].x = 1.0f * rand() / RAND_MAX;
+    centers[i].y = 1.0f * rand() / RAND_MAX;
+    centers[i].color.Init(rand() & 255,rand() & 255,rand() & 255,255);
+  }
+
+  GenTexture start(size,size);
+  for(sInt i=0;i<start.NPixels;i++)
+    start.Data[i].Init(rand() & 255,rand() & 255,rand() & 255,255);
 
-    // linear combination of them
-    LinearInput inputs[4];
-    for(sInt i=0;i<4;i++)
+  for(sInt pass=0;pass<4;pass++)
+  {
+    sInt count = (pass & 2) ? maxCenters : 16; // row sweep, then grid search
+    sInt mode = (pass & 1) ? GenTexture::CellOuter : GenTexture::CellInner;
+    sF32 amp = (pass & 1) ? 1.0f : 0.5f * sFSqrt(sF32(count));
+
+    GenTexture tex = start;
+    tex.Cells(tex,centers,count,amp,mode);
+
+    GenTexture grad = start;
+    GenTexture ref(size,size);
+    for(sInt x=0;x<size;x++)
     {
-      inputs[i].Tex = &voro[i];
-      inputs[i].Weight = 1.5f;
-      inputs[i].UShift = 0.0f;
-      inputs[i].VShift = 0.0f;
-      inputs[i].FilterMode = GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterNearest;
+      ref.Cells(grad,centers,count,amp,mode);
+      grad.Data[x] = ref.Data[x];
     }
+    ref.Cells(grad,centers,count,amp,mode);
+    sCopyMem(ref.Data,grad.Data,size * sizeof(Pixel));
 
-    GenTexture baseTex;
-    baseTex.Init(256,256);
-    baseTex.LinearCombine(black,0.0f,inputs,4);
+    bool same = !sCmpMem(tex.Data,ref.Data,ref.NPixels * sizeof(Pixel));
+    printf("cells in place %4dx%-4d %3d centers, %s: %s\n",size,size,count,(pass & 1) ? "outer" : "inner",
+      same ? "ok" : "DIFFERS from serial result!");
+    ok = ok && same;
+  }
 
-    // blur it
-    baseTex.Blur(baseTex,0.0074f,0.0074f,1,GenTexture::WrapU|GenTexture::WrapV);
+  delete[] centers;
+  return ok;
+}
 
-    // add a noise layer
-    GenTexture noiseLayer;
-    noiseLayer.Init(256,256);
-    noiseLayer.Noise(LinearGradient(0xff000000,0xff646464),4,4,5,0.995f,3,GenTexture::NoiseDirect|GenTexture::NoiseNormalize|GenTexture::NoiseBandlimit);
+// Time Cells with more and more centers (the row sweep is used up to a
+// few hundred centers, a grid search above that)
+static void CellsBenchmark(sInt size)
+{
+  GenTexture gradBW = LinearGradient(0xff000000,0xffffffff);
+  GenTexture tex(size,size);
+  static const sInt maxCenters = 65536;
+  CellCenter *centers = new CellCenter[maxCenters];
 
-    baseTex.Paste(baseTex,noiseLayer,0.0f,0.0f,1.0f,0.0f,0.0f,1.0f,GenTexture::CombineAdd,0);
+  srand(1);
+  for(sInt i=0;i<maxCenters;i++)
+  {
+    sInt intens = rand() & 255;
 
-    // colorize it
-    Colorize(baseTex,0xff747d8e,0xfff1feff);
+    centers[i].x = 1.0f * rand() / RAND_MAX;
+    centers[i].y = 1.0f * rand() / RAND_MAX;
+    centers[i].color.Init(intens,intens,intens,255);
+  }
 
-    // Create transform matrix for grid pattern
-    Matrix44 m1,m2,m3;
-    MatTranslate(m1,-0.5f,-0.5f,0.0f);
-    MatScale(m2,3.0f * sSQRT2F,3.0f * sSQRT2F,1.0f);
-    MatMult(m3,m2,m1);
-    MatRotateZ(m1,0.125f * sPI2F);
-    MatMult(m2,m1,m3);
-    MatTranslate(m1,0.5f,0.5f,0.0f);
-    MatMult(m3,m1,m2);
+  for(sInt count=16;count<=maxCenters;count*=4)
+  {
+    // amp so cells are about the same brightness for every count
+    sF32 amp = 0.5f * sFSqrt(sF32(count));
 
-    // Grid pattern GlowRect
-    GenTexture rect1,rect1x,rect1n;
-    rect1.Init(256,256);
-    rect1.LinearCombine(black,1.0f,0,0); // black background
-    rect1.GlowRect(rect1,gradWB,0.5f,0.5f,0.41f,0.0f,0.0f,0.25f,0.7805f,0.64f);
+    sInt startTime = timeGetTime();
+    tex.Cells(gradBW,centers,count,amp,GenTexture::CellInner);
+    sInt innerTime = timeGetTime() - startTime;
 
-    rect1x.Init(256,256);
-    rect1x.CoordMatrixTransform(rect1,m3,GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterBilinear);
+    startTime = timeGetTime();
+    tex.Cells(gradBW,centers,count,1.0f,GenTexture::CellOuter);
+    sInt outerTime = timeGetTime() - startTime;
 
-    // Make a normalmap from it
-    rect1n.Init(256,256);
-    rect1n.Derive(rect1x,GenTexture::DeriveNormals,2.5f);
+    printf("cells %4dx%-4d %5d centers: inner %5d ms, outer %5d ms\n",size,size,count,innerTime,outerTime);
+  }
 
-    // Apply as bump map
-    GenTexture finalTex;
-    Pixel amb,diff;
+  delete[] centers;
+}
 
-    finalTex.Init(256,256);
-    amb.Init(0xff101010);
-    diff.Init(0xffffffff);
-    finalTex.Bump(baseTex,rect1n,0,0,0.0f,0.0f,0.0f,-2.518f,0.719f,-3.10f,amb,diff,sTRUE);
+// Output callback for StreamBenchmark: adds up the red channel of a block
+struct RowSum
+{
+  sInt XRes;
+  sU64 Sum;
+};
 
-    // Second grid pattern GlowRect
-    GenTexture rect2,rect2x;
-    rect2.Init(256,256);
-    rect2.LinearCombine(white,1.0f,0,0); // white background
-    rect2.GlowRect(rect2,gradBW,0.5f,0.5f,0.36f,0.0f,0.0f,0.20f,0.8805f,0.74f);
+static void SumRows(const Pixel *rows,sInt,sInt count,void *user)
+{
+  RowSum *sum = (RowSum *) user;
+
+  for(sInt i=0;i<count*sum->XRes;i++)
+    sum->Sum += rows[i].r;
+}
 
-    rect2x.Init(256,256);
-    rect2x.CoordMatrixTransform(rect2,m3,GenTexture::WrapU|GenTexture::WrapV|GenTexture::FilterBilinear);
+// Runs a chain of filters with TexStream: first on a small image to compare
+// against the GenTexture functions, then on a big (non power of 2) one.
+static void StreamBenchmark(sInt xres,sInt yres)
+{
+  // small source textures
+  GenTexture gradBW = LinearGradient(0xff000000,0xffffffff);
+  GenTexture noise(256,256),voro(256,256);
+
+  srand(1);
+  noise.Noise(gradBW,2,2,6,0.5f,123,GenTexture::NoiseDirect|GenTexture::NoiseBandlimit|GenTexture::NoiseNormalize);
+  RandomVoronoi(voro,gradBW,255,100,0.05f);
 
-    // Multiply it over
-    finalTex.Paste(finalTex,rect2x,0.0f,0.0f,1.0f,0.0f,0.0f,1.0f,GenTexture::CombineMultiply,0);
+  Pixel black;
+  black.Init(0,0,0,255);
+
+  Matrix44 colorize;
+  ColorizeMatrix(colorize,0xff747d8e,0xfff1feff);
+
+  for(sInt pass=0;pass<2;pass++)
+  {
+    sInt w = pass ? xres : 300;
+    sInt h = pass ? yres : 200;
+
+    // base = noise + voronoi cells (tiled 4x), colorized, lit with its own normals
+    TexStreamTexture noiseIn(noise),voroIn(voro);
+    LinearStreamInput inputs[2] =
+    {
+      { &noiseIn, 0.7f, 0.0f, 0.0f, GenTexture::FilterBilinear },
+      { &voroIn,  0.4f, 0.1f, 0.3f, GenTexture::FilterNearest },
+    };
+
+    TexStreamLinearCombine base(w,h,black,0.0f,inputs,2);
+    TexStreamColorMatrix color(base,colorize,sTRUE);
+    TexStreamDerive normals(base,GenTexture::DeriveNormals,2.5f);
+    TexStreamTernary final(color,normals,base,GenTexture::TernaryLerp);
+
+    if(pass == 0)
+    {
+      // same thing with whole textures
+      LinearInput texInputs[2] =
+      {
+        { &noise, 0.7f, 0.0f, 0.0f, GenTexture::FilterBilinear },
+        { &voro,  0.4f, 0.1f, 0.3f, GenTexture::FilterNearest },
+      };
+
+      GenTexture baseTex(w,h),colorTex(w,h),normalTex(w,h),finalTex(w,h),streamed;
+      baseTex.LinearCombine(black,0.0f,texInputs,2);
+      colorTex.ColorMatrixTransform(baseTex,colorize,sTRUE);
+      normalTex.Derive(baseTex,GenTexture::DeriveNormals,2.5f);
+      finalTex.Ternary(colorTex,normalTex,baseTex,GenTexture::TernaryLerp);
+
+      final.Run(streamed,16);
+      printf("stream %4dx%-4d: %s\n",w,h,sCmpMem(streamed.Data,finalTex.Data,finalTex.NPixels * sizeof(Pixel)) ? "DIFFERS from GenTexture result!" : "same as GenTexture");
+    }
+    else
+    {
+      RowSum sum;
+      sum.XRes = w;
+      sum.Sum = 0;
+
+      sInt startTime = timeGetTime();
+      final.Run(64,SumRows,&sum);
+      sInt time = timeGetTime() - startTime;
+
+      printf("stream %4dx%-4d: %5d ms in 64-row blocks (whole textures would need %d MB)\n",w,h,time,sInt(sS64(w) * h * sizeof(Pixel) * 4 >> 20));
+    }
+  }
+}
+
+int main(int argc,char **argv)
+{
+  // number of threads to use (default: 1)
+  sInt maxThreads = (argc > 1) ? sMax(atoi(argv[1]),1) : 1;
+
+  // initialize generator
+  InitTexgen();
+  SetTexgenThreads(maxThreads);
+
+  timeBeginPeriod(1);
+  sInt startTime = timeGetTime();
+
+  for(sInt i=0;i<100;i++)
+  {
+    GenTexture finalTex;
+    GenerateDemoTexture(finalTex,256);
   }
 
   sInt totalTime = timeGetTime() - startTime;
-  timeEndPeriod(1);
 
   printf("%d ms/tex\n",totalTime / 100);
 
+  // thread scaling on big textures
+  if(!ScalingBenchmark(1024,maxThreads) || !ScalingBenchmark(2048,maxThreads))
+    return 1;
+
+  // lazy evaluation with caching
+  GraphBenchmark(1024);
+
+  // cells with up to 64k centers
+  CellsBenchmark(1024);
+  if(!CellsInPlaceCheck(64))
+    return 1;
+
+  // streaming on a big non power of 2 image
+  StreamBenchmark(6000,5000);
+
+  timeEndPeriod(1);
+
   /*SaveImage(baseTex,"baseTex.tga");
   SaveImage(finalTex,"final.tga");*/
 
@@ -6,6 +6,15 @@
 /****************************************************************************/
 
 #include "gentexture.hpp"
+#include "pixelkernels.hpp"
+
+#ifdef _WIN32
+  #define WIN32_LEAN_AND_MEAN
+  #define NOMINMAX
+  #include <windows.h>
+#else
+  #include <pthread.h>
+#endif
 
 /****************************************************************************/
 /***                                                                      ***/
@@ -19,18 +28,45 @@ static sBool IsPowerOf2(sInt x)
   return (x & (x-1)) == 0;
 }
 
-// Returns floor(log2(x))
-static sInt FloorLog2(sInt x)
+// Returns i mod n (in 0..n-1, also for negative i)
+static sInt WrapIndex(sInt i,sInt n)
+{
+  if(IsPowerOf2(n))
+    return i & (n-1);
+
+  i %= n;
+  return (i < 0) ? i + n : i;
+}
+
+// Coordinate (1.7.24 fixed point) of the center of pixel i out of res
+static sInt PixelCenter(sInt i,sInt res)
+{
+  return (sS64(2*i + 1) << 23) / res;
+}
+
+// Returns a new[]ed table with PixelCenter(i,res) for i=0..res-1
+static sInt *PixelCenters(sInt res)
 {
-  sInt res = 0;
+  sInt *centers = new sInt[res];
+  for(sInt i=0;i<res;i++)
+    centers[i] = PixelCenter(i,res);
 
-  if(x & 0xffff0000)  x >>= 16, res += 16;
-  if(x & 0x0000ff00)  x >>=  8, res +=  8;
-  if(x & 0x000000f0)  x >>=  4, res +=  4;
-  if(x & 0x0000000c)  x >>=  2, res +=  2;
-  if(x & 0x00000002)  res++;
+  return centers;
+}
+
+// Pixel index for point sampling at coordinate x (not wrapped yet)
+static sInt NearestIndex(sInt x,sInt res,sInt clamp)
+{
+  sInt i = (sS64(x) * res) >> 24;
+  return clamp ? sClamp(i,0,res-1) : i;
+}
 
-  return res;
+// Position for bilinear sampling at coordinate x: pixel index (not wrapped
+// yet) in the upper bits, 24 bits fraction. Pixel 0 starts at its center.
+static sS64 BilinearPos(sInt x,sInt res,sInt clamp)
+{
+  sS64 pos = sS64(x) * res - (1 << 23);
+  return clamp ? sClamp<sS64>(pos,0,sS64(res-1) << 24) : pos;
 }
 
 // Multiply intensities.
@@ -65,6 +101,277 @@ static sF32 LerpF(sF32 t,sF32 a,sF32 b)
   return a + t * (b - a);
 }
 
+/****************************************************************************/
+/***                                                                      ***/
+/***   Threading                                                          ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// All operators split their work into bands of rows (or columns) that can
+// be processed independently. The bands are handed out to threads in a
+// fixed round-robin order, so the only synchronization is handing out the
+// job and waiting for it to finish, and since every band computes exactly
+// what the serial loop would have computed for it, the results are
+// bit-identical for any thread count.
+//
+// The worker threads are started once by SetTexgenThreads and then sleep
+// until the next job arrives. Only one job runs at a time; nested calls
+// (and calls from other threads while a job is running) just run serially.
+
+static const sInt MaxThreads = 64;      // upper limit for SetTexgenThreads
+static const sInt MinBandSize = 4;      // don't make bands smaller than this
+static const sInt BandsPerThread = 4;   // for load balancing
+
+static sInt NumThreads = 1;
+
+typedef void (*BandFunc)(void *user,sInt start,sInt end);
+
+struct BandJob
+{
+  BandFunc Func;
+  void *User;
+  sInt NItems;
+  sInt NBands;
+  sInt NThreads;
+};
+
+static void RunBands(const BandJob *job,sInt index)
+{
+  for(sInt i=index;i<job->NBands;i+=job->NThreads)
+  {
+    sInt start = sS64(i+0) * job->NItems / job->NBands;
+    sInt end   = sS64(i+1) * job->NItems / job->NBands;
+    job->Func(job->User,start,end);
+  }
+}
+
+// Minimal mutex/condition variable wrappers
+
+#ifdef _WIN32
+
+typedef CRITICAL_SECTION PoolMutex;
+typedef CONDITION_VARIABLE PoolCond;
+typedef HANDLE PoolThread;
+
+static void MutexInit(PoolMutex *m)     { InitializeCriticalSection(m); }
+static void MutexLock(PoolMutex *m)     { EnterCriticalSection(m); }
+static sBool MutexTryLock(PoolMutex *m) { return TryEnterCriticalSection(m) != 0; }
+static void MutexUnlock(PoolMutex *m)   { LeaveCriticalSection(m); }
+static void CondInit(PoolCond *c)       { InitializeConditionVariable(c); }
+static void CondWait(PoolCond *c,PoolMutex *m) { SleepConditionVariableCS(c,m,INFINITE); }
+static void CondBroadcast(PoolCond *c)  { WakeAllConditionVariable(c); }
+
+#else
+
+typedef pthread_mutex_t PoolMutex;
+typedef pthread_cond_t PoolCond;
+typedef pthread_t PoolThread;
+
+static void MutexInit(PoolMutex *m)     { pthread_mutex_init(m,0); }
+static void MutexLock(PoolMutex *m)     { pthread_mutex_lock(m); }
+static sBool MutexTryLock(PoolMutex *m) { return pthread_mutex_trylock(m) == 0; }
+static void MutexUnlock(PoolMutex *m)   { pthread_mutex_unlock(m); }
+static void CondInit(PoolCond *c)       { pthread_cond_init(c,0); }
+static void CondWait(PoolCond *c,PoolMutex *m) { pthread_cond_wait(c,m); }
+static void CondBroadcast(PoolCond *c)  { pthread_cond_broadcast(c); }
+
+#endif
+
+struct BandPool
+{
+  PoolMutex JobLock;          // held while a job runs
+  PoolMutex Lock;             // protects the fields below
+  PoolCond WorkCond;          // signalled when a job is posted or on quit
+  PoolCond DoneCond;          // signalled when the last worker is done
+
+  const BandJob *Job;
+  sU32 Generation;            // incremented for every posted job
+  sU32 StartGeneration;       // Generation when the workers were started
+  sInt Pending;               // workers still busy with the current job
+  sBool Quit;
+
+  sInt Count;                 // number of running worker threads
+  PoolThread Threads[MaxThreads];
+  sInt Index[MaxThreads];
+
+  BandPool();
+  ~BandPool();
+  void Start(sInt count);
+  void Stop();
+  void Run(BandJob *job);
+  void Work(sInt index);
+};
+
+static BandPool Pool;
+
+#ifdef _WIN32
+static DWORD WINAPI BandThreadProc(LPVOID arg)
+#else
+static void *BandThreadProc(void *arg)
+#endif
+{
+  Pool.Work(*(sInt *) arg);
+  return 0;
+}
+
+BandPool::BandPool()
+{
+  MutexInit(&JobLock);
+  MutexInit(&Lock);
+  CondInit(&WorkCond);
+  CondInit(&DoneCond);
+  Job = 0;
+  Generation = 0;
+  StartGeneration = 0;
+  Pending = 0;
+  Quit = sFALSE;
+  Count = 0;
+}
+
+BandPool::~BandPool()
+{
+  Stop();
+}
+
+// Starts count worker threads (worker i does the bands of thread i+1).
+// If a thread can't be created, the pool just stays smaller.
+void BandPool::Start(sInt count)
+{
+  Quit = sFALSE;
+  StartGeneration = Generation;
+  for(sInt i=0;i<count;i++)
+  {
+    Index[Count] = Count+1;
+#ifdef _WIN32
+    Threads[Count] = CreateThread(0,0,BandThreadProc,&Index[Count],0,0);
+    if(!Threads[Count])
+      break;
+#else
+    if(pthread_create(&Threads[Count],0,BandThreadProc,&Index[Count]) != 0)
+      break;
+#endif
+    Count++;
+  }
+}
+
+void BandPool::Stop()
+{
+  MutexLock(&Lock);
+  Quit = sTRUE;
+  CondBroadcast(&WorkCond);
+  MutexUnlock(&Lock);
+
+  for(sInt i=0;i<Count;i++)
+  {
+#ifdef _WIN32
+    WaitForSingleObject(Threads[i],INFINITE);
+    CloseHandle(Threads[i]);
+#else
+    pthread_join(Threads[i],0);
+#endif
+  }
+  Count = 0;
+}
+
+// Start() runs while no job is active, so the workers begin at the current
+// generation even if the first job is posted before they get to run.
+void BandPool::Work(sInt index)
+{
+  MutexLock(&Lock);
+  sU32 seen = StartGeneration;
+  for(;;)
+  {
+    while(!Quit && Generation == seen)
+      CondWait(&WorkCond,&Lock);
+    if(Quit)
+      break;
+
+    seen = Generation;
+    const BandJob *job = Job;
+    if(index < job->NThreads)
+    {
+      MutexUnlock(&Lock);
+      RunBands(job,index);
+      MutexLock(&Lock);
+      if(--Pending == 0)
+        CondBroadcast(&DoneCond);
+    }
+  }
+  MutexUnlock(&Lock);
+}
+
+void BandPool::Run(BandJob *job)
+{
+  // nested or concurrent call: do it all here.
+  if(!MutexTryLock(&JobLock))
+  {
+    job->NThreads = 1;
+    RunBands(job,0);
+    return;
+  }
+
+  job->NThreads = sMin(job->NThreads,Count+1);
+  if(job->NThreads > 1)
+  {
+    MutexLock(&Lock);
+    Job = job;
+    Pending = job->NThreads - 1;
+    Generation++;
+    CondBroadcast(&WorkCond);
+    MutexUnlock(&Lock);
+  }
+
+  // the calling thread does its share too
+  RunBands(job,0);
+
+  if(job->NThreads > 1)
+  {
+    MutexLock(&Lock);
+    while(Pending)
+      CondWait(&DoneCond,&Lock);
+    Job = 0;
+    MutexUnlock(&Lock);
+  }
+
+  MutexUnlock(&JobLock);
+}
+
+// Calls func(user,start,end) for bands covering [0,nItems), using up to
+// NumThreads threads (including the calling one) if allowThreads is set.
+static void RunParallel(sInt nItems,sBool allowThreads,BandFunc func,void *user)
+{
+  sInt nThreads = allowThreads ? sMin(NumThreads,nItems / MinBandSize) : 1;
+  if(nThreads <= 1)
+  {
+    func(user,0,nItems);
+    return;
+  }
+
+  BandJob job;
+  job.Func = func;
+  job.User = user;
+  job.NItems = nItems;
+  job.NBands = sMin(nThreads * BandsPerThread,nItems / MinBandSize);
+  job.NThreads = nThreads;
+  Pool.Run(&job);
+}
+
+// Convenience wrapper: body(start,end) gets called for every band.
+template<class Body> static void ForBands(sInt nItems,sBool allowThreads,const Body &body)
+{
+  struct Thunk
+  {
+    static void Call(void *user,sInt start,sInt end)
+    {
+      (*(const Body *) user)(start,end);
+    }
+  };
+
+  RunParallel(nItems,allowThreads,Thunk::Call,(void *) &body);
+}
+
+/****************************************************************************/
+
 // Perlin permutation table
 static sU16 Ptable[4096];
 static sU32 *Ptemp;
@@ -287,150 +594,350 @@ void Pixel::CompositeScreen(const Pixel &x)
 
 /****************************************************************************/
 /***                                                                      ***/
-/***   GenTexture                                                         ***/
+/***   Pixel kernels (scalar reference versions)                          ***/
 /***                                                                      ***/
 /****************************************************************************/
 
-GenTexture::GenTexture()
+static void CompositeAddScalar(Pixel *dst,const Pixel *src,sInt count)
 {
-  Data = 0;
-  XRes = 0;
-  YRes = 0;
-
-  UpdateSize();
+  for(sInt i=0;i<count;i++)
+    dst[i].CompositeAdd(src[i]);
 }
 
-GenTexture::GenTexture(sInt xres,sInt yres)
+static void CompositeMulCScalar(Pixel *dst,const Pixel *src,sInt count)
 {
-  Data = 0;
-  XRes = 0;
-  YRes = 0;
-
-  Init(xres,yres);
+  for(sInt i=0;i<count;i++)
+    dst[i].CompositeMulC(src[i]);
 }
 
-GenTexture::GenTexture(const GenTexture &x)
+static void CompositeROverScalar(Pixel *dst,const Pixel *src,sInt count)
 {
-  XRes = x.XRes;
-  YRes = x.YRes;
-  UpdateSize();
-
-  Data = new Pixel[NPixels];
-  sCopyMem(Data,x.Data,NPixels * sizeof(Pixel));
+  for(sInt i=0;i<count;i++)
+    dst[i].CompositeROver(src[i]);
 }
 
-GenTexture::~GenTexture()
+static void CompositeScreenScalar(Pixel *dst,const Pixel *src,sInt count)
 {
-  delete[] Data;
+  for(sInt i=0;i<count;i++)
+    dst[i].CompositeScreen(src[i]);
 }
 
-void GenTexture::Init(sInt xres,sInt yres)
+static void LerpScalar(Pixel *dst,const Pixel *x,const Pixel *y,sInt t,sInt count)
 {
-  if(XRes != xres || YRes != yres)
-  {
-    delete[] Data;
-
-    sVERIFY(IsPowerOf2(xres));
-    sVERIFY(IsPowerOf2(yres));
-
-    XRes = xres;
-    YRes = yres;
-    UpdateSize();
-
-    Data = new Pixel[NPixels];
-  }
+  for(sInt i=0;i<count;i++)
+    dst[i].Lerp(t,x[i],y[i]);
 }
 
-void GenTexture::UpdateSize()
+static void SampleBilinearScalar(Pixel &result,const Pixel *row0,const Pixel *row1,sInt x0,sInt x1,sInt fx,sInt fy)
 {
-  NPixels = XRes * YRes;
-  ShiftX = FloorLog2(XRes);
-  ShiftY = FloorLog2(YRes);
-
-  MinX = 1 << (24 - 1 - ShiftX);
-  MinY = 1 << (24 - 1 - ShiftY);
+  Pixel t0,t1;
+  t0.Lerp(fx,row0[x0],row0[x1]);
+  t1.Lerp(fx,row1[x0],row1[x1]);
+  result.Lerp(fy,t0,t1);
 }
 
-void GenTexture::Swap(GenTexture &x)
+static void ColorMatrixScalar(Pixel *outPix,const Pixel *inPix,sInt count,const sInt m[4][4],sBool clampPremult)
 {
-  sSwap(Data,x.Data);
-  sSwap(XRes,x.XRes);
-  sSwap(YRes,x.YRes);
-  sSwap(NPixels,x.NPixels);
-  sSwap(ShiftX,x.ShiftX);
-  sSwap(ShiftY,x.ShiftY);
-  sSwap(MinX,x.MinX);
-  sSwap(MinY,x.MinY);
-}
+  for(sInt i=0;i<count;i++)
+  {
+    Pixel &out = outPix[i];
+    const Pixel &in = inPix[i];
 
-GenTexture &GenTexture::operator =(const GenTexture &x)
-{
-  GenTexture t=x;
-  
-  Swap(t);
-  return *this;
-}
+    sInt r = MulShift16(m[0][0],in.r) + MulShift16(m[0][1],in.g) + MulShift16(m[0][2],in.b) + MulShift16(m[0][3],in.a);
+    sInt g = MulShift16(m[1][0],in.r) + MulShift16(m[1][1],in.g) + MulShift16(m[1][2],in.b) + MulShift16(m[1][3],in.a);
+    sInt b = MulShift16(m[2][0],in.r) + MulShift16(m[2][1],in.g) + MulShift16(m[2][2],in.b) + MulShift16(m[2][3],in.a);
+    sInt a = MulShift16(m[3][0],in.r) + MulShift16(m[3][1],in.g) + MulShift16(m[3][2],in.b) + MulShift16(m[3][3],in.a);
 
-sBool GenTexture::SizeMatchesWith(const GenTexture &x) const
-{
-  return XRes == x.XRes && YRes == x.YRes;
+    if(clampPremult)
+    {
+      out.a = sClamp<sInt>(a,0,65535);
+      out.r = sClamp<sInt>(r,0,out.a);
+      out.g = sClamp<sInt>(g,0,out.a);
+      out.b = sClamp<sInt>(b,0,out.a);
+    }
+    else
+    {
+      out.r = sClamp<sInt>(r,0,65535);
+      out.g = sClamp<sInt>(g,0,65535);
+      out.b = sClamp<sInt>(b,0,65535);
+      out.a = sClamp<sInt>(a,0,65535);
+    }
+  }
 }
 
-// ---- Sampling helpers
-void GenTexture::SampleNearest(Pixel &result,sInt x,sInt y,sInt wrapMode) const
+// Wrap computation on pixel coordinates
+static sInt WrapCoord(sInt x,sInt width,sInt mode)
 {
-  if(wrapMode & 1)  x = sClamp(x,MinX,0x1000000-MinX);
-  if(wrapMode & 2)  y = sClamp(y,MinY,0x1000000-MinY);
-
-  x &= 0xffffff;
-  y &= 0xffffff;
-
-  sInt ix = x >> (24 - ShiftX);
-  sInt iy = y >> (24 - ShiftY);
-
-  result = Data[(iy << ShiftX) + ix];
+  if(mode == 0) // wrap
+    return WrapIndex(x,width);
+  else
+    return sClamp(x,0,width-1);
 }
 
-void GenTexture::SampleBilinear(Pixel &result,sInt x,sInt y,sInt wrapMode) const
+// Size is half of edge length in pixels, 26.6 fixed point
+static void Blur1DScalar(Pixel *dst,const Pixel *src,sInt width,sInt sizeFixed,sInt wrapMode)
 {
-  if(wrapMode & 1)  x = sClamp(x,MinX,0x1000000-MinX);
-  if(wrapMode & 2)  y = sClamp(y,MinY,0x1000000-MinY);
+  sVERIFY(sizeFixed > 32); // kernel should be wider than one pixel
+  sInt frac = (sizeFixed - 32) & 63;
+  sInt offset = (sizeFixed + 32) >> 6;
 
-  x = (x - MinX) & 0xffffff;
-  y = (y - MinY) & 0xffffff;
+  sVERIFY(((offset - 1) * 64 + frac + 32) == sizeFixed);
+  sU32 denom = sizeFixed * 2;
+  sU32 bias = denom / 2;
 
-  sInt x0 = x >> (24 - ShiftX);
-  sInt x1 = (x0 + 1) & (XRes - 1);
-  sInt y0 = y >> (24 - ShiftY);
-  sInt y1 = (y0 + 1) & (YRes - 1);
-  sInt fx = sU32(x << (ShiftX + 8)) >> 16;
-  sInt fy = sU32(y << (ShiftY + 8)) >> 16;
+  // initialize accumulators
+  sU32 accu[4];
+  if(wrapMode == 0) // wrap around
+  {
+    // leftmost and rightmost pixels (the partially covered ones)
+    sInt xl = WrapCoord(-offset,width,wrapMode);
+    sInt xr = WrapCoord(offset,width,wrapMode);
+    accu[0] = frac * (src[xl].r + src[xr].r) + bias;
+    accu[1] = frac * (src[xl].g + src[xr].g) + bias;
+    accu[2] = frac * (src[xl].b + src[xr].b) + bias;
+    accu[3] = frac * (src[xl].a + src[xr].a) + bias;
 
-  Pixel t0,t1;
-  t0.Lerp(fx,Data[(y0 << ShiftX) + x0],Data[(y0 << ShiftX) + x1]);
-  t1.Lerp(fx,Data[(y1 << ShiftX) + x0],Data[(y1 << ShiftX) + x1]);
-  result.Lerp(fy,t0,t1);
-}
+    // inner part of filter kernel
+    for(sInt x=-offset+1;x<=offset-1;x++)
+    {
+      sInt xc = WrapCoord(x,width,wrapMode);
+      
+      accu[0] += src[xc].r << 6;
+      accu[1] += src[xc].g << 6;
+      accu[2] += src[xc].b << 6;
+      accu[3] += src[xc].a << 6;
+    }
+  }
+  else // clamp on edge
+  {
+    // on the left edge, the first pixel is repeated over and over
+    accu[0] = src[0].r * (sizeFixed + 32) + bias;
+    accu[1] = src[0].g * (sizeFixed + 32) + bias;
+    accu[2] = src[0].b * (sizeFixed + 32) + bias;
+    accu[3] = src[0].a * (sizeFixed + 32) + bias;
 
-void GenTexture::SampleFiltered(Pixel &result,sInt x,sInt y,sInt filterMode) const
-{
-  if(filterMode & FilterBilinear)
-    SampleBilinear(result,x,y,filterMode);
-  else
-    SampleNearest(result,x,y,filterMode);
-}
+    // rightmost pixel
+    sInt xr = WrapCoord(offset,width,wrapMode);
+    accu[0] += frac * src[xr].r;
+    accu[1] += frac * src[xr].g;
+    accu[2] += frac * src[xr].b;
+    accu[3] += frac * src[xr].a;
 
-void GenTexture::SampleGradient(Pixel &result,sInt x) const
-{
-  x = sClamp(x,0,1<<24);
-  x -= x >> ShiftX; // x=(1<<24) -> Take rightmost pixel
+    // inner part of filter kernel (the right half)
+    for(sInt x=1;x<=offset-1;x++)
+    {
+      sInt xc = WrapCoord(x,width,wrapMode);
 
-  sInt x0 = x >> (24 - ShiftX);
-  sInt x1 = (x0 + 1) & (XRes - 1);
-  sInt fx = sU32(x << (ShiftX + 8)) >> 16;
+      accu[0] += src[xc].r << 6;
+      accu[1] += src[xc].g << 6;
+      accu[2] += src[xc].b << 6;
+      accu[3] += src[xc].a << 6;
+    }
+  }
 
-  result.Lerp(fx,Data[x0],Data[x1]);
-}
+  // generate output pixels
+  for(sInt x=0;x<width;x++)
+  {
+    // write out state of accumulator
+    dst[x].r = accu[0] / denom;
+    dst[x].g = accu[1] / denom;
+    dst[x].b = accu[2] / denom;
+    dst[x].a = accu[3] / denom;
+
+    // update accumulator
+    sInt xl0 = WrapCoord(x-offset+0,width,wrapMode);
+    sInt xl1 = WrapCoord(x-offset+1,width,wrapMode);
+    sInt xr0 = WrapCoord(x+offset+0,width,wrapMode);
+    sInt xr1 = WrapCoord(x+offset+1,width,wrapMode);
+
+    accu[0] += 64 * (src[xr0].r - src[xl1].r) + frac * (src[xr1].r - src[xr0].r - src[xl0].r + src[xl1].r);
+    accu[1] += 64 * (src[xr0].g - src[xl1].g) + frac * (src[xr1].g - src[xr0].g - src[xl0].g + src[xl1].g);
+    accu[2] += 64 * (src[xr0].b - src[xl1].b) + frac * (src[xr1].b - src[xr0].b - src[xl0].b + src[xl1].b);
+    accu[3] += 64 * (src[xr0].a - src[xl1].a) + frac * (src[xr1].a - src[xr0].a - src[xl0].a + src[xl1].a);
+  }
+}
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Kernel selection                                                   ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+static PixelKernels KernelTable[KernelsCount] =
+{
+  {
+    CompositeAddScalar,
+    CompositeMulCScalar,
+    CompositeROverScalar,
+    CompositeScreenScalar,
+    LerpScalar,
+    SampleBilinearScalar,
+    ColorMatrixScalar,
+    Blur1DScalar,
+  },
+};
+
+static sInt KernelSetSupported = KernelsScalar;
+static sInt KernelSetCurrent = KernelsScalar;
+static const PixelKernels *Kernels = &KernelTable[KernelsScalar];
+
+// Every set starts out as a copy of the one below it, so sets only need to
+// provide the kernels they actually speed up.
+static void InitKernels()
+{
+  KernelTable[KernelsSSE2] = KernelTable[KernelsScalar];
+  InitKernelsSSE2(KernelTable[KernelsSSE2]);
+
+  KernelTable[KernelsAVX2] = KernelTable[KernelsSSE2];
+  InitKernelsAVX2(KernelTable[KernelsAVX2]);
+
+  KernelSetSupported = DetectKernelSet();
+  SetKernelSet(KernelSetSupported);
+}
+
+sInt SetKernelSet(sInt set)
+{
+  KernelSetCurrent = sClamp<sInt>(set,KernelsScalar,KernelSetSupported);
+  Kernels = &KernelTable[KernelSetCurrent];
+
+  return KernelSetCurrent;
+}
+
+sInt GetKernelSet()
+{
+  return KernelSetCurrent;
+}
+
+const PixelKernels *GetKernels(sInt set)
+{
+  return &KernelTable[sClamp<sInt>(set,KernelsScalar,KernelSetSupported)];
+}
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   GenTexture                                                         ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+GenTexture::GenTexture()
+{
+  Data = 0;
+  XRes = 0;
+  YRes = 0;
+
+  UpdateSize();
+}
+
+GenTexture::GenTexture(sInt xres,sInt yres)
+{
+  Data = 0;
+  XRes = 0;
+  YRes = 0;
+
+  Init(xres,yres);
+}
+
+GenTexture::GenTexture(const GenTexture &x)
+{
+  XRes = x.XRes;
+  YRes = x.YRes;
+  UpdateSize();
+
+  Data = new Pixel[NPixels];
+  sCopyMem(Data,x.Data,NPixels * sizeof(Pixel));
+}
+
+GenTexture::~GenTexture()
+{
+  delete[] Data;
+}
+
+void GenTexture::Init(sInt xres,sInt yres)
+{
+  if(XRes != xres || YRes != yres)
+  {
+    delete[] Data;
+
+    sVERIFY(xres >= 1 && yres >= 1);
+
+    XRes = xres;
+    YRes = yres;
+    UpdateSize();
+
+    Data = new Pixel[NPixels];
+  }
+}
+
+void GenTexture::UpdateSize()
+{
+  NPixels = XRes * YRes;
+}
+
+void GenTexture::Swap(GenTexture &x)
+{
+  sSwap(Data,x.Data);
+  sSwap(XRes,x.XRes);
+  sSwap(YRes,x.YRes);
+  sSwap(NPixels,x.NPixels);
+}
+
+GenTexture &GenTexture::operator =(const GenTexture &x)
+{
+  GenTexture t=x;
+  
+  Swap(t);
+  return *this;
+}
+
+sBool GenTexture::SizeMatchesWith(const GenTexture &x) const
+{
+  return XRes == x.XRes && YRes == x.YRes;
+}
+
+// ---- Sampling helpers
+void GenTexture::SampleNearest(Pixel &result,sInt x,sInt y,sInt wrapMode) const
+{
+  sInt ix = WrapIndex(NearestIndex(x,XRes,wrapMode & 1),XRes);
+  sInt iy = WrapIndex(NearestIndex(y,YRes,wrapMode & 2),YRes);
+
+  result = Data[iy*XRes + ix];
+}
+
+void GenTexture::SampleBilinear(Pixel &result,sInt x,sInt y,sInt wrapMode) const
+{
+  sS64 px = BilinearPos(x,XRes,wrapMode & 1);
+  sS64 py = BilinearPos(y,YRes,wrapMode & 2);
+
+  sInt x0 = WrapIndex(sInt(px >> 24),XRes);
+  sInt x1 = WrapIndex(x0 + 1,XRes);
+  sInt y0 = WrapIndex(sInt(py >> 24),YRes);
+  sInt y1 = WrapIndex(y0 + 1,YRes);
+  sInt fx = sInt(px >> 8) & 0xffff;
+  sInt fy = sInt(py >> 8) & 0xffff;
+
+  Kernels->SampleBilinear(result,&Data[y0*XRes],&Data[y1*XRes],x0,x1,fx,fy);
+}
+
+void GenTexture::SampleFiltered(Pixel &result,sInt x,sInt y,sInt filterMode) const
+{
+  if(filterMode & FilterBilinear)
+    SampleBilinear(result,x,y,filterMode);
+  else
+    SampleNearest(result,x,y,filterMode);
+}
+
+void GenTexture::SampleGradient(Pixel &result,sInt x) const
+{
+  x = sClamp(x,0,1<<24);
+  x -= sU32(x) / sU32(XRes); // x=(1<<24) -> Take rightmost pixel
+
+  sS64 pos = sS64(x) * XRes;
+  sInt x0 = sInt(pos >> 24);
+  sInt x1 = WrapIndex(x0 + 1,XRes);
+  sInt fx = sInt(pos >> 8) & 0xffff;
+
+  result.Lerp(fx,Data[x0],Data[x1]);
+}
 
 // ---- The operators themselves
 
@@ -459,41 +966,50 @@ void GenTexture::Noise(const GenTexture &grad,sInt freqX,sInt freqY,sInt oct,sF3
     scaling *= (1 << 23);
   }
 
-  sInt offsX = (1 << (16 - ShiftX + freqX)) >> 1;
-  sInt offsY = (1 << (16 - ShiftY + freqY)) >> 1;
+  // pixel centers in noise space (16.16 fixed point)
+  sInt *noiseX = new sInt[XRes];
+  for(sInt x=0;x<XRes;x++)
+    noiseX[x] = (sS64(2*x + 1) << (15 + freqX)) / XRes;
 
-  Pixel *out = Data;
-  for(sInt y=0;y<YRes;y++)
+  ForBands(YRes,&grad != this,[&](sInt yStart,sInt yEnd)
   {
-    for(sInt x=0;x<XRes;x++)
+    Pixel *out = &Data[yStart*XRes];
+    for(sInt y=yStart;y<yEnd;y++)
     {
-      sInt n = offset;
-      sF32 s = scaling;
+      sInt noiseY = (sS64(2*y + 1) << (15 + freqY)) / YRes;
 
-      sInt px = (x << (16 - ShiftX + freqX)) + offsX;
-      sInt py = (y << (16 - ShiftY + freqY)) + offsY;
-      sInt mx = (1 << freqX) - 1;
-      sInt my = (1 << freqY) - 1;
-
-      for(sInt i=0;i<oct;i++)
+      for(sInt x=0;x<XRes;x++)
       {
-        sF32 nv = (mode & NoiseBandlimit) ? Noise2(px,py,mx,my,seed) : GNoise2(px,py,mx,my,seed);
-        if(mode & NoiseAbs)
-          nv = sFAbs(nv);
+        sInt n = offset;
+        sF32 s = scaling;
 
-        n += nv * s;
-        s *= fadeoff;
+        sInt px = noiseX[x];
+        sInt py = noiseY;
+        sInt mx = (1 << freqX) - 1;
+        sInt my = (1 << freqY) - 1;
 
-        px += px;
-        py += py;
-        mx += mx + 1;
-        my += my + 1;
-      }
+        for(sInt i=0;i<oct;i++)
+        {
+          sF32 nv = (mode & NoiseBandlimit) ? Noise2(px,py,mx,my,seed) : GNoise2(px,py,mx,my,seed);
+          if(mode & NoiseAbs)
+            nv = sFAbs(nv);
 
-      grad.SampleGradient(*out,n);
-      out++;
+          n += nv * s;
+          s *= fadeoff;
+
+          px += px;
+          py += py;
+          mx += mx + 1;
+          my += my + 1;
+        }
+
+        grad.SampleGradient(*out,n);
+        out++;
+      }
     }
-  }
+  });
+
+  delete[] noiseX;
 }
 
 void GenTexture::GlowRect(const GenTexture &bgTex,const GenTexture &grad,sF32 orgx,sF32 orgy,sF32 ux,sF32 uy,sF32 vx,sF32 vy,sF32 rectu,sF32 rectv)
@@ -529,50 +1045,53 @@ void GenTexture::GlowRect(const GenTexture &bgTex,const GenTexture &grad,sF32 or
   sF32 gus = 1.0f / (65536.0f - ruf);
   sF32 gvs = 1.0f / (65536.0f - rvf);
 
-  for(sInt y=minY;y<=maxY;y++)
+  ForBands(maxY+1-minY,&grad != this,[&](sInt yStart,sInt yEnd)
   {
-    Pixel *out = &Data[y*XRes + minX];
-    sInt u = u0;
-    sInt v = v0;
-
-    for(sInt x=minX;x<=maxX;x++)
+    for(sInt y=minY+yStart;y<minY+yEnd;y++)
     {
-      if(u>-65536 && u<65536 && v>-65536 && v<65536)
-      {
-        Pixel col;
-
-        sInt du = sMax(sAbs(u) - ruf,0);
-        sInt dv = sMax(sAbs(v) - rvf,0);
+      Pixel *out = &Data[y*XRes + minX];
+      sInt u = u0 + (y-minY) * dudy;
+      sInt v = v0 + (y-minY) * dvdy;
 
-        if(!du && !dv)
-        {
-          grad.SampleGradient(col,0);
-          out->CompositeROver(col);
-        }
-        else
+      for(sInt x=minX;x<=maxX;x++)
+      {
+        if(u>-65536 && u<65536 && v>-65536 && v<65536)
         {
-          sF32 dus = du * gus;
-          sF32 dvs = dv * gvs;
-          sF32 dist = dus*dus + dvs*dvs;
+          Pixel col;
+
+          sInt du = sMax(sAbs(u) - ruf,0);
+          sInt dv = sMax(sAbs(v) - rvf,0);
 
-          if(dist < 1.0f)
+          if(!du && !dv)
           {
-            grad.SampleGradient(col,(1 << 24) * sFSqrt(dist));
+            grad.SampleGradient(col,0);
             out->CompositeROver(col);
           }
+          else
+          {
+            sF32 dus = du * gus;
+            sF32 dvs = dv * gvs;
+            sF32 dist = dus*dus + dvs*dvs;
+
+            if(dist < 1.0f)
+            {
+              grad.SampleGradient(col,(1 << 24) * sFSqrt(dist));
+              out->CompositeROver(col);
+            }
+          }
         }
-      }
 
-      u += dudx;
-      v += dvdx;
-      out++;
+        u += dudx;
+        v += dvdx;
+        out++;
+      }
     }
-
-    u0 += dudy;
-    v0 += dvdy;
-  }
+  });
 }
 
+// Center count from which Cells uses a grid instead of the row sweep
+static const sInt CellsGridMin = 256;
+
 struct CellPoint
 {
   sInt x;
@@ -581,11 +1100,357 @@ struct CellPoint
   sInt node;
 };
 
+// Calculate new y distances for row center yc and (insertion) sort by them.
+static void CellsSortRow(CellPoint *points,sInt nCenters,sInt yc,sInt scale)
+{
+  // calculate new y distances
+  for(sInt i=0;i<nCenters;i++)
+  {
+    sInt dy = (yc - points[i].y) & (scale - 1);
+    points[i].distY = sSquare(sMin(dy,scale-dy));
+  }
+
+  // (insertion) sort by y-distance
+  for(sInt i=1;i<nCenters;i++)
+  {
+    CellPoint v = points[i];
+    sInt j = i;
+
+    while(j && points[j-1].distY > v.distY)
+    {
+      points[j] = points[j-1];
+      j--;
+    }
+
+    points[j] = v;
+  }
+}
+
+// Squared distance along one axis of (wrapping) cell space
+static sInt CellsAxisDist(sInt d,sInt scale)
+{
+  d &= scale - 1;
+  return sSquare(sMin(d,scale-d));
+}
+
+// Gradient position for a pixel with nearest/second nearest squared
+// distances best/best2.
+static sInt CellsLevel(sInt best,sInt best2,sF32 amp,sInt mode,sInt scale)
+{
+  sF32 d0 = sFSqrt(best) / scale;
+
+  if((mode & 1) == GenTexture::CellInner) // inner
+    return sClamp<sInt>(d0*amp,0,1<<24);
+  else // outer
+  {
+    sF32 d1 = sFSqrt(best2) / scale;
+
+    if(d0+d1 > 0.0f)
+      return sClamp<sInt>(d0 / (d1 + d0) * 2 * amp,0,1<<24);
+    else
+      return 0;
+  }
+}
+
+// Nearest and second nearest center found so far
+struct CellNearest
+{
+  sInt Best,Besti;          // squared distance, center index
+  sInt Best2,Best2i;
+};
+
+// Cell centers bucketed into a uniform grid over cell space. Used instead
+// of the row sweep when there are many centers; finds the same nearest and
+// second nearest centers, ties included.
+struct CellGrid
+{
+  const CellPoint *Points;  // centers in index order
+  sInt Scale;               // size of cell space
+  sInt Shift;               // grid cells are 1<<Shift units wide
+  sInt Size;                // grid cells per axis
+  sInt *Start;              // Size*Size+1 offsets into Bucket
+  CellPoint *Bucket;        // centers sorted by grid cell
+
+  CellGrid(const CellPoint *points,sInt nCenters,sInt scaleF);
+  ~CellGrid();
+
+  sBool Before(const CellPoint &p,const CellPoint &q,sInt y,sInt yres) const;
+  void Scan(CellNearest &n,const CellPoint *p,const CellPoint *pEnd,sInt xc,sInt yc,sInt y,sInt yres) const;
+  void Search(CellNearest &n,sInt xc,sInt yc,sInt y,sInt yres) const;
+
+private:
+  CellGrid(const CellGrid &);
+  CellGrid &operator =(const CellGrid &);
+};
+
+CellGrid::CellGrid(const CellPoint *points,sInt nCenters,sInt scaleF)
+{
+  // about 1-4 centers per grid cell
+  sInt bits = 0;
+  while(bits < scaleF && (nCenters >> (2*(bits+1))) >= 1)
+    bits++;
+
+  Points = points;
+  Scale = 1 << scaleF;
+  Shift = scaleF - bits;
+  Size = 1 << bits;
+  Start = new sInt[Size*Size + 1];
+  Bucket = new CellPoint[nCenters];
+
+  // counting sort by grid cell (stable, so buckets stay in index order)
+  sSetMem(Start,0,(Size*Size + 1) * sizeof(sInt));
+  for(sInt i=0;i<nCenters;i++)
+    Start[((points[i].y >> Shift) << bits) + (points[i].x >> Shift) + 1]++;
+
+  for(sInt i=0;i<Size*Size;i++)
+    Start[i+1] += Start[i];
+
+  sInt *fill = new sInt[Size*Size];
+  sCopyMem(fill,Start,Size*Size * sizeof(sInt));
+  for(sInt i=0;i<nCenters;i++)
+    Bucket[fill[((points[i].y >> Shift) << bits) + (points[i].x >> Shift)]++] = points[i];
+
+  delete[] fill;
+}
+
+CellGrid::~CellGrid()
+{
+  delete[] Start;
+  delete[] Bucket;
+}
+
+// Does p come before q in the order the row sweep visits centers on row y?
+// That's sorted by y distance, with ties in the order of the row above
+// (and index order on the first row).
+sBool CellGrid::Before(const CellPoint &p,const CellPoint &q,sInt y,sInt yres) const
+{
+  if(p.y != q.y)
+  {
+    for(;y>=0;y--)
+    {
+      sInt yc = (sS64(2*y + 1) * (Scale >> 1)) / yres;
+      sInt dp = CellsAxisDist(yc - p.y,Scale);
+      sInt dq = CellsAxisDist(yc - q.y,Scale);
+      if(dp != dq)
+        return dp < dq;
+    }
+  }
+
+  return p.node < q.node;
+}
+
+// Updates nearest/second nearest with centers [p,pEnd)
+void CellGrid::Scan(CellNearest &n,const CellPoint *p,const CellPoint *pEnd,sInt xc,sInt yc,sInt y,sInt yres) const
+{
+  sInt best = n.Best, besti = n.Besti;
+  sInt best2 = n.Best2, best2i = n.Best2i;
+
+  for(;p<pEnd;p++)
+  {
+    sInt dist = CellsAxisDist(xc - p->x,Scale) + CellsAxisDist(yc - p->y,Scale);
+    if(dist > best2)
+      continue;
+
+    if(dist < best)
+    {
+      best2 = best;
+      best2i = besti;
+      best = dist;
+      besti = p->node;
+    }
+    else if(dist == best)
+    {
+      if(Before(*p,Points[besti],y,yres))
+        besti = p->node;
+    }
+    else if(dist < best2)
+    {
+      best2 = dist;
+      best2i = p->node;
+    }
+    else if(Before(*p,Points[best2i],y,yres))
+      best2i = p->node;
+  }
+
+  n.Best = best;
+  n.Besti = besti;
+  n.Best2 = best2;
+  n.Best2i = best2i;
+}
+
+// Nearest center to (xc,yc) and the nearest one with a larger distance
+// (Besti/Best2i are -1 if there is none). The result doesn't depend on the
+// order centers are seen in, so this starts with the 3x3 grid cells around
+// the pixel, then searches rings further out until no closer center can
+// remain.
+void CellGrid::Search(CellNearest &n,sInt xc,sInt yc,sInt y,sInt yres) const
+{
+  sInt cs = 1 << Shift;
+  sInt cx = xc >> Shift, cy = yc >> Shift;
+  sInt ox = xc & (cs - 1), oy = yc & (cs - 1);
+  sInt edge = sMin(sMin(ox + 1,cs - ox),sMin(oy + 1,cs - oy));
+
+  n.Best = n.Best2 = sSquare(Scale);
+  n.Besti = n.Best2i = -1;
+
+  // centers of a row of grid cells are stored contiguously
+  for(sInt j=-1;j<=1;j++)
+  {
+    sInt row = ((cy + j) & (Size - 1)) * Size;
+
+    if(cx >= 1 && cx + 1 < Size)
+      Scan(n,&Bucket[Start[row + cx - 1]],&Bucket[Start[row + cx + 2]],xc,yc,y,yres);
+    else
+    {
+      for(sInt i=-1;i<=1;i++)
+      {
+        sInt cell = row + ((cx + i) & (Size - 1));
+        Scan(n,&Bucket[Start[cell]],&Bucket[Start[cell+1]],xc,yc,y,yres);
+      }
+    }
+  }
+
+  // ring r is at least (r-1)*cs + edge away; at Size/2 everything is covered
+  for(sInt r=2;r<=Size/2 && sSquare((r-1)*cs + edge) <= n.Best2;r++)
+  {
+    for(sInt j=-r;j<=r;j++)
+    {
+      sInt gy = (j > 0) ? j*cs - oy : (j < 0) ? oy + 1 - (j+1)*cs : 0;
+      sInt row = ((cy + j) & (Size - 1)) * Size;
+      sInt step = (j == -r || j == r) ? 1 : 2*r; // only the ends of inner rows
+
+      for(sInt i=-r;i<=r;i+=step)
+      {
+        // skip cells too far away to matter
+        sInt gx = (i > 0) ? i*cs - ox : (i < 0) ? ox + 1 - (i+1)*cs : 0;
+        if(sSquare(gx) + sSquare(gy) > n.Best2)
+          continue;
+
+        sInt cell = row + ((cx + i) & (Size - 1));
+        Scan(n,&Bucket[Start[cell]],&Bucket[Start[cell+1]],xc,yc,y,yres);
+      }
+    }
+  }
+}
+
+// Cells with the grid search. The row sweep doesn't start every pixel from
+// scratch but from the two centers it found for the previous one, which
+// wins them ties (and if they are at the same distance, that's also the
+// second distance). Do the same here so results don't change.
+static void CellsGrid(GenTexture &dest,const GenTexture &grad,const CellCenter *centers,const CellPoint *points,sInt nCenters,const sInt *cellX,sF32 amp,sInt mode)
+{
+  static const sInt scaleF = 14;
+  static const sInt scale = 1<<scaleF;
+
+  CellGrid grid(points,nCenters,scaleF);
+  sBool inPlace = &grad == &dest;
+
+  ForBands(dest.YRes,!inPlace,[&](sInt yStart,sInt yEnd)
+  {
+    Pixel *rowColors = new Pixel[dest.XRes];
+    Pixel *out = &dest.Data[yStart*dest.XRes];
+
+    for(sInt y=yStart;y<yEnd;y++)
+    {
+      Pixel *rowOut = out;
+      sInt yc = (sS64(2*y + 1) << (scaleF - 1)) / dest.YRes;
+      sInt best,best2,besti,best2i;
+
+      besti = best2i = -1;
+
+      for(sInt x=0;x<dest.XRes;x++)
+      {
+        sInt xc = cellX[x];
+        CellNearest near;
+        grid.Search(near,xc,yc,y,dest.YRes);
+
+        sInt m = near.Best, mi = near.Besti;
+        sInt m2 = near.Best2, m2i = near.Best2i;
+
+        if(besti != -1 && best2i != -1)
+        {
+          sInt a = besti, b = best2i;
+          sInt da = CellsAxisDist(xc - points[a].x,scale) + CellsAxisDist(yc - points[a].y,scale);
+          sInt db = CellsAxisDist(xc - points[b].x,scale) + CellsAxisDist(yc - points[b].y,scale);
+          if(db < da)
+          {
+            sSwap(a,b);
+            sSwap(da,db);
+          }
+
+          if(da == m && db == m)
+          {
+            best = best2 = m;
+            besti = a;
+            best2i = b;
+          }
+          else
+          {
+            best = m;
+            best2 = m2;
+            besti = (da == m) ? a : mi;
+            best2i = (da == m2) ? a : (db == m2) ? b : m2i;
+          }
+        }
+        else if(besti != -1)
+        {
+          // only one distance last time, which the sweep keeps as it is
+          if(best < m)
+          {
+            best2 = m;
+            best2i = mi;
+          }
+          else if(best == m)
+          {
+            best2 = m2;
+            best2i = m2i;
+          }
+          else
+          {
+            if(m2i == -1 || best <= m2)
+            {
+              best2 = best;
+              best2i = besti;
+            }
+            else
+            {
+              best2 = m2;
+              best2i = m2i;
+            }
+
+            best = m;
+            besti = mi;
+          }
+        }
+        else
+        {
+          best = m;
+          best2 = m2;
+          besti = mi;
+          best2i = m2i;
+        }
+
+        grad.SampleGradient(*out,CellsLevel(best,best2,amp,mode,scale));
+        rowColors[x] = centers[besti].color;
+        if(inPlace)
+          out->CompositeMulC(rowColors[x]);
+
+        out++;
+      }
+
+      // multiply with cell colors
+      if(!inPlace)
+        Kernels->CompositeMulC(rowOut,rowColors,dest.XRes);
+    }
+
+    delete[] rowColors;
+  });
+}
+
 void GenTexture::Cells(const GenTexture &grad,const CellCenter *centers,sInt nCenters,sF32 amp,sInt mode)
 {
   sVERIFY(((mode & 1) == 0) ? nCenters >= 1 : nCenters >= 2);
 
-  Pixel *out = Data;
   CellPoint *points = NULL;
 
   points = new CellPoint[nCenters];
@@ -602,118 +1467,127 @@ void GenTexture::Cells(const GenTexture &grad,const CellCenter *centers,sInt nCe
     points[i].node = i;
   }
 
-  sInt stepX = 1 << (scaleF - ShiftX);
-  sInt stepY = 1 << (scaleF - ShiftY);
-  sInt yc = stepY >> 1;
-  
-  amp = amp * (1 << 24);
+  // pixel centers in cell space
+  sInt *cellX = new sInt[XRes];
+  for(sInt x=0;x<XRes;x++)
+    cellX[x] = (sS64(2*x + 1) << (scaleF - 1)) / XRes;
 
-  for(sInt y=0;y<YRes;y++)
-  {
-    sInt xc = stepX >> 1;
 
-    // calculate new y distances
-    for(sInt i=0;i<nCenters;i++)
-    {
-      sInt dy = (yc - points[i].y) & (scale - 1);
-      points[i].distY = sSquare(sMin(dy,scale-dy));
-    }
+  amp = amp * (1 << 24);
 
-    // (insertion) sort by y-distance
-    for(sInt i=1;i<nCenters;i++)
-    {
-      CellPoint v = points[i];
-      sInt j = i;
+  // In place, the first row samples the pixels to its left, which have to
+  // be multiplied with their cell color already. Color every pixel right
+  // away then, like the serial code did.
+  sBool inPlace = &grad == this;
 
-      while(j && points[j-1].distY > v.distY)
-      {
-        points[j] = points[j-1];
-        j--;
-      }
+  // many centers: grid search instead of the row sweep
+  if(nCenters >= CellsGridMin)
+  {
+    CellsGrid(*this,grad,centers,points,nCenters,cellX,amp,mode);
 
-      points[j] = v;
-    }
+    delete[] points;
+    delete[] cellX;
+    return;
+  }
+
+  // The sort order of points carries over from one row to the next, and
+  // it decides which center wins when two are at the same distance.
+  // Centers with equal y keep their original order forever; two centers
+  // with different y can only tie on rows at least half a texture apart.
+  // So sorting for the row above the band start, then for the start row,
+  // gives exactly the order the serial loop would arrive at.
+  ForBands(YRes,!inPlace,[&](sInt yStart,sInt yEnd)
+  {
+    CellPoint *bandPoints = new CellPoint[nCenters];
+    Pixel *rowColors = new Pixel[XRes];
+    sCopyMem(bandPoints,points,nCenters * sizeof(CellPoint));
 
-    sInt best,best2;
-    sInt besti,best2i;
+    Pixel *out = &Data[yStart*XRes];
 
-    best = best2 = sSquare(scale);
-    besti = best2i = -1;
+    if(yStart)
+      CellsSortRow(bandPoints,nCenters,(sS64(2*yStart - 1) << (scaleF - 1)) / YRes,scale);
 
-    for(sInt x=0;x<XRes;x++)
+    for(sInt y=yStart;y<yEnd;y++)
     {
-      sInt t,dx;
+      Pixel *rowOut = out;
+      sInt yc = (sS64(2*y + 1) << (scaleF - 1)) / YRes;
 
-      // update "best point" stats
-      if(besti != -1 && best2i != -1)
-      {
-        dx = (xc - points[besti].x) & (scale - 1);
-        best = sSquare(sMin(dx,scale-dx)) + points[besti].distY;
+      CellsSortRow(bandPoints,nCenters,yc,scale);
 
-        dx = (xc - points[best2i].x) & (scale - 1);
-        best2 = sSquare(sMin(dx,scale-dx)) + points[best2i].distY;
-        if(best2 < best)
-        {
-          sSwap(best,best2);
-          sSwap(besti,best2i);
-        }
-      }
+      sInt best,best2;
+      sInt besti,best2i;
 
-      // search for better points
-      for(sInt i=0;i<nCenters && best2 > points[i].distY;i++)
+      best = best2 = sSquare(scale);
+      besti = best2i = -1;
+
+      for(sInt x=0;x<XRes;x++)
       {
-        sInt dx = (xc - points[i].x) & (scale - 1);
-        dx = sSquare(sMin(dx,scale-dx));
+        sInt xc = cellX[x];
+        sInt t,dx;
 
-        sInt dist = dx + points[i].distY;
-        if(dist < best)
+        // update "best point" stats
+        if(besti != -1 && best2i != -1)
         {
-          best2 = best;
-          best2i = besti;
-          best = dist;
-          besti = i;
+          dx = (xc - bandPoints[besti].x) & (scale - 1);
+          best = sSquare(sMin(dx,scale-dx)) + bandPoints[besti].distY;
+
+          dx = (xc - bandPoints[best2i].x) & (scale - 1);
+          best2 = sSquare(sMin(dx,scale-dx)) + bandPoints[best2i].distY;
+          if(best2 < best)
+          {
+            sSwap(best,best2);
+            sSwap(besti,best2i);
+          }
         }
-        else if(dist > best && dist < best2)
+
+        // search for better points
+        for(sInt i=0;i<nCenters && best2 > bandPoints[i].distY;i++)
         {
-          best2 = dist;
-          best2i = i;
+          sInt dx = (xc - bandPoints[i].x) & (scale - 1);
+          dx = sSquare(sMin(dx,scale-dx));
+
+          sInt dist = dx + bandPoints[i].distY;
+          if(dist < best)
+          {
+            best2 = best;
+            best2i = besti;
+            best = dist;
+            besti = i;
+          }
+          else if(dist > best && dist < best2)
+          {
+            best2 = dist;
+            best2i = i;
+          }
         }
-      }
 
-      // color the pixel accordingly
-      sF32 d0 = sFSqrt(best) / scale;
+        // color the pixel accordingly
+        t = CellsLevel(best,best2,amp,mode,scale);
 
-      if((mode & 1) == CellInner) // inner
-        t = sClamp<sInt>(d0*amp,0,1<<24);
-      else // outer
-      {
-        sF32 d1 = sFSqrt(best2) / scale;
+        grad.SampleGradient(*out,t);
+        rowColors[x] = centers[bandPoints[besti].node].color;
+        if(inPlace)
+          out->CompositeMulC(rowColors[x]);
 
-        if(d0+d1 > 0.0f)
-          t = sClamp<sInt>(d0 / (d1 + d0) * 2 * amp,0,1<<24);
-        else
-          t = 0;
+        out++;
       }
 
-      grad.SampleGradient(*out,t);
-      out[0].CompositeMulC(centers[points[besti].node].color);
-
-      out++;
-      xc += stepX;
+      // multiply with cell colors
+      if(!inPlace)
+        Kernels->CompositeMulC(rowOut,rowColors,XRes);
     }
 
-    yc += stepY;
-  }
+    delete[] bandPoints;
+    delete[] rowColors;
+  });
 
   delete[] points;
+  delete[] cellX;
 }
 
-void GenTexture::ColorMatrixTransform(const GenTexture &x,const Matrix44 &matrix,sBool clampPremult)
+// Converts a color matrix to 16.16 fixed point
+static void ColorMatrixSetup(sInt m[4][4],const Matrix44 &matrix)
 {
-  sInt m[4][4];
-
-  sVERIFY(SizeMatchesWith(x));
-
   for(sInt i=0;i<4;i++)
   {
     for(sInt j=0;j<4;j++)
@@ -722,38 +1596,25 @@ void GenTexture::ColorMatrixTransform(const GenTexture &x,const Matrix44 &matrix
       m[i][j] = matrix[i][j] * 65536.0f;
     }
   }
+}
 
-  for(sInt i=0;i<NPixels;i++)
-  {
-    Pixel &out = Data[i];
-    const Pixel &in = x.Data[i];
+void GenTexture::ColorMatrixTransform(const GenTexture &x,const Matrix44 &matrix,sBool clampPremult)
+{
+  sInt m[4][4];
 
-    sInt r = MulShift16(m[0][0],in.r) + MulShift16(m[0][1],in.g) + MulShift16(m[0][2],in.b) + MulShift16(m[0][3],in.a);
-    sInt g = MulShift16(m[1][0],in.r) + MulShift16(m[1][1],in.g) + MulShift16(m[1][2],in.b) + MulShift16(m[1][3],in.a);
-    sInt b = MulShift16(m[2][0],in.r) + MulShift16(m[2][1],in.g) + MulShift16(m[2][2],in.b) + MulShift16(m[2][3],in.a);
-    sInt a = MulShift16(m[3][0],in.r) + MulShift16(m[3][1],in.g) + MulShift16(m[3][2],in.b) + MulShift16(m[3][3],in.a);
+  sVERIFY(SizeMatchesWith(x));
+  ColorMatrixSetup(m,matrix);
 
-    if(clampPremult)
-    {
-      out.a = sClamp<sInt>(a,0,65535);
-      out.r = sClamp<sInt>(r,0,out.a);
-      out.g = sClamp<sInt>(g,0,out.a);
-      out.b = sClamp<sInt>(b,0,out.a);
-    }
-    else
-    {
-      out.r = sClamp<sInt>(r,0,65535);
-      out.g = sClamp<sInt>(g,0,65535);
-      out.b = sClamp<sInt>(b,0,65535);
-      out.a = sClamp<sInt>(a,0,65535);
-    }
-  }
+  ForBands(YRes,sTRUE,[&](sInt yStart,sInt yEnd)
+  {
+    Kernels->ColorMatrix(&Data[yStart*XRes],&x.Data[yStart*XRes],(yEnd-yStart)*XRes,m,clampPremult);
+  });
 }
 
 void GenTexture::CoordMatrixTransform(const GenTexture &in,const Matrix44 &matrix,sInt mode)
 {
-  sInt scaleX = 1 << (24 - ShiftX);
-  sInt scaleY = 1 << (24 - ShiftY);
+  sF32 scaleX = 16777216.0f / XRes;
+  sF32 scaleY = 16777216.0f / YRes;
 
   sInt dudx = matrix[0][0] * scaleX;
   sInt dudy = matrix[0][1] * scaleY;
@@ -762,35 +1623,35 @@ void GenTexture::CoordMatrixTransform(const GenTexture &in,const Matrix44 &matri
 
   sInt u0 = matrix[0][3] * (1 << 24) + ((dudx + dudy) >> 1);
   sInt v0 = matrix[1][3] * (1 << 24) + ((dvdx + dvdy) >> 1);
-  Pixel *out = Data;
 
-  for(sInt y=0;y<YRes;y++)
+  ForBands(YRes,&in != this,[&](sInt yStart,sInt yEnd)
   {
-    sInt u = u0;
-    sInt v = v0;
+    Pixel *out = &Data[yStart*XRes];
 
-    for(sInt x=0;x<XRes;x++)
+    for(sInt y=yStart;y<yEnd;y++)
     {
-      in.SampleFiltered(*out,u,v,mode);
+      sInt u = u0 + y*dudy;
+      sInt v = v0 + y*dvdy;
 
-      u += dudx;
-      v += dvdx;
-      out++;
-    }
+      for(sInt x=0;x<XRes;x++)
+      {
+        in.SampleFiltered(*out,u,v,mode);
 
-    u0 += dudy;
-    v0 += dvdy;
-  }
+        u += dudx;
+        v += dvdx;
+        out++;
+      }
+    }
+  });
 }
 
-void GenTexture::ColorRemap(const GenTexture &inTex,const GenTexture &mapR,const GenTexture &mapG,const GenTexture &mapB)
+// ColorRemap for count pixels
+static void ColorRemapRow(Pixel *outRow,const Pixel *inRow,sInt count,const GenTexture &mapR,const GenTexture &mapG,const GenTexture &mapB)
 {
-  sVERIFY(SizeMatchesWith(inTex));
-
-  for(sInt i=0;i<NPixels;i++)
+  for(sInt i=0;i<count;i++)
   {
-    const Pixel &in = inTex.Data[i];
-    Pixel &out = Data[i];
+    const Pixel &in = inRow[i];
+    Pixel &out = outRow[i];
 
     if(in.a == 65535) // alpha==1, everything easy.
     {
@@ -824,172 +1685,102 @@ void GenTexture::ColorRemap(const GenTexture &inTex,const GenTexture &mapR,const
   }
 }
 
-void GenTexture::CoordRemap(const GenTexture &in,const GenTexture &remapTex,sF32 strengthU,sF32 strengthV,sInt mode)
+void GenTexture::ColorRemap(const GenTexture &inTex,const GenTexture &mapR,const GenTexture &mapG,const GenTexture &mapB)
 {
-  sVERIFY(SizeMatchesWith(remapTex));
-
-  const Pixel *remap = remapTex.Data;
-  Pixel *out = Data;
-
-  sInt u0 = MinX;
-  sInt v0 = MinY;
-  sInt scaleU = (1 << 24) * strengthU;
-  sInt scaleV = (1 << 24) * strengthV;
-  sInt stepU = 1 << (24 - ShiftX);
-  sInt stepV = 1 << (24 - ShiftY);
+  sVERIFY(SizeMatchesWith(inTex));
 
-  for(sInt y=0;y<YRes;y++)
+  sBool threaded = &mapR != this && &mapG != this && &mapB != this;
+  ForBands(YRes,threaded,[&](sInt yStart,sInt yEnd)
   {
-    sInt u = u0;
-    sInt v = v0;
-
-    for(sInt x=0;x<XRes;x++)
-    {
-      sInt dispU = u + MulShift16(scaleU,(remap->r - 32768) * 2);
-      sInt dispV = v + MulShift16(scaleV,(remap->g - 32768) * 2);
-      in.SampleFiltered(*out,dispU,dispV,mode);
-
-      u += stepU;
-      remap++;
-      out++;
-    }
-
-    v0 += stepV;
-  }
+    ColorRemapRow(&Data[yStart*XRes],&inTex.Data[yStart*XRes],(yEnd-yStart)*XRes,mapR,mapG,mapB);
+  });
 }
 
-void GenTexture::Derive(const GenTexture &in,DeriveOp op,sF32 strength)
+void GenTexture::CoordRemap(const GenTexture &in,const GenTexture &remapTex,sF32 strengthU,sF32 strengthV,sInt mode)
 {
-  sVERIFY(SizeMatchesWith(in));
+  sVERIFY(SizeMatchesWith(remapTex));
 
-  Pixel *out = Data;
+  sInt scaleU = (1 << 24) * strengthU;
+  sInt scaleV = (1 << 24) * strengthV;
+  sInt *centerU = PixelCenters(XRes);
 
-  for(sInt y=0;y<YRes;y++)
+  ForBands(YRes,&in != this,[&](sInt yStart,sInt yEnd)
   {
-    for(sInt x=0;x<XRes;x++)
+    const Pixel *remap = &remapTex.Data[yStart*XRes];
+    Pixel *out = &Data[yStart*XRes];
+
+    for(sInt y=yStart;y<yEnd;y++)
     {
-      sInt dx2 = in.Data[y*XRes + ((x+1) & (XRes-1))].r - in.Data[y*XRes + ((x-1) & (XRes-1))].r;
-      sInt dy2 = in.Data[x + ((y+1) & (YRes - 1)) * XRes].r - in.Data[x + ((y-1) & (YRes - 1)) * XRes].r;
-      sF32 dx = dx2 * strength / (2 * 65535.0f);
-      sF32 dy = dy2 * strength / (2 * 65535.0f);
+      sInt v = PixelCenter(y,YRes);
 
-      switch(op)
+      for(sInt x=0;x<XRes;x++)
       {
-      case DeriveGradient:
-        out->r = sClamp<sInt>(dx*32768.0f + 32768.0f,0,65535);
-        out->g = sClamp<sInt>(dy*32768.0f + 32768.0f,0,65535);
-        out->b = 0;
-        out->a = 65535;
-        break;
-
-      case DeriveNormals:
-        {
-          // (1 0 dx)^T x (0 1 dy)^T = (-dx -dy 1)
-          sF32 scale = 32768.0f * sFInvSqrt(1.0f + dx*dx + dy*dy);
+        sInt dispU = centerU[x] + MulShift16(scaleU,(remap->r - 32768) * 2);
+        sInt dispV = v + MulShift16(scaleV,(remap->g - 32768) * 2);
+        in.SampleFiltered(*out,dispU,dispV,mode);
 
-          out->r = sClamp<sInt>(-dx*scale + 32768.0f,0,65535);
-          out->g = sClamp<sInt>(-dy*scale + 32768.0f,0,65535);
-          out->b = sClamp<sInt>(    scale + 32768.0f,0,65535);
-          out->a = 65535;
-        }
-        break;
+        remap++;
+        out++;
       }
-
-      out++;
     }
-  }
-}
+  });
 
-// Wrap computation on pixel coordinates
-static sInt WrapCoord(sInt x,sInt width,sInt mode)
-{
-  if(mode == 0) // wrap
-    return x & (width - 1);
-  else
-    return sClamp(x,0,width-1);
+  delete[] centerU;
 }
 
-// Size is half of edge length in pixels, 26.6 fixed point
-static void Blur1DBuffer(Pixel *dst,const Pixel *src,sInt width,sInt sizeFixed,sInt wrapMode)
+// Derive for one row, from that row and its neighbors above and below
+static void DeriveRow(Pixel *out,const Pixel *prev,const Pixel *row,const Pixel *next,sInt width,GenTexture::DeriveOp op,sF32 strength)
 {
-  sVERIFY(sizeFixed > 32); // kernel should be wider than one pixel
-  sInt frac = (sizeFixed - 32) & 63;
-  sInt offset = (sizeFixed + 32) >> 6;
-
-  sVERIFY(((offset - 1) * 64 + frac + 32) == sizeFixed);
-  sU32 denom = sizeFixed * 2;
-  sU32 bias = denom / 2;
-
-  // initialize accumulators
-  sU32 accu[4];
-  if(wrapMode == 0) // wrap around
-  {
-    // leftmost and rightmost pixels (the partially covered ones)
-    sInt xl = WrapCoord(-offset,width,wrapMode);
-    sInt xr = WrapCoord(offset,width,wrapMode);
-    accu[0] = frac * (src[xl].r + src[xr].r) + bias;
-    accu[1] = frac * (src[xl].g + src[xr].g) + bias;
-    accu[2] = frac * (src[xl].b + src[xr].b) + bias;
-    accu[3] = frac * (src[xl].a + src[xr].a) + bias;
-
-    // inner part of filter kernel
-    for(sInt x=-offset+1;x<=offset-1;x++)
-    {
-      sInt xc = WrapCoord(x,width,wrapMode);
-      
-      accu[0] += src[xc].r << 6;
-      accu[1] += src[xc].g << 6;
-      accu[2] += src[xc].b << 6;
-      accu[3] += src[xc].a << 6;
-    }
-  }
-  else // clamp on edge
+  for(sInt x=0;x<width;x++)
   {
-    // on the left edge, the first pixel is repeated over and over
-    accu[0] = src[0].r * (sizeFixed + 32) + bias;
-    accu[1] = src[0].g * (sizeFixed + 32) + bias;
-    accu[2] = src[0].b * (sizeFixed + 32) + bias;
-    accu[3] = src[0].a * (sizeFixed + 32) + bias;
+    sInt xl = x ? x-1 : width-1;
+    sInt xr = (x+1 < width) ? x+1 : 0;
 
-    // rightmost pixel
-    sInt xr = WrapCoord(offset,width,wrapMode);
-    accu[0] += frac * src[xr].r;
-    accu[1] += frac * src[xr].g;
-    accu[2] += frac * src[xr].b;
-    accu[3] += frac * src[xr].a;
+    sInt dx2 = row[xr].r - row[xl].r;
+    sInt dy2 = next[x].r - prev[x].r;
+    sF32 dx = dx2 * strength / (2 * 65535.0f);
+    sF32 dy = dy2 * strength / (2 * 65535.0f);
 
-    // inner part of filter kernel (the right half)
-    for(sInt x=1;x<=offset-1;x++)
+    switch(op)
     {
-      sInt xc = WrapCoord(x,width,wrapMode);
+    case GenTexture::DeriveGradient:
+      out->r = sClamp<sInt>(dx*32768.0f + 32768.0f,0,65535);
+      out->g = sClamp<sInt>(dy*32768.0f + 32768.0f,0,65535);
+      out->b = 0;
+      out->a = 65535;
+      break;
 
-      accu[0] += src[xc].r << 6;
-      accu[1] += src[xc].g << 6;
-      accu[2] += src[xc].b << 6;
-      accu[3] += src[xc].a << 6;
+    case GenTexture::DeriveNormals:
+      {
+        // (1 0 dx)^T x (0 1 dy)^T = (-dx -dy 1)
+        sF32 scale = 32768.0f * sFInvSqrt(1.0f + dx*dx + dy*dy);
+
+        out->r = sClamp<sInt>(-dx*scale + 32768.0f,0,65535);
+        out->g = sClamp<sInt>(-dy*scale + 32768.0f,0,65535);
+        out->b = sClamp<sInt>(    scale + 32768.0f,0,65535);
+        out->a = 65535;
+      }
+      break;
     }
+
+    out++;
   }
+}
 
-  // generate output pixels
-  for(sInt x=0;x<width;x++)
-  {
-    // write out state of accumulator
-    dst[x].r = accu[0] / denom;
-    dst[x].g = accu[1] / denom;
-    dst[x].b = accu[2] / denom;
-    dst[x].a = accu[3] / denom;
+void GenTexture::Derive(const GenTexture &in,DeriveOp op,sF32 strength)
+{
+  sVERIFY(SizeMatchesWith(in));
 
-    // update accumulator
-    sInt xl0 = WrapCoord(x-offset+0,width,wrapMode);
-    sInt xl1 = WrapCoord(x-offset+1,width,wrapMode);
-    sInt xr0 = WrapCoord(x+offset+0,width,wrapMode);
-    sInt xr1 = WrapCoord(x+offset+1,width,wrapMode);
+  ForBands(YRes,&in != this,[&](sInt yStart,sInt yEnd)
+  {
+    for(sInt y=yStart;y<yEnd;y++)
+    {
+      const Pixel *prev = &in.Data[WrapIndex(y-1,YRes)*XRes];
+      const Pixel *next = &in.Data[WrapIndex(y+1,YRes)*XRes];
 
-    accu[0] += 64 * (src[xr0].r - src[xl1].r) + frac * (src[xr1].r - src[xr0].r - src[xl0].r + src[xl1].r);
-    accu[1] += 64 * (src[xr0].g - src[xl1].g) + frac * (src[xr1].g - src[xr0].g - src[xl0].g + src[xl1].g);
-    accu[2] += 64 * (src[xr0].b - src[xl1].b) + frac * (src[xr1].b - src[xr0].b - src[xl0].b + src[xl1].b);
-    accu[3] += 64 * (src[xr0].a - src[xl1].a) + frac * (src[xr1].a - src[xr0].a - src[xl0].a + src[xl1].a);
-  }
+      DeriveRow(&Data[y*XRes],prev,&in.Data[y*XRes],next,XRes,op,strength);
+    }
+  });
 }
 
 void GenTexture::Blur(const GenTexture &inImg,sF32 sizex,sF32 sizey,sInt order,sInt wrapMode)
@@ -1004,31 +1795,38 @@ void GenTexture::Blur(const GenTexture &inImg,sF32 sizex,sF32 sizey,sInt order,s
     *this = inImg;
   else
   {
-    // allocate pixel buffers
-    sInt bufSize = sMax(XRes,YRes);
-    Pixel *buf1 = new Pixel[bufSize];
-    Pixel *buf2 = new Pixel[bufSize];
     const GenTexture *in = &inImg;
 
     // horizontal blur
     if(sizePixX > 32)
     {
       // go through image row by row
-      for(sInt y=0;y<YRes;y++)
+      ForBands(YRes,sTRUE,[&](sInt yStart,sInt yEnd)
       {
-        // copy pixels into buffer 1
-        sCopyMem(buf1,&in->Data[y*XRes],XRes * sizeof(Pixel));
+        // allocate pixel buffers
+        Pixel *buf1 = new Pixel[XRes];
+        Pixel *buf2 = new Pixel[XRes];
 
-        // blur order times, ping-ponging between buffers
-        for(sInt i=0;i<order;i++)
+        for(sInt y=yStart;y<yEnd;y++)
         {
-          Blur1DBuffer(buf2,buf1,XRes,sizePixX,(wrapMode & ClampU) ? 1 : 0);
-          sSwap(buf1,buf2);
+          // copy pixels into buffer 1
+          sCopyMem(buf1,&in->Data[y*XRes],XRes * sizeof(Pixel));
+
+          // blur order times, ping-ponging between buffers
+          for(sInt i=0;i<order;i++)
+          {
+            Kernels->Blur1D(buf2,buf1,XRes,sizePixX,(wrapMode & ClampU) ? 1 : 0);
+            sSwap(buf1,buf2);
+          }
+
+          // copy pixels back
+          sCopyMem(&Data[y*XRes],buf1,XRes * sizeof(Pixel));
         }
 
-        // copy pixels back
-        sCopyMem(&Data[y*XRes],buf1,XRes * sizeof(Pixel));
-      }
+        // clean up
+        delete[] buf1;
+        delete[] buf2;
+      });
 
       in = this;
     }
@@ -1037,70 +1835,82 @@ void GenTexture::Blur(const GenTexture &inImg,sF32 sizex,sF32 sizey,sInt order,s
     if(sizePixY > 32)
     {
       // go through image column by column
-      for(sInt x=0;x<XRes;x++)
+      ForBands(XRes,sTRUE,[&](sInt xStart,sInt xEnd)
       {
-        // copy pixels into buffer 1
-        const Pixel *src = &in->Data[x];
-        Pixel *dst = buf1;
+        // allocate pixel buffers
+        Pixel *buf1 = new Pixel[YRes];
+        Pixel *buf2 = new Pixel[YRes];
 
-        for(sInt y=0;y<YRes;y++)
+        for(sInt x=xStart;x<xEnd;x++)
         {
-          *dst++ = *src;
-          src += XRes;
-        }
+          // copy pixels into buffer 1
+          const Pixel *src = &in->Data[x];
+          Pixel *dst = buf1;
 
-        // blur order times, ping-ponging between buffers
-        for(sInt i=0;i<order;i++)
-        {
-          Blur1DBuffer(buf2,buf1,YRes,sizePixY,(wrapMode & ClampV) ? 1 : 0);
-          sSwap(buf1,buf2);
-        }
+          for(sInt y=0;y<YRes;y++)
+          {
+            *dst++ = *src;
+            src += XRes;
+          }
 
-        // copy pixels back
-        src = buf1;
-        dst = &Data[x];
+          // blur order times, ping-ponging between buffers
+          for(sInt i=0;i<order;i++)
+          {
+            Kernels->Blur1D(buf2,buf1,YRes,sizePixY,(wrapMode & ClampV) ? 1 : 0);
+            sSwap(buf1,buf2);
+          }
 
-        for(sInt y=0;y<YRes;y++)
-        {
-          *dst = *src++;
-          dst += XRes;
+          // copy pixels back
+          src = buf1;
+          dst = &Data[x];
+
+          for(sInt y=0;y<YRes;y++)
+          {
+            *dst = *src++;
+            dst += XRes;
+          }
         }
-      }
-    }
 
-    // clean up
-    delete[] buf1;
-    delete[] buf2;
+        // clean up
+        delete[] buf1;
+        delete[] buf2;
+      });
+    }
   }
 }
 
-void GenTexture::Ternary(const GenTexture &in1Tex,const GenTexture &in2Tex,const GenTexture &in3Tex,TernaryOp op)
+// Ternary for count pixels
+static void TernaryRow(Pixel *out,const Pixel *in1,const Pixel *in2,const Pixel *in3,sInt count,GenTexture::TernaryOp op)
 {
-  sVERIFY(SizeMatchesWith(in1Tex) && SizeMatchesWith(in2Tex) && SizeMatchesWith(in3Tex));
-
-  for(sInt i=0;i<NPixels;i++)
+  for(sInt i=0;i<count;i++)
   {
-    Pixel &out = Data[i];
-    const Pixel &in1 = in1Tex.Data[i];
-    const Pixel &in2 = in2Tex.Data[i];
-    const Pixel &in3 = in3Tex.Data[i];
-
     switch(op)
     {
-    case TernaryLerp:
-      out.r = MulIntens(65535-in3.r,in1.r) + MulIntens(in3.r,in2.r);
-      out.g = MulIntens(65535-in3.r,in1.g) + MulIntens(in3.r,in2.g);
-      out.b = MulIntens(65535-in3.r,in1.b) + MulIntens(in3.r,in2.b);
-      out.a = MulIntens(65535-in3.r,in1.a) + MulIntens(in3.r,in2.a);
+    case GenTexture::TernaryLerp:
+      out[i].r = MulIntens(65535-in3[i].r,in1[i].r) + MulIntens(in3[i].r,in2[i].r);
+      out[i].g = MulIntens(65535-in3[i].r,in1[i].g) + MulIntens(in3[i].r,in2[i].g);
+      out[i].b = MulIntens(65535-in3[i].r,in1[i].b) + MulIntens(in3[i].r,in2[i].b);
+      out[i].a = MulIntens(65535-in3[i].r,in1[i].a) + MulIntens(in3[i].r,in2[i].a);
       break;
 
-    case TernarySelect:
-      out = (in3.r >= 32768) ? in2 : in1;
+    case GenTexture::TernarySelect:
+      out[i] = (in3[i].r >= 32768) ? in2[i] : in1[i];
       break;
     }
   }
 }
 
+void GenTexture::Ternary(const GenTexture &in1Tex,const GenTexture &in2Tex,const GenTexture &in3Tex,TernaryOp op)
+{
+  sVERIFY(SizeMatchesWith(in1Tex) && SizeMatchesWith(in2Tex) && SizeMatchesWith(in3Tex));
+
+  ForBands(YRes,sTRUE,[&](sInt yStart,sInt yEnd)
+  {
+    sInt start = yStart*XRes;
+    TernaryRow(&Data[start],&in1Tex.Data[start],&in2Tex.Data[start],&in3Tex.Data[start],(yEnd-yStart)*XRes,op);
+  });
+}
+
 void GenTexture::Paste(const GenTexture &bgTex,const GenTexture &inTex,sF32 orgx,sF32 orgy,sF32 ux,sF32 uy,sF32 vx,sF32 vy,CombineOp op,sInt mode)
 {
   sVERIFY(SizeMatchesWith(bgTex));
@@ -1130,128 +1940,131 @@ void GenTexture::Paste(const GenTexture &bgTex,const GenTexture &inTex,sF32 orgx
   sInt dudy = -vx * invM / YRes;
   sInt dvdy = ux * invM / YRes;
 
-  for(sInt y=minY;y<=maxY;y++)
+  ForBands(maxY+1-minY,&inTex != this,[&](sInt yStart,sInt yEnd)
   {
-    Pixel *out = &Data[y*XRes + minX];
-    sInt u = u0;
-    sInt v = v0;
-
-    for(sInt x=minX;x<=maxX;x++)
+    for(sInt y=minY+yStart;y<minY+yEnd;y++)
     {
-      if(u >= 0 && u < 0x1000000 && v >= 0 && v < 0x1000000)
+      Pixel *out = &Data[y*XRes + minX];
+      sInt u = u0 + (y-minY) * dudy;
+      sInt v = v0 + (y-minY) * dvdy;
+
+      for(sInt x=minX;x<=maxX;x++)
       {
-        Pixel in;
-        sInt transIn,transOut;
+        if(u >= 0 && u < 0x1000000 && v >= 0 && v < 0x1000000)
+        {
+          Pixel in;
+          sInt transIn,transOut;
 
-        inTex.SampleFiltered(in,u,v,ClampU|ClampV|((mode & 1) ? FilterBilinear : FilterNearest));
+          inTex.SampleFiltered(in,u,v,ClampU|ClampV|((mode & 1) ? FilterBilinear : FilterNearest));
 
-        switch(op)
-        {
-        case CombineAdd:
-          out->r = sMin(out->r + in.r,65535);
-          out->g = sMin(out->g + in.g,65535);
-          out->b = sMin(out->b + in.b,65535);
-          out->a = sMin(out->a + in.a,65535);
-          break;
-
-        case CombineSub:
-          out->r = sMax<sInt>(out->r - in.r,0);
-          out->g = sMax<sInt>(out->g - in.g,0);
-          out->b = sMax<sInt>(out->b - in.b,0);
-          out->a = sMax<sInt>(out->a - in.a,0);
-          break;
-
-        case CombineMulC:
-          out->r = MulIntens(out->r,in.r);
-          out->g = MulIntens(out->g,in.g);
-          out->b = MulIntens(out->b,in.b);
-          out->a = MulIntens(out->a,in.a);
-          break;
-
-        case CombineMin:
-          out->r = sMin(out->r,in.r);
-          out->g = sMin(out->g,in.g);
-          out->b = sMin(out->b,in.b);
-          out->a = sMin(out->a,in.a);
-          break;
-
-        case CombineMax:
-          out->r = sMax(out->r,in.r);
-          out->g = sMax(out->g,in.g);
-          out->b = sMax(out->b,in.b);
-          out->a = sMax(out->a,in.a);
-          break;
-
-        case CombineSetAlpha:
-          out->a = in.r;
-          break;
-
-        case CombinePreAlpha:
-          out->r = MulIntens(out->r,in.r);
-          out->g = MulIntens(out->g,in.r);
-          out->b = MulIntens(out->b,in.r);
-          out->a = in.g;
-          break;
-
-        case CombineOver:
-          transIn = 65535 - in.a;
-
-          out->r = MulIntens(transIn,out->r) + in.r;
-          out->g = MulIntens(transIn,out->g) + in.g;
-          out->b = MulIntens(transIn,out->b) + in.b;
-          out->a += MulIntens(in.a,65535-out->a);
-          break;
-
-        case CombineMultiply:
-          transIn = 65535 - in.a;
-          transOut = 65535 - out->a;
-
-          out->r = MulIntens(transIn,out->r) + MulIntens(transOut,in.r) + MulIntens(in.r,out->r);
-          out->g = MulIntens(transIn,out->g) + MulIntens(transOut,in.g) + MulIntens(in.g,out->g);
-          out->b = MulIntens(transIn,out->b) + MulIntens(transOut,in.b) + MulIntens(in.b,out->b);
-          out->a += MulIntens(in.a,transOut);
-          break;
-
-        case CombineScreen:
-          out->r += MulIntens(in.r,65535-out->r);
-          out->g += MulIntens(in.g,65535-out->g);
-          out->b += MulIntens(in.b,65535-out->b);
-          out->a += MulIntens(in.a,65535-out->a);
-          break;
-
-        case CombineDarken:
-          out->r += in.r - sMax(MulIntens(in.r,out->a),MulIntens(out->r,in.a));
-          out->g += in.g - sMax(MulIntens(in.g,out->a),MulIntens(out->g,in.a));
-          out->b += in.b - sMax(MulIntens(in.b,out->a),MulIntens(out->b,in.a));
-          out->a += MulIntens(in.a,65535-out->a);
-          break;
-
-        case CombineLighten:
-          out->r += in.r - sMin(MulIntens(in.r,out->a),MulIntens(out->r,in.a));
-          out->g += in.g - sMin(MulIntens(in.g,out->a),MulIntens(out->g,in.a));
-          out->b += in.b - sMin(MulIntens(in.b,out->a),MulIntens(out->b,in.a));
-          out->a += MulIntens(in.a,65535-out->a);
-          break;
+          switch(op)
+          {
+          case CombineAdd:
+            out->r = sMin(out->r + in.r,65535);
+            out->g = sMin(out->g + in.g,65535);
+            out->b = sMin(out->b + in.b,65535);
+            out->a = sMin(out->a + in.a,65535);
+            break;
+
+          case CombineSub:
+            out->r = sMax<sInt>(out->r - in.r,0);
+            out->g = sMax<sInt>(out->g - in.g,0);
+            out->b = sMax<sInt>(out->b - in.b,0);
+            out->a = sMax<sInt>(out->a - in.a,0);
+            break;
+
+          case CombineMulC:
+            out->r = MulIntens(out->r,in.r);
+            out->g = MulIntens(out->g,in.g);
+            out->b = MulIntens(out->b,in.b);
+            out->a = MulIntens(out->a,in.a);
+            break;
+
+          case CombineMin:
+            out->r = sMin(out->r,in.r);
+            out->g = sMin(out->g,in.g);
+            out->b = sMin(out->b,in.b);
+            out->a = sMin(out->a,in.a);
+            break;
+
+          case CombineMax:
+            out->r = sMax(out->r,in.r);
+            out->g = sMax(out->g,in.g);
+            out->b = sMax(out->b,in.b);
+            out->a = sMax(out->a,in.a);
+            break;
+
+          case CombineSetAlpha:
+            out->a = in.r;
+            break;
+
+          case CombinePreAlpha:
+            out->r = MulIntens(out->r,in.r);
+            out->g = MulIntens(out->g,in.r);
+            out->b = MulIntens(out->b,in.r);
+            out->a = in.g;
+            break;
+
+          case CombineOver:
+            transIn = 65535 - in.a;
+
+            out->r = MulIntens(transIn,out->r) + in.r;
+            out->g = MulIntens(transIn,out->g) + in.g;
+            out->b = MulIntens(transIn,out->b) + in.b;
+            out->a += MulIntens(in.a,65535-out->a);
+            break;
+
+          case CombineMultiply:
+            transIn = 65535 - in.a;
+            transOut = 65535 - out->a;
+
+            out->r = MulIntens(transIn,out->r) + MulIntens(transOut,in.r) + MulIntens(in.r,out->r);
+            out->g = MulIntens(transIn,out->g) + MulIntens(transOut,in.g) + MulIntens(in.g,out->g);
+            out->b = MulIntens(transIn,out->b) + MulIntens(transOut,in.b) + MulIntens(in.b,out->b);
+            out->a += MulIntens(in.a,transOut);
+            break;
+
+          case CombineScreen:
+            out->r += MulIntens(in.r,65535-out->r);
+            out->g += MulIntens(in.g,65535-out->g);
+            out->b += MulIntens(in.b,65535-out->b);
+            out->a += MulIntens(in.a,65535-out->a);
+            break;
+
+          case CombineDarken:
+            out->r += in.r - sMax(MulIntens(in.r,out->a),MulIntens(out->r,in.a));
+            out->g += in.g - sMax(MulIntens(in.g,out->a),MulIntens(out->g,in.a));
+            out->b += in.b - sMax(MulIntens(in.b,out->a),MulIntens(out->b,in.a));
+            out->a += MulIntens(in.a,65535-out->a);
+            break;
+
+          case CombineLighten:
+            out->r += in.r - sMin(MulIntens(in.r,out->a),MulIntens(out->r,in.a));
+            out->g += in.g - sMin(MulIntens(in.g,out->a),MulIntens(out->g,in.a));
+            out->b += in.b - sMin(MulIntens(in.b,out->a),MulIntens(out->b,in.a));
+            out->a += MulIntens(in.a,65535-out->a);
+            break;
+          }
         }
-      }
 
-      u += dudx;
-      v += dvdx;
-      out++;
+        u += dudx;
+        v += dvdx;
+        out++;
+      }
     }
-
-    u0 += dudy;
-    v0 += dvdy;
-  }
+  });
 }
 
 void GenTexture::Bump(const GenTexture &surface,const GenTexture &normals,const GenTexture *specular,const GenTexture *falloffMap,sF32 px,sF32 py,sF32 pz,sF32 dx,sF32 dy,sF32 dz,const Pixel &ambient,const Pixel &diffuse,sBool directional)
 {
   sVERIFY(SizeMatchesWith(surface) && SizeMatchesWith(normals));
 
-  sF32 L[3],H[3]; // light/halfway vector
+  sF32 dirL[3],dirH[3]; // light/halfway vector for directional lights
   sF32 invX,invY;
 
+  sSetMem(dirL,0,sizeof(dirL));
+  sSetMem(dirH,0,sizeof(dirH));
+
   sF32 scale = sFInvSqrt(dx*dx + dy*dy + dz*dz);
   dx *= scale;
   dy *= scale;
@@ -1259,103 +2072,118 @@ void GenTexture::Bump(const GenTexture &surface,const GenTexture &normals,const
 
   if(directional)
   {
-    L[0] = -dx;
-    L[1] = -dy;
-    L[2] = -dz;
-
-    scale = sFInvSqrt(2.0f + 2.0f * L[2]); // 1/sqrt((L + <0,0,1>)^2)
-    H[0] = L[0] * scale;
-    H[1] = L[1] * scale;
-    H[2] = (L[2] + 1.0f) * scale;
+    dirL[0] = -dx;
+    dirL[1] = -dy;
+    dirL[2] = -dz;
+
+    scale = sFInvSqrt(2.0f + 2.0f * dirL[2]); // 1/sqrt((L + <0,0,1>)^2)
+    dirH[0] = dirL[0] * scale;
+    dirH[1] = dirL[1] * scale;
+    dirH[2] = (dirL[2] + 1.0f) * scale;
   }
 
   invX = 1.0f / XRes;
   invY = 1.0f / YRes;
-  Pixel *out = Data;
-  const Pixel *surf = surface.Data;
-  const Pixel *normal = normals.Data;
 
-  for(sInt y=0;y<YRes;y++)
+  sBool threaded = specular != this && falloffMap != this;
+  ForBands(YRes,threaded,[&](sInt yStart,sInt yEnd)
   {
-    for(sInt x=0;x<XRes;x++)
+    Pixel *out = &Data[yStart*XRes];
+    const Pixel *surf = &surface.Data[yStart*XRes];
+    const Pixel *normal = &normals.Data[yStart*XRes];
+
+    // light/halfway vector (updated per pixel for point lights)
+    sF32 L[3],H[3];
+    sCopyMem(L,dirL,sizeof(L));
+    sCopyMem(H,dirH,sizeof(H));
+
+    for(sInt y=yStart;y<yEnd;y++)
     {
-      // determine vectors to light
-      if(!directional)
+      for(sInt x=0;x<XRes;x++)
       {
-        L[0] = px - (x + 0.5f) * invX;
-        L[1] = py - (y + 0.5f) * invY;
-        L[2] = pz;
+        // determine vectors to light
+        if(!directional)
+        {
+          L[0] = px - (x + 0.5f) * invX;
+          L[1] = py - (y + 0.5f) * invY;
+          L[2] = pz;
 
-        sF32 scale = sFInvSqrt(L[0]*L[0] + L[1]*L[1] + L[2]*L[2]);
-        L[0] *= scale;
-        L[1] *= scale;
-        L[2] *= scale;
+          sF32 scale = sFInvSqrt(L[0]*L[0] + L[1]*L[1] + L[2]*L[2]);
+          L[0] *= scale;
+          L[1] *= scale;
+          L[2] *= scale;
 
-        // determine halfway vector
-        if(specular)
-        {
-          sF32 scale = sFInvSqrt(2.0f + 2.0f * L[2]); // 1/sqrt((L + <0,0,1>)^2)
-          H[0] = L[0] * scale;
-          H[1] = L[1] * scale;
-          H[2] = (L[2] + 1.0f) * scale;
+          // determine halfway vector
+          if(specular)
+          {
+            sF32 scale = sFInvSqrt(2.0f + 2.0f * L[2]); // 1/sqrt((L + <0,0,1>)^2)
+            H[0] = L[0] * scale;
+            H[1] = L[1] * scale;
+            H[2] = (L[2] + 1.0f) * scale;
+          }
         }
-      }
 
-      // fetch normal
-      sF32 N[3];
-      N[0] = (normal->r - 0x8000) / 32768.0f;
-      N[1] = (normal->g - 0x8000) / 32768.0f;
-      N[2] = (normal->b - 0x8000) / 32768.0f;
+        // fetch normal
+        sF32 N[3];
+        N[0] = (normal->r - 0x8000) / 32768.0f;
+        N[1] = (normal->g - 0x8000) / 32768.0f;
+        N[2] = (normal->b - 0x8000) / 32768.0f;
 
-      // get falloff term if specified
-      Pixel falloff;
-      if(falloffMap)
-      {
-        sF32 spotTerm = sMax<sF32>(dx*L[0] + dy*L[1] + dz*L[2],0.0f);
-        falloffMap->SampleGradient(falloff,spotTerm * (1<<24));
-      }
+        // get falloff term if specified
+        Pixel falloff;
+        if(falloffMap)
+        {
+          sF32 spotTerm = sMax<sF32>(dx*L[0] + dy*L[1] + dz*L[2],0.0f);
+          falloffMap->SampleGradient(falloff,spotTerm * (1<<24));
+        }
 
-      // lighting calculation
-      sF32 NdotL = sMax<sF32>(N[0]*L[0] + N[1]*L[1] + N[2]*L[2],0.0f);
-      Pixel ambDiffuse;
+        // lighting calculation
+        sF32 NdotL = sMax<sF32>(N[0]*L[0] + N[1]*L[1] + N[2]*L[2],0.0f);
+        Pixel ambDiffuse;
 
-      ambDiffuse.r = NdotL * diffuse.r;
-      ambDiffuse.g = NdotL * diffuse.g;
-      ambDiffuse.b = NdotL * diffuse.b;
-      ambDiffuse.a = NdotL * diffuse.a;
-      if(falloffMap)
-        ambDiffuse.CompositeMulC(falloff);
+        ambDiffuse.r = NdotL * diffuse.r;
+        ambDiffuse.g = NdotL * diffuse.g;
+        ambDiffuse.b = NdotL * diffuse.b;
+        ambDiffuse.a = NdotL * diffuse.a;
+        if(falloffMap)
+          ambDiffuse.CompositeMulC(falloff);
 
-      ambDiffuse.CompositeAdd(ambient);
-      out->r = MulIntens(surf->r,ambDiffuse.r);
-      out->g = MulIntens(surf->g,ambDiffuse.g);
-      out->b = MulIntens(surf->b,ambDiffuse.b);
-      out->a = MulIntens(surf->a,ambDiffuse.a);
+        ambDiffuse.CompositeAdd(ambient);
+        out->r = MulIntens(surf->r,ambDiffuse.r);
+        out->g = MulIntens(surf->g,ambDiffuse.g);
+        out->b = MulIntens(surf->b,ambDiffuse.b);
+        out->a = MulIntens(surf->a,ambDiffuse.a);
 
-      if(specular)
-      {
-        Pixel addTerm;
-        sF32 NdotH = sMax<sF32>(N[0]*H[0] + N[1]*H[1] + N[2]*H[2],0.0f);
-        specular->SampleGradient(addTerm,NdotH * (1<<24));
-        if(falloffMap)
-          addTerm.CompositeMulC(falloff);
+        if(specular)
+        {
+          Pixel addTerm;
+          sF32 NdotH = sMax<sF32>(N[0]*H[0] + N[1]*H[1] + N[2]*H[2],0.0f);
+          specular->SampleGradient(addTerm,NdotH * (1<<24));
+          if(falloffMap)
+            addTerm.CompositeMulC(falloff);
+
+          out->r = sClamp<sInt>(out->r+addTerm.r,0,out->a);
+          out->g = sClamp<sInt>(out->g+addTerm.g,0,out->a);
+          out->b = sClamp<sInt>(out->b+addTerm.b,0,out->a);
+        }
 
-        out->r = sClamp<sInt>(out->r+addTerm.r,0,out->a);
-        out->g = sClamp<sInt>(out->g+addTerm.g,0,out->a);
-        out->b = sClamp<sInt>(out->b+addTerm.b,0,out->a);
+        out++;
+        surf++;
+        normal++;
       }
-
-      out++;
-      surf++;
-      normal++;
     }
-  }
+  });
 }
 
-void GenTexture::LinearCombine(const Pixel &color,sF32 constWeight,const LinearInput *inputs,sInt nInputs)
+// LinearCombine parameters in fixed point
+struct LinearSetup
+{
+  sInt W[256],UO[256],VO[256];  // weights and offsets of the inputs
+  sInt Const[4];                // preweighted constant color
+};
+
+template<class Input> static void LinearCombineSetup(LinearSetup &ls,const Pixel &color,sF32 constWeight,const Input *inputs,sInt nInputs)
 {
-  sInt w[256],uo[256],vo[256];
-  
   sVERIFY(nInputs <= 255);
   sVERIFY(constWeight >= -127.0f && constWeight <= 127.0f);
 
@@ -1366,72 +2194,385 @@ void GenTexture::LinearCombine(const Pixel &color,sF32 constWeight,const LinearI
     sVERIFY(inputs[i].UShift >= -127.0f && inputs[i].UShift <= 127.0f);
     sVERIFY(inputs[i].VShift >= -127.0f && inputs[i].VShift <= 127.0f);
 
-    w[i] = inputs[i].Weight * 65536.0f;
-    uo[i] = inputs[i].UShift * (1 << 24);
-    vo[i] = inputs[i].VShift * (1 << 24);
+    ls.W[i] = inputs[i].Weight * 65536.0f;
+    ls.UO[i] = inputs[i].UShift * (1 << 24);
+    ls.VO[i] = inputs[i].VShift * (1 << 24);
   }
 
   // compute preweighted constant color
-  sInt c_r,c_g,c_b,c_a,t;
+  sInt t = constWeight * 65536.0f;
+  ls.Const[0] = MulShift16(t,color.r);
+  ls.Const[1] = MulShift16(t,color.g);
+  ls.Const[2] = MulShift16(t,color.b);
+  ls.Const[3] = MulShift16(t,color.a);
+}
 
-  t = constWeight * 65536.0f;
-  c_r = MulShift16(t,color.r);
-  c_g = MulShift16(t,color.g);
-  c_b = MulShift16(t,color.b);
-  c_a = MulShift16(t,color.a);
+// First row of an input (of yres rows) needed at coordinate v, not wrapped
+// yet. Bilinear filtering also needs the row after it, with weight fy.
+static sInt LinearInputRow(sInt v,sInt yres,sInt mode,sInt &fy)
+{
+  fy = 0;
+  if(!(mode & GenTexture::FilterBilinear))
+    return NearestIndex(v,yres,mode & GenTexture::ClampV);
 
-  // calculate output image
-  sInt u0 = MinX;
-  sInt v0 = MinY;
-  sInt stepU = 1 << (24 - ShiftX);
-  sInt stepV = 1 << (24 - ShiftY);
-  Pixel *out = Data;
+  sS64 pos = BilinearPos(v,yres,mode & GenTexture::ClampV);
+  fy = sInt(pos >> 8) & 0xffff;
+  return sInt(pos >> 24);
+}
 
-  for(sInt y=0;y<YRes;y++)
+// Adds one input to a row of accumulators (4 per pixel). row0 and row1 are
+// the input rows picked by LinearInputRow, inXRes is the input width.
+static void LinearAccumRow(sInt *acc,const sInt *centerU,sInt width,const Pixel *row0,const Pixel *row1,sInt fy,sInt inXRes,sInt mode,sInt uo,sInt w)
+{
+  for(sInt x=0;x<width;x++)
   {
-    sInt u = u0;
-    sInt v = v0;
+    sInt u = centerU[x] + uo;
+    Pixel inPix;
 
-    for(sInt x=0;x<XRes;x++)
+    if(mode & GenTexture::FilterBilinear)
     {
-      sInt acc_r,acc_g,acc_b,acc_a;
+      sS64 px = BilinearPos(u,inXRes,mode & GenTexture::ClampU);
+      sInt x0 = WrapIndex(sInt(px >> 24),inXRes);
+      sInt x1 = WrapIndex(x0 + 1,inXRes);
+
+      Kernels->SampleBilinear(inPix,row0,row1,x0,x1,sInt(px >> 8) & 0xffff,fy);
+    }
+    else
+      inPix = row0[WrapIndex(NearestIndex(u,inXRes,mode & GenTexture::ClampU),inXRes)];
+
+    acc[0] += MulShift16(w,inPix.r);
+    acc[1] += MulShift16(w,inPix.g);
+    acc[2] += MulShift16(w,inPix.b);
+    acc[3] += MulShift16(w,inPix.a);
+    acc += 4;
+  }
+}
+
+static void LinearInitRow(sInt *acc,const LinearSetup &ls,sInt width)
+{
+  for(sInt x=0;x<width;x++)
+  {
+    acc[0] = ls.Const[0];
+    acc[1] = ls.Const[1];
+    acc[2] = ls.Const[2];
+    acc[3] = ls.Const[3];
+    acc += 4;
+  }
+}
+
+// store (with clamping)
+static void LinearStoreRow(Pixel *out,const sInt *acc,sInt width)
+{
+  for(sInt x=0;x<width;x++)
+  {
+    out->r = sClamp(acc[0],0,65535);
+    out->g = sClamp(acc[1],0,65535);
+    out->b = sClamp(acc[2],0,65535);
+    out->a = sClamp(acc[3],0,65535);
+    acc += 4;
+    out++;
+  }
+}
+
+void GenTexture::LinearCombine(const Pixel &color,sF32 constWeight,const LinearInput *inputs,sInt nInputs)
+{
+  LinearSetup ls;
+  LinearCombineSetup(ls,color,constWeight,inputs,nInputs);
+
+  // calculate output image
+  sInt *centerU = PixelCenters(XRes);
 
-      // initialize accumulator with start value
-      acc_r = c_r;
-      acc_g = c_g;
-      acc_b = c_b;
-      acc_a = c_a;
+  sBool threaded = sTRUE;
+  for(sInt i=0;i<nInputs;i++)
+    threaded &= inputs[i].Tex != this;
+
+  ForBands(YRes,threaded,[&](sInt yStart,sInt yEnd)
+  {
+    sInt *acc = new sInt[XRes*4];
+
+    for(sInt y=yStart;y<yEnd;y++)
+    {
+      sInt v = PixelCenter(y,YRes);
 
       // accumulate inputs
+      LinearInitRow(acc,ls,XRes);
       for(sInt j=0;j<nInputs;j++)
       {
-        const LinearInput &in = inputs[j];
-        Pixel inPix;
-
-        in.Tex->SampleFiltered(inPix,u + uo[j],v + vo[j],in.FilterMode);
+        const GenTexture *tex = inputs[j].Tex;
+        sInt fy;
+        sInt y0 = LinearInputRow(v + ls.VO[j],tex->YRes,inputs[j].FilterMode,fy);
 
-        acc_r += MulShift16(w[j],inPix.r);
-        acc_g += MulShift16(w[j],inPix.g);
-        acc_b += MulShift16(w[j],inPix.b);
-        acc_a += MulShift16(w[j],inPix.a);
+        const Pixel *row0 = &tex->Data[WrapIndex(y0,tex->YRes) * tex->XRes];
+        const Pixel *row1 = &tex->Data[WrapIndex(y0 + 1,tex->YRes) * tex->XRes];
+        LinearAccumRow(acc,centerU,XRes,row0,row1,fy,tex->XRes,inputs[j].FilterMode,ls.UO[j],ls.W[j]);
       }
 
-      // store (with clamping)
-      out->r = sClamp(acc_r,0,65535);
-      out->g = sClamp(acc_g,0,65535);
-      out->b = sClamp(acc_b,0,65535);
-      out->a = sClamp(acc_a,0,65535);
-
-      // advance to next pixel
-      u += stepU;
-      out++;
+      LinearStoreRow(&Data[y*XRes],acc,XRes);
     }
 
-    v0 += stepV;
-  }
+    delete[] acc;
+  });
+
+  delete[] centerU;
 }
 
 void InitTexgen()
 {
   InitPerlin();
+  InitKernels();
+}
+
+void SetTexgenThreads(sInt count)
+{
+  NumThreads = sClamp(count,1,MaxThreads);
+  if(Pool.Count != NumThreads-1)
+  {
+    Pool.Stop();
+    Pool.Start(NumThreads-1);
+  }
+}
+
+sInt GetTexgenThreads()
+{
+  return NumThreads;
+}
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Scanline streaming                                                 ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+TexStream::TexStream(sInt xres,sInt yres)
+{
+  sVERIFY(xres >= 1 && yres >= 1);
+
+  XRes = xres;
+  YRes = yres;
+
+  for(sInt i=0;i<3;i++)
+  {
+    Buffer[i] = 0;
+    BufferSize[i] = 0;
+  }
+}
+
+TexStream::~TexStream()
+{
+  for(sInt i=0;i<3;i++)
+    delete[] Buffer[i];
+}
+
+void TexStream::Run(sInt blockRows,void (*output)(const Pixel *rows,sInt y0,sInt count,void *user),void *user)
+{
+  Pixel *block = new Pixel[blockRows * XRes];
+
+  for(sInt y=0;y<YRes;y+=blockRows)
+  {
+    sInt count = sMin(blockRows,YRes-y);
+
+    GetRows(block,y,count);
+    output(block,y,count,user);
+  }
+
+  delete[] block;
+}
+
+void TexStream::Run(GenTexture &dest,sInt blockRows)
+{
+  dest.Init(XRes,YRes);
+
+  for(sInt y=0;y<YRes;y+=blockRows)
+    GetRows(&dest.Data[y*XRes],y,sMin(blockRows,YRes-y));
+}
+
+const Pixel *TexStream::FetchRows(TexStream &in,sInt slot,sInt y0,sInt count)
+{
+  sVERIFY(slot >= 0 && slot < 3);
+
+  sInt size = count * in.XRes;
+  if(BufferSize[slot] < size)
+  {
+    delete[] Buffer[slot];
+    Buffer[slot] = new Pixel[size];
+    BufferSize[slot] = size;
+  }
+
+  // get rows in runs up to the bottom of the input
+  for(sInt i=0;i<count;)
+  {
+    sInt start = WrapIndex(y0 + i,in.YRes);
+    sInt n = sMin(count - i,in.YRes - start);
+
+    in.GetRows(&Buffer[slot][i * in.XRes],start,n);
+    i += n;
+  }
+
+  return Buffer[slot];
+}
+
+// ---- Texture
+
+TexStreamTexture::TexStreamTexture(const GenTexture &tex)
+  : TexStream(tex.XRes,tex.YRes), Tex(tex)
+{
+}
+
+void TexStreamTexture::GetRows(Pixel *dest,sInt y0,sInt count)
+{
+  sCopyMem(dest,&Tex.Data[y0*XRes],count * XRes * sizeof(Pixel));
+}
+
+// ---- ColorMatrixTransform
+
+TexStreamColorMatrix::TexStreamColorMatrix(TexStream &in,const Matrix44 &matrix,sBool clampPremult)
+  : TexStream(in.XRes,in.YRes), In(in)
+{
+  ColorMatrixSetup(Matrix,matrix);
+  ClampPremult = clampPremult;
+}
+
+void TexStreamColorMatrix::GetRows(Pixel *dest,sInt y0,sInt count)
+{
+  const Pixel *in = FetchRows(In,0,y0,count);
+
+  ForBands(count,sTRUE,[&](sInt yStart,sInt yEnd)
+  {
+    Kernels->ColorMatrix(&dest[yStart*XRes],&in[yStart*XRes],(yEnd-yStart)*XRes,Matrix,ClampPremult);
+  });
+}
+
+// ---- ColorRemap
+
+TexStreamColorRemap::TexStreamColorRemap(TexStream &in,const GenTexture &mapR,const GenTexture &mapG,const GenTexture &mapB)
+  : TexStream(in.XRes,in.YRes), In(in), MapR(mapR), MapG(mapG), MapB(mapB)
+{
+}
+
+void TexStreamColorRemap::GetRows(Pixel *dest,sInt y0,sInt count)
+{
+  const Pixel *in = FetchRows(In,0,y0,count);
+
+  ForBands(count,sTRUE,[&](sInt yStart,sInt yEnd)
+  {
+    ColorRemapRow(&dest[yStart*XRes],&in[yStart*XRes],(yEnd-yStart)*XRes,MapR,MapG,MapB);
+  });
+}
+
+// ---- Derive
+
+TexStreamDerive::TexStreamDerive(TexStream &in,GenTexture::DeriveOp op,sF32 strength)
+  : TexStream(in.XRes,in.YRes), In(in)
+{
+  Op = op;
+  Strength = strength;
+}
+
+void TexStreamDerive::GetRows(Pixel *dest,sInt y0,sInt count)
+{
+  // one extra row above and below
+  const Pixel *in = FetchRows(In,0,y0-1,count+2);
+
+  ForBands(count,sTRUE,[&](sInt yStart,sInt yEnd)
+  {
+    for(sInt y=yStart;y<yEnd;y++)
+    {
+      const Pixel *row = &in[(y+1)*XRes];
+      DeriveRow(&dest[y*XRes],row - XRes,row,row + XRes,XRes,Op,Strength);
+    }
+  });
+}
+
+// ---- Ternary
+
+TexStreamTernary::TexStreamTernary(TexStream &in1,TexStream &in2,TexStream &in3,GenTexture::TernaryOp op)
+  : TexStream(in1.XRes,in1.YRes), In1(in1), In2(in2), In3(in3)
+{
+  sVERIFY(in2.XRes == XRes && in2.YRes == YRes);
+  sVERIFY(in3.XRes == XRes && in3.YRes == YRes);
+
+  Op = op;
+}
+
+void TexStreamTernary::GetRows(Pixel *dest,sInt y0,sInt count)
+{
+  const Pixel *in1 = FetchRows(In1,0,y0,count);
+  const Pixel *in2 = FetchRows(In2,1,y0,count);
+  const Pixel *in3 = FetchRows(In3,2,y0,count);
+
+  ForBands(count,sTRUE,[&](sInt yStart,sInt yEnd)
+  {
+    sInt start = yStart*XRes;
+    TernaryRow(&dest[start],&in1[start],&in2[start],&in3[start],(yEnd-yStart)*XRes,Op);
+  });
+}
+
+// ---- LinearCombine
+
+TexStreamLinearCombine::TexStreamLinearCombine(sInt xres,sInt yres,const Pixel &color,sF32 constWeight,const LinearStreamInput *inputs,sInt nInputs)
+  : TexStream(xres,yres)
+{
+  Setup = new LinearSetup;
+  LinearCombineSetup(*Setup,color,constWeight,inputs,nInputs);
+
+  NInputs = nInputs;
+  Inputs = new LinearStreamInput[sMax(nInputs,1)];
+  for(sInt i=0;i<nInputs;i++)
+    Inputs[i] = inputs[i];
+
+  CenterU = PixelCenters(XRes);
+  Acc = 0;
+  AccSize = 0;
+}
+
+TexStreamLinearCombine::~TexStreamLinearCombine()
+{
+  delete Setup;
+  delete[] Inputs;
+  delete[] CenterU;
+  delete[] Acc;
+}
+
+void TexStreamLinearCombine::GetRows(Pixel *dest,sInt y0,sInt count)
+{
+  if(AccSize < count * XRes * 4)
+  {
+    delete[] Acc;
+    AccSize = count * XRes * 4;
+    Acc = new sInt[AccSize];
+  }
+
+  LinearInitRow(Acc,*Setup,count * XRes);
+
+  // one input at a time, so only one input block needs to be around
+  for(sInt j=0;j<NInputs;j++)
+  {
+    TexStream &in = *Inputs[j].Stream;
+    sInt mode = Inputs[j].FilterMode;
+    sInt vo = Setup->VO[j];
+    sInt fy;
+
+    // rows needed for this block (coordinates grow with y)
+    sInt first = LinearInputRow(PixelCenter(y0,YRes) + vo,in.YRes,mode,fy);
+    sInt last = LinearInputRow(PixelCenter(y0+count-1,YRes) + vo,in.YRes,mode,fy) + 1;
+    const Pixel *rows = FetchRows(in,0,first,last+1-first);
+
+    ForBands(count,sTRUE,[&](sInt yStart,sInt yEnd)
+    {
+      for(sInt y=yStart;y<yEnd;y++)
+      {
+        sInt rowFy;
+        sInt r = LinearInputRow(PixelCenter(y0+y,YRes) + vo,in.YRes,mode,rowFy);
+
+        const Pixel *row0 = &rows[(r - first) * in.XRes];
+        LinearAccumRow(&Acc[y*XRes*4],CenterU,XRes,row0,row0 + in.XRes,rowFy,in.XRes,mode,Setup->UO[j],Setup->W[j]);
+      }
+    });
+  }
+
+  ForBands(count,sTRUE,[&](sInt yStart,sInt yEnd)
+  {
+    for(sInt y=yStart;y<yEnd;y++)
+      LinearStoreRow(&dest[y*XRes],&Acc[y*XRes*4],XRes);
+  });
 }
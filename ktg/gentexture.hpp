@@ -58,15 +58,10 @@ typedef sF32 Matrix44[4][4];
 struct GenTexture
 {
   Pixel *Data;    // pointer to pixel data.
-  sInt XRes;      // width of texture (must be a power of 2)
-  sInt YRes;      // height of texture (must be a power of 2)
+  sInt XRes;      // width of texture (any size, powers of 2 are fastest)
+  sInt YRes;      // height of texture (any size, powers of 2 are fastest)
   sInt NPixels;   // width*height (number of pixels)
 
-  sInt ShiftX;    // log2(XRes)
-  sInt ShiftY;    // log2(YRes)
-  sInt MinX;      // (1 << 24) / (2 * XRes) = Min X for clamp to edge
-  sInt MinY;      // (1 << 24) / (2 * YRes) = Min Y for clamp to edge
-
   GenTexture();
   GenTexture(sInt xres,sInt yres);
   GenTexture(const GenTexture &x);
@@ -172,7 +167,125 @@ struct GenTexture
   void LinearCombine(const Pixel &color,sF32 constWeight,const LinearInput *inputs,sInt nInputs);
 };
 
+// TexStream. Computes an image in blocks of rows (scanlines), so chains of
+// point-wise and small-footprint filters can process big images without
+// ever holding a whole intermediate texture in memory. Each stage asks its
+// inputs for just the rows it needs for a block; the rows Derive and
+// bilinear sampling need above and below a block get computed twice.
+// Results are exactly the same as with the GenTexture functions.
+//
+// Stages refer to their inputs (which must stay alive), they don't own them.
+struct TexStream
+{
+  sInt XRes;      // width of image
+  sInt YRes;      // height of image
+
+  TexStream(sInt xres,sInt yres);
+  virtual ~TexStream();
+
+  // Compute rows y0..y0+count-1 (all inside 0..YRes-1) into dest
+  virtual void GetRows(Pixel *dest,sInt y0,sInt count) = 0;
+
+  // Compute the whole image in blocks of (up to) blockRows rows, calling
+  // output for every block
+  void Run(sInt blockRows,void (*output)(const Pixel *rows,sInt y0,sInt count,void *user),void *user);
+
+  // Compute the whole image into a texture
+  void Run(GenTexture &dest,sInt blockRows);
+
+protected:
+  // Get rows y0..y0+count-1 of in (wrapping around vertically) into buffer
+  // slot 0..2 of this stage. Stays valid until the slot is used again.
+  const Pixel *FetchRows(TexStream &in,sInt slot,sInt y0,sInt count);
+
+private:
+  Pixel *Buffer[3];
+  sInt BufferSize[3];
+
+  TexStream(const TexStream &);
+  TexStream &operator =(const TexStream &);
+};
+
+// Rows of an existing texture
+struct TexStreamTexture : public TexStream
+{
+  const GenTexture &Tex;
+
+  TexStreamTexture(const GenTexture &tex);
+  void GetRows(Pixel *dest,sInt y0,sInt count);
+};
+
+// Stream versions of the generator functions (same parameters)
+struct TexStreamColorMatrix : public TexStream
+{
+  TexStream &In;
+  sInt Matrix[4][4];    // 16.16 fixed point
+  sBool ClampPremult;
+
+  TexStreamColorMatrix(TexStream &in,const Matrix44 &matrix,sBool clampPremult);
+  void GetRows(Pixel *dest,sInt y0,sInt count);
+};
+
+struct TexStreamColorRemap : public TexStream
+{
+  TexStream &In;
+  const GenTexture &MapR,&MapG,&MapB;
+
+  TexStreamColorRemap(TexStream &in,const GenTexture &mapR,const GenTexture &mapG,const GenTexture &mapB);
+  void GetRows(Pixel *dest,sInt y0,sInt count);
+};
+
+struct TexStreamDerive : public TexStream
+{
+  TexStream &In;
+  GenTexture::DeriveOp Op;
+  sF32 Strength;
+
+  TexStreamDerive(TexStream &in,GenTexture::DeriveOp op,sF32 strength);
+  void GetRows(Pixel *dest,sInt y0,sInt count);
+};
+
+struct TexStreamTernary : public TexStream
+{
+  TexStream &In1,&In2,&In3;
+  GenTexture::TernaryOp Op;
+
+  TexStreamTernary(TexStream &in1,TexStream &in2,TexStream &in3,GenTexture::TernaryOp op);
+  void GetRows(Pixel *dest,sInt y0,sInt count);
+};
+
+// LinearStreamInput. One input for TexStreamLinearCombine.
+struct LinearStreamInput
+{
+  TexStream *Stream;        // the input stream
+  sF32 Weight;              // its weight
+  sF32 UShift,VShift;       // u/v translate parameter
+  sInt FilterMode;          // filtering mode (as in CoordMatrixTransform)
+};
+
+struct LinearSetup;
+
+struct TexStreamLinearCombine : public TexStream
+{
+  LinearStreamInput *Inputs;
+  sInt NInputs;
+  LinearSetup *Setup;       // weights etc. in fixed point
+  sInt *CenterU;            // u coordinate of pixel centers
+  sInt *Acc;                // accumulators for one block
+  sInt AccSize;
+
+  TexStreamLinearCombine(sInt xres,sInt yres,const Pixel &color,sF32 constWeight,const LinearStreamInput *inputs,sInt nInputs);
+  ~TexStreamLinearCombine();
+  void GetRows(Pixel *dest,sInt y0,sInt count);
+};
+
 // Initialize the generator
 void InitTexgen();
 
+// Number of threads the generator functions may use (default: 1).
+// Results are the same for any thread count. SetTexgenThreads starts (or
+// restarts) the worker threads, don't call it while generating.
+void SetTexgenThreads(sInt count);
+sInt GetTexgenThreads();
+
 #endif // __TP_GENTEXTURE_HPP_
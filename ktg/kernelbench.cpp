@@ -0,0 +1,216 @@
+/****************************************************************************/
+/***                                                                      ***/
+/***   Written by Fabian Giesen.                                          ***/
+/***   I hereby place this code in the public domain.                     ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// Pixel kernel benchmark: runs every kernel with every kernel set this CPU
+// supports, prints megapixels/s and checks the results against the scalar
+// reference code.
+
+#define _CRT_SECURE_NO_WARNINGS
+
+#include <stdio.h>
+#include "gentexture.hpp"
+#include "pixelkernels.hpp"
+
+#ifdef _WIN32
+  #pragma comment(lib,"winmm.lib")
+  #include <windows.h>
+#else
+  #include <sys/time.h>
+  static long timeGetTime()
+  {
+      timeval tim;
+      gettimeofday(&tim, NULL);
+      return tim.tv_sec * 1000 + tim.tv_usec / 1000;
+  }
+#endif
+
+static const char *SetNames[KernelsCount] = { "scalar", "SSE2", "AVX2" };
+
+static const sInt NPixels = 1 << 20;    // pixels per kernel call
+static const sInt MinTime = 200;        // ms per measurement (at least)
+
+static Pixel *SrcA,*SrcB,*Dest,*Ref;
+static sInt BestSet;
+static sBool Mismatch = sFALSE;
+
+// Fill with random 16-bit values
+static void RandomPixels(Pixel *p,sInt count)
+{
+  for(sInt i=0;i<count;i++)
+  {
+    p[i].r = (rand() << 4) ^ rand();
+    p[i].g = (rand() << 4) ^ rand();
+    p[i].b = (rand() << 4) ^ rand();
+    p[i].a = (rand() << 4) ^ rand();
+  }
+}
+
+// Runs body(kernels) repeatedly, returns megapixels/s
+template<class Body> static sF32 Measure(const PixelKernels *k,sInt pixelsPerCall,const Body &body)
+{
+  sInt calls = 0;
+  sInt start = timeGetTime(),time;
+
+  do
+  {
+    body(k);
+    calls++;
+    time = timeGetTime() - start;
+  }
+  while(time < MinTime);
+
+  return 1.0f * calls * pixelsPerCall / (sMax<sInt>(time,1) * 1000.0f);
+}
+
+// Benchmarks one kernel. body(kernels) writes its result to Dest, which is
+// reset from Ref before the correctness check.
+template<class Body> static void BenchKernel(const char *name,const Body &body)
+{
+  Pixel *init = new Pixel[NPixels];
+  sCopyMem(init,Dest,NPixels * sizeof(Pixel));
+
+  // reference result
+  body(GetKernels(KernelsScalar));
+  sCopyMem(Ref,Dest,NPixels * sizeof(Pixel));
+
+  printf("%-16s",name);
+  for(sInt set=KernelsScalar;set<=BestSet;set++)
+  {
+    const PixelKernels *k = GetKernels(set);
+
+    sCopyMem(Dest,init,NPixels * sizeof(Pixel));
+    body(k);
+    sBool ok = sCmpMem(Dest,Ref,NPixels * sizeof(Pixel)) == 0;
+    Mismatch |= !ok;
+
+    sF32 mps = Measure(k,NPixels,body);
+    printf(" %9.1f MP/s%s",mps,ok ? "  " : " !");
+  }
+  printf("\n");
+
+  sCopyMem(Dest,init,NPixels * sizeof(Pixel));
+  delete[] init;
+}
+
+// Benchmarks a whole generator op at 1024x1024 with every kernel set
+template<class Body> static void BenchOp(const char *name,const Body &body)
+{
+  GenTexture out(1024,1024),ref(1024,1024);
+
+  SetKernelSet(KernelsScalar);
+  body(ref);
+
+  printf("%-16s",name);
+  for(sInt set=KernelsScalar;set<=BestSet;set++)
+  {
+    SetKernelSet(set);
+    body(out);
+    sBool ok = sCmpMem(out.Data,ref.Data,out.NPixels * sizeof(Pixel)) == 0;
+    Mismatch |= !ok;
+
+    sF32 mps = Measure(GetKernels(set),out.NPixels,[&](const PixelKernels *) { body(out); });
+    printf(" %9.1f MP/s%s",mps,ok ? "  " : " !");
+  }
+  printf("\n");
+
+  SetKernelSet(BestSet);
+}
+
+int main()
+{
+  InitTexgen();
+  BestSet = DetectKernelSet();
+
+  SrcA = new Pixel[NPixels];
+  SrcB = new Pixel[NPixels];
+  Dest = new Pixel[NPixels];
+  Ref = new Pixel[NPixels];
+
+  srand(1);
+  RandomPixels(SrcA,NPixels);
+  RandomPixels(SrcB,NPixels);
+  RandomPixels(Dest,NPixels);
+
+  printf("%-16s","kernel");
+  for(sInt set=KernelsScalar;set<=BestSet;set++)
+    printf(" %14s",SetNames[set]);
+  printf("\n");
+
+  // raw kernels
+  BenchKernel("CompositeAdd",[](const PixelKernels *k) { k->CompositeAdd(Dest,SrcA,NPixels); });
+  BenchKernel("CompositeMulC",[](const PixelKernels *k) { k->CompositeMulC(Dest,SrcA,NPixels); });
+  BenchKernel("CompositeROver",[](const PixelKernels *k) { k->CompositeROver(Dest,SrcA,NPixels); });
+  BenchKernel("CompositeScreen",[](const PixelKernels *k) { k->CompositeScreen(Dest,SrcA,NPixels); });
+  BenchKernel("Lerp",[](const PixelKernels *k) { k->Lerp(Dest,SrcA,SrcB,40000,NPixels); });
+
+  BenchKernel("SampleBilinear",[](const PixelKernels *k)
+  {
+    for(sInt i=0;i<NPixels;i++)
+      k->SampleBilinear(Dest[i],SrcA + (i & ~1023),SrcB + (i & ~1023),i & 1023,(i+1) & 1023,SrcA[i].r,SrcB[i].g);
+  });
+
+  sInt m[4][4] =
+  {
+    {  70000, -20000,   5000,   3000 },
+    { -10000,  60000,  -4000,  20000 },
+    {   1000,   2000,  50000, -65536 },
+    {      0,      0,  -3000,  65536 },
+  };
+  BenchKernel("ColorMatrix",[&](const PixelKernels *k) { k->ColorMatrix(Dest,SrcA,NPixels,m,sFALSE); });
+  BenchKernel("ColorMatrixPre",[&](const PixelKernels *k) { k->ColorMatrix(Dest,SrcA,NPixels,m,sTRUE); });
+
+  BenchKernel("Blur1D wrap",[](const PixelKernels *k)
+  {
+    for(sInt i=0;i<NPixels;i+=1024)
+      k->Blur1D(Dest+i,SrcA+i,1024,300,0);
+  });
+
+  BenchKernel("Blur1D clamp",[](const PixelKernels *k)
+  {
+    for(sInt i=0;i<NPixels;i+=1024)
+      k->Blur1D(Dest+i,SrcA+i,1024,1000,1);
+  });
+
+  // whole ops
+  GenTexture grad(2,1),src(1024,1024);
+  grad.Data[0].Init(0xff000000);
+  grad.Data[1].Init(0xffffffff);
+  src.Noise(grad,2,2,4,0.5f,1,GenTexture::NoiseBandlimit|GenTexture::NoiseNormalize);
+
+  Matrix44 cm =
+  {
+    { 0.9f, 0.1f, 0.0f, 0.05f },
+    { 0.0f, 0.8f, 0.2f, 0.0f  },
+    { 0.1f, 0.0f, 0.7f, 0.1f  },
+    { 0.0f, 0.0f, 0.0f, 1.0f  },
+  };
+  Matrix44 xm =
+  {
+    { 1.3f, 0.4f, 0.0f, 0.1f },
+    { -0.2f,0.9f, 0.0f, 0.3f },
+    { 0.0f, 0.0f, 1.0f, 0.0f },
+    { 0.0f, 0.0f, 0.0f, 1.0f },
+  };
+
+  printf("\n");
+  BenchOp("ColorMatrixXform",[&](GenTexture &out) { out.ColorMatrixTransform(src,cm,sTRUE); });
+  BenchOp("CoordMatrixXform",[&](GenTexture &out) { out.CoordMatrixTransform(src,xm,GenTexture::FilterBilinear); });
+  BenchOp("Blur",[&](GenTexture &out) { out.Blur(src,0.01f,0.01f,2,0); });
+
+  delete[] SrcA;
+  delete[] SrcB;
+  delete[] Dest;
+  delete[] Ref;
+
+  if(Mismatch)
+  {
+    printf("\nresults marked with ! differ from the scalar code!\n");
+    return 1;
+  }
+
+  return 0;
+}
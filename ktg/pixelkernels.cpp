@@ -0,0 +1,783 @@
+/****************************************************************************/
+/***                                                                      ***/
+/***   Written by Fabian Giesen.                                          ***/
+/***   I hereby place this code in the public domain.                     ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// Vectorized versions of the pixel kernels. Pixels are 4x16 bits, so one
+// SSE register holds 2 pixels and one AVX2 register 4. All kernels do the
+// exact same integer math as the scalar code in gentexture.cpp (usually
+// rearranged so it fits into 16- or 32-bit lanes); the comments explain why
+// the results are identical.
+
+#include "pixelkernels.hpp"
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+  #define KERNELS_X86
+#endif
+
+#if defined(KERNELS_X86) && (!defined(_MSC_VER) || _MSC_VER >= 1800)
+  #define KERNELS_AVX2 // compiler knows about AVX2 intrinsics
+#endif
+
+#ifdef KERNELS_X86
+
+#include <emmintrin.h>
+#ifdef KERNELS_AVX2
+  #include <immintrin.h>
+#endif
+
+#ifdef _MSC_VER
+  #include <intrin.h>
+#else
+  #include <cpuid.h>
+#endif
+
+// GCC and Clang only emit instructions the target allows, so functions using
+// newer instruction sets need to say so (the rest of the code stays
+// runnable on older CPUs). SSE2 is always there on x64.
+#if defined(__GNUC__) && !defined(__SSE2__)
+  #define sTARGET_SSE2  __attribute__((target("sse2")))
+#else
+  #define sTARGET_SSE2
+#endif
+
+#if defined(__GNUC__) && !defined(__AVX2__)
+  #define sTARGET_AVX2  __attribute__((target("avx2")))
+#else
+  #define sTARGET_AVX2
+#endif
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   CPU detection                                                      ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+static void CpuId(sU32 regs[4],sU32 leaf,sU32 subleaf)
+{
+#ifdef _MSC_VER
+  int r[4];
+  __cpuidex(r,leaf,subleaf);
+  for(sInt i=0;i<4;i++)
+    regs[i] = r[i];
+#else
+  __cpuid_count(leaf,subleaf,regs[0],regs[1],regs[2],regs[3]);
+#endif
+}
+
+static sU64 XGetBV(sU32 index)
+{
+#ifdef _MSC_VER
+  return _xgetbv(index);
+#else
+  sU32 lo,hi;
+  __asm__ __volatile__("xgetbv" : "=a"(lo),"=d"(hi) : "c"(index));
+  return lo | (sU64(hi) << 32);
+#endif
+}
+
+sInt DetectKernelSet()
+{
+  sU32 regs[4]; // eax,ebx,ecx,edx
+
+  CpuId(regs,0,0);
+  sU32 maxLeaf = regs[0];
+
+  CpuId(regs,1,0);
+  if(!(regs[3] & (1 << 26))) // no SSE2
+    return KernelsScalar;
+
+  // AVX2 needs CPU support (AVX+AVX2) and the OS saving YMM registers
+  sBool osxsave = (regs[2] & (1 << 27)) != 0;
+  sBool avx = (regs[2] & (1 << 28)) != 0;
+
+#ifdef KERNELS_AVX2
+  if(maxLeaf >= 7 && osxsave && avx && (XGetBV(0) & 6) == 6)
+  {
+    CpuId(regs,7,0);
+    if(regs[1] & (1 << 5))
+      return KernelsAVX2;
+  }
+#else
+  (void) maxLeaf;
+  (void) osxsave;
+  (void) avx;
+#endif
+
+  return KernelsSSE2;
+}
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Helpers                                                            ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// Wrap computation on pixel coordinates (same as in gentexture.cpp)
+static sInt WrapCoord(sInt x,sInt width,sInt mode)
+{
+  if(mode == 0) // wrap
+  {
+    if((width & (width - 1)) == 0)
+      return x & (width - 1);
+
+    x %= width;
+    return (x < 0) ? x + width : x;
+  }
+  else
+    return sClamp(x,0,width-1);
+}
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   SSE2                                                               ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// Takes the high 16 bits of all 32-bit lanes in a,b (in order).
+// The arithmetic shift makes the values fit into signed 16 bits, so the
+// saturating pack just reassembles the original bit patterns.
+sTARGET_SSE2 static __m128i PackHigh16(__m128i a,__m128i b)
+{
+  return _mm_packs_epi32(_mm_srai_epi32(a,16),_mm_srai_epi32(b,16));
+}
+
+// Same for the low 16 bits (i.e. truncation to sU16)
+sTARGET_SSE2 static __m128i PackLow16(__m128i a,__m128i b)
+{
+  a = _mm_srai_epi32(_mm_slli_epi32(a,16),16);
+  b = _mm_srai_epi32(_mm_slli_epi32(b,16),16);
+  return _mm_packs_epi32(a,b);
+}
+
+// Broadcast alpha of both pixels to all 4 channels
+sTARGET_SSE2 static __m128i SplatAlpha(__m128i x)
+{
+  return _mm_shufflehi_epi16(_mm_shufflelo_epi16(x,0xff),0xff);
+}
+
+// Low 32 bits of 32x32 products (SSE2 has no pmulld)
+sTARGET_SSE2 static __m128i MulLo32(__m128i a,__m128i b)
+{
+  __m128i even = _mm_mul_epu32(a,b);
+  __m128i odd = _mm_mul_epu32(_mm_srli_epi64(a,32),_mm_srli_epi64(b,32));
+  return _mm_unpacklo_epi32(_mm_shuffle_epi32(even,_MM_SHUFFLE(0,0,2,0)),_mm_shuffle_epi32(odd,_MM_SHUFFLE(0,0,2,0)));
+}
+
+// MulIntens on 8 lanes: x=a*b+0x8000, (x + (x >> 16)) >> 16.
+// x stays below 2^32, so 32-bit lanes are exact.
+sTARGET_SSE2 static __m128i MulIntens16(__m128i a,__m128i b)
+{
+  __m128i lo = _mm_mullo_epi16(a,b);
+  __m128i hi = _mm_mulhi_epu16(a,b);
+  __m128i bias = _mm_set1_epi32(0x8000);
+
+  __m128i x0 = _mm_add_epi32(_mm_unpacklo_epi16(lo,hi),bias);
+  __m128i x1 = _mm_add_epi32(_mm_unpackhi_epi16(lo,hi),bias);
+  x0 = _mm_add_epi32(x0,_mm_srli_epi32(x0,16));
+  x1 = _mm_add_epi32(x1,_mm_srli_epi32(x1,16));
+
+  return PackHigh16(x0,x1);
+}
+
+// Lerp on 8 lanes, t=0..65535 in all lanes.
+// a + ((t*(b-a)) >> 16) == ((a << 16) + t*b - t*a) >> 16, and the value
+// before the shift is in [0,2^32), so it can be computed mod 2^32.
+sTARGET_SSE2 static __m128i Lerp16(__m128i a,__m128i b,__m128i t)
+{
+  __m128i zero = _mm_setzero_si128();
+  __m128i tbLo = _mm_mullo_epi16(b,t);
+  __m128i tbHi = _mm_mulhi_epu16(b,t);
+  __m128i taLo = _mm_mullo_epi16(a,t);
+  __m128i taHi = _mm_mulhi_epu16(a,t);
+
+  __m128i x0 = _mm_unpacklo_epi16(zero,a);
+  __m128i x1 = _mm_unpackhi_epi16(zero,a);
+  x0 = _mm_sub_epi32(_mm_add_epi32(x0,_mm_unpacklo_epi16(tbLo,tbHi)),_mm_unpacklo_epi16(taLo,taHi));
+  x1 = _mm_sub_epi32(_mm_add_epi32(x1,_mm_unpackhi_epi16(tbLo,tbHi)),_mm_unpackhi_epi16(taLo,taHi));
+
+  return PackHigh16(x0,x1);
+}
+
+// ---- Composite
+
+sTARGET_SSE2 static void CompositeAddSSE2(Pixel *dst,const Pixel *src,sInt count)
+{
+  sInt i;
+
+  for(i=0;i+2<=count;i+=2)
+  {
+    __m128i d = _mm_loadu_si128((const __m128i *) &dst[i]);
+    __m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+    _mm_storeu_si128((__m128i *) &dst[i],_mm_adds_epu16(d,s));
+  }
+
+  for(;i<count;i++)
+    dst[i].CompositeAdd(src[i]);
+}
+
+sTARGET_SSE2 static void CompositeMulCSSE2(Pixel *dst,const Pixel *src,sInt count)
+{
+  sInt i;
+
+  for(i=0;i+2<=count;i+=2)
+  {
+    __m128i d = _mm_loadu_si128((const __m128i *) &dst[i]);
+    __m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+    _mm_storeu_si128((__m128i *) &dst[i],MulIntens16(d,s));
+  }
+
+  for(;i<count;i++)
+    dst[i].CompositeMulC(src[i]);
+}
+
+sTARGET_SSE2 static void CompositeROverSSE2(Pixel *dst,const Pixel *src,sInt count)
+{
+  __m128i ones = _mm_set1_epi32(-1);
+  sInt i;
+
+  for(i=0;i+2<=count;i+=2)
+  {
+    __m128i d = _mm_loadu_si128((const __m128i *) &dst[i]);
+    __m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+    __m128i transIn = _mm_xor_si128(SplatAlpha(s),ones); // 65535 - s.a
+
+    // sums wrap around just like the sU16 stores in Pixel::CompositeROver
+    _mm_storeu_si128((__m128i *) &dst[i],_mm_add_epi16(MulIntens16(transIn,d),s));
+  }
+
+  for(;i<count;i++)
+    dst[i].CompositeROver(src[i]);
+}
+
+sTARGET_SSE2 static void CompositeScreenSSE2(Pixel *dst,const Pixel *src,sInt count)
+{
+  __m128i ones = _mm_set1_epi32(-1);
+  sInt i;
+
+  for(i=0;i+2<=count;i+=2)
+  {
+    __m128i d = _mm_loadu_si128((const __m128i *) &dst[i]);
+    __m128i s = _mm_loadu_si128((const __m128i *) &src[i]);
+    _mm_storeu_si128((__m128i *) &dst[i],_mm_add_epi16(d,MulIntens16(s,_mm_xor_si128(d,ones))));
+  }
+
+  for(;i<count;i++)
+    dst[i].CompositeScreen(src[i]);
+}
+
+// ---- Lerp/sampling
+
+sTARGET_SSE2 static void LerpSSE2(Pixel *dst,const Pixel *x,const Pixel *y,sInt t,sInt count)
+{
+  sInt i = 0;
+
+  if(t >= 0 && t < 65536) // t=65536 doesn't fit into 16 bits, use the scalar code
+  {
+    __m128i vt = _mm_set1_epi16((short) t);
+
+    for(;i+2<=count;i+=2)
+    {
+      __m128i a = _mm_loadu_si128((const __m128i *) &x[i]);
+      __m128i b = _mm_loadu_si128((const __m128i *) &y[i]);
+      _mm_storeu_si128((__m128i *) &dst[i],Lerp16(a,b,vt));
+    }
+  }
+
+  for(;i<count;i++)
+    dst[i].Lerp(t,x[i],y[i]);
+}
+
+// Both horizontal lerps in one go, then the vertical one.
+sTARGET_SSE2 static void SampleBilinearSSE2(Pixel &result,const Pixel *row0,const Pixel *row1,sInt x0,sInt x1,sInt fx,sInt fy)
+{
+  __m128i a = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) &row0[x0]),_mm_loadl_epi64((const __m128i *) &row1[x0]));
+  __m128i b = _mm_unpacklo_epi64(_mm_loadl_epi64((const __m128i *) &row0[x1]),_mm_loadl_epi64((const __m128i *) &row1[x1]));
+  __m128i t = Lerp16(a,b,_mm_set1_epi16((short) fx));
+  __m128i r = Lerp16(t,_mm_unpackhi_epi64(t,t),_mm_set1_epi16((short) fy));
+
+  _mm_storel_epi64((__m128i *) &result,r);
+}
+
+// ---- Color matrix
+
+// The matrix coefficients m (16.16 fixed point, |m| < 128) are split into
+// m = mh*65536 + ml with 0<=ml<65536. Then
+//   MulShift16(m,c) = mh*c + ((ml*c + 0x8000) >> 16)
+// exactly. The second term is computed with 16-bit multiplies; for the
+// first one, c is split into bytes so all partial products fit in 16 bits.
+struct ColorMatrixSSE2Coeffs
+{
+  __m128i ML[4];    // ml[i][j] for fixed j, i in lanes (both pixels)
+  __m128i MH[4];    // mh[i][j] likewise
+};
+
+sTARGET_SSE2 static void ColorMatrixSetupSSE2(ColorMatrixSSE2Coeffs &c,const sInt m[4][4])
+{
+  for(sInt j=0;j<4;j++)
+  {
+    c.ML[j] = _mm_setr_epi16(m[0][j] & 0xffff,m[1][j] & 0xffff,m[2][j] & 0xffff,m[3][j] & 0xffff,
+                             m[0][j] & 0xffff,m[1][j] & 0xffff,m[2][j] & 0xffff,m[3][j] & 0xffff);
+    c.MH[j] = _mm_setr_epi16(m[0][j] >> 16,m[1][j] >> 16,m[2][j] >> 16,m[3][j] >> 16,
+                             m[0][j] >> 16,m[1][j] >> 16,m[2][j] >> 16,m[3][j] >> 16);
+  }
+}
+
+// acc0/acc1 (pixel 0/1, 32-bit lanes) += MulShift16(m[i][j],cj)
+sTARGET_SSE2 static void ColorMatrixTermSSE2(__m128i &acc0,__m128i &acc1,__m128i cj,__m128i ml,__m128i mh)
+{
+  __m128i zero = _mm_setzero_si128();
+
+  // (ml*c + 0x8000) >> 16 = hi16(ml*c) + (lo16(ml*c) >> 15)
+  __m128i low = _mm_add_epi16(_mm_mulhi_epu16(ml,cj),_mm_srli_epi16(_mm_mullo_epi16(ml,cj),15));
+  acc0 = _mm_add_epi32(acc0,_mm_unpacklo_epi16(low,zero));
+  acc1 = _mm_add_epi32(acc1,_mm_unpackhi_epi16(low,zero));
+
+  // mh*c = ((mh*(c >> 8)) << 8) + mh*(c & 255)
+  __m128i ph = _mm_mullo_epi16(mh,_mm_srli_epi16(cj,8));
+  __m128i pl = _mm_mullo_epi16(mh,_mm_and_si128(cj,_mm_set1_epi16(0xff)));
+  __m128i h0 = _mm_add_epi32(_mm_slli_epi32(_mm_srai_epi32(_mm_unpacklo_epi16(ph,ph),16),8),_mm_srai_epi32(_mm_unpacklo_epi16(pl,pl),16));
+  __m128i h1 = _mm_add_epi32(_mm_slli_epi32(_mm_srai_epi32(_mm_unpackhi_epi16(ph,ph),16),8),_mm_srai_epi32(_mm_unpackhi_epi16(pl,pl),16));
+  acc0 = _mm_add_epi32(acc0,h0);
+  acc1 = _mm_add_epi32(acc1,h1);
+}
+
+sTARGET_SSE2 static __m128i ColorMatrix2SSE2(__m128i in,const ColorMatrixSSE2Coeffs &c,sBool clampPremult)
+{
+  __m128i acc0 = _mm_setzero_si128();
+  __m128i acc1 = _mm_setzero_si128();
+
+  ColorMatrixTermSSE2(acc0,acc1,_mm_shufflehi_epi16(_mm_shufflelo_epi16(in,0x00),0x00),c.ML[0],c.MH[0]);
+  ColorMatrixTermSSE2(acc0,acc1,_mm_shufflehi_epi16(_mm_shufflelo_epi16(in,0x55),0x55),c.ML[1],c.MH[1]);
+  ColorMatrixTermSSE2(acc0,acc1,_mm_shufflehi_epi16(_mm_shufflelo_epi16(in,0xaa),0xaa),c.ML[2],c.MH[2]);
+  ColorMatrixTermSSE2(acc0,acc1,_mm_shufflehi_epi16(_mm_shufflelo_epi16(in,0xff),0xff),c.ML[3],c.MH[3]);
+
+  // clamp to [0,65535]: bias by -32768, saturate to signed 16 bits
+  __m128i bias = _mm_set1_epi32(32768);
+  __m128i out = _mm_packs_epi32(_mm_sub_epi32(acc0,bias),_mm_sub_epi32(acc1,bias));
+
+  // clamp r,g,b to [0,a] (biased values compare just like unbiased ones)
+  if(clampPremult)
+    out = _mm_min_epi16(out,SplatAlpha(out));
+
+  return _mm_xor_si128(out,_mm_set1_epi16(-32768));
+}
+
+sTARGET_SSE2 static void ColorMatrixSSE2(Pixel *out,const Pixel *in,sInt count,const sInt m[4][4],sBool clampPremult)
+{
+  ColorMatrixSSE2Coeffs c;
+  ColorMatrixSetupSSE2(c,m);
+
+  sInt i;
+  for(i=0;i+2<=count;i+=2)
+  {
+    __m128i v = _mm_loadu_si128((const __m128i *) &in[i]);
+    _mm_storeu_si128((__m128i *) &out[i],ColorMatrix2SSE2(v,c,clampPremult));
+  }
+
+  if(i<count) // one pixel left
+  {
+    __m128i v = _mm_loadl_epi64((const __m128i *) &in[i]);
+    _mm_storel_epi64((__m128i *) &out[i],ColorMatrix2SSE2(v,c,clampPremult));
+  }
+}
+
+// ---- Blur
+
+// Load one pixel, expand channels to 32 bits
+sTARGET_SSE2 static __m128i LoadPixel32(const Pixel *p)
+{
+  return _mm_unpacklo_epi16(_mm_loadl_epi64((const __m128i *) p),_mm_setzero_si128());
+}
+
+// Unsigned 32-bit division by going through doubles. For a,d < 2^32 the
+// correctly rounded a/d never crosses an integer boundary (the distance to
+// the next integer is at least 1/d, more than half an ulp), so truncation
+// gives exactly a/d.
+sTARGET_SSE2 static __m128i DivU32SSE2(__m128i x,__m128d denom)
+{
+  __m128i xs = _mm_xor_si128(x,_mm_set1_epi32(0x80000000));
+  __m128d offs = _mm_set1_pd(2147483648.0);
+  __m128d lo = _mm_add_pd(_mm_cvtepi32_pd(xs),offs);
+  __m128d hi = _mm_add_pd(_mm_cvtepi32_pd(_mm_shuffle_epi32(xs,_MM_SHUFFLE(1,0,3,2))),offs);
+
+  lo = _mm_div_pd(lo,denom);
+  hi = _mm_div_pd(hi,denom);
+
+  return _mm_unpacklo_epi64(_mm_cvttpd_epi32(lo),_mm_cvttpd_epi32(hi));
+}
+
+// Same structure as Blur1DScalar, with the 4 channel accumulators in one register.
+sTARGET_SSE2 static void Blur1DSSE2(Pixel *dst,const Pixel *src,sInt width,sInt sizeFixed,sInt wrapMode)
+{
+  sVERIFY(sizeFixed > 32); // kernel should be wider than one pixel
+  sInt frac = (sizeFixed - 32) & 63;
+  sInt offset = (sizeFixed + 32) >> 6;
+
+  sVERIFY(((offset - 1) * 64 + frac + 32) == sizeFixed);
+  sU32 denom = sizeFixed * 2;
+  sU32 bias = denom / 2;
+
+  __m128i vfrac = _mm_set1_epi32(frac);
+  __m128i accu;
+
+  // initialize accumulators
+  if(wrapMode == 0) // wrap around
+  {
+    // leftmost and rightmost pixels (the partially covered ones)
+    sInt xl = WrapCoord(-offset,width,wrapMode);
+    sInt xr = WrapCoord(offset,width,wrapMode);
+    accu = MulLo32(vfrac,_mm_add_epi32(LoadPixel32(&src[xl]),LoadPixel32(&src[xr])));
+    accu = _mm_add_epi32(accu,_mm_set1_epi32(bias));
+
+    // inner part of filter kernel
+    for(sInt x=-offset+1;x<=offset-1;x++)
+      accu = _mm_add_epi32(accu,_mm_slli_epi32(LoadPixel32(&src[WrapCoord(x,width,wrapMode)]),6));
+  }
+  else // clamp on edge
+  {
+    // on the left edge, the first pixel is repeated over and over
+    accu = MulLo32(_mm_set1_epi32(sizeFixed + 32),LoadPixel32(&src[0]));
+    accu = _mm_add_epi32(accu,_mm_set1_epi32(bias));
+
+    // rightmost pixel
+    sInt xr = WrapCoord(offset,width,wrapMode);
+    accu = _mm_add_epi32(accu,MulLo32(vfrac,LoadPixel32(&src[xr])));
+
+    // inner part of filter kernel (the right half)
+    for(sInt x=1;x<=offset-1;x++)
+      accu = _mm_add_epi32(accu,_mm_slli_epi32(LoadPixel32(&src[WrapCoord(x,width,wrapMode)]),6));
+  }
+
+  // generate output pixels
+  __m128d vdenom = _mm_set1_pd(denom);
+
+  for(sInt x=0;x<width;x++)
+  {
+    // write out state of accumulator
+    __m128i q = DivU32SSE2(accu,vdenom);
+    _mm_storel_epi64((__m128i *) &dst[x],PackLow16(q,q));
+
+    // update accumulator
+    __m128i l0 = LoadPixel32(&src[WrapCoord(x-offset+0,width,wrapMode)]);
+    __m128i l1 = LoadPixel32(&src[WrapCoord(x-offset+1,width,wrapMode)]);
+    __m128i r0 = LoadPixel32(&src[WrapCoord(x+offset+0,width,wrapMode)]);
+    __m128i r1 = LoadPixel32(&src[WrapCoord(x+offset+1,width,wrapMode)]);
+
+    __m128i edge = _mm_add_epi32(_mm_sub_epi32(r1,_mm_add_epi32(r0,l0)),l1);
+    accu = _mm_add_epi32(accu,_mm_slli_epi32(_mm_sub_epi32(r0,l1),6));
+    accu = _mm_add_epi32(accu,MulLo32(vfrac,edge));
+  }
+}
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   AVX2                                                               ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+// Mostly the SSE2 kernels with twice the width. All the 16/32-bit
+// unpack/pack operations work within 128-bit lanes, so pixel order is
+// preserved just as in the SSE2 versions.
+
+#ifdef KERNELS_AVX2
+
+sTARGET_AVX2 static __m256i PackHigh16AVX2(__m256i a,__m256i b)
+{
+  return _mm256_packs_epi32(_mm256_srai_epi32(a,16),_mm256_srai_epi32(b,16));
+}
+
+sTARGET_AVX2 static __m256i SplatAlphaAVX2(__m256i x)
+{
+  return _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(x,0xff),0xff);
+}
+
+sTARGET_AVX2 static __m256i MulIntens16AVX2(__m256i a,__m256i b)
+{
+  __m256i lo = _mm256_mullo_epi16(a,b);
+  __m256i hi = _mm256_mulhi_epu16(a,b);
+  __m256i bias = _mm256_set1_epi32(0x8000);
+
+  __m256i x0 = _mm256_add_epi32(_mm256_unpacklo_epi16(lo,hi),bias);
+  __m256i x1 = _mm256_add_epi32(_mm256_unpackhi_epi16(lo,hi),bias);
+  x0 = _mm256_add_epi32(x0,_mm256_srli_epi32(x0,16));
+  x1 = _mm256_add_epi32(x1,_mm256_srli_epi32(x1,16));
+
+  return PackHigh16AVX2(x0,x1);
+}
+
+sTARGET_AVX2 static __m256i Lerp16AVX2(__m256i a,__m256i b,__m256i t)
+{
+  __m256i zero = _mm256_setzero_si256();
+  __m256i tbLo = _mm256_mullo_epi16(b,t);
+  __m256i tbHi = _mm256_mulhi_epu16(b,t);
+  __m256i taLo = _mm256_mullo_epi16(a,t);
+  __m256i taHi = _mm256_mulhi_epu16(a,t);
+
+  __m256i x0 = _mm256_unpacklo_epi16(zero,a);
+  __m256i x1 = _mm256_unpackhi_epi16(zero,a);
+  x0 = _mm256_sub_epi32(_mm256_add_epi32(x0,_mm256_unpacklo_epi16(tbLo,tbHi)),_mm256_unpacklo_epi16(taLo,taHi));
+  x1 = _mm256_sub_epi32(_mm256_add_epi32(x1,_mm256_unpackhi_epi16(tbLo,tbHi)),_mm256_unpackhi_epi16(taLo,taHi));
+
+  return PackHigh16AVX2(x0,x1);
+}
+
+// ---- Composite (4 pixels at a time, SSE2 for the rest)
+
+sTARGET_AVX2 static void CompositeAddAVX2(Pixel *dst,const Pixel *src,sInt count)
+{
+  sInt i;
+
+  for(i=0;i+4<=count;i+=4)
+  {
+    __m256i d = _mm256_loadu_si256((const __m256i *) &dst[i]);
+    __m256i s = _mm256_loadu_si256((const __m256i *) &src[i]);
+    _mm256_storeu_si256((__m256i *) &dst[i],_mm256_adds_epu16(d,s));
+  }
+
+  CompositeAddSSE2(dst+i,src+i,count-i);
+}
+
+sTARGET_AVX2 static void CompositeMulCAVX2(Pixel *dst,const Pixel *src,sInt count)
+{
+  sInt i;
+
+  for(i=0;i+4<=count;i+=4)
+  {
+    __m256i d = _mm256_loadu_si256((const __m256i *) &dst[i]);
+    __m256i s = _mm256_loadu_si256((const __m256i *) &src[i]);
+    _mm256_storeu_si256((__m256i *) &dst[i],MulIntens16AVX2(d,s));
+  }
+
+  CompositeMulCSSE2(dst+i,src+i,count-i);
+}
+
+sTARGET_AVX2 static void CompositeROverAVX2(Pixel *dst,const Pixel *src,sInt count)
+{
+  __m256i ones = _mm256_set1_epi32(-1);
+  sInt i;
+
+  for(i=0;i+4<=count;i+=4)
+  {
+    __m256i d = _mm256_loadu_si256((const __m256i *) &dst[i]);
+    __m256i s = _mm256_loadu_si256((const __m256i *) &src[i]);
+    __m256i transIn = _mm256_xor_si256(SplatAlphaAVX2(s),ones);
+    _mm256_storeu_si256((__m256i *) &dst[i],_mm256_add_epi16(MulIntens16AVX2(transIn,d),s));
+  }
+
+  CompositeROverSSE2(dst+i,src+i,count-i);
+}
+
+sTARGET_AVX2 static void CompositeScreenAVX2(Pixel *dst,const Pixel *src,sInt count)
+{
+  __m256i ones = _mm256_set1_epi32(-1);
+  sInt i;
+
+  for(i=0;i+4<=count;i+=4)
+  {
+    __m256i d = _mm256_loadu_si256((const __m256i *) &dst[i]);
+    __m256i s = _mm256_loadu_si256((const __m256i *) &src[i]);
+    _mm256_storeu_si256((__m256i *) &dst[i],_mm256_add_epi16(d,MulIntens16AVX2(s,_mm256_xor_si256(d,ones))));
+  }
+
+  CompositeScreenSSE2(dst+i,src+i,count-i);
+}
+
+sTARGET_AVX2 static void LerpAVX2(Pixel *dst,const Pixel *x,const Pixel *y,sInt t,sInt count)
+{
+  sInt i = 0;
+
+  if(t >= 0 && t < 65536)
+  {
+    __m256i vt = _mm256_set1_epi16((short) t);
+
+    for(;i+4<=count;i+=4)
+    {
+      __m256i a = _mm256_loadu_si256((const __m256i *) &x[i]);
+      __m256i b = _mm256_loadu_si256((const __m256i *) &y[i]);
+      _mm256_storeu_si256((__m256i *) &dst[i],Lerp16AVX2(a,b,vt));
+    }
+  }
+
+  LerpSSE2(dst+i,x+i,y+i,t,count-i);
+}
+
+// ---- Color matrix (see the SSE2 version for the math)
+
+sTARGET_AVX2 static void ColorMatrixTermAVX2(__m256i &acc0,__m256i &acc1,__m256i cj,__m256i ml,__m256i mh)
+{
+  __m256i zero = _mm256_setzero_si256();
+
+  __m256i low = _mm256_add_epi16(_mm256_mulhi_epu16(ml,cj),_mm256_srli_epi16(_mm256_mullo_epi16(ml,cj),15));
+  acc0 = _mm256_add_epi32(acc0,_mm256_unpacklo_epi16(low,zero));
+  acc1 = _mm256_add_epi32(acc1,_mm256_unpackhi_epi16(low,zero));
+
+  __m256i ph = _mm256_mullo_epi16(mh,_mm256_srli_epi16(cj,8));
+  __m256i pl = _mm256_mullo_epi16(mh,_mm256_and_si256(cj,_mm256_set1_epi16(0xff)));
+  __m256i h0 = _mm256_add_epi32(_mm256_slli_epi32(_mm256_srai_epi32(_mm256_unpacklo_epi16(ph,ph),16),8),_mm256_srai_epi32(_mm256_unpacklo_epi16(pl,pl),16));
+  __m256i h1 = _mm256_add_epi32(_mm256_slli_epi32(_mm256_srai_epi32(_mm256_unpackhi_epi16(ph,ph),16),8),_mm256_srai_epi32(_mm256_unpackhi_epi16(pl,pl),16));
+  acc0 = _mm256_add_epi32(acc0,h0);
+  acc1 = _mm256_add_epi32(acc1,h1);
+}
+
+sTARGET_AVX2 static void ColorMatrixAVX2(Pixel *out,const Pixel *in,sInt count,const sInt m[4][4],sBool clampPremult)
+{
+  __m256i ML[4],MH[4];
+
+  for(sInt j=0;j<4;j++)
+  {
+    ML[j] = _mm256_setr_epi16(m[0][j] & 0xffff,m[1][j] & 0xffff,m[2][j] & 0xffff,m[3][j] & 0xffff,
+                              m[0][j] & 0xffff,m[1][j] & 0xffff,m[2][j] & 0xffff,m[3][j] & 0xffff,
+                              m[0][j] & 0xffff,m[1][j] & 0xffff,m[2][j] & 0xffff,m[3][j] & 0xffff,
+                              m[0][j] & 0xffff,m[1][j] & 0xffff,m[2][j] & 0xffff,m[3][j] & 0xffff);
+    MH[j] = _mm256_setr_epi16(m[0][j] >> 16,m[1][j] >> 16,m[2][j] >> 16,m[3][j] >> 16,
+                              m[0][j] >> 16,m[1][j] >> 16,m[2][j] >> 16,m[3][j] >> 16,
+                              m[0][j] >> 16,m[1][j] >> 16,m[2][j] >> 16,m[3][j] >> 16,
+                              m[0][j] >> 16,m[1][j] >> 16,m[2][j] >> 16,m[3][j] >> 16);
+  }
+
+  __m256i bias = _mm256_set1_epi32(32768);
+  __m256i sign = _mm256_set1_epi16(-32768);
+  sInt i;
+
+  for(i=0;i+4<=count;i+=4)
+  {
+    __m256i v = _mm256_loadu_si256((const __m256i *) &in[i]);
+    __m256i acc0 = _mm256_setzero_si256();
+    __m256i acc1 = _mm256_setzero_si256();
+
+    ColorMatrixTermAVX2(acc0,acc1,_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v,0x00),0x00),ML[0],MH[0]);
+    ColorMatrixTermAVX2(acc0,acc1,_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v,0x55),0x55),ML[1],MH[1]);
+    ColorMatrixTermAVX2(acc0,acc1,_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v,0xaa),0xaa),ML[2],MH[2]);
+    ColorMatrixTermAVX2(acc0,acc1,_mm256_shufflehi_epi16(_mm256_shufflelo_epi16(v,0xff),0xff),ML[3],MH[3]);
+
+    __m256i res = _mm256_packs_epi32(_mm256_sub_epi32(acc0,bias),_mm256_sub_epi32(acc1,bias));
+    if(clampPremult)
+      res = _mm256_min_epi16(res,SplatAlphaAVX2(res));
+
+    _mm256_storeu_si256((__m256i *) &out[i],_mm256_xor_si256(res,sign));
+  }
+
+  ColorMatrixSSE2(out+i,in+i,count-i,m,clampPremult);
+}
+
+// ---- Blur (SSE2 structure, but AVX does the 4 divisions in one go)
+
+sTARGET_AVX2 static __m128i DivU32AVX2(__m128i x,__m256d denom)
+{
+  __m128i xs = _mm_xor_si128(x,_mm_set1_epi32(0x80000000));
+  __m256d v = _mm256_add_pd(_mm256_cvtepi32_pd(xs),_mm256_set1_pd(2147483648.0));
+
+  return _mm256_cvttpd_epi32(_mm256_div_pd(v,denom));
+}
+
+sTARGET_AVX2 static __m128i LoadPixel32AVX2(const Pixel *p)
+{
+  return _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i *) p));
+}
+
+sTARGET_AVX2 static void Blur1DAVX2(Pixel *dst,const Pixel *src,sInt width,sInt sizeFixed,sInt wrapMode)
+{
+  sVERIFY(sizeFixed > 32); // kernel should be wider than one pixel
+  sInt frac = (sizeFixed - 32) & 63;
+  sInt offset = (sizeFixed + 32) >> 6;
+
+  sVERIFY(((offset - 1) * 64 + frac + 32) == sizeFixed);
+  sU32 denom = sizeFixed * 2;
+  sU32 bias = denom / 2;
+
+  __m128i vfrac = _mm_set1_epi32(frac);
+  __m128i accu;
+
+  // initialize accumulators
+  if(wrapMode == 0) // wrap around
+  {
+    sInt xl = WrapCoord(-offset,width,wrapMode);
+    sInt xr = WrapCoord(offset,width,wrapMode);
+    accu = _mm_mullo_epi32(vfrac,_mm_add_epi32(LoadPixel32AVX2(&src[xl]),LoadPixel32AVX2(&src[xr])));
+    accu = _mm_add_epi32(accu,_mm_set1_epi32(bias));
+
+    for(sInt x=-offset+1;x<=offset-1;x++)
+      accu = _mm_add_epi32(accu,_mm_slli_epi32(LoadPixel32AVX2(&src[WrapCoord(x,width,wrapMode)]),6));
+  }
+  else // clamp on edge
+  {
+    accu = _mm_mullo_epi32(_mm_set1_epi32(sizeFixed + 32),LoadPixel32AVX2(&src[0]));
+    accu = _mm_add_epi32(accu,_mm_set1_epi32(bias));
+
+    sInt xr = WrapCoord(offset,width,wrapMode);
+    accu = _mm_add_epi32(accu,_mm_mullo_epi32(vfrac,LoadPixel32AVX2(&src[xr])));
+
+    for(sInt x=1;x<=offset-1;x++)
+      accu = _mm_add_epi32(accu,_mm_slli_epi32(LoadPixel32AVX2(&src[WrapCoord(x,width,wrapMode)]),6));
+  }
+
+  // generate output pixels
+  __m256d vdenom = _mm256_set1_pd(denom);
+
+  for(sInt x=0;x<width;x++)
+  {
+    __m128i q = DivU32AVX2(accu,vdenom);
+    q = _mm_and_si128(q,_mm_set1_epi32(0xffff)); // truncate to sU16
+    _mm_storel_epi64((__m128i *) &dst[x],_mm_packus_epi32(q,q));
+
+    __m128i l0 = LoadPixel32AVX2(&src[WrapCoord(x-offset+0,width,wrapMode)]);
+    __m128i l1 = LoadPixel32AVX2(&src[WrapCoord(x-offset+1,width,wrapMode)]);
+    __m128i r0 = LoadPixel32AVX2(&src[WrapCoord(x+offset+0,width,wrapMode)]);
+    __m128i r1 = LoadPixel32AVX2(&src[WrapCoord(x+offset+1,width,wrapMode)]);
+
+    __m128i edge = _mm_add_epi32(_mm_sub_epi32(r1,_mm_add_epi32(r0,l0)),l1);
+    accu = _mm_add_epi32(accu,_mm_slli_epi32(_mm_sub_epi32(r0,l1),6));
+    accu = _mm_add_epi32(accu,_mm_mullo_epi32(vfrac,edge));
+  }
+}
+
+#endif // KERNELS_AVX2
+
+/****************************************************************************/
+
+void InitKernelsSSE2(PixelKernels &k)
+{
+  k.CompositeAdd = CompositeAddSSE2;
+  k.CompositeMulC = CompositeMulCSSE2;
+  k.CompositeROver = CompositeROverSSE2;
+  k.CompositeScreen = CompositeScreenSSE2;
+  k.Lerp = LerpSSE2;
+  k.SampleBilinear = SampleBilinearSSE2;
+  k.ColorMatrix = ColorMatrixSSE2;
+  k.Blur1D = Blur1DSSE2;
+}
+
+void InitKernelsAVX2(PixelKernels &k)
+{
+#ifdef KERNELS_AVX2
+  k.CompositeAdd = CompositeAddAVX2;
+  k.CompositeMulC = CompositeMulCAVX2;
+  k.CompositeROver = CompositeROverAVX2;
+  k.CompositeScreen = CompositeScreenAVX2;
+  k.Lerp = LerpAVX2;
+  k.ColorMatrix = ColorMatrixAVX2;
+  k.Blur1D = Blur1DAVX2;
+#endif
+}
+
+#else // !KERNELS_X86
+
+// No vectorized kernels for other architectures (yet).
+
+sInt DetectKernelSet()
+{
+  return KernelsScalar;
+}
+
+void InitKernelsSSE2(PixelKernels &k)
+{
+}
+
+void InitKernelsAVX2(PixelKernels &k)
+{
+}
+
+#endif
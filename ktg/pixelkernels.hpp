@@ -0,0 +1,63 @@
+/****************************************************************************/
+/***                                                                      ***/
+/***   Written by Fabian Giesen.                                          ***/
+/***   I hereby place this code in the public domain.                     ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+#ifndef __TP_PIXELKERNELS_HPP_
+#define __TP_PIXELKERNELS_HPP_
+
+#include "gentexture.hpp"
+
+// Kernel sets. Every set computes exactly the same results as the scalar
+// reference code, they only differ in speed.
+enum KernelSet
+{
+  KernelsScalar = 0,    // plain C++ (reference implementation)
+  KernelsSSE2,          // SSE2 (2 pixels per register)
+  KernelsAVX2,          // AVX2 (4 pixels per register)
+
+  KernelsCount,
+};
+
+// The inner loops of the generator that are worth vectorizing.
+struct PixelKernels
+{
+  // dst[i].Composite*(src[i]) for count pixels
+  void (*CompositeAdd)(Pixel *dst,const Pixel *src,sInt count);
+  void (*CompositeMulC)(Pixel *dst,const Pixel *src,sInt count);
+  void (*CompositeROver)(Pixel *dst,const Pixel *src,sInt count);
+  void (*CompositeScreen)(Pixel *dst,const Pixel *src,sInt count);
+
+  // dst[i].Lerp(t,x[i],y[i]) for count pixels
+  void (*Lerp)(Pixel *dst,const Pixel *x,const Pixel *y,sInt t,sInt count);
+
+  // Bilinear interpolation between row0[x0],row0[x1],row1[x0],row1[x1]
+  // with fx,fy=0..65535 (as in GenTexture::SampleBilinear)
+  void (*SampleBilinear)(Pixel &result,const Pixel *row0,const Pixel *row1,sInt x0,sInt x1,sInt fx,sInt fy);
+
+  // Color matrix for count pixels (m is 16.16 fixed point, see ColorMatrixTransform)
+  void (*ColorMatrix)(Pixel *out,const Pixel *in,sInt count,const sInt m[4][4],sBool clampPremult);
+
+  // One box filter pass over a row/column of pixels (see GenTexture::Blur)
+  void (*Blur1D)(Pixel *dst,const Pixel *src,sInt width,sInt sizeFixed,sInt wrapMode);
+};
+
+// Returns the best kernel set supported by this CPU
+sInt DetectKernelSet();
+
+// Selects the kernel set used by the generator functions (clamped to what
+// the CPU supports) and returns the set actually selected. InitTexgen picks
+// the best one; don't change this while generator functions are running.
+sInt SetKernelSet(sInt set);
+sInt GetKernelSet();
+
+// Access to the kernels of a given set (for testing and benchmarking)
+const PixelKernels *GetKernels(sInt set);
+
+// ---- Internal: fills in the vectorized versions (pixelkernels.cpp)
+void InitKernelsSSE2(PixelKernels &kernels);
+void InitKernelsAVX2(PixelKernels &kernels);
+
+#endif // __TP_PIXELKERNELS_HPP_
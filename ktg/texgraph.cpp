@@ -0,0 +1,718 @@
+/****************************************************************************/
+/***                                                                      ***/
+/***   Written by Fabian Giesen.                                          ***/
+/***   I hereby place this code in the public domain.                     ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+#include "texgraph.hpp"
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   Nodes and results                                                  ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+enum TexGraphOp
+{
+  OpImage = 0,
+  OpNoise,
+  OpGlowRect,
+  OpCells,
+  OpColorMatrixTransform,
+  OpCoordMatrixTransform,
+  OpColorRemap,
+  OpCoordRemap,
+  OpDerive,
+  OpBlur,
+  OpTernary,
+  OpPaste,
+  OpBump,
+  OpLinearCombine,
+};
+
+static const sInt MaxInputs = 256;
+static const sU64 DefaultCacheLimit = 64 << 20;
+
+struct TexGraphNode
+{
+  sInt Op;
+  sInt XRes,YRes;
+  sInt *Inputs;             // node ids (-1 = not used)
+  sInt NInputs;
+  sU8 *Params;              // op specific parameter block (see below)
+  sInt ParamSize;
+  sU64 Key;                 // hash of op, size, parameters and input keys
+};
+
+struct TexGraphResult
+{
+  sU64 Key;
+  GenTexture *Tex;
+  sInt Refs;                // pending consumers (0 = only in cache)
+  sU32 LastUse;
+};
+
+// Parameter blocks. They are hashed as raw bytes, so the helpers clear
+// them before filling them in (padding has to be deterministic).
+struct NoiseParams        { sInt FreqX,FreqY,Oct; sF32 Fadeoff; sInt Seed,Mode; };
+struct GlowRectParams     { sF32 OrgX,OrgY,UX,UY,VX,VY,RectU,RectV; };
+struct CellsParams        { sF32 Amp; sInt Mode,NCenters; };  // followed by the centers
+struct MatrixParams       { Matrix44 Matrix; sInt Mode; };
+struct CoordRemapParams   { sF32 StrengthU,StrengthV; sInt Mode; };
+struct DeriveParams       { sInt Op; sF32 Strength; };
+struct BlurParams         { sF32 SizeX,SizeY; sInt Order,Mode; };
+struct TernaryParams      { sInt Op; };
+struct PasteParams        { sF32 OrgX,OrgY,UX,UY,VX,VY; sInt Op,Mode; };
+struct BumpParams         { Pixel Ambient,Diffuse; sF32 PX,PY,PZ,DX,DY,DZ; sInt Directional; };
+struct LinearParams       { Pixel Color; sF32 ConstWeight; sInt NInputs; }; // followed by NInputs LinearInputs (Tex=0)
+
+static sU64 ResultBytes(const TexGraphResult *r)
+{
+  return sU64(r->Tex->NPixels) * sizeof(Pixel);
+}
+
+// 64-bit FNV-1a
+static sU64 HashBytes(sU64 hash,const void *data,sInt size)
+{
+  const sU8 *bytes = (const sU8 *) data;
+
+  for(sInt i=0;i<size;i++)
+    hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+
+  return hash;
+}
+
+// Grows an array of pointers so it can hold at least count elements
+template<class T> static void GrowArray(T **&array,sInt &alloc,sInt count)
+{
+  if(count <= alloc)
+    return;
+
+  sInt newAlloc = sMax(alloc*2,sMax(count,16));
+  T **newArray = new T*[newAlloc];
+  if(alloc)
+    sCopyMem(newArray,array,alloc * sizeof(T*));
+
+  delete[] array;
+  array = newArray;
+  alloc = newAlloc;
+}
+
+/****************************************************************************/
+/***                                                                      ***/
+/***   TexGraph                                                           ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+TexGraph::TexGraph()
+{
+  NodesComputed = 0;
+  NodesCached = 0;
+  CurrentBytes = 0;
+  PeakBytes = 0;
+
+  Nodes = 0;
+  NodeCount = NodeAlloc = 0;
+  Results = 0;
+  ResultCount = ResultAlloc = 0;
+  Pinned = 0;
+  PinnedCount = 0;
+
+  CacheLimit = DefaultCacheLimit;
+  CachedBytes = 0;
+  UseCounter = 0;
+}
+
+TexGraph::~TexGraph()
+{
+  Clear();
+  FlushCache();
+
+  delete[] Nodes;
+  delete[] Results;
+  delete[] Pinned;
+}
+
+sInt TexGraph::AddNode(sInt op,sInt xres,sInt yres,const sInt *inputs,sInt nInputs,const void *params,sInt paramSize,const void *extra,sInt extraSize)
+{
+  sVERIFY(nInputs <= MaxInputs);
+
+  TexGraphNode *node = new TexGraphNode;
+  node->Op = op;
+  node->XRes = xres;
+  node->YRes = yres;
+
+  node->NInputs = nInputs;
+  node->Inputs = new sInt[sMax(nInputs,1)];
+  for(sInt i=0;i<nInputs;i++)
+  {
+    sVERIFY(inputs[i] >= -1 && inputs[i] < NodeCount);
+    node->Inputs[i] = inputs[i];
+  }
+
+  // parameter block (extra data starts 8-byte aligned)
+  sInt extraOffset = sAlign(paramSize,8);
+  node->ParamSize = extraOffset + extraSize;
+  node->Params = new sU8[sMax(node->ParamSize,1)];
+  sSetMem(node->Params,0,node->ParamSize);
+  if(paramSize)
+    sCopyMem(node->Params,params,paramSize);
+  if(extraSize)
+    sCopyMem(node->Params + extraOffset,extra,extraSize);
+
+  // calc key
+  sU64 key = 0xcbf29ce484222325ull;
+  key = HashBytes(key,&op,sizeof(op));
+  key = HashBytes(key,&xres,sizeof(xres));
+  key = HashBytes(key,&yres,sizeof(yres));
+  key = HashBytes(key,node->Params,node->ParamSize);
+  for(sInt i=0;i<nInputs;i++)
+  {
+    sU64 inKey = (inputs[i] >= 0) ? Nodes[inputs[i]]->Key : 0;
+    key = HashBytes(key,&inKey,sizeof(inKey));
+  }
+  node->Key = key;
+
+  GrowArray(Nodes,NodeAlloc,NodeCount+1);
+  Nodes[NodeCount] = node;
+  return NodeCount++;
+}
+
+const TexGraphNode *TexGraph::GetNode(sInt node) const
+{
+  sVERIFY(node >= 0 && node < NodeCount);
+  return Nodes[node];
+}
+
+sInt TexGraph::Image(sInt xres,sInt yres,const Pixel *pixels)
+{
+  return AddNode(OpImage,xres,yres,0,0,pixels,xres*yres*sizeof(Pixel));
+}
+
+sInt TexGraph::Gradient(sU32 startCol,sU32 endCol)
+{
+  Pixel grad[2];
+  grad[0].Init(startCol);
+  grad[1].Init(endCol);
+
+  return Image(2,1,grad);
+}
+
+sInt TexGraph::Noise(sInt xres,sInt yres,sInt grad,sInt freqX,sInt freqY,sInt oct,sF32 fadeoff,sInt seed,sInt mode)
+{
+  NoiseParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.FreqX = freqX;
+  p.FreqY = freqY;
+  p.Oct = oct;
+  p.Fadeoff = fadeoff;
+  p.Seed = seed;
+  p.Mode = mode;
+
+  return AddNode(OpNoise,xres,yres,&grad,1,&p,sizeof(p));
+}
+
+sInt TexGraph::GlowRect(sInt background,sInt grad,sF32 orgx,sF32 orgy,sF32 ux,sF32 uy,sF32 vx,sF32 vy,sF32 rectu,sF32 rectv)
+{
+  const TexGraphNode *bg = GetNode(background);
+  sInt inputs[2] = { background,grad };
+
+  GlowRectParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.OrgX = orgx;
+  p.OrgY = orgy;
+  p.UX = ux;
+  p.UY = uy;
+  p.VX = vx;
+  p.VY = vy;
+  p.RectU = rectu;
+  p.RectV = rectv;
+
+  return AddNode(OpGlowRect,bg->XRes,bg->YRes,inputs,2,&p,sizeof(p));
+}
+
+sInt TexGraph::Cells(sInt xres,sInt yres,sInt grad,const CellCenter *centers,sInt nCenters,sF32 amp,sInt mode)
+{
+  CellsParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.Amp = amp;
+  p.Mode = mode;
+  p.NCenters = nCenters;
+
+  return AddNode(OpCells,xres,yres,&grad,1,&p,sizeof(p),centers,nCenters*sizeof(CellCenter));
+}
+
+sInt TexGraph::ColorMatrixTransform(sInt in,const Matrix44 &matrix,sBool clampPremult)
+{
+  const TexGraphNode *src = GetNode(in);
+
+  MatrixParams p;
+  sSetMem(&p,0,sizeof(p));
+  sCopyMem(p.Matrix,matrix,sizeof(Matrix44));
+  p.Mode = clampPremult;
+
+  return AddNode(OpColorMatrixTransform,src->XRes,src->YRes,&in,1,&p,sizeof(p));
+}
+
+sInt TexGraph::CoordMatrixTransform(sInt in,const Matrix44 &matrix,sInt filterMode)
+{
+  const TexGraphNode *src = GetNode(in);
+
+  MatrixParams p;
+  sSetMem(&p,0,sizeof(p));
+  sCopyMem(p.Matrix,matrix,sizeof(Matrix44));
+  p.Mode = filterMode;
+
+  return AddNode(OpCoordMatrixTransform,src->XRes,src->YRes,&in,1,&p,sizeof(p));
+}
+
+sInt TexGraph::ColorRemap(sInt in,sInt mapR,sInt mapG,sInt mapB)
+{
+  const TexGraphNode *src = GetNode(in);
+  sInt inputs[4] = { in,mapR,mapG,mapB };
+
+  return AddNode(OpColorRemap,src->XRes,src->YRes,inputs,4,0,0);
+}
+
+sInt TexGraph::CoordRemap(sInt in,sInt remap,sF32 strengthU,sF32 strengthV,sInt filterMode)
+{
+  const TexGraphNode *remapNode = GetNode(remap);
+  sInt inputs[2] = { in,remap };
+
+  CoordRemapParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.StrengthU = strengthU;
+  p.StrengthV = strengthV;
+  p.Mode = filterMode;
+
+  return AddNode(OpCoordRemap,remapNode->XRes,remapNode->YRes,inputs,2,&p,sizeof(p));
+}
+
+sInt TexGraph::Derive(sInt in,GenTexture::DeriveOp op,sF32 strength)
+{
+  const TexGraphNode *src = GetNode(in);
+
+  DeriveParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.Op = op;
+  p.Strength = strength;
+
+  return AddNode(OpDerive,src->XRes,src->YRes,&in,1,&p,sizeof(p));
+}
+
+sInt TexGraph::Blur(sInt in,sF32 sizex,sF32 sizey,sInt order,sInt mode)
+{
+  const TexGraphNode *src = GetNode(in);
+
+  BlurParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.SizeX = sizex;
+  p.SizeY = sizey;
+  p.Order = order;
+  p.Mode = mode;
+
+  return AddNode(OpBlur,src->XRes,src->YRes,&in,1,&p,sizeof(p));
+}
+
+sInt TexGraph::Ternary(sInt in1,sInt in2,sInt in3,GenTexture::TernaryOp op)
+{
+  const TexGraphNode *src = GetNode(in1);
+  sInt inputs[3] = { in1,in2,in3 };
+
+  TernaryParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.Op = op;
+
+  return AddNode(OpTernary,src->XRes,src->YRes,inputs,3,&p,sizeof(p));
+}
+
+sInt TexGraph::Paste(sInt background,sInt snippet,sF32 orgx,sF32 orgy,sF32 ux,sF32 uy,sF32 vx,sF32 vy,GenTexture::CombineOp op,sInt mode)
+{
+  const TexGraphNode *bg = GetNode(background);
+  sInt inputs[2] = { background,snippet };
+
+  PasteParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.OrgX = orgx;
+  p.OrgY = orgy;
+  p.UX = ux;
+  p.UY = uy;
+  p.VX = vx;
+  p.VY = vy;
+  p.Op = op;
+  p.Mode = mode;
+
+  return AddNode(OpPaste,bg->XRes,bg->YRes,inputs,2,&p,sizeof(p));
+}
+
+sInt TexGraph::Bump(sInt surface,sInt normals,sInt specular,sInt falloff,sF32 px,sF32 py,sF32 pz,sF32 dx,sF32 dy,sF32 dz,const Pixel &ambient,const Pixel &diffuse,sBool directional)
+{
+  const TexGraphNode *src = GetNode(surface);
+  sInt inputs[4] = { surface,normals,specular,falloff };
+
+  BumpParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.Ambient = ambient;
+  p.Diffuse = diffuse;
+  p.PX = px;
+  p.PY = py;
+  p.PZ = pz;
+  p.DX = dx;
+  p.DY = dy;
+  p.DZ = dz;
+  p.Directional = directional;
+
+  return AddNode(OpBump,src->XRes,src->YRes,inputs,4,&p,sizeof(p));
+}
+
+sInt TexGraph::LinearCombine(sInt xres,sInt yres,const Pixel &color,sF32 constWeight,const LinearNodeInput *inputs,sInt nInputs)
+{
+  sVERIFY(nInputs <= MaxInputs);
+
+  LinearParams p;
+  sSetMem(&p,0,sizeof(p));
+  p.Color = color;
+  p.ConstWeight = constWeight;
+  p.NInputs = nInputs;
+
+  // the texture pointers are filled in at evaluation time
+  sInt nodes[MaxInputs];
+  LinearInput lin[MaxInputs];
+  sSetMem(lin,0,sizeof(LinearInput) * nInputs);
+
+  for(sInt i=0;i<nInputs;i++)
+  {
+    nodes[i] = inputs[i].Node;
+    lin[i].Tex = 0;
+    lin[i].Weight = inputs[i].Weight;
+    lin[i].UShift = inputs[i].UShift;
+    lin[i].VShift = inputs[i].VShift;
+    lin[i].FilterMode = inputs[i].FilterMode;
+  }
+
+  return AddNode(OpLinearCombine,xres,yres,nodes,nInputs,&p,sizeof(p),lin,nInputs*sizeof(LinearInput));
+}
+
+void TexGraph::Clear()
+{
+  Unpin();
+  Trim();
+
+  for(sInt i=0;i<NodeCount;i++)
+  {
+    delete[] Nodes[i]->Inputs;
+    delete[] Nodes[i]->Params;
+    delete Nodes[i];
+  }
+
+  NodeCount = 0;
+}
+
+void TexGraph::Evaluate(const sInt *nodes,sInt count)
+{
+  Unpin();
+
+  NodesComputed = 0;
+  NodesCached = 0;
+  PeakBytes = CurrentBytes;
+
+  sInt *uses = new sInt[sMax(NodeCount,1)];
+  TexGraphResult **results = new TexGraphResult*[sMax(NodeCount,1)];
+  TexGraphResult *inputs[MaxInputs];
+
+  for(sInt i=0;i<NodeCount;i++)
+  {
+    uses[i] = 0;
+    results[i] = 0;
+  }
+
+  for(sInt i=0;i<count;i++)
+  {
+    sVERIFY(nodes[i] >= 0 && nodes[i] < NodeCount);
+    uses[nodes[i]]++;
+  }
+
+  // Find out what needs to be computed. Inputs are always declared before
+  // their consumers, so walking backwards sees all uses of a node before
+  // the node itself. Cached results get referenced right away so they
+  // can't be evicted while the other nodes are computed.
+  for(sInt i=NodeCount-1;i>=0;i--)
+  {
+    if(!uses[i])
+      continue;
+
+    const TexGraphNode *node = Nodes[i];
+    TexGraphResult *res = Find(node->Key);
+    if(res)
+    {
+      if(!res->Refs)
+        CachedBytes -= ResultBytes(res);
+
+      res->Refs += uses[i];
+      res->LastUse = ++UseCounter;
+      results[i] = res;
+      NodesCached++;
+    }
+    else
+    {
+      for(sInt j=0;j<node->NInputs;j++)
+        if(node->Inputs[j] >= 0)
+          uses[node->Inputs[j]]++;
+    }
+  }
+
+  // Compute in declaration order, releasing inputs after their last use.
+  for(sInt i=0;i<NodeCount;i++)
+  {
+    if(!uses[i] || results[i])
+      continue;
+
+    const TexGraphNode *node = Nodes[i];
+    for(sInt j=0;j<node->NInputs;j++)
+      inputs[j] = (node->Inputs[j] >= 0) ? results[node->Inputs[j]] : 0;
+
+    // a node with the same key may have been computed already
+    TexGraphResult *res = Find(node->Key);
+    if(res)
+    {
+      if(!res->Refs)
+        CachedBytes -= ResultBytes(res);
+    }
+    else
+    {
+      res = Compute(node,inputs);
+      NodesComputed++;
+    }
+
+    res->Refs += uses[i];
+    res->LastUse = ++UseCounter;
+    results[i] = res;
+
+    for(sInt j=0;j<node->NInputs;j++)
+      if(inputs[j])
+        Release(inputs[j]);
+  }
+
+  // hand out the results
+  delete[] Pinned;
+  Pinned = new TexGraphResult*[sMax(count,1)];
+  PinnedCount = count;
+
+  for(sInt i=0;i<count;i++)
+    Pinned[i] = results[nodes[i]];
+
+  delete[] uses;
+  delete[] results;
+}
+
+const GenTexture *TexGraph::Evaluate(sInt node)
+{
+  Evaluate(&node,1);
+  return Pinned[0]->Tex;
+}
+
+const GenTexture *TexGraph::Result(sInt node) const
+{
+  TexGraphResult *res = Find(GetNode(node)->Key);
+  return res ? res->Tex : 0;
+}
+
+void TexGraph::SetCacheLimit(sU64 bytes)
+{
+  CacheLimit = bytes;
+  Trim();
+}
+
+void TexGraph::FlushCache()
+{
+  sU64 oldLimit = CacheLimit;
+
+  CacheLimit = 0;
+  Trim();
+  CacheLimit = oldLimit;
+}
+
+TexGraphResult *TexGraph::Find(sU64 key) const
+{
+  for(sInt i=0;i<ResultCount;i++)
+    if(Results[i]->Key == key)
+      return Results[i];
+
+  return 0;
+}
+
+TexGraphResult *TexGraph::Compute(const TexGraphNode *node,TexGraphResult **inputs)
+{
+  GenTexture *in[MaxInputs];
+  for(sInt i=0;i<node->NInputs;i++)
+    in[i] = inputs[i] ? inputs[i]->Tex : 0;
+
+  GenTexture *out = new GenTexture(node->XRes,node->YRes);
+  const void *params = node->Params;
+
+  switch(node->Op)
+  {
+  case OpImage:
+    sCopyMem(out->Data,params,out->NPixels * sizeof(Pixel));
+    break;
+
+  case OpNoise:
+    {
+      const NoiseParams *p = (const NoiseParams *) params;
+      out->Noise(*in[0],p->FreqX,p->FreqY,p->Oct,p->Fadeoff,p->Seed,p->Mode);
+    }
+    break;
+
+  case OpGlowRect:
+    {
+      const GlowRectParams *p = (const GlowRectParams *) params;
+      out->GlowRect(*in[0],*in[1],p->OrgX,p->OrgY,p->UX,p->UY,p->VX,p->VY,p->RectU,p->RectV);
+    }
+    break;
+
+  case OpCells:
+    {
+      const CellsParams *p = (const CellsParams *) params;
+      const CellCenter *centers = (const CellCenter *) (node->Params + sAlign(sizeof(CellsParams),8));
+      out->Cells(*in[0],centers,p->NCenters,p->Amp,p->Mode);
+    }
+    break;
+
+  case OpColorMatrixTransform:
+    {
+      const MatrixParams *p = (const MatrixParams *) params;
+      out->ColorMatrixTransform(*in[0],p->Matrix,p->Mode != 0);
+    }
+    break;
+
+  case OpCoordMatrixTransform:
+    {
+      const MatrixParams *p = (const MatrixParams *) params;
+      out->CoordMatrixTransform(*in[0],p->Matrix,p->Mode);
+    }
+    break;
+
+  case OpColorRemap:
+    out->ColorRemap(*in[0],*in[1],*in[2],*in[3]);
+    break;
+
+  case OpCoordRemap:
+    {
+      const CoordRemapParams *p = (const CoordRemapParams *) params;
+      out->CoordRemap(*in[0],*in[1],p->StrengthU,p->StrengthV,p->Mode);
+    }
+    break;
+
+  case OpDerive:
+    {
+      const DeriveParams *p = (const DeriveParams *) params;
+      out->Derive(*in[0],(GenTexture::DeriveOp) p->Op,p->Strength);
+    }
+    break;
+
+  case OpBlur:
+    {
+      const BlurParams *p = (const BlurParams *) params;
+      out->Blur(*in[0],p->SizeX,p->SizeY,p->Order,p->Mode);
+    }
+    break;
+
+  case OpTernary:
+    {
+      const TernaryParams *p = (const TernaryParams *) params;
+      out->Ternary(*in[0],*in[1],*in[2],(GenTexture::TernaryOp) p->Op);
+    }
+    break;
+
+  case OpPaste:
+    {
+      const PasteParams *p = (const PasteParams *) params;
+      out->Paste(*in[0],*in[1],p->OrgX,p->OrgY,p->UX,p->UY,p->VX,p->VY,(GenTexture::CombineOp) p->Op,p->Mode);
+    }
+    break;
+
+  case OpBump:
+    {
+      const BumpParams *p = (const BumpParams *) params;
+      out->Bump(*in[0],*in[1],in[2],in[3],p->PX,p->PY,p->PZ,p->DX,p->DY,p->DZ,p->Ambient,p->Diffuse,p->Directional != 0);
+    }
+    break;
+
+  case OpLinearCombine:
+    {
+      const LinearParams *p = (const LinearParams *) params;
+      LinearInput lin[MaxInputs];
+
+      sCopyMem(lin,node->Params + sAlign(sizeof(LinearParams),8),p->NInputs * sizeof(LinearInput));
+      for(sInt i=0;i<p->NInputs;i++)
+        lin[i].Tex = in[i];
+
+      out->LinearCombine(p->Color,p->ConstWeight,lin,p->NInputs);
+    }
+    break;
+
+  default:
+    sVERIFYFALSE;
+  }
+
+  TexGraphResult *res = new TexGraphResult;
+  res->Key = node->Key;
+  res->Tex = out;
+  res->Refs = 0;
+  res->LastUse = ++UseCounter;
+
+  GrowArray(Results,ResultAlloc,ResultCount+1);
+  Results[ResultCount++] = res;
+
+  CurrentBytes += ResultBytes(res);
+  PeakBytes = sMax(PeakBytes,CurrentBytes);
+
+  return res;
+}
+
+void TexGraph::Release(TexGraphResult *res)
+{
+  sVERIFY(res->Refs > 0);
+
+  if(--res->Refs == 0)
+  {
+    CachedBytes += ResultBytes(res);
+    Trim();
+  }
+}
+
+void TexGraph::Unpin()
+{
+  for(sInt i=0;i<PinnedCount;i++)
+  {
+    if(--Pinned[i]->Refs == 0)
+      CachedBytes += ResultBytes(Pinned[i]);
+  }
+
+  PinnedCount = 0;
+}
+
+// Frees least recently used unreferenced results until the cache fits
+// into its limit.
+void TexGraph::Trim()
+{
+  while(CachedBytes > CacheLimit)
+  {
+    sInt oldest = -1;
+    for(sInt i=0;i<ResultCount;i++)
+    {
+      if(!Results[i]->Refs && (oldest < 0 || Results[i]->LastUse < Results[oldest]->LastUse))
+        oldest = i;
+    }
+
+    sVERIFY(oldest >= 0);
+    TexGraphResult *res = Results[oldest];
+    CachedBytes -= ResultBytes(res);
+    CurrentBytes -= ResultBytes(res);
+
+    delete res->Tex;
+    delete res;
+    Results[oldest] = Results[--ResultCount];
+  }
+}
@@ -0,0 +1,116 @@
+/****************************************************************************/
+/***                                                                      ***/
+/***   Written by Fabian Giesen.                                          ***/
+/***   I hereby place this code in the public domain.                     ***/
+/***                                                                      ***/
+/****************************************************************************/
+
+#ifndef __TP_TEXGRAPH_HPP_
+#define __TP_TEXGRAPH_HPP_
+
+#include "gentexture.hpp"
+
+// LinearNodeInput. One input for TexGraph::LinearCombine (same as
+// LinearInput, but refers to a graph node instead of a texture).
+struct LinearNodeInput
+{
+  sInt Node;                // the input node
+  sF32 Weight;              // its weight
+  sF32 UShift,VShift;       // u/v translate parameter
+  sInt FilterMode;          // filtering mode (as in CoordMatrixTransform)
+};
+
+struct TexGraphNode;
+struct TexGraphResult;
+
+// Lazily evaluated graph of generator operations.
+//
+// Nodes are declared first (each declaration returns a node id) and only
+// computed when Evaluate asks for them. Results are keyed by a hash of
+// (operation, size, parameters, keys of the inputs), so two nodes with the
+// same key share one result, and re-declaring a graph after changing a
+// parameter only recomputes the nodes that depend on it.
+//
+// Intermediate results are released as soon as their last consumer has
+// run. Released results are kept in a cache (least recently used ones go
+// first once it exceeds its size limit); with a limit of 0 they are freed
+// immediately, which gives the lowest peak memory usage.
+struct TexGraph
+{
+  TexGraph();
+  ~TexGraph();
+
+  // Node declaration. Inputs are ids of nodes declared earlier; optional
+  // inputs can be -1. Unless there is an explicit xres/yres, the result has
+  // the size of the first input.
+  sInt Image(sInt xres,sInt yres,const Pixel *pixels);
+  sInt Gradient(sU32 startCol,sU32 endCol); // 2x1 linear gradient (0xaarrggbb colors)
+
+  sInt Noise(sInt xres,sInt yres,sInt grad,sInt freqX,sInt freqY,sInt oct,sF32 fadeoff,sInt seed,sInt mode);
+  sInt GlowRect(sInt background,sInt grad,sF32 orgx,sF32 orgy,sF32 ux,sF32 uy,sF32 vx,sF32 vy,sF32 rectu,sF32 rectv);
+  sInt Cells(sInt xres,sInt yres,sInt grad,const CellCenter *centers,sInt nCenters,sF32 amp,sInt mode);
+
+  sInt ColorMatrixTransform(sInt in,const Matrix44 &matrix,sBool clampPremult);
+  sInt CoordMatrixTransform(sInt in,const Matrix44 &matrix,sInt filterMode);
+  sInt ColorRemap(sInt in,sInt mapR,sInt mapG,sInt mapB);
+  sInt CoordRemap(sInt in,sInt remap,sF32 strengthU,sF32 strengthV,sInt filterMode); // size of remap
+  sInt Derive(sInt in,GenTexture::DeriveOp op,sF32 strength);
+  sInt Blur(sInt in,sF32 sizex,sF32 sizey,sInt order,sInt mode);
+
+  sInt Ternary(sInt in1,sInt in2,sInt in3,GenTexture::TernaryOp op);
+  sInt Paste(sInt background,sInt snippet,sF32 orgx,sF32 orgy,sF32 ux,sF32 uy,sF32 vx,sF32 vy,GenTexture::CombineOp op,sInt mode);
+  sInt Bump(sInt surface,sInt normals,sInt specular,sInt falloff,sF32 px,sF32 py,sF32 pz,sF32 dx,sF32 dy,sF32 dz,const Pixel &ambient,const Pixel &diffuse,sBool directional);
+  sInt LinearCombine(sInt xres,sInt yres,const Pixel &color,sF32 constWeight,const LinearNodeInput *inputs,sInt nInputs);
+
+  // Forget all nodes (results of the last Evaluate become invalid). The
+  // cache is kept, so nodes that are declared again with the same
+  // parameters don't need to be recomputed.
+  void Clear();
+
+  // Compute the given nodes and everything they depend on that isn't
+  // cached. The results stay valid until the next Evaluate or Clear.
+  void Evaluate(const sInt *nodes,sInt count);
+  const GenTexture *Evaluate(sInt node);
+
+  // Result of a node if it is available (always for nodes passed to the
+  // last Evaluate call), 0 otherwise.
+  const GenTexture *Result(sInt node) const;
+
+  // Maximum number of bytes kept in released results (default: 64MB).
+  void SetCacheLimit(sU64 bytes);
+  void FlushCache();
+
+  // Statistics
+  sInt NodesComputed;       // nodes computed by the last Evaluate
+  sInt NodesCached;         // nodes taken from the cache by the last Evaluate
+  sU64 CurrentBytes;        // texture memory currently held (results+cache)
+  sU64 PeakBytes;           // peak texture memory during the last Evaluate
+
+  // ---- Internal
+  TexGraphNode **Nodes;
+  sInt NodeCount,NodeAlloc;
+
+  TexGraphResult **Results;
+  sInt ResultCount,ResultAlloc;
+
+  TexGraphResult **Pinned;  // results handed out by the last Evaluate
+  sInt PinnedCount;
+
+  sU64 CacheLimit;
+  sU64 CachedBytes;         // bytes in results nobody refers to
+  sU32 UseCounter;
+
+  sInt AddNode(sInt op,sInt xres,sInt yres,const sInt *inputs,sInt nInputs,const void *params,sInt paramSize,const void *extra=0,sInt extraSize=0);
+  const TexGraphNode *GetNode(sInt node) const;
+  TexGraphResult *Find(sU64 key) const;
+  TexGraphResult *Compute(const TexGraphNode *node,TexGraphResult **inputs);
+  void Release(TexGraphResult *result);
+  void Unpin();
+  void Trim();
+
+private:
+  TexGraph(const TexGraph &);
+  TexGraph &operator =(const TexGraph &);
+};
+
+#endif // __TP_TEXGRAPH_HPP_
@@ -0,0 +1,291 @@
+#include "types.h"
+#include "jobpool.h"
+
+static const int MAXTHREADS = 16;
+
+#ifdef _WIN32
+
+#include <Windows.h>
+
+struct V2JobPool
+{
+  struct Worker
+  {
+    V2JobPool *pool;
+    HANDLE thndl;
+    HANDLE startev;               // set to start working on a batch
+  } workers[MAXTHREADS];
+
+  HANDLE doneev[MAXTHREADS];      // set by the workers when the batch is done
+  sInt nthreads;
+  CRITICAL_SECTION crsec;         // one batch at a time
+
+  // current batch
+  V2JOBFUNC *job;
+  void *jobparm;
+  sInt count;
+  volatile LONG next;             // next job to run
+  volatile LONG exit;
+};
+
+// works on jobs of the current batch until there are none left
+static void runJobs(V2JobPool *pool)
+{
+  LONG i;
+  while ((i = InterlockedIncrement(&pool->next) - 1) < pool->count)
+    pool->job(pool->jobparm, i);
+}
+
+static DWORD WINAPI workerfunc(void *param)
+{
+  V2JobPool::Worker *w = (V2JobPool::Worker *)param;
+  V2JobPool *pool = w->pool;
+
+  for (;;)
+  {
+    WaitForSingleObject(w->startev, INFINITE);
+    if (pool->exit)
+      break;
+
+    runJobs(pool);
+    SetEvent(pool->doneev[w - pool->workers]);
+  }
+
+  return 0;
+}
+
+V2JobPool * __stdcall jobPoolCreate(int nthreads)
+{
+  if (nthreads <= 0)
+  {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    nthreads = si.dwNumberOfProcessors - 1;
+  }
+
+  V2JobPool *pool = new V2JobPool;
+  pool->nthreads = sClamp(nthreads, 0, MAXTHREADS);
+  pool->exit = 0;
+  InitializeCriticalSection(&pool->crsec);
+
+  for (sInt i=0; i < pool->nthreads; i++)
+  {
+    V2JobPool::Worker &w = pool->workers[i];
+    DWORD id;
+
+    w.pool = pool;
+    w.startev = CreateEvent(0, FALSE, FALSE, 0);
+    pool->doneev[i] = CreateEvent(0, FALSE, FALSE, 0);
+    w.thndl = CreateThread(0, 0, workerfunc, &w, 0, &id);
+  }
+
+  return pool;
+}
+
+void __stdcall jobPoolDestroy(V2JobPool *pool)
+{
+  if (!pool)
+    return;
+
+  // wake everyone up and wait for them to exit
+  pool->exit = 1;
+  for (sInt i=0; i < pool->nthreads; i++)
+  {
+    V2JobPool::Worker &w = pool->workers[i];
+
+    SetEvent(w.startev);
+    WaitForSingleObject(w.thndl, INFINITE);
+    CloseHandle(w.thndl);
+    CloseHandle(w.startev);
+    CloseHandle(pool->doneev[i]);
+  }
+
+  DeleteCriticalSection(&pool->crsec);
+  delete pool;
+}
+
+void __stdcall jobPoolRun(void *ptr, V2JOBFUNC *job, void *jobparm, int count)
+{
+  V2JobPool *pool = (V2JobPool *)ptr;
+
+  EnterCriticalSection(&pool->crsec);
+
+  pool->job = job;
+  pool->jobparm = jobparm;
+  pool->count = count;
+  pool->next = 0;
+
+  // no need to wake more workers than there are jobs to share
+  sInt nwake = sMin(pool->nthreads, count - 1);
+  for (sInt i=0; i < nwake; i++)
+    SetEvent(pool->workers[i].startev);
+
+  runJobs(pool);
+
+  if (nwake > 0)
+    WaitForMultipleObjects(nwake, pool->doneev, TRUE, INFINITE);
+
+  LeaveCriticalSection(&pool->crsec);
+}
+
+#else
+
+// same thing with pthreads. there are no auto-reset events, so the workers
+// wait for the batch counter to change instead.
+
+#include <pthread.h>
+#include <unistd.h>
+
+struct V2JobPool
+{
+  struct Worker
+  {
+    V2JobPool *pool;
+    sInt index;
+    pthread_t thndl;
+  } workers[MAXTHREADS];
+
+  sInt nthreads;
+  pthread_mutex_t batchlock;      // one batch at a time
+  pthread_mutex_t lock;           // protects the fields below
+  pthread_cond_t startcond;       // signaled when a batch starts or on exit
+  pthread_cond_t donecond;        // signaled when the last worker is done
+  sU32 batch;                     // incremented for every batch
+  sInt nwake;                     // workers taking part in the current batch
+  sInt busy;                      // ... that are still working on it
+  sInt exit;
+
+  // current batch
+  V2JOBFUNC *job;
+  void *jobparm;
+  sInt count;
+  volatile long next;             // next job to run
+};
+
+// works on jobs of the current batch until there are none left
+static void runJobs(V2JobPool *pool)
+{
+  long i;
+  while ((i = __sync_fetch_and_add(&pool->next, 1)) < pool->count)
+    pool->job(pool->jobparm, i);
+}
+
+static void *workerfunc(void *param)
+{
+  V2JobPool::Worker *w = (V2JobPool::Worker *)param;
+  V2JobPool *pool = w->pool;
+  sU32 seen = 0;                  // no batch has run before the workers start
+
+  pthread_mutex_lock(&pool->lock);
+  for (;;)
+  {
+    while (!pool->exit && (pool->batch == seen || w->index >= pool->nwake))
+    {
+      seen = pool->batch;
+      pthread_cond_wait(&pool->startcond, &pool->lock);
+    }
+    if (pool->exit)
+      break;
+
+    seen = pool->batch;
+    pthread_mutex_unlock(&pool->lock);
+    runJobs(pool);
+    pthread_mutex_lock(&pool->lock);
+    if (!--pool->busy)
+      pthread_cond_signal(&pool->donecond);
+  }
+  pthread_mutex_unlock(&pool->lock);
+
+  return 0;
+}
+
+V2JobPool * __stdcall jobPoolCreate(int nthreads)
+{
+  if (nthreads <= 0)
+    nthreads = (int)sysconf(_SC_NPROCESSORS_ONLN) - 1;
+
+  V2JobPool *pool = new V2JobPool;
+  pool->nthreads = 0;
+  pool->batch = 0;
+  pool->nwake = 0;
+  pool->busy = 0;
+  pool->exit = 0;
+  pthread_mutex_init(&pool->batchlock, 0);
+  pthread_mutex_init(&pool->lock, 0);
+  pthread_cond_init(&pool->startcond, 0);
+  pthread_cond_init(&pool->donecond, 0);
+
+  // if a thread can't be created, the pool just stays smaller
+  nthreads = sClamp(nthreads, 0, MAXTHREADS);
+  for (sInt i=0; i < nthreads; i++)
+  {
+    V2JobPool::Worker &w = pool->workers[pool->nthreads];
+
+    w.pool = pool;
+    w.index = pool->nthreads;
+    if (pthread_create(&w.thndl, 0, workerfunc, &w))
+      break;
+    pool->nthreads++;
+  }
+
+  return pool;
+}
+
+void __stdcall jobPoolDestroy(V2JobPool *pool)
+{
+  if (!pool)
+    return;
+
+  // wake everyone up and wait for them to exit
+  pthread_mutex_lock(&pool->lock);
+  pool->exit = 1;
+  pthread_cond_broadcast(&pool->startcond);
+  pthread_mutex_unlock(&pool->lock);
+
+  for (sInt i=0; i < pool->nthreads; i++)
+    pthread_join(pool->workers[i].thndl, 0);
+
+  pthread_cond_destroy(&pool->donecond);
+  pthread_cond_destroy(&pool->startcond);
+  pthread_mutex_destroy(&pool->lock);
+  pthread_mutex_destroy(&pool->batchlock);
+  delete pool;
+}
+
+void __stdcall jobPoolRun(void *ptr, V2JOBFUNC *job, void *jobparm, int count)
+{
+  V2JobPool *pool = (V2JobPool *)ptr;
+
+  pthread_mutex_lock(&pool->batchlock);
+
+  pool->job = job;
+  pool->jobparm = jobparm;
+  pool->count = count;
+  pool->next = 0;
+
+  // no need to wake more workers than there are jobs to share
+  sInt nwake = sMax(sMin(pool->nthreads, count - 1), 0);
+  if (nwake > 0)
+  {
+    pthread_mutex_lock(&pool->lock);
+    pool->nwake = nwake;
+    pool->busy = nwake;
+    pool->batch++;
+    pthread_cond_broadcast(&pool->startcond);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  runJobs(pool);
+
+  if (nwake > 0)
+  {
+    pthread_mutex_lock(&pool->lock);
+    while (pool->busy)
+      pthread_cond_wait(&pool->donecond, &pool->lock);
+    pthread_mutex_unlock(&pool->lock);
+  }
+
+  pthread_mutex_unlock(&pool->batchlock);
+}
+
+#endif
@@ -0,0 +1,24 @@
+#ifndef _JOBPOOL_H_
+#define _JOBPOOL_H_
+
+// same as in synth.h and libv2.h, so this works with either of them
+typedef void (__stdcall V2JOBFUNC)(void *jobparm, int index);
+
+// Worker threads for synthSetJobRunner:
+//
+//   V2JobPool *pool = jobPoolCreate(0);
+//   synthSetJobRunner(synth, jobPoolRun, pool);
+//
+// The calling thread works on the jobs, too. A pool can be shared by
+// several synth instances; their batches of jobs then run one at a time.
+
+struct V2JobPool;
+
+// nthreads: number of worker threads (0: one less than the number of CPUs)
+extern V2JobPool * __stdcall jobPoolCreate(int nthreads=0);
+extern void __stdcall jobPoolDestroy(V2JobPool *pool);
+
+// runs job(jobparm, 0..count-1) on the pool, returns when all are done
+extern void __stdcall jobPoolRun(void *pool, V2JOBFUNC *job, void *jobparm, int count);
+
+#endif
@@ -116,6 +116,16 @@ extern "C"
   // r    : pointer to float variable where right VU is stored
   void __stdcall synthGetMainVU(void *pthis, float *l, float *r);
 
+  // renders the channels in parallel (C++ synth core only, see jobpool.h)
+  // pthis  : pointer to work mem
+  // runjobs: has to call job(jobparm, i) for every i in 0..count-1, in any order
+  //          and on any threads, and return when all calls are done
+  // parm   : passed to runjobs
+  // The output stays exactly the same. synthInit resets this to 0.
+  typedef void (__stdcall V2JOBFUNC)(void *jobparm, int index);
+  typedef void (__stdcall V2RUNJOBS)(void *parm, V2JOBFUNC *job, void *jobparm, int count);
+  void __stdcall synthSetJobRunner(void *pthis, V2RUNJOBS *runjobs, void *parm);
+
 #ifdef __cplusplus
 }
 #endif
@@ -25,6 +25,14 @@ extern "C"
 
 	extern long __stdcall synthGetFrameSize(void *pthis);
 
+	// parallel channel rendering (C++ synth core only)
+	// runjobs has to call job(jobparm, i) for every i in 0..count-1, in any order
+	// and on any threads, and return when all calls are done. Output stays exactly
+	// the same. synthInit resets this to 0 (render everything on the calling thread).
+	typedef void (__stdcall V2JOBFUNC)(void *jobparm, int index);
+	typedef void (__stdcall V2RUNJOBS)(void *parm, V2JOBFUNC *job, void *jobparm, int count);
+	extern void __stdcall synthSetJobRunner(void *pthis, V2RUNJOBS *runjobs, void *parm);
+
 #ifdef RONAN
 	extern void __stdcall synthSetLyrics(void *pthis, const char **ptr);
 #endif
@@ -15,6 +15,20 @@
 #define DEBUGSCOPES 0
 #define COVERAGE    0
 
+// SSE2 kernels for the oscillators and filters. The scalar code stays the
+// reference implementation; build with V2_SSE2=0 to use it everywhere.
+#ifndef V2_SSE2
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define V2_SSE2 1
+#else
+#define V2_SSE2 0
+#endif
+#endif
+
+#if V2_SSE2
+#include <emmintrin.h>
+#endif
+
 // --------------------------------------------------------------------------
 // Debug scopes
 // --------------------------------------------------------------------------
@@ -204,6 +218,13 @@ static inline T clamp(T x, T min, T max)
   return (x < min) ? min : (x > max) ? max : x;
 }
 
+// parameter block differs from the old one? (bitwise, so this is exact)
+template<typename T>
+static inline bool changed(const T &para, const T &old)
+{
+  return memcmp(&para, &old, sizeof(T)) != 0;
+}
+
 // uniform randon number generator
 // just a linear congruential generator, nothing fancy.
 static inline sU32 urandom(sU32 *seed)
@@ -240,9 +261,38 @@ static inline sF32 lerp(sF32 a, sF32 b, sF32 t)
   return a + t * (b-a);
 }
 
+#if V2_SSE2
+// unsigned 32-bit a < b
+static inline __m128i sse_ult(__m128i a, __m128i b)
+{
+  const __m128i bias = _mm_set1_epi32((int)0x80000000u);
+  return _mm_cmplt_epi32(_mm_xor_si128(a, bias), _mm_xor_si128(b, bias));
+}
+
+// (mask ? a : b)
+static inline __m128 sse_select(__m128 mask, __m128 a, __m128 b)
+{
+  return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b));
+}
+
+// utof23 on 4 values
+static inline __m128 sse_utof23(__m128i x)
+{
+  __m128i bits = _mm_or_si128(_mm_srli_epi32(x, 9), _mm_set1_epi32(0x3f800000));
+  return _mm_sub_ps(_mm_castsi128_ps(bits), _mm_set1_ps(1.0f));
+}
+
+// wave counter values for the next 4 samples
+static inline __m128i sse_counters(sU32 cnt, sU32 freq)
+{
+  return _mm_add_epi32(_mm_set1_epi32((int)cnt), _mm_set_epi32((int)(3*freq), (int)(2*freq), (int)freq, 0));
+}
+#endif
+
 // DEBUG
 #include <stdarg.h>
 #include <stdio.h>
+#ifdef _WIN32
 extern "C" void __stdcall OutputDebugStringA(const char *what);
 static void dprintf(const char *fmt, ...)
 {
@@ -253,6 +303,7 @@ static void dprintf(const char *fmt, ...)
   va_end(arg);
   OutputDebugStringA(buf);
 }
+#endif
 
 // --------------------------------------------------------------------------
 // Building blocks
@@ -440,11 +491,8 @@ struct V2Instance
   sInt SRcFrameSize;
   sF32 SRfciframe;
 
-  // buffers
-  sF32 vcebuf[MAX_FRAME_SIZE];
-  sF32 vcebuf2[MAX_FRAME_SIZE];
+  // buffers (voice and channel buffers are in V2ChanBuf)
   StereoSample levelbuf[MAX_FRAME_SIZE]; // original V2 overlaps level buffer with voice buffers
-  StereoSample chanbuf[MAX_FRAME_SIZE];
   sF32 aux1buf[MAX_FRAME_SIZE];
   sF32 aux2buf[MAX_FRAME_SIZE];
   StereoSample mixbuf[MAX_FRAME_SIZE];
@@ -551,14 +599,26 @@ struct V2Osc
     nfres = 1.0f - sqrtf(col);
   }
 
+  // does this oscillator read the AuxA/B buses?
+  bool readsAux() const
+  {
+    return (mode & 7) == OSC_AUXA || (mode & 7) == OSC_AUXB;
+  }
+
   void render(sF32 *dest, sInt nsamples)
   {
     switch (mode & 7)
     {
     case OSC_OFF:     break;
+#if V2_SSE2
+    case OSC_TRI_SAW: renderTriSawSSE(dest, nsamples); break;
+    case OSC_PULSE:   renderPulseSSE(dest, nsamples); break;
+    case OSC_SIN:     renderSinSSE(dest, nsamples); break;
+#else
     case OSC_TRI_SAW: renderTriSaw(dest, nsamples); break;
     case OSC_PULSE:   renderPulse(dest, nsamples); break;
     case OSC_SIN:     renderSin(dest, nsamples); break;
+#endif
     case OSC_NOISE:   renderNoise(dest, nsamples); break;
     case OSC_FM_SIN:  renderFMSin(dest, nsamples); break;
     case OSC_AUXA:    renderAux(dest, inst->auxabuf, nsamples); break;
@@ -902,6 +962,123 @@ private:
       dest[i] = aux;
     }
   }
+
+#if V2_SSE2
+  // SSE2 versions of the oscillators, 4 samples at a time. They produce the
+  // same results as the reference code above.
+
+  inline void output4(sF32 *dest, __m128 x)
+  {
+    __m128 d = _mm_loadu_ps(dest);
+    _mm_storeu_ps(dest, ring ? _mm_mul_ps(d, x) : _mm_add_ps(d, x));
+  }
+
+  // up/was up/carry bits of the oscillator state machine for 4 samples.
+  // returns true if all of them are plain up or down samples (cases a and c).
+  inline bool osm_steady4(__m128i &up)
+  {
+    __m128i c = sse_counters(cnt, freq);
+    __m128i vbrpt = _mm_set1_epi32((int)brpt);
+    __m128i vfreq = _mm_set1_epi32(freq);
+
+    up = sse_ult(c, vbrpt);
+    __m128i wasup = sse_ult(_mm_sub_epi32(c, vfreq), vbrpt);
+    __m128i carry = sse_ult(c, vfreq);
+    return !_mm_movemask_epi8(_mm_or_si128(_mm_xor_si128(up, wasup), carry));
+  }
+
+  void renderTriSawSSE(sF32 *dest, sInt nsamples)
+  {
+    // Blocks that stay on one slope are just linear functions and are
+    // done here, the ones containing a transition go through the
+    // reference code, which handles all the cases.
+    sF32 f = utof23(freq);
+    sF32 col = utof23(brpt);
+    sF32 c1 = gain / col;
+    sF32 c2 = -gain / (1.0f - col);
+
+    __m128 vf = _mm_set1_ps(f);
+    __m128 vcol = _mm_set1_ps(col);
+    __m128 vc1 = _mm_set1_ps(c1);
+    __m128 vc2 = _mm_set1_ps(c2);
+    __m128 vgain = _mm_set1_ps(gain);
+
+    sInt i = 0;
+    for (; i + 4 <= nsamples; i += 4)
+    {
+      __m128i up;
+      if (!osm_steady4(up))
+      {
+        renderTriSaw(dest + i, 4);
+        continue;
+      }
+
+      __m128 p = _mm_sub_ps(sse_utof23(sse_counters(cnt, freq)), vcol);
+      __m128 c = sse_select(_mm_castsi128_ps(up), vc1, vc2);
+      __m128 y = _mm_mul_ps(c, _mm_sub_ps(_mm_add_ps(p, p), vf));
+      output4(dest + i, _mm_add_ps(y, vgain));
+      cnt += 4u*freq;
+    }
+
+    if (i < nsamples)
+      renderTriSaw(dest + i, nsamples - i);
+  }
+
+  void renderPulseSSE(sF32 *dest, sInt nsamples)
+  {
+    // same idea as renderTriSawSSE
+    __m128 vgain = _mm_set1_ps(gain);
+    __m128 vngain = _mm_set1_ps(-gain);
+
+    sInt i = 0;
+    for (; i + 4 <= nsamples; i += 4)
+    {
+      __m128i up;
+      if (!osm_steady4(up))
+      {
+        renderPulse(dest + i, 4);
+        continue;
+      }
+
+      output4(dest + i, sse_select(_mm_castsi128_ps(up), vgain, vngain));
+      cnt += 4u*freq;
+    }
+
+    if (i < nsamples)
+      renderPulse(dest + i, nsamples - i);
+  }
+
+  void renderSinSSE(sF32 *dest, sInt nsamples)
+  {
+    // see renderSin for what's going on
+    __m128 vgain = _mm_set1_ps(gain);
+    __m128 vpi = _mm_set1_ps(fcpi);
+    __m128 v1p5pi = _mm_set1_ps(fc1p5pi);
+
+    sInt i = 0;
+    for (; i + 4 <= nsamples; i += 4)
+    {
+      __m128i phase = _mm_add_epi32(sse_counters(cnt, freq), _mm_set1_epi32(0x40000000));
+      cnt += 4u*freq;
+
+      phase = _mm_xor_si128(phase, _mm_srai_epi32(phase, 31));
+      __m128i bits = _mm_or_si128(_mm_srli_epi32(phase, 8), _mm_set1_epi32(0x3f800000));
+      __m128 t = _mm_sub_ps(_mm_mul_ps(_mm_castsi128_ps(bits), vpi), v1p5pi);
+
+      // fastsin
+      __m128 t2 = _mm_mul_ps(t, t);
+      __m128 s = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(-0.00018542f), t2), _mm_set1_ps(0.0083143f));
+      s = _mm_sub_ps(_mm_mul_ps(s, t2), _mm_set1_ps(0.16666f));
+      s = _mm_add_ps(_mm_mul_ps(s, t2), _mm_set1_ps(1.0f));
+      s = _mm_mul_ps(s, t);
+
+      output4(dest + i, _mm_mul_ps(vgain, s));
+    }
+
+    if (i < nsamples)
+      renderSin(dest + i, nsamples - i);
+  }
+#endif
 };
 
 // --------------------------------------------------------------------------
@@ -1192,6 +1369,194 @@ struct V2Flt
 
     DEBUG_PLOT_STRIDED(this, dest, step, nsamples);
   }
+
+  // Renders up to 4 independent filters (none may read a buffer another one
+  // writes, except for its own src==dest). Results are the same as calling
+  // render on each of them. The filter recursions are latency bound, so with
+  // SSE2 this runs them side by side, one per lane.
+  static void renderMany(V2Flt *const *flt, sF32 *const *dest, const sF32 *const *src, sInt count, sInt nsamples, sInt step=1)
+  {
+    assert(count <= 4);
+
+#if V2_SSE2
+    sInt lrc[4], moog[4];
+    sInt nlrc = 0, nmoog = 0;
+
+    for (sInt i=0; i < count; i++)
+    {
+      switch (flt[i]->mode & 7)
+      {
+      case BYPASS:              flt[i]->render(dest[i], src[i], nsamples, step); break;
+      case MOOGL: case MOOGH:   moog[nmoog++] = i; break;
+      default:                  lrc[nlrc++] = i; break;
+      }
+    }
+
+    if (nlrc > 1)
+      renderLRCLanes(flt, dest, src, lrc, nlrc, nsamples, step);
+    else if (nlrc)
+      flt[lrc[0]]->render(dest[lrc[0]], src[lrc[0]], nsamples, step);
+
+    if (nmoog > 1)
+      renderMoogLanes(flt, dest, src, moog, nmoog, nsamples, step);
+    else if (nmoog)
+      flt[moog[0]]->render(dest[moog[0]], src[moog[0]], nsamples, step);
+#else
+    for (sInt i=0; i < count; i++)
+      flt[i]->render(dest[i], src[i], nsamples, step);
+#endif
+  }
+
+private:
+#if V2_SSE2
+  // lanes that aren't in use run on zeros and their output is dropped.
+  static const sInt NLANES = 4;
+
+  static void renderLRCLanes(V2Flt *const *flt, sF32 *const *dest, const sF32 *const *src,
+    const sInt *which, sInt count, sInt nsamples, sInt step)
+  {
+    COVER("VCF LRC lanes");
+
+    sF32 l[NLANES] = { 0 }, b[NLANES] = { 0 }, freq[NLANES] = { 0 }, reso[NLANES] = { 0 };
+    sU32 sel[5][NLANES] = { { 0 } }; // output select masks for LOW..ALL
+    sF32 *d[NLANES];
+    const sF32 *s[NLANES];
+
+    for (sInt i=0; i < count; i++)
+    {
+      V2Flt *f = flt[which[i]];
+      l[i] = f->lrc.l;
+      b[i] = f->lrc.b;
+      freq[i] = f->cfreq;
+      reso[i] = f->res;
+      sel[(f->mode & 7) - LOW][i] = ~0u;
+      d[i] = dest[which[i]];
+      s[i] = src[which[i]];
+    }
+
+    __m128 vl = _mm_loadu_ps(l);
+    __m128 vb = _mm_loadu_ps(b);
+    __m128 vfreq = _mm_loadu_ps(freq);
+    __m128 vreso = _mm_loadu_ps(reso);
+    __m128 vdc = _mm_set1_ps(fcdcoffset);
+    __m128 mlow   = _mm_loadu_ps((const sF32 *)sel[LOW - LOW]);
+    __m128 mband  = _mm_loadu_ps((const sF32 *)sel[BAND - LOW]);
+    __m128 mhigh  = _mm_loadu_ps((const sF32 *)sel[HIGH - LOW]);
+    __m128 mnotch = _mm_loadu_ps((const sF32 *)sel[NOTCH - LOW]);
+    __m128 mall   = _mm_loadu_ps((const sF32 *)sel[ALL - LOW]);
+
+    sF32 in[NLANES] = { 0 }, out[NLANES];
+    for (sInt j=0; j < nsamples*step; j += step)
+    {
+      for (sInt i=0; i < count; i++)
+        in[i] = s[i][j];
+
+      // V2LRC::step_2x
+      __m128 x = _mm_add_ps(_mm_loadu_ps(in), vdc);
+      vl = _mm_add_ps(vl, _mm_sub_ps(_mm_mul_ps(vfreq, vb), vdc));
+      vb = _mm_add_ps(vb, _mm_mul_ps(vfreq, _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(vb, vreso)), vl)));
+      vl = _mm_add_ps(vl, _mm_mul_ps(vfreq, vb));
+      __m128 h = _mm_sub_ps(_mm_sub_ps(x, _mm_mul_ps(vb, vreso)), vl);
+      vb = _mm_add_ps(vb, _mm_mul_ps(vfreq, h));
+
+      __m128 y = _mm_and_ps(mlow, vl);
+      y = _mm_or_ps(y, _mm_and_ps(mband, vb));
+      y = _mm_or_ps(y, _mm_and_ps(mhigh, h));
+      y = _mm_or_ps(y, _mm_and_ps(mnotch, _mm_add_ps(vl, h)));
+      y = _mm_or_ps(y, _mm_and_ps(mall, _mm_add_ps(_mm_add_ps(vl, vb), h)));
+      _mm_storeu_ps(out, y);
+
+      for (sInt i=0; i < count; i++)
+        d[i][j] = out[i];
+    }
+
+    _mm_storeu_ps(l, vl);
+    _mm_storeu_ps(b, vb);
+    for (sInt i=0; i < count; i++)
+    {
+      V2Flt *f = flt[which[i]];
+      f->lrc.l = l[i];
+      f->lrc.b = b[i];
+      DEBUG_PLOT_STRIDED(f, d[i], step, nsamples);
+    }
+  }
+
+  static void renderMoogLanes(V2Flt *const *flt, sF32 *const *dest, const sF32 *const *src,
+    const sInt *which, sInt count, sInt nsamples, sInt step)
+  {
+    COVER("VCF moog lanes");
+
+    sF32 st[5][NLANES] = { { 0 } }, mf[NLANES] = { 0 }, mp[NLANES] = { 0 }, mq[NLANES] = { 0 };
+    sU32 high[NLANES] = { 0 };
+    sF32 *d[NLANES];
+    const sF32 *s[NLANES];
+
+    for (sInt i=0; i < count; i++)
+    {
+      V2Flt *f = flt[which[i]];
+      for (sInt k=0; k < 5; k++)
+        st[k][i] = f->moog.b[k];
+      mf[i] = f->moogf;
+      mp[i] = f->moogp;
+      mq[i] = f->moogq;
+      high[i] = (f->mode & 7) == MOOGH ? ~0u : 0;
+      d[i] = dest[which[i]];
+      s[i] = src[which[i]];
+    }
+
+    __m128 b0 = _mm_loadu_ps(st[0]), b1 = _mm_loadu_ps(st[1]), b2 = _mm_loadu_ps(st[2]);
+    __m128 b3 = _mm_loadu_ps(st[3]), b4 = _mm_loadu_ps(st[4]);
+    __m128 vf = _mm_loadu_ps(mf);
+    __m128 vp = _mm_loadu_ps(mp);
+    __m128 vq = _mm_loadu_ps(mq);
+    __m128 mhigh = _mm_loadu_ps((const sF32 *)high);
+    __m128 vdc = _mm_set1_ps(fcdcoffset);
+    __m128 v1_6 = _mm_set1_ps(1.0f/6.0f);
+
+    sF32 in[NLANES] = { 0 }, out[NLANES];
+    for (sInt j=0; j < nsamples*step; j += step)
+    {
+      for (sInt i=0; i < count; i++)
+        in[i] = s[i][j];
+
+      __m128 realin = _mm_loadu_ps(in);
+      __m128 y = _mm_setzero_ps();
+
+      // V2Moog::step, twice (2x oversampling)
+      for (sInt pass=0; pass < 2; pass++)
+      {
+        __m128 x = _mm_sub_ps(_mm_add_ps(realin, vdc), _mm_mul_ps(vq, b4));
+        __m128 t1 = b1; b1 = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(x, b0), vp), _mm_mul_ps(b1, vf));
+        __m128 t2 = b2; b2 = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(t1, b1), vp), _mm_mul_ps(b2, vf));
+        __m128 t3 = b3; b3 = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(t2, b2), vp), _mm_mul_ps(b3, vf));
+        y = _mm_sub_ps(_mm_mul_ps(_mm_add_ps(t3, b3), vp), _mm_mul_ps(b4, vf));
+
+        y = _mm_sub_ps(y, _mm_mul_ps(_mm_mul_ps(_mm_mul_ps(y, y), y), v1_6));
+        y = _mm_sub_ps(y, vdc);
+        b4 = _mm_sub_ps(y, vdc);
+        b0 = realin;
+      }
+
+      _mm_storeu_ps(out, sse_select(mhigh, _mm_sub_ps(realin, y), y));
+
+      for (sInt i=0; i < count; i++)
+        d[i][j] = out[i];
+    }
+
+    _mm_storeu_ps(st[0], b0);
+    _mm_storeu_ps(st[1], b1);
+    _mm_storeu_ps(st[2], b2);
+    _mm_storeu_ps(st[3], b3);
+    _mm_storeu_ps(st[4], b4);
+    for (sInt i=0; i < count; i++)
+    {
+      V2Flt *f = flt[which[i]];
+      for (sInt k=0; k < 5; k++)
+        f->moog.b[k] = st[k][i];
+      DEBUG_PLOT_STRIDED(f, d[i], step, nsamples);
+    }
+  }
+#endif
 };
 
 // --------------------------------------------------------------------------
@@ -1494,8 +1859,12 @@ struct V2Dist
     case FLT_NOTCH:
     case FLT_ALL:
       COVER("DIST stereo filter");
-      fltl.render(&dest[0].l, &src[0].l, nsamples, 2);
-      fltr.render(&dest[0].r, &src[0].r, nsamples, 2);
+      {
+        V2Flt *flt[2] = { &fltl, &fltr };
+        sF32 *d[2] = { &dest[0].l, &dest[0].r };
+        const sF32 *s[2] = { &src[0].l, &src[0].r };
+        V2Flt::renderMany(flt, d, s, 2, nsamples, 2);
+      }
       break;
 
     default:
@@ -1675,43 +2044,100 @@ struct V2Voice
     DEBUG_PLOT_VAL(&curvol, curvol);
   }
 
-  void render(StereoSample *dest, sInt nsamples)
+  bool readsAux() const
+  {
+    for (sInt i=0; i < syVV2::NOSC; i++)
+      if (osc[i].readsAux())
+        return true;
+
+    return false;
+  }
+
+  // Voices are rendered in three steps so the filters of several voices
+  // can run side by side: renderOsc, renderFilters, renderOut.
+  static const sInt MAXGROUP = 4;
+
+  void renderOsc(sF32 *voice, sInt nsamples)
   {
     assert(nsamples <= V2Instance::MAX_FRAME_SIZE);
 
     // clear voice buffer
-    sF32 *voice = inst->vcebuf;
-    sF32 *voice2 = inst->vcebuf2;
     memset(voice, 0, nsamples * sizeof(*voice));
 
     // oscillators -> voice buffer
     for (sInt i=0; i < syVV2::NOSC; i++)
       osc[i].render(voice, nsamples);
+  }
 
-    // voice buffer -> filters -> voice buffer
-    switch (fmode)
+  // voice buffer -> filters -> voice buffer, for up to MAXGROUP voices
+  static void renderFilters(V2Voice *const *voices, sF32 *const *vce, sF32 *const *vce2, sInt count, sInt nsamples)
+  {
+    assert(count <= MAXGROUP);
+
+    // only the first n are used, the rest is just cleared for the compiler
+    V2Flt *flt[MAXGROUP] = { 0 };
+    sF32 *dest[MAXGROUP] = { 0 };
+    const sF32 *src[MAXGROUP] = { 0 };
+    sInt n;
+
+    // parallel: 2nd filter, voice -> voice2
+    n = 0;
+    for (sInt i=0; i < count; i++)
     {
-    case FLTR_SINGLE:
-      COVER("VOICE filter single");
-      vcf[0].render(voice, voice, nsamples);
-      break;
+      if (voices[i]->fmode == FLTR_PARALLEL)
+      {
+        COVER("VOICE filter parallel");
+        flt[n] = &voices[i]->vcf[1];
+        dest[n] = vce2[i];
+        src[n++] = vce[i];
+      }
+    }
+    V2Flt::renderMany(flt, dest, src, n, nsamples);
 
-    case FLTR_SERIAL:
-    default:
-      COVER("VOICE filter serial");
-      vcf[0].render(voice, voice, nsamples);
-      vcf[1].render(voice, voice, nsamples);
-      break;
+    // everyone: 1st filter
+    n = 0;
+    for (sInt i=0; i < count; i++)
+    {
+      if (voices[i]->fmode == FLTR_SINGLE)
+      {
+        COVER("VOICE filter single");
+      }
+      flt[n] = &voices[i]->vcf[0];
+      dest[n] = vce[i];
+      src[n++] = vce[i];
+    }
+    V2Flt::renderMany(flt, dest, src, n, nsamples);
 
-    case FLTR_PARALLEL:
-      COVER("VOICE filter parallel");
-      vcf[1].render(voice2, voice, nsamples);
-      vcf[0].render(voice, voice, nsamples);
-      for (sInt i=0; i < nsamples; i++)
-        voice[i] = voice[i]*f1gain + voice2[i]*f2gain;
-      break;
+    // serial: 2nd filter
+    n = 0;
+    for (sInt i=0; i < count; i++)
+    {
+      sInt fmode = voices[i]->fmode;
+      if (fmode != FLTR_SINGLE && fmode != FLTR_PARALLEL)
+      {
+        COVER("VOICE filter serial");
+        flt[n] = &voices[i]->vcf[1];
+        dest[n] = vce[i];
+        src[n++] = vce[i];
+      }
+    }
+    V2Flt::renderMany(flt, dest, src, n, nsamples);
+
+    // parallel: mix
+    for (sInt i=0; i < count; i++)
+    {
+      V2Voice *v = voices[i];
+      if (v->fmode == FLTR_PARALLEL)
+      {
+        sF32 *voice = vce[i], *voice2 = vce2[i];
+        for (sInt j=0; j < nsamples; j++)
+          voice[j] = voice[j]*v->f1gain + voice2[j]*v->f2gain;
+      }
     }
+  }
 
+  void renderOut(StereoSample *dest, sF32 *voice, sInt nsamples)
+  {
     // voice buffer -> distortion -> voice buffer
     dist.renderMono(voice, voice, nsamples);
 
@@ -1737,29 +2163,7 @@ struct V2Voice
 
   void set(const syVV2 *para)
   {
-    xpose = para->transp - 64.0f;
-    updateNote();
-
-    fmode = (sInt)para->routing;
-    keysync = (sInt)para->oscsync;
-
-    // equal power panning
-    sF32 p = para->panning / 128.0f;
-    lvol = sqrtf(1.0f - p);
-    rvol = sqrtf(p);
-
-    // filter balance for parallel
-    sF32 x = (para->fltbal - 64.0f) / 64.0f;
-    if (x >= 0.0f)
-    {
-      f2gain = 1.0f;
-      f1gain = 1.0f - x;
-    }
-    else
-    {
-      f1gain = 1.0f;
-      f2gain = 1.0f + x;
-    }
+    setMain(para);
 
     // subsections
     for (sInt i=0; i < syVV2::NOSC; i++)
@@ -1777,6 +2181,38 @@ struct V2Voice
     dist.set(&para->dist);
   }
 
+  // Same result as set(para), given that old is what the voice was set to
+  // last time. Only the sections whose parameters changed are recomputed.
+  void update(const syVV2 *para, const syVV2 *old)
+  {
+    // the oscillator pitch depends on the transpose, so any change to the
+    // main parameters redoes them, too.
+    bool main = changed(para->panning, old->panning) || changed(para->transp, old->transp) ||
+      changed(para->routing, old->routing) || changed(para->fltbal, old->fltbal) ||
+      changed(para->oscsync, old->oscsync);
+    if (main)
+      setMain(para);
+
+    for (sInt i=0; i < syVV2::NOSC; i++)
+      if (main || changed(para->osc[i], old->osc[i]))
+        osc[i].set(&para->osc[i]);
+
+    for (sInt i=0; i < syVV2::NENV; i++)
+      if (changed(para->env[i], old->env[i]))
+        env[i].set(&para->env[i]);
+
+    for (sInt i=0; i < syVV2::NFLT; i++)
+      if (changed(para->flt[i], old->flt[i]))
+        vcf[i].set(&para->flt[i]);
+
+    for (sInt i=0; i < syVV2::NLFO; i++)
+      if (changed(para->lfo[i], old->lfo[i]))
+        lfo[i].set(&para->lfo[i]);
+
+    if (changed(para->dist, old->dist))
+      dist.set(&para->dist);
+  }
+
   void noteOn(sInt note, sInt vel)
   {
     this->note = note;
@@ -1833,6 +2269,34 @@ struct V2Voice
   }
 
 private:
+  // main parameters: transpose, routing, panning, filter balance, key sync
+  void setMain(const syVV2 *para)
+  {
+    xpose = para->transp - 64.0f;
+    updateNote();
+
+    fmode = (sInt)para->routing;
+    keysync = (sInt)para->oscsync;
+
+    // equal power panning
+    sF32 p = para->panning / 128.0f;
+    lvol = sqrtf(1.0f - p);
+    rvol = sqrtf(p);
+
+    // filter balance for parallel
+    sF32 x = (para->fltbal - 64.0f) / 64.0f;
+    if (x >= 0.0f)
+    {
+      f2gain = 1.0f;
+      f1gain = 1.0f - x;
+    }
+    else
+    {
+      f1gain = 1.0f;
+      f2gain = 1.0f + x;
+    }
+  }
+
   void updateNote()
   {
     sF32 n = xpose + (sF32)note;
@@ -2177,7 +2641,7 @@ struct V2Comp
     release = powf(2.0f, -para->release * 16.0f / 128.0f);
   }
 
-  void render(StereoSample *buf, sInt nsamples)
+  void render(StereoSample *buf, StereoSample *levels, sInt nsamples)
   {
     if (mode & MODE_BIT_OFF)
       return;
@@ -2185,7 +2649,6 @@ struct V2Comp
     COVER("COMP render");
 
     // Step 1: level detect (fills LD buffers)
-    StereoSample *levels = inst->levelbuf;
     switch (mode & (MODE_BIT_RMS | MODE_BIT_STEREO))
     {
     case MODE_BIT_PEAK | MODE_BIT_MONO:
@@ -2471,24 +2934,37 @@ struct V2Chan
 
   void set(const syVChan *para)
   {
-    aarcv = para->auxarcv / 128.0f;
-    abrcv = para->auxbrcv / 128.0f;
-    aasnd = fcgain * (para->auxasnd / 128.0f);
-    absnd = fcgain * (para->auxbsnd / 128.0f);
-    chgain = fcgain * (para->chanvol / 128.0f);
-    a1gain = chgain * fcgainh * (para->aux1 / 128.0f);
-    a2gain = chgain * fcgainh * (para->aux2 / 128.0f);
-    fxr = (sInt)para->fxroute;
+    setMain(para);
     dist.set(&para->dist);
     chorus.set(&para->chorus);
     comp.set(&para->comp);
     boost.set(&para->boost);
   }
 
-  void process(sInt nsamples)
+  // Same result as set(para), given that old is what the channel was set
+  // to last time. Only the effects whose parameters changed are recomputed.
+  void update(const syVChan *para, const syVChan *old)
   {
-    StereoSample *chan = inst->chanbuf;
+    setMain(para);
+    if (changed(para->dist, old->dist))
+      dist.set(&para->dist);
+    if (changed(para->chorus, old->chorus))
+      chorus.set(&para->chorus);
+    if (changed(para->comp, old->comp))
+      comp.set(&para->comp);
+    if (changed(para->boost, old->boost))
+      boost.set(&para->boost);
+  }
 
+  // does this channel read the AuxA/B buses?
+  bool receivesAux() const
+  {
+    return aarcv != 0.0f || abrcv != 0.0f;
+  }
+
+  // channel effects
+  void process(StereoSample *chan, StereoSample *levelbuf, sInt nsamples)
+  {
     // AuxA/B receive (stereo)
     accumulate(chan, inst->auxabuf, nsamples, aarcv);
     accumulate(chan, inst->auxbbuf, nsamples, abrcv);
@@ -2496,7 +2972,7 @@ struct V2Chan
     // Filters
     dcf1.renderStereo(chan, chan, nsamples);
     DEBUG_PLOT_STEREO(&dcf1, chan, nsamples);
-    comp.render(chan, nsamples);
+    comp.render(chan, levelbuf, nsamples);
     boost.render(chan, nsamples);
     if (fxr == FXR_DIST_THEN_CHORUS)
     {
@@ -2510,7 +2986,11 @@ struct V2Chan
       dist.renderStereo(chan, chan, nsamples);
       dcf2.renderStereo(chan, chan, nsamples);
     }
+  }
 
+  // channel output -> aux buses and mix buffer
+  void mix(const StereoSample *chan, sInt nsamples)
+  {
     // Aux1/2 send (mono)
     accumulateMonoMix(inst->aux1buf, chan, nsamples, a1gain);
     accumulateMonoMix(inst->aux2buf, chan, nsamples, a2gain);
@@ -2526,6 +3006,19 @@ struct V2Chan
   }
 
 private:
+  // gains and routing (cheap, so they're always recomputed)
+  void setMain(const syVChan *para)
+  {
+    aarcv = para->auxarcv / 128.0f;
+    abrcv = para->auxbrcv / 128.0f;
+    aasnd = fcgain * (para->auxasnd / 128.0f);
+    absnd = fcgain * (para->auxbsnd / 128.0f);
+    chgain = fcgain * (para->chanvol / 128.0f);
+    a1gain = chgain * fcgainh * (para->aux1 / 128.0f);
+    a2gain = chgain * fcgainh * (para->aux2 / 128.0f);
+    fxr = (sInt)para->fxroute;
+  }
+
   void accumulate(StereoSample *dest, const StereoSample *src, sInt nsamples, sF32 gain)
   {
     if (gain == 0.0f)
@@ -2620,6 +3113,16 @@ struct V2ChanInfo
   sU8 ctl[7]; // controllers
 };
 
+// Buffers for rendering one channel. Every channel has its own set, so
+// channels can be rendered at the same time.
+struct V2ChanBuf
+{
+  StereoSample chan[V2Instance::MAX_FRAME_SIZE];  // channel output
+  sF32 vce[V2Voice::MAXGROUP][V2Instance::MAX_FRAME_SIZE]; // voice buffers
+  sF32 vce2[V2Voice::MAXGROUP][V2Instance::MAX_FRAME_SIZE];
+  StereoSample level[V2Instance::MAX_FRAME_SIZE]; // compressor levels
+};
+
 // V2Synth holds a V2Instance.
 // In the original code these are one and the same struct (SYN) but that
 // would turn out fairly awkward in this C++ version, hence the split.
@@ -2642,6 +3145,7 @@ struct V2Synth
   V2Voice voicesw[POLY];
   syVChan chansv[CHANS];
   V2Chan chansw[CHANS];
+  bool chanset[CHANS];  // chansw[i] was set from chansv[i]
 
   struct Globals
   {
@@ -2670,6 +3174,12 @@ struct V2Synth
   sF32 chandelbuf[CHANS][2][2048];
 
   V2Instance instance;
+  V2ChanBuf chanbuf[CHANS];
+
+  // parallel channel rendering (see synthSetJobRunner)
+  V2RUNJOBS *runjobs;
+  void *runjobsparm;
+  sInt jobchans[CHANS]; // channels rendered by the current jobs
 
   syWRonan ronan;
 
@@ -2680,6 +3190,10 @@ struct V2Synth
     // Look away please :)
     memset(this, 0, sizeof(this));
 
+    // no job runner until one is set
+    runjobs = 0;
+    runjobsparm = 0;
+
     // set sampling rate
     this->samplerate = samplerate;
     instance.calcNewSampleRate(samplerate);
@@ -2700,6 +3214,7 @@ struct V2Synth
     {
       chans[i].ctl[6] = 0x7f;
       chansw[i].init(&instance, chandelbuf[i][0], chandelbuf[i][1], COUNTOF(chandelbuf[i][0]));
+      chanset[i] = false;
     }
 
     // global filters
@@ -2892,7 +3407,7 @@ struct V2Synth
           allocpos[usevoice] = curalloc++;
 
           // and note on!
-          storeV2Values(usevoice);
+          storeV2Values(usevoice, true);
           voicesw[usevoice].noteOn(cmd[0], cmd[1]);
           cmd += 2;
           break;
@@ -3085,7 +3600,9 @@ private:
     return in;
   }
 
-  void storeV2Values(sInt vind)
+  // noteon: voice was just (re)assigned, set it up from scratch. otherwise
+  // only the parameters that changed since the last frame are recomputed.
+  void storeV2Values(sInt vind, bool noteon=false)
   {
     assert(vind >= 0 && vind < POLY);
     sInt chan = chanmap[vind];
@@ -3096,8 +3613,8 @@ private:
     const V2Sound *patch = getpatch(chans[chan].pgm);
 
     // voice data
-    syVV2 *vpara = &voicesv[vind];
-    sF32 *vparaf = (sF32 *)vpara;
+    syVV2 para;
+    sF32 *vparaf = (sF32 *)&para;
     V2Voice *voice = &voicesw[vind];
     
     // copy voice dependent data
@@ -3115,7 +3632,11 @@ private:
       vparaf[mod->dest] = clamp(vparaf[mod->dest] + scale*getmodsource(voice, chan, mod->source), 0.0f, 128.0f);
     }
 
-    voice->set(vpara);
+    if (noteon)
+      voice->set(&para);
+    else
+      voice->update(&para, &voicesv[vind]);
+    voicesv[vind] = para;
   }
 
   void storeChanValues(sInt chan)
@@ -3126,8 +3647,8 @@ private:
     const V2Sound *patch = getpatch(chans[chan].pgm);
 
     // chan data
-    syVChan *cpara = &chansv[chan];
-    sF32 *cparaf = (sF32 *)cpara;
+    syVChan para;
+    sF32 *cparaf = (sF32 *)&para;
     V2Chan *cwork = &chansw[chan];
     V2Voice *voice = &voicesw[voicemap[chan]];
 
@@ -3147,7 +3668,12 @@ private:
       cparaf[dest] = clamp(cparaf[dest] + scale*getmodsource(voice, chan, mod->source), 0.0f, 128.0f);
     }
 
-    cwork->set(cpara);
+    if (chanset[chan])
+      cwork->update(&para, &chansv[chan]);
+    else
+      cwork->set(&para);
+    chansv[chan] = para;
+    chanset[chan] = true;
   }
 
   void tick()
@@ -3191,6 +3717,66 @@ private:
 #endif
   }
 
+  // renders a group of voices on one channel. the voices are added to
+  // the channel buffer in order.
+  void renderVoices(V2ChanBuf &buf, const sInt *group, sInt count, sInt nsamples)
+  {
+    V2Voice *voices[V2Voice::MAXGROUP] = { 0 };
+    sF32 *vce[V2Voice::MAXGROUP] = { 0 }, *vce2[V2Voice::MAXGROUP] = { 0 };
+
+    for (sInt i=0; i < count; i++)
+    {
+      voices[i] = &voicesw[group[i]];
+      vce[i] = buf.vce[i];
+      vce2[i] = buf.vce2[i];
+      voices[i]->renderOsc(vce[i], nsamples);
+    }
+
+    V2Voice::renderFilters(voices, vce, vce2, count, nsamples);
+
+    for (sInt i=0; i < count; i++)
+      voices[i]->renderOut(buf.chan, vce[i], nsamples);
+  }
+
+  // render all voices of a channel plus its effects into its chanbuf
+  void renderChan(sInt chan, sInt nsamples)
+  {
+    V2ChanBuf &buf = chanbuf[chan];
+
+    // clear channel buffer
+    memset(buf.chan, 0, nsamples * sizeof(StereoSample));
+
+    // render all voices on this channel
+    sInt group[V2Voice::MAXGROUP];
+    sInt ngroup = 0;
+    for (sInt voice=0; voice < POLY; voice++)
+    {
+      if (chanmap[voice] == chan)
+      {
+        group[ngroup++] = voice;
+        if (ngroup == V2Voice::MAXGROUP)
+        {
+          renderVoices(buf, group, ngroup, nsamples);
+          ngroup = 0;
+        }
+      }
+    }
+    if (ngroup)
+      renderVoices(buf, group, ngroup, nsamples);
+
+    // channel 15 -> Ronan
+    if (chan == CHANS-1)
+      ronanCBProcess(&ronan, &buf.chan[0].l, nsamples);
+
+    chansw[chan].process(buf.chan, buf.level, nsamples);
+  }
+
+  static void __stdcall renderChanJob(void *pthis, int index)
+  {
+    V2Synth *synth = (V2Synth *)pthis;
+    synth->renderChan(synth->jobchans[index], synth->instance.SRcFrameSize);
+  }
+
   void renderFrame()
   {
     sInt nsamples = instance.SRcFrameSize;
@@ -3204,34 +3790,47 @@ private:
     memset(instance.auxabuf, 0, nsamples * sizeof(StereoSample));
     memset(instance.auxbbuf, 0, nsamples * sizeof(StereoSample));
 
-    // process all channels
+    // Find active channels. Channels that don't read the AuxA/B buses
+    // (which are filled by the channels before them) don't depend on each
+    // other, so with a job runner they are rendered in parallel first.
+    bool active[CHANS], readsaux[CHANS], isjob[CHANS];
+    sInt njobs = 0;
+
     for (sInt chan=0; chan < CHANS; chan++)
-    {
-      // check if any voices are active on this channel
-      sInt voice = 0;
-      while (voice < POLY && chanmap[voice] != chan)
-        voice++;
+      active[chan] = readsaux[chan] = false;
 
-      if (voice == POLY)
+    for (sInt voice=0; voice < POLY; voice++)
+    {
+      sInt chan = chanmap[voice];
+      if (chan < 0)
         continue;
 
-      // clear channel buffer
-      memset(instance.chanbuf, 0, nsamples * sizeof(StereoSample));
+      active[chan] = true;
+      if (voicesw[voice].readsAux())
+        readsaux[chan] = true;
+    }
 
-      // render all voices on this channel
-      for (; voice < POLY; voice++)
-      {
-        if (chanmap[voice] != chan)
-          continue;
+    for (sInt chan=0; chan < CHANS; chan++)
+    {
+      isjob[chan] = active[chan] && !readsaux[chan] && !chansw[chan].receivesAux();
+      if (isjob[chan])
+        jobchans[njobs++] = chan;
+    }
 
-        voicesw[voice].render(instance.chanbuf, nsamples);
-      }
+    bool parallel = runjobs && njobs > 1;
+    if (parallel)
+      runjobs(runjobsparm, renderChanJob, this, njobs);
 
-      // channel 15 -> Ronan
-      if (chan == CHANS-1)
-        ronanCBProcess(&ronan, &instance.chanbuf[0].l, nsamples);
+    // render the remaining channels and mix everything, in channel order
+    for (sInt chan=0; chan < CHANS; chan++)
+    {
+      if (!active[chan])
+        continue;
 
-      chansw[chan].process(nsamples); 
+      if (!parallel || !isjob[chan])
+        renderChan(chan, nsamples);
+
+      chansw[chan].mix(chanbuf[chan].chan, nsamples);
     }
 
     // global filters
@@ -3262,7 +3861,7 @@ private:
     }
 
     // sum compressor
-    compr.render(mix, nsamples);
+    compr.render(mix, instance.levelbuf, nsamples);
 
     DEBUG_PLOT_STEREO(mix, mix, nsamples);
   }
@@ -3327,6 +3926,12 @@ long __stdcall synthGetFrameSize(void *pthis)
   return ((V2Synth *)pthis)->instance.SRcFrameSize;
 }
 
+void __stdcall synthSetJobRunner(void *pthis, V2RUNJOBS *runjobs, void *parm)
+{
+  ((V2Synth *)pthis)->runjobs = runjobs;
+  ((V2Synth *)pthis)->runjobsparm = parm;
+}
+
 extern "C" void * __stdcall synthGetSpeechMem(void *pthis)
 {
   return &((V2Synth *)pthis)->ronan;
@@ -11,13 +11,23 @@ typedef char              sChar;
 
 typedef signed   char     sS8;
 typedef signed   short    sS16;
+#ifdef _MSC_VER
 typedef signed   long     sS32;
 typedef signed   __int64  sS64;
+#else
+typedef signed   int      sS32;
+typedef signed   long long sS64;
+#endif
 
 typedef unsigned char     sU8;
 typedef unsigned short    sU16;
+#ifdef _MSC_VER
 typedef unsigned long     sU32;
 typedef unsigned __int64  sU64;
+#else
+typedef unsigned int      sU32;
+typedef unsigned long long sU64;
+#endif
 
 typedef float             sF32;
 typedef double            sF64;
@@ -25,6 +35,12 @@ typedef double            sF64;
 #define sTRUE             1
 #define sFALSE            0
 
+// calling conventions only matter for MSVC/Win32 builds
+#if !defined(_MSC_VER) && !defined(__stdcall)
+#define __stdcall
+#define __cdecl
+#endif
+
 //
 #ifdef _DEBUG
 extern void __cdecl printf2(const char *format, ...);
@@ -9,6 +9,8 @@
 /*************************************************************************************/
 
 
+#include <string.h>
+
 #include "v2mplayer.h"
 #include "libv2.h"
 
@@ -26,19 +28,10 @@ namespace
   //////////////////////////////////////////////////////////////////////////////////////////////////////
 	{
 		// performs 64bit (nexttime-time)*usecs/td2 and a 32.32bit addition to smpldelta:smplrem
-		__asm {
-			mov eax, [nexttime]
-			sub eax, [time]
-			mov ebx, [usecs]
-			mul ebx
-			mov ebx, [td2]
-			div ebx
-			mov ecx, [smplrem]
-			add [ecx], edx
-			adc eax, 0
-			mov ecx, [smpldelta]
-			mov [ecx], eax
-		}
+		sU64 t=(sU64)(nexttime-time)*usecs;
+		sU64 rem=(sU64)*smplrem+(sU32)(t%td2);
+		*smplrem=(sU32)rem;
+		*smpldelta=(sU32)(t/td2)+(sU32)(rem>>32);
 	}
 }
 
@@ -165,6 +158,9 @@ void V2MPlayer::Reset()
 		synthInit(m_synth,(void*)m_base.patchmap,m_samplerate);
 		synthSetGlobals(m_synth,(void*)m_base.globals);
 		synthSetLyrics(m_synth,m_base.speechptrs);
+#ifdef V2MPLAYER_JOB_RUNNER
+		synthSetJobRunner(m_synth,m_runjobs,m_runjobsparm);
+#endif
 	}
 }
 
@@ -311,16 +307,7 @@ void V2MPlayer::Play(sU32 a_time)
 
 	m_base.valid=sFALSE;
 	sU32 destsmpl, cursmpl=0;
-	__asm
-	{
-		mov  ecx, this
-		mov	 eax, [a_time]
-		mov  ebx, [ecx + m_samplerate]
-		imul ebx
-		mov  ebx, [ecx + m_tpc]
-		idiv ebx
-		mov  [destsmpl], eax
-	}
+	destsmpl=(sU32)((sS64)(sS32)a_time*(sS32)m_samplerate/(sS32)m_tpc);
 
 	m_state.state=PlayerState::PLAYING;
 	m_state.smpldelta=0;
@@ -353,16 +340,7 @@ void V2MPlayer::Stop(sU32 a_fadetime)
 	if (a_fadetime)
 	{
 		sU32 ftsmpls;
-		__asm
-		{
-			mov  ecx, this
-			mov	 eax, [a_fadetime]
-			mov  ebx, [ecx + m_samplerate]
-			imul ebx
-			mov  ebx, [ecx + m_tpc]
-			idiv ebx
-			mov  [ftsmpls], eax
-		}
+		ftsmpls=(sU32)((sS64)(sS32)a_fadetime*(sS32)m_samplerate/(sS32)m_tpc);
 		m_fadedelta=m_fadeval/ftsmpls;
 	}
 	else
@@ -406,13 +384,7 @@ void V2MPlayer::Render(sF32 *a_buffer, sU32 a_len, sBool a_add)
 	{
     if (!a_add)
     {
-		  __asm {
-			  mov edi, [a_buffer]
-			  mov ecx, [a_len]
-			  shl ecx, 1
-			  xor eax, eax
-			  rep stosd
-		  }
+		  memset(a_buffer,0,2*a_len*sizeof(sF32));
     }
 	}
 	else
@@ -441,6 +413,20 @@ sBool V2MPlayer::IsPlaying()
 }
 
 
+#ifdef V2MPLAYER_JOB_RUNNER
+
+void V2MPlayer::SetJobRunner(V2RUNJOBS *a_runjobs, void *a_parm)
+////////////////////////////////////////////////////////////////
+{
+	m_runjobs=a_runjobs;
+	m_runjobsparm=a_parm;
+	if (m_base.valid && m_samplerate)
+		synthSetJobRunner(m_synth,m_runjobs,m_runjobsparm);
+}
+
+#endif
+
+
 #ifdef V2MPLAYER_SYNC_FUNCTIONS
 
 sU32 V2MPlayer::CalcPositions(sS32 **a_dest)
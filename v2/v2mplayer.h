@@ -27,13 +27,23 @@ typedef char              sChar;
 
 typedef signed   char     sS8;
 typedef signed   short    sS16;
+#ifdef _MSC_VER
 typedef signed   long     sS32;
 typedef signed   __int64  sS64;
+#else
+typedef signed   int      sS32;
+typedef signed   long long sS64;
+#endif
 
 typedef unsigned char     sU8;
 typedef unsigned short    sU16;
+#ifdef _MSC_VER
 typedef unsigned long     sU32;
 typedef unsigned __int64  sU64;
+#else
+typedef unsigned int      sU32;
+typedef unsigned long long sU64;
+#endif
 
 typedef float             sF32;
 typedef double            sF64;
@@ -41,12 +51,22 @@ typedef double            sF64;
 #define sTRUE             1
 #define sFALSE            0
 
+// calling conventions only matter for MSVC/Win32 builds
+#if !defined(_MSC_VER) && !defined(__stdcall)
+#define __stdcall
+#define __cdecl
+#endif
+
 template<class T> inline T sMin(const T a, const T b) { return (a<b)?a:b;  }
 template<class T> inline T sMax(const T a, const T b) { return (a>b)?a:b;  }
 template<class T> inline T sClamp(const T x, const T min, const T max) { return sMax(min,sMin(max,x)); }
 
 #endif
 
+#ifdef V2MPLAYER_JOB_RUNNER
+#include "libv2.h"
+#endif
+
 
 /*************************************************************************************/
 /**                                                                                 **/
@@ -60,7 +80,13 @@ public:
 
   // init
   // call this instead of a constructor
-  void Init(sU32 a_tickspersec=1000) { m_tpc=a_tickspersec; m_base.valid=0; }
+  void Init(sU32 a_tickspersec=1000)
+	{
+		m_tpc=a_tickspersec; m_base.valid=0;
+	#ifdef V2MPLAYER_JOB_RUNNER
+		m_runjobs=0; m_runjobsparm=0;
+	#endif
+	}
 
 
 
@@ -124,6 +150,20 @@ public:
   sBool IsPlaying();
 
 
+	#ifdef V2MPLAYER_JOB_RUNNER
+
+	// renders the synth channels in parallel, see synthSetJobRunner() in libv2.h
+	// (C++ synth core only). Unlike there, the runner stays set when Play()
+	// resets the synth.
+	//
+	// a_runjobs : job runner, 0 to render everything on the calling thread
+	// a_parm    : passed to a_runjobs
+	//
+	void SetJobRunner(V2RUNJOBS *a_runjobs, void *a_parm);
+
+	#endif
+
+
 	#ifdef V2MPLAYER_SYNC_FUNCTIONS
 
 	// Retrieves an array of timer<->song position 
@@ -241,6 +281,10 @@ private:
 	sU8         m_midibuf[4096];
 	sF32        m_fadeval;
 	sF32        m_fadedelta;
+#ifdef V2MPLAYER_JOB_RUNNER
+	V2RUNJOBS  *m_runjobs;
+	void       *m_runjobsparm;
+#endif
 
 	// internal methods
 
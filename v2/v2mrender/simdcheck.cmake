@@ -0,0 +1,34 @@
+#
+# Renders a song with the SSE2 synth (on one and on two threads) and with the
+# scalar reference synth, and fails unless all three are byte-identical.
+#
+# cmake -DSSE2=<v2mrender> -DSCALAR=<v2mrender_scalar> -DSONG=<file.v2m>
+#       -DOUT=<output prefix> -P simdcheck.cmake
+#
+
+set(ARGS -F -l 30)
+
+execute_process(COMMAND ${SSE2} ${ARGS} ${SONG} ${OUT}_sse2.wav RESULT_VARIABLE res OUTPUT_QUIET)
+if(NOT res EQUAL 0)
+  message(FATAL_ERROR "rendering ${SONG} with ${SSE2} failed")
+endif()
+
+execute_process(COMMAND ${SSE2} ${ARGS} -j 2 ${SONG} ${OUT}_sse2_j2.wav RESULT_VARIABLE res OUTPUT_QUIET)
+if(NOT res EQUAL 0)
+  message(FATAL_ERROR "rendering ${SONG} with ${SSE2} -j 2 failed")
+endif()
+
+execute_process(COMMAND ${SCALAR} ${ARGS} ${SONG} ${OUT}_scalar.wav RESULT_VARIABLE res OUTPUT_QUIET)
+if(NOT res EQUAL 0)
+  message(FATAL_ERROR "rendering ${SONG} with ${SCALAR} failed")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUT}_sse2.wav ${OUT}_scalar.wav RESULT_VARIABLE res)
+if(NOT res EQUAL 0)
+  message(FATAL_ERROR "${SONG}: SSE2 output differs from the scalar reference")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} -E compare_files ${OUT}_sse2.wav ${OUT}_sse2_j2.wav RESULT_VARIABLE res)
+if(NOT res EQUAL 0)
+  message(FATAL_ERROR "${SONG}: output on two threads differs")
+endif()
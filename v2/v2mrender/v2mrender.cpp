@@ -0,0 +1,245 @@
+/*************************************************************************************/
+/*************************************************************************************/
+/**                                                                                 **/
+/**  V2MRender - headless .v2m to .wav renderer and synth benchmark                 **/
+/**  This file is in the public domain                                              **/
+/**                                                                                 **/
+/*************************************************************************************/
+/*************************************************************************************/
+
+#define _CRT_SECURE_NO_DEPRECATE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+
+#include "../v2mplayer.h"
+#include "../libv2.h"
+#include "../jobpool.h"
+
+static V2MPlayer player;
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+static void usage()
+{
+	printf("\nV2MRENDER - renders .v2m files faster than realtime\n\n"
+		"Usage: v2mrender [options] <infile.v2m> [outfile.wav]\n\n"
+		"  -r <rate>   sample rate in Hz (default 44100)\n"
+		"  -f <len>    samples per render call (default 4096)\n"
+		"  -n <runs>   number of timed runs, the best one is reported (default 1)\n"
+		"  -l <secs>   maximum length in seconds (default: until the song ends)\n"
+		"  -t <secs>   release tail rendered after the song ends (default 2)\n"
+		"  -j <n>      render the channels on n threads, 0: one per CPU (default 1)\n"
+		"  -F          write 32bit float instead of 16bit PCM\n\n"
+		"Old format .v2m files need to be converted with conv2m first.\n\n");
+}
+
+static sU8 *loadFile(const char *name, sU32 *len)
+{
+	FILE *f=fopen(name,"rb");
+	if (!f) return 0;
+
+	fseek(f,0,SEEK_END);
+	*len=ftell(f);
+	fseek(f,0,SEEK_SET);
+
+	sU8 *data=new sU8[*len];
+	if (fread(data,1,*len,f)!=*len)
+	{
+		delete[] data;
+		data=0;
+	}
+	fclose(f);
+	return data;
+}
+
+static void putU16(FILE *f, sU32 v) { fputc(v&0xff,f); fputc((v>>8)&0xff,f); }
+static void putU32(FILE *f, sU32 v) { putU16(f,v&0xffff); putU16(f,v>>16); }
+
+static sBool writeWav(const char *name, const sF32 *smp, sU32 nsamples, sU32 samplerate, sBool fp)
+{
+	FILE *f=fopen(name,"wb");
+	if (!f) return sFALSE;
+
+	sU32 bps=fp?4:2;
+	sU32 datalen=nsamples*2*bps;
+
+	fwrite("RIFF",1,4,f); putU32(f,36+datalen);
+	fwrite("WAVEfmt ",1,8,f); putU32(f,16);
+	putU16(f,fp?3:1);               // WAVE_FORMAT_IEEE_FLOAT / WAVE_FORMAT_PCM
+	putU16(f,2);
+	putU32(f,samplerate);
+	putU32(f,samplerate*2*bps);
+	putU16(f,2*bps);
+	putU16(f,8*bps);
+	fwrite("data",1,4,f); putU32(f,datalen);
+
+	for (sU32 i=0; i<2*nsamples; i++)
+	{
+		if (fp)
+		{
+			sU32 v;
+			memcpy(&v,&smp[i],4);
+			putU32(f,v);
+		}
+		else
+		{
+			sF32 v=smp[i]*32768.0f;
+			sInt s=(sInt)(v<0 ? v-0.5f : v+0.5f);
+			putU16(f,(sU32)sClamp(s,-32768,32767));
+		}
+	}
+
+	sBool ok=!ferror(f);
+	fclose(f);
+	return ok;
+}
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+int main(int argc, char **argv)
+{
+	sU32 samplerate=44100;
+	sU32 framelen=4096;
+	sInt runs=1;
+	sF64 maxsecs=0;
+	sF64 tailsecs=2;
+	sInt threads=1;
+	sBool fp=sFALSE;
+	const char *infile=0, *outfile=0;
+
+	for (sInt i=1; i<argc; i++)
+	{
+		const char *a=argv[i];
+		if (a[0]=='-' && a[1] && !a[2])
+		{
+			if (a[1]=='F') { fp=sTRUE; continue; }
+			if (i+1>=argc) { usage(); return 1; }
+			const char *v=argv[++i];
+			switch (a[1])
+			{
+			case 'r': samplerate=atoi(v); break;
+			case 'f': framelen=atoi(v); break;
+			case 'n': runs=atoi(v); break;
+			case 'l': maxsecs=atof(v); break;
+			case 't': tailsecs=atof(v); break;
+			case 'j': threads=atoi(v); break;
+			default: usage(); return 1;
+			}
+		}
+		else if (!infile) infile=a;
+		else if (!outfile) outfile=a;
+		else { usage(); return 1; }
+	}
+
+	if (!infile || samplerate<8000 || !framelen || runs<1 || tailsecs<0 || threads<0)
+	{
+		usage();
+		return 1;
+	}
+
+	sU32 v2mlen;
+	sU8 *v2m=loadFile(infile,&v2mlen);
+	if (!v2m)
+	{
+		printf("can't read %s\n",infile);
+		return 1;
+	}
+
+	player.Init();
+	if (!player.Open(v2m,samplerate))
+	{
+		printf("%s is not a valid .v2m file\n",infile);
+		return 1;
+	}
+
+	// the calling thread renders, too, so the pool gets one thread less
+	V2JobPool *pool=0;
+	if (threads!=1)
+	{
+		pool=jobPoolCreate(threads ? threads-1 : 0);
+		player.SetJobRunner(jobPoolRun,pool);
+	}
+
+	sU32 maxsmpl=maxsecs>0 ? (sU32)(maxsecs*samplerate) : ~0u;
+	sU32 tailsmpl=(sU32)(tailsecs*samplerate);
+
+	// the song is kept in memory only if it's written out
+	sF32 *song=0;
+	sU32 songcap=0;
+	sF32 *frame=new sF32[2*framelen];
+
+	sU32 nsamples=0;
+	sF64 best=0, total=0;
+
+	for (sInt run=0; run<runs; run++)
+	{
+		sU32 pos=0, tail=tailsmpl;
+		sF64 secs=0;
+
+		player.Play();
+		while (pos<maxsmpl)
+		{
+			sU32 todo=sMin(framelen,maxsmpl-pos);
+			if (!player.IsPlaying())
+			{
+				if (!tail) break;
+				todo=sMin(todo,tail);
+				tail-=todo;
+			}
+
+			sF32 *dest=frame;
+			if (outfile && !run)
+			{
+				if (pos+todo>songcap)
+				{
+					songcap=sMax(2*songcap,pos+todo);
+					sF32 *n=new sF32[2*songcap];
+					if (song) memcpy(n,song,2*pos*sizeof(sF32));
+					delete[] song;
+					song=n;
+				}
+				dest=song+2*pos;
+			}
+
+			std::chrono::steady_clock::time_point t0=std::chrono::steady_clock::now();
+			player.Render(dest,todo);
+			secs+=std::chrono::duration<sF64>(std::chrono::steady_clock::now()-t0).count();
+
+			pos+=todo;
+		}
+		player.Stop();
+
+		nsamples=pos;
+		total+=secs;
+		if (!run || secs<best) best=secs;
+
+		if (runs>1)
+			printf("run %d: %.3fs\n",run+1,secs);
+	}
+
+	sF64 songsecs=(sF64)nsamples/samplerate;
+	printf("%s: %.2fs of audio at %d Hz, %d samples per call\n",infile,songsecs,(sInt)samplerate,(sInt)framelen);
+	printf("render time: best %.3fs, average %.3fs\n",best,total/runs);
+	printf("realtime factor: %.1fx\n",best>0 ? songsecs/best : 0.0);
+
+	sInt ret=0;
+	if (outfile)
+	{
+		if (writeWav(outfile,song,nsamples,samplerate,fp))
+			printf("wrote %s\n",outfile);
+		else
+		{
+			printf("can't write %s\n",outfile);
+			ret=1;
+		}
+	}
+
+	player.Close();
+	jobPoolDestroy(pool);
+	delete[] song;
+	delete[] frame;
+	delete[] v2m;
+	return ret;
+}